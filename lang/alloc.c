@@ -0,0 +1,93 @@
+#include "alloc.h"
+
+#include <malloc.h>
+#include <stdatomic.h>
+
+typedef struct {
+	atomic_llong allocations;
+	atomic_llong bytes;
+	atomic_llong live;
+	atomic_llong peak;
+} alloc_counters;
+
+static const char* _names[ALLOC_SUBSYSTEMS] = {
+	[ALLOC_LEXER]        = "lexer",
+	[ALLOC_PREPROCESSOR] = "preprocessor",
+	[ALLOC_PARSER]       = "parser",
+	[ALLOC_LISTS]        = "lists",
+	[ALLOC_MAPS]         = "maps",
+	[ALLOC_SEMANTIC]     = "semantic",
+};
+
+int alloc_stats_enabled = 0;
+
+// One set per subsystem and the last one for all of them, its peak is the peak of the sum
+static alloc_counters _counters[ALLOC_SUBSYSTEMS + 1];
+
+void alloc_stats_start() {
+	alloc_stats_enabled = 1;
+}
+
+const char* alloc_subsystem_name(enum alloc_subsystem s) {
+	return _names[s];
+}
+
+static void _raise_peak(alloc_counters* c, long long live) {
+	long long peak = atomic_load_explicit(&c->peak, memory_order_relaxed);
+	while(live > peak && !atomic_compare_exchange_weak_explicit(&c->peak, &peak, live, memory_order_relaxed, memory_order_relaxed));
+}
+
+static void _add(alloc_counters* c, long long size) {
+	atomic_fetch_add_explicit(&c->allocations, 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&c->bytes, size, memory_order_relaxed);
+	_raise_peak(c, atomic_fetch_add_explicit(&c->live, size, memory_order_relaxed) + size);
+}
+
+void alloc_count(enum alloc_subsystem s, void* ptr) {
+	if(ptr == NULL) {
+		return;
+	}
+	long long size = malloc_usable_size(ptr);
+	_add(&_counters[s], size);
+	_add(&_counters[ALLOC_SUBSYSTEMS], size);
+}
+
+void alloc_uncount(enum alloc_subsystem s, void* ptr) {
+	if(ptr == NULL) {
+		return;
+	}
+	long long size = malloc_usable_size(ptr);
+	atomic_fetch_sub_explicit(&_counters[s].live, size, memory_order_relaxed);
+	atomic_fetch_sub_explicit(&_counters[ALLOC_SUBSYSTEMS].live, size, memory_order_relaxed);
+}
+
+static void _read(alloc_counters* c, alloc_stats* stats) {
+	stats->allocations = atomic_load(&c->allocations);
+	stats->bytes = atomic_load(&c->bytes);
+	stats->live  = atomic_load(&c->live);
+	stats->peak  = atomic_load(&c->peak);
+}
+
+void alloc_stats_get(enum alloc_subsystem s, alloc_stats* stats) {
+	_read(&_counters[s], stats);
+}
+
+void alloc_stats_total(alloc_stats* stats) {
+	_read(&_counters[ALLOC_SUBSYSTEMS], stats);
+}
+
+static void _print(FILE* out, const char* name, alloc_stats* s) {
+	fprintf(out, "%-14s %12lld %14lld %14lld %14lld\n", name, s->allocations, s->bytes, s->live, s->peak);
+}
+
+void alloc_stats_print(FILE* out) {
+	alloc_stats s;
+
+	fprintf(out, "%-14s %12s %14s %14s %14s\n", "subsystem", "allocations", "bytes", "live bytes", "peak bytes");
+	for(int i = 0; i < ALLOC_SUBSYSTEMS; i++) {
+		alloc_stats_get(i, &s);
+		_print(out, _names[i], &s);
+	}
+	alloc_stats_total(&s);
+	_print(out, "total", &s);
+}
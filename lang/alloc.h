@@ -0,0 +1,104 @@
+#ifndef _ALLOC_H
+#define _ALLOC_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Heap allocations of the compiler are tagged with the subsystem that owns them. A block
+// has to be freed with the tag it was allocated with, the size freed is taken from the
+// allocator, so nothing is stored next to the block.
+enum alloc_subsystem {
+	ALLOC_LEXER,
+	ALLOC_PREPROCESSOR,
+	ALLOC_PARSER,
+	ALLOC_LISTS,
+	ALLOC_MAPS,
+	ALLOC_SEMANTIC,
+	ALLOC_SUBSYSTEMS
+};
+
+typedef struct {
+	long long allocations;
+	long long bytes;
+	long long live;
+	long long peak;
+} alloc_stats;
+
+// Counting only starts with alloc_stats_start, until then the functions below are
+// plain libc calls. Whether a block was counted is not recorded, a block is uncounted by
+// whatever is in effect when it is freed, so start the stats before allocating anything
+// that will be freed afterwards or the live bytes go negative
+extern int alloc_stats_enabled;
+
+void alloc_stats_start();
+void alloc_stats_get(enum alloc_subsystem s, alloc_stats* stats);
+void alloc_stats_total(alloc_stats* stats);
+void alloc_stats_print(FILE* out);
+const char* alloc_subsystem_name(enum alloc_subsystem s);
+
+void alloc_count(enum alloc_subsystem s, void* ptr);
+void alloc_uncount(enum alloc_subsystem s, void* ptr);
+
+static inline void* hatch_malloc(enum alloc_subsystem s, size_t size) {
+	void* ptr = malloc(size);
+	if(alloc_stats_enabled) {
+		alloc_count(s, ptr);
+	}
+	return ptr;
+}
+
+static inline void* hatch_calloc(enum alloc_subsystem s, size_t count, size_t size) {
+	void* ptr = calloc(count, size);
+	if(alloc_stats_enabled) {
+		alloc_count(s, ptr);
+	}
+	return ptr;
+}
+
+static inline void* hatch_realloc(enum alloc_subsystem s, void* ptr, size_t size) {
+	if(alloc_stats_enabled) {
+		alloc_uncount(s, ptr);
+	}
+	ptr = realloc(ptr, size);
+	if(alloc_stats_enabled) {
+		alloc_count(s, ptr);
+	}
+	return ptr;
+}
+
+static inline void* hatch_reallocarray(enum alloc_subsystem s, void* ptr, size_t count, size_t size) {
+	if(alloc_stats_enabled) {
+		alloc_uncount(s, ptr);
+	}
+	ptr = reallocarray(ptr, count, size);
+	if(alloc_stats_enabled) {
+		alloc_count(s, ptr);
+	}
+	return ptr;
+}
+
+static inline char* hatch_strdup(enum alloc_subsystem s, const char* str) {
+	char* ptr = strdup(str);
+	if(alloc_stats_enabled) {
+		alloc_count(s, ptr);
+	}
+	return ptr;
+}
+
+static inline char* hatch_strndup(enum alloc_subsystem s, const char* str, size_t size) {
+	char* ptr = strndup(str, size);
+	if(alloc_stats_enabled) {
+		alloc_count(s, ptr);
+	}
+	return ptr;
+}
+
+static inline void hatch_free(enum alloc_subsystem s, void* ptr) {
+	if(alloc_stats_enabled) {
+		alloc_uncount(s, ptr);
+	}
+	free(ptr);
+}
+
+#endif
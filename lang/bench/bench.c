@@ -0,0 +1,266 @@
+#include "alloc.h"
+#include "corpus.h"
+#include "counters.h"
+#include "emit.h"
+#include "hatch.h"
+#include "lex.h"
+#include "preprocess.h"
+#include "source.h"
+#include "syntax.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MAX_SIZES 16
+#define DEFAULT_REPETITIONS 7
+
+enum bench_phase {
+	PHASE_LEX,
+	PHASE_PARSE,
+	PHASE_PRINT,
+	PHASE_FREE,
+	PHASE_COUNT
+};
+
+static const char* _phase_names[PHASE_COUNT] = {
+	[PHASE_LEX]   = "lex",
+	[PHASE_PARSE] = "parse",
+	[PHASE_PRINT] = "print",
+	[PHASE_FREE]  = "free",
+};
+
+typedef struct {
+	double*   seconds;
+	long long allocations;
+	long long bytes;
+	// Sums over the runs that could read the counter
+	long long counters[COUNTERS];
+	int       counted[COUNTERS];
+} phase_samples;
+
+typedef struct {
+	double    started;
+	alloc_stats before;
+	counter_set* counters;
+} phase_clock;
+
+void help() {
+	printf("usage: hatch_bench [-s <seed>] [-r <repetitions>] [sizes...]\n"
+	       "  generates a corpus of every size (K, M or G suffix, default 64K 1M 16M) and\n"
+	       "  reports median and p95 time, throughput and allocations of every phase, and\n"
+	       "  IPC and cache and branch misses per token where hardware counters are readable\n"
+	       "  -s <seed>         seed of the corpus generator (default 1)\n"
+	       "  -r <repetitions>  runs per size (default %d)\n", DEFAULT_REPETITIONS);
+}
+
+static double _now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void _begin(phase_clock* c) {
+	alloc_stats_total(&c->before);
+	counters_start(c->counters);
+	c->started = _now();
+}
+
+static void _end(phase_clock* c, phase_samples* s, int repetition) {
+	s->seconds[repetition] = _now() - c->started;
+
+	counter_values values;
+	counters_stop(c->counters, &values);
+	for(int i = 0; i < COUNTERS; i++) {
+		if(values.valid[i]) {
+			s->counters[i] += values.values[i];
+			s->counted[i]++;
+		}
+	}
+
+	alloc_stats after;
+	alloc_stats_total(&after);
+	// Every run allocates the same, the last one is reported
+	s->allocations = after.allocations - c->before.allocations;
+	s->bytes = after.bytes - c->before.bytes;
+}
+
+static int _compare_seconds(const void* a, const void* b) {
+	double x = *(const double*) a;
+	double y = *(const double*) b;
+	return x < y ? -1 : x > y;
+}
+
+// Nearest rank, so with few repetitions p95 is the slowest run
+static double _percentile(double* sorted, int amount, int percent) {
+	int rank = (amount * percent + 99) / 100;
+	return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+static int _run(const char* data, size_t size, preprocess_config* config, counter_set* counters,
+		phase_samples* phases, int repetition, int* tokens_amount) {
+	phase_clock clock = { .counters = counters };
+	int code = 0;
+
+	source_manager* sm = source_manager_create();
+	source_entry* file = source_add_buffer(sm, "corpus.dc", data, size, SOURCE_LOC_INVALID);
+	preprocessor* pp = preprocess_create(sm, config);
+	token_stream* tokens = lex_stream_create(sm);
+	syntax_tree* ast = syntax_tree_create();
+	emitter* out = emitter_create_buffer();
+
+	_begin(&clock);
+	code = lex(pp, file, tokens);
+	_end(&clock, &phases[PHASE_LEX], repetition);
+	*tokens_amount = tokens->size;
+
+	if(code == 0) {
+		_begin(&clock);
+		code = syntax_build_tree(tokens, ast);
+		_end(&clock, &phases[PHASE_PARSE], repetition);
+	}
+
+	if(code == 0) {
+		_begin(&clock);
+		syntax_print_tree(ast, out);
+		_end(&clock, &phases[PHASE_PRINT], repetition);
+	}
+
+	_begin(&clock);
+	syntax_tree_free(ast);
+	lex_stream_free(tokens);
+	preprocess_free(pp);
+	source_manager_free(sm);
+	_end(&clock, &phases[PHASE_FREE], repetition);
+
+	emitter_free(out);
+
+	return code;
+}
+
+static double _mean(phase_samples* s, enum hw_counter counter) {
+	return s->counted[counter] ? (double) s->counters[counter] / s->counted[counter] : -1;
+}
+
+static void _print_ratio(double numerator, double denominator, int precision) {
+	if(numerator < 0 || denominator <= 0) {
+		printf(" %12s", "n/a");
+	} else {
+		printf(" %12.*f", precision, numerator / denominator);
+	}
+}
+
+static void _print_counters(phase_samples* phases, int tokens_amount) {
+	printf("  %-6s %12s %12s %12s %12s %12s %12s\n", "phase", "cycles/tok", "instr/tok", "IPC",
+			"br-miss/tok", "L1d-miss/tok", "LLC-miss/tok");
+	for(int i = 0; i < PHASE_COUNT; i++) {
+		phase_samples* s = &phases[i];
+		printf("  %-6s", _phase_names[i]);
+		_print_ratio(_mean(s, COUNTER_CYCLES), tokens_amount, 1);
+		_print_ratio(_mean(s, COUNTER_INSTRUCTIONS), tokens_amount, 1);
+		_print_ratio(_mean(s, COUNTER_INSTRUCTIONS), _mean(s, COUNTER_CYCLES), 2);
+		_print_ratio(_mean(s, COUNTER_BRANCH_MISSES), tokens_amount, 3);
+		_print_ratio(_mean(s, COUNTER_L1D_MISSES), tokens_amount, 3);
+		_print_ratio(_mean(s, COUNTER_LLC_MISSES), tokens_amount, 3);
+		printf("\n");
+	}
+}
+
+static int _bench(uint64_t seed, long long size, int repetitions, preprocess_config* config, counter_set* counters) {
+	emitter* corpus = emitter_create_buffer();
+	size_t length = corpus_generate(seed, size, corpus);
+	emit_char(corpus, '\0');
+
+	phase_samples phases[PHASE_COUNT] = {0};
+	for(int i = 0; i < PHASE_COUNT; i++) {
+		phases[i].seconds = calloc(repetitions, sizeof(double));
+	}
+
+	int code = 0;
+	int tokens_amount = 0;
+	for(int r = 0; r < repetitions && !code; r++) {
+		code = _run(corpus->data, length, config, counters, phases, r, &tokens_amount);
+	}
+
+	if(code) {
+		fprintf(stderr, "Generated corpus of %lld bytes (seed %llu) failed to compile\n",
+				size, (unsigned long long) seed);
+	} else {
+		printf("corpus %zu bytes, seed %llu, %d repetitions\n", length, (unsigned long long) seed, repetitions);
+		printf("  %-6s %12s %12s %10s %10s %14s %14s\n",
+				"phase", "median ms", "p95 ms", "MB/s", "p95 MB/s", "allocations", "alloc bytes");
+		for(int i = 0; i < PHASE_COUNT; i++) {
+			phase_samples* s = &phases[i];
+			qsort(s->seconds, repetitions, sizeof(double), _compare_seconds);
+			double median = _percentile(s->seconds, repetitions, 50);
+			double p95 = _percentile(s->seconds, repetitions, 95);
+			printf("  %-6s %12.3f %12.3f %10.1f %10.1f %14lld %14lld\n",
+					_phase_names[i], median * 1e3, p95 * 1e3,
+					median > 0 ? length / 1048576.0 / median : 0.0,
+					p95 > 0 ? length / 1048576.0 / p95 : 0.0,
+					s->allocations, s->bytes);
+		}
+		if(counters->available) {
+			_print_counters(phases, tokens_amount);
+		}
+		printf("\n");
+	}
+
+	for(int i = 0; i < PHASE_COUNT; i++) {
+		free(phases[i].seconds);
+	}
+	emitter_free(corpus);
+
+	return code;
+}
+
+int main(int argc, const char** argv) {
+	uint64_t seed = 1;
+	int repetitions = DEFAULT_REPETITIONS;
+	long long sizes[MAX_SIZES];
+	int sizes_amount = 0;
+
+	for(int i = 1; i < argc; i++) {
+		if(!strcmp(argv[i], "-s") && i + 1 < argc) {
+			seed = strtoull(argv[++i], NULL, 10);
+		} else if(!strcmp(argv[i], "-r") && i + 1 < argc) {
+			repetitions = atoi(argv[++i]);
+		} else if(argv[i][0] != '-' && sizes_amount < MAX_SIZES) {
+			sizes[sizes_amount++] = corpus_parse_size(argv[i]);
+		} else {
+			help();
+			return 1;
+		}
+	}
+
+	if(repetitions < 1) {
+		help();
+		return 1;
+	}
+	if(sizes_amount == 0) {
+		sizes[sizes_amount++] = 64 << 10;
+		sizes[sizes_amount++] = 1 << 20;
+		sizes[sizes_amount++] = 16 << 20;
+	}
+
+	alloc_stats_start();
+	hatch_init();
+
+	counter_set counters;
+	if(counters_open(&counters) == 0) {
+		fprintf(stderr, "Hardware counters are unavailable, reporting time and allocations only\n");
+	}
+
+	preprocess_config* config = preprocess_config_create(0, NULL, 0, NULL);
+
+	int code = 0;
+	for(int i = 0; i < sizes_amount && !code; i++) {
+		code = _bench(seed, sizes[i], repetitions, config, &counters);
+	}
+
+	preprocess_config_free(config);
+	counters_close(&counters);
+
+	return code;
+}
@@ -0,0 +1,456 @@
+#include "corpus.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_NAMES      64
+#define MAX_LOOP_DEPTH 3
+#define MAX_EXPR_DEPTH 4
+#define NAME_SIZE      24
+
+typedef struct {
+	uint64_t state;
+	emitter* out;
+	size_t   size;
+	int      indent;
+
+	unsigned char* params;
+	int functions;
+	int functions_capacity;
+	int globals;
+	int macros;
+	int flags;
+	int classes;
+	int typedefs;
+
+	char names[MAX_NAMES][NAME_SIZE];
+	int  names_amount;
+	int  loop_depth;
+	int  counters;
+} generator;
+
+static const char* _types[] = { "i8", "i16", "i32", "i64", "u8", "u16", "u32", "u64", "float", "double" };
+static const char* _binary[] = {
+	"+", "-", "*", "/", "<<", ">>", "<", ">", "<=", ">=", "==", "!=", "&", "^", "|", "&&", "||"
+};
+static const char* _unary[] = { "-", "!", "~" };
+static const char* _assign[] = { "=", "+=", "-=", "*=", "/=" };
+static const char* _words[] = {
+	"parse", "token", "stream", "value", "buffer", "node", "scope", "table", "index", "cache"
+};
+
+#define COUNT(a) ((int) (sizeof(a) / sizeof((a)[0])))
+
+// splitmix64
+static uint64_t _next(generator* g) {
+	uint64_t z = (g->state += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+static int _below(generator* g, int n) {
+	return (int) (_next(g) % n);
+}
+
+static int _chance(generator* g, int percent) {
+	return _below(g, 100) < percent;
+}
+
+static void _text(generator* g, const char* s) {
+	size_t length = strlen(s);
+	emit(g->out, s, length);
+	g->size += length;
+}
+
+static void _format(generator* g, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static void _format(generator* g, const char* fmt, ...) {
+	char buf[128];
+	va_list args;
+	va_start(args, fmt);
+	vsnprintf(buf, sizeof(buf), fmt, args);
+	va_end(args);
+	_text(g, buf);
+}
+
+static void _line(generator* g) {
+	_text(g, "\n");
+	for(int i = 0; i < g->indent; i++) {
+		_text(g, "\t");
+	}
+}
+
+static const char* _type(generator* g) {
+	return _types[_below(g, COUNT(_types))];
+}
+
+static void _push_name(generator* g, const char* fmt, int index) {
+	if(g->names_amount < MAX_NAMES) {
+		snprintf(g->names[g->names_amount++], NAME_SIZE, fmt, index);
+	}
+}
+
+static void _comment(generator* g) {
+	switch(_below(g, 3)) {
+		case 0:
+			_format(g, "// %s the %s", _words[_below(g, COUNT(_words))], _words[_below(g, COUNT(_words))]);
+			break;
+		case 1:
+			_format(g, "/* %s %d */", _words[_below(g, COUNT(_words))], _below(g, 1000));
+			break;
+		default:
+			_format(g, "/* %s /* nested %s */ %d */", _words[_below(g, COUNT(_words))],
+					_words[_below(g, COUNT(_words))], _below(g, 1000));
+			break;
+	}
+}
+
+static void _expression(generator* g, int depth);
+
+static void _operand(generator* g, int depth) {
+	int kind = _below(g, depth < MAX_EXPR_DEPTH ? 10 : 6);
+	switch(kind) {
+		case 0:
+		case 1:
+			_format(g, "%d", _below(g, 100000));
+			break;
+		case 2:
+			_format(g, "%d.%d", _below(g, 1000), _below(g, 100));
+			break;
+		case 3:
+			if(g->macros) {
+				_format(g, "M%d", _below(g, g->macros));
+				break;
+			}
+			// fallthrough
+		case 4:
+		case 5:
+			if(g->names_amount && (g->globals == 0 || _chance(g, 80))) {
+				_text(g, g->names[_below(g, g->names_amount)]);
+			} else if(g->globals) {
+				_format(g, "g%d", _below(g, g->globals));
+			} else {
+				_format(g, "0x%X", _below(g, 0xFFFF));
+			}
+			break;
+		case 6:
+			_text(g, "(");
+			_expression(g, depth + 1);
+			_text(g, ")");
+			break;
+		case 7:
+			// "- -x", since "--x" would lex as a decrement
+			_text(g, _unary[_below(g, COUNT(_unary))]);
+			_text(g, " ");
+			_operand(g, depth + 1);
+			break;
+		case 8:
+			if(g->functions) {
+				int f = _below(g, g->functions);
+				_format(g, "f%d(", f);
+				for(int i = 0; i < g->params[f]; i++) {
+					if(i) {
+						_text(g, ", ");
+					}
+					_expression(g, depth + 1);
+				}
+				_text(g, ")");
+				break;
+			}
+			// fallthrough
+		default:
+			_format(g, "sizeof(%s)", _type(g));
+			break;
+	}
+}
+
+static void _expression(generator* g, int depth) {
+	// Mostly short, sometimes the long chains the operator precedence levels are built for
+	int operands = _chance(g, 8) && depth == 0 ? 16 + _below(g, 48) : 1 + _below(g, 4);
+	_operand(g, depth);
+	for(int i = 1; i < operands; i++) {
+		_format(g, " %s ", _binary[_below(g, COUNT(_binary))]);
+		_operand(g, depth);
+	}
+}
+
+static void _block(generator* g, int statements);
+
+static void _statement(generator* g) {
+	int kind = _below(g, 10);
+	if(kind >= 7 && g->loop_depth >= MAX_LOOP_DEPTH) {
+		kind = _below(g, 7);
+	}
+	switch(kind) {
+		case 0:
+		case 1: {
+			int v = g->counters++;
+			_format(g, "let %s v%d = ", _type(g), v);
+			_expression(g, 0);
+			_text(g, ";");
+			_push_name(g, "v%d", v);
+			break;
+		}
+		case 2:
+		case 3:
+			if(g->names_amount) {
+				_format(g, "%s %s ", g->names[_below(g, g->names_amount)], _assign[_below(g, COUNT(_assign))]);
+				_expression(g, 0);
+				_text(g, ";");
+				break;
+			}
+			// fallthrough
+		case 4:
+			if(g->names_amount && _chance(g, 50)) {
+				_format(g, "%s%s;", g->names[_below(g, g->names_amount)], _chance(g, 50) ? "++" : "--");
+			} else {
+				_expression(g, 0);
+				_text(g, ";");
+			}
+			break;
+		case 5:
+			_text(g, "if(");
+			_expression(g, 0);
+			_text(g, ") ");
+			_block(g, 1 + _below(g, 3));
+			if(_chance(g, 40)) {
+				_text(g, " else ");
+				_block(g, 1 + _below(g, 3));
+			}
+			break;
+		case 6:
+			_comment(g);
+			break;
+		case 7: {
+			int k = g->counters++;
+			_format(g, "for(let i32 k%d = 0; k%d < %d; k%d++) ", k, k, 1 + _below(g, 64), k);
+			int saved = g->names_amount;
+			_push_name(g, "k%d", k);
+			g->loop_depth++;
+			_block(g, 1 + _below(g, 4));
+			g->loop_depth--;
+			g->names_amount = saved;
+			break;
+		}
+		case 8:
+			_text(g, "while(");
+			_expression(g, 0);
+			_text(g, ") ");
+			g->loop_depth++;
+			_block(g, 1 + _below(g, 4));
+			g->loop_depth--;
+			break;
+		default:
+			_text(g, "do ");
+			g->loop_depth++;
+			_block(g, 1 + _below(g, 4));
+			g->loop_depth--;
+			_text(g, " while(");
+			_expression(g, 0);
+			_text(g, ");");
+			break;
+	}
+}
+
+static void _block(generator* g, int statements) {
+	int saved = g->names_amount;
+	_text(g, "{");
+	g->indent++;
+	for(int i = 0; i < statements; i++) {
+		_line(g);
+		_statement(g);
+	}
+	if(g->loop_depth && _chance(g, 20)) {
+		_line(g);
+		_text(g, _chance(g, 50) ? "break;" : "continue;");
+	}
+	g->indent--;
+	_line(g);
+	_text(g, "}");
+	g->names_amount = saved;
+}
+
+static void _function_body(generator* g, int params) {
+	g->names_amount = 0;
+	g->counters = 0;
+	for(int i = 0; i < params; i++) {
+		_push_name(g, "a%d", i);
+	}
+
+	int saved = g->names_amount;
+	_text(g, "{");
+	g->indent++;
+	int statements = 2 + _below(g, 8);
+	for(int i = 0; i < statements; i++) {
+		_line(g);
+		_statement(g);
+	}
+	_line(g);
+	_text(g, "return ");
+	_expression(g, 0);
+	_text(g, ";");
+	g->indent--;
+	_line(g);
+	_text(g, "}");
+	g->names_amount = saved;
+}
+
+static void _signature(generator* g, const char* name, int index, int params) {
+	_format(g, "fun %s %s%d(", _type(g), name, index);
+	for(int i = 0; i < params; i++) {
+		_format(g, i ? ", %s a%d" : "%s a%d", _type(g), i);
+	}
+	_text(g, ")");
+}
+
+static int _new_function(generator* g, int params) {
+	if(g->functions == g->functions_capacity) {
+		g->functions_capacity = g->functions_capacity ? g->functions_capacity * 2 : 64;
+		g->params = realloc(g->params, g->functions_capacity);
+	}
+	g->params[g->functions] = params;
+	return g->functions++;
+}
+
+static void _function(generator* g) {
+	int params = _below(g, 5);
+	_signature(g, "f", g->functions, params);
+	_text(g, " ");
+	_function_body(g, params);
+	// Only callable once it is defined, which keeps recursion out of the corpus
+	_new_function(g, params);
+}
+
+static void _global(generator* g, int index) {
+	g->names_amount = 0;
+	_format(g, "let const %s g%d = ", _type(g), index);
+	_expression(g, 0);
+	_text(g, ";");
+}
+
+static void _class(generator* g) {
+	int members = 1 + _below(g, 4);
+	int methods = 1 + _below(g, 4);
+	static const char* qualifiers[] = { "", "public ", "private ", "protected " };
+
+	_format(g, "class C%d {", g->classes++);
+	g->indent++;
+	for(int i = 0; i < members; i++) {
+		_line(g);
+		_format(g, "%slet %s m%d;", qualifiers[_below(g, 4)], _type(g), i);
+	}
+	for(int i = 0; i < methods; i++) {
+		_line(g);
+		int params = _below(g, 4);
+		_text(g, qualifiers[_below(g, 4)]);
+		if(_chance(g, 25)) {
+			_text(g, "static ");
+		}
+		_signature(g, "method", i, params);
+		_text(g, " ");
+		_function_body(g, params);
+	}
+	g->indent--;
+	_line(g);
+	_text(g, "}");
+}
+
+static void _macro(generator* g) {
+	if(_chance(g, 30)) {
+		_format(g, "#define F%d", g->flags++);
+		return;
+	}
+	// Macro bodies only use literals, so they expand the same wherever they are used
+	_format(g, "#define M%d (%d %s %d)", g->macros++, _below(g, 1000),
+			_binary[_below(g, 5)], 1 + _below(g, 1000));
+}
+
+static void _conditional(generator* g) {
+	if(g->flags == 0) {
+		_macro(g);
+		return;
+	}
+	_format(g, _chance(g, 50) ? "#ifdef F%d" : "#ifndef F%d", _below(g, g->flags));
+	_line(g);
+
+	// Both branches declare the same names, whichever one survives
+	int global = g->globals++;
+	int params = _below(g, 4);
+	int function = g->functions;
+
+	_global(g, global);
+	_line(g);
+	_signature(g, "f", function, params);
+	_text(g, " ");
+	_function_body(g, params);
+	_line(g);
+	_text(g, "#else");
+	_line(g);
+	_global(g, global);
+	_line(g);
+	_signature(g, "f", function, params);
+	_text(g, " ");
+	_function_body(g, params);
+	_line(g);
+	_text(g, "#endif");
+
+	_new_function(g, params);
+}
+
+static void _declaration(generator* g) {
+	int kind = _below(g, 100);
+	if(kind < 45) {
+		_function(g);
+	} else if(kind < 55) {
+		_class(g);
+	} else if(kind < 65) {
+		_global(g, g->globals++);
+	} else if(kind < 73) {
+		_macro(g);
+	} else if(kind < 80) {
+		_conditional(g);
+	} else if(kind < 85) {
+		_format(g, "typedef %s%s t%d;", _chance(g, 50) ? "*" : "", _type(g), g->typedefs++);
+	} else if(kind < 90) {
+		int params = _below(g, 4);
+		_signature(g, "f", g->functions, params);
+		_text(g, ";");
+		_new_function(g, params);
+	} else {
+		_comment(g);
+	}
+	_text(g, "\n");
+	if(_chance(g, 30)) {
+		_text(g, "\n");
+	}
+}
+
+size_t corpus_generate(uint64_t seed, size_t size, emitter* out) {
+	generator g;
+	memset(&g, 0, sizeof(g));
+	g.state = seed;
+	g.out = out;
+
+	_format(&g, "// generated corpus, seed %llu\n\n", (unsigned long long) seed);
+	while(g.size < size) {
+		_declaration(&g);
+	}
+
+	free(g.params);
+	return g.size;
+}
+
+long long corpus_parse_size(const char* s) {
+	char* end;
+	long long size = strtoll(s, &end, 10);
+	switch(*end) {
+		case 'k': case 'K': size <<= 10; break;
+		case 'm': case 'M': size <<= 20; break;
+		case 'g': case 'G': size <<= 30; break;
+		default: break;
+	}
+	return size;
+}
@@ -0,0 +1,17 @@
+#ifndef _CORPUS_H
+#define _CORPUS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "emit.h"
+
+// Writes a valid .dc program of about size bytes (it stops after the declaration that
+// reaches size) made of functions with nested loops and conditions, classes, long
+// expressions, typedefs, macros, #ifdef blocks and comments. Every name it uses is
+// declared before. The same seed and size always give the same program.
+size_t corpus_generate(uint64_t seed, size_t size, emitter* out);
+
+long long corpus_parse_size(const char* s);
+
+#endif
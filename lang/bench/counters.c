@@ -0,0 +1,124 @@
+#include "counters.h"
+
+#include <string.h>
+
+static const char* _names[COUNTERS] = {
+	[COUNTER_CYCLES]        = "cycles",
+	[COUNTER_INSTRUCTIONS]  = "instructions",
+	[COUNTER_BRANCH_MISSES] = "branch-misses",
+	[COUNTER_L1D_MISSES]    = "L1d-misses",
+	[COUNTER_LLC_MISSES]    = "LLC-misses",
+};
+
+const char* counter_name(enum hw_counter counter) {
+	return _names[counter];
+}
+
+#ifdef __linux__
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define CACHE_MISS(cache) \
+	((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+static const struct {
+	unsigned int       type;
+	unsigned long long config;
+} _events[COUNTERS] = {
+	[COUNTER_CYCLES]        = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+	[COUNTER_INSTRUCTIONS]  = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+	[COUNTER_BRANCH_MISSES] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+	[COUNTER_L1D_MISSES]    = { PERF_TYPE_HW_CACHE, CACHE_MISS(PERF_COUNT_HW_CACHE_L1D) },
+	[COUNTER_LLC_MISSES]    = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+};
+
+static int _open(unsigned int type, unsigned long long config) {
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = type;
+	attr.config = config;
+	attr.disabled = 1;
+	// User space only, which perf_event_paranoid 2 still allows
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+	return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+int counters_open(counter_set* c) {
+	c->available = 0;
+	for(int i = 0; i < COUNTERS; i++) {
+		c->fds[i] = _open(_events[i].type, _events[i].config);
+		if(c->fds[i] >= 0) {
+			c->available++;
+		}
+	}
+	return c->available;
+}
+
+void counters_close(counter_set* c) {
+	for(int i = 0; i < COUNTERS; i++) {
+		if(c->fds[i] >= 0) {
+			close(c->fds[i]);
+			c->fds[i] = -1;
+		}
+	}
+	c->available = 0;
+}
+
+void counters_start(counter_set* c) {
+	for(int i = 0; i < COUNTERS; i++) {
+		if(c->fds[i] >= 0) {
+			ioctl(c->fds[i], PERF_EVENT_IOC_RESET, 0);
+			ioctl(c->fds[i], PERF_EVENT_IOC_ENABLE, 0);
+		}
+	}
+}
+
+void counters_stop(counter_set* c, counter_values* out) {
+	for(int i = 0; i < COUNTERS; i++) {
+		if(c->fds[i] >= 0) {
+			ioctl(c->fds[i], PERF_EVENT_IOC_DISABLE, 0);
+		}
+	}
+	for(int i = 0; i < COUNTERS; i++) {
+		unsigned long long data[3];
+		out->values[i] = 0;
+		out->valid[i] = 0;
+		if(c->fds[i] < 0 || read(c->fds[i], data, sizeof(data)) != sizeof(data) || data[2] == 0) {
+			continue;
+		}
+		// More events than hardware counters get multiplexed, scale up to the full time
+		out->values[i] = data[2] < data[1] ? (long long) ((double) data[0] * data[1] / data[2]) : (long long) data[0];
+		out->valid[i] = 1;
+	}
+}
+
+#else
+
+int counters_open(counter_set* c) {
+	for(int i = 0; i < COUNTERS; i++) {
+		c->fds[i] = -1;
+	}
+	c->available = 0;
+	return 0;
+}
+
+void counters_close(counter_set* c) {
+	(void) c;
+}
+
+void counters_start(counter_set* c) {
+	(void) c;
+}
+
+void counters_stop(counter_set* c, counter_values* out) {
+	(void) c;
+	memset(out, 0, sizeof(*out));
+}
+
+#endif
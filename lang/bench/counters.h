@@ -0,0 +1,34 @@
+#ifndef _COUNTERS_H
+#define _COUNTERS_H
+
+enum hw_counter {
+	COUNTER_CYCLES,
+	COUNTER_INSTRUCTIONS,
+	COUNTER_BRANCH_MISSES,
+	COUNTER_L1D_MISSES,
+	COUNTER_LLC_MISSES,
+	COUNTERS
+};
+
+// Each counter is opened on its own, so hosts that only lack cache events
+// still report the rest. A counter that could not be opened has fd -1.
+typedef struct {
+	int fds[COUNTERS];
+	int available;
+} counter_set;
+
+typedef struct {
+	long long values[COUNTERS];
+	int       valid[COUNTERS];
+} counter_values;
+
+// Returns the amount of counters opened, 0 without perf_event_open (other systems,
+// containers without the syscall or a too strict perf_event_paranoid)
+int  counters_open(counter_set* c);
+void counters_close(counter_set* c);
+void counters_start(counter_set* c);
+void counters_stop(counter_set* c, counter_values* out);
+
+const char* counter_name(enum hw_counter counter);
+
+#endif
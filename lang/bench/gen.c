@@ -0,0 +1,54 @@
+#include "corpus.h"
+#include "emit.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+void help() {
+	printf("usage: hatch_gen [-s <seed>] [-o <file>] <size>\n"
+	       "  writes a generated .dc program of about <size> bytes (K, M or G suffix)\n"
+	       "  -s <seed>  seed of the generator (default 1), the same seed and size\n"
+	       "             always give the same program\n"
+	       "  -o <file>  write to <file> instead of stdout\n");
+}
+
+int main(int argc, const char** argv) {
+	uint64_t seed = 1;
+	long long size = 0;
+	const char* output = NULL;
+
+	for(int i = 1; i < argc; i++) {
+		if(!strcmp(argv[i], "-s") && i + 1 < argc) {
+			seed = strtoull(argv[++i], NULL, 10);
+		} else if(!strcmp(argv[i], "-o") && i + 1 < argc) {
+			output = argv[++i];
+		} else if(argv[i][0] != '-') {
+			size = corpus_parse_size(argv[i]);
+		} else {
+			help();
+			return 1;
+		}
+	}
+
+	if(size <= 0) {
+		help();
+		return 1;
+	}
+
+	emitter* out = output ? emitter_open(output) : emitter_create(STDOUT_FILENO);
+	if(out == NULL) {
+		perror("Error opening output file");
+		return 1;
+	}
+
+	corpus_generate(seed, size, out);
+
+	if(emitter_close(out)) {
+		fprintf(stderr, "Error writing output\n");
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,355 @@
+#include "emit.h"
+#include "hatch.h"
+#include "lex.h"
+#include "map.h"
+#include "preprocess.h"
+#include "source.h"
+#include "syntax.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define STEPS 4
+#define DEFAULT_REPETITIONS 3
+// Allowed growth exponent of a linear case, the slack covers cache effects of the bigger inputs
+#define LINEAR_BOUND 1.35
+#define COLLIDING_BLOCKS 20
+
+typedef void (*case_generator)(emitter* out, long long n);
+
+typedef struct {
+	const char*    name;
+	const char*    unit;
+	long long      largest;
+	double         bound;
+	// Inputs nested deeper than the parser allows have to be rejected, not crash it
+	int            rejected;
+	case_generator generate;
+} scaling_case;
+
+typedef struct {
+	int errors;
+} diagnostic_counter;
+
+void help() {
+	printf("usage: hatch_scaling [-r <repetitions>] [-d <divisor>] [cases...]\n"
+	       "  lexes and parses adversarial inputs at %d doubling sizes and fails when\n"
+	       "  the time grows faster than the bound of the case\n"
+	       "  -r <repetitions>  runs per size, the fastest one counts (default %d)\n"
+	       "  -d <divisor>      divide every size, for quick runs\n", STEPS, DEFAULT_REPETITIONS);
+}
+
+static double _now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void _defines(emitter* out, long long n) {
+	for(long long i = 0; i < n; i++) {
+		emit_format(out, "#define D%lld (%lld + 1)\n", i, i);
+	}
+	for(long long i = 0; i < n; i++) {
+		emit_format(out, "let const i32 v%lld = D%lld;\n", i, n - 1 - i);
+	}
+}
+
+static void _conditionals(emitter* out, long long n) {
+	for(long long i = 0; i < n; i += 2) {
+		emit_format(out, "#define F%lld\n", i);
+	}
+	for(long long i = 0; i < n; i++) {
+		emit_format(out, "#ifdef F%lld\nlet const i32 a%lld = 1;\n#else\nlet const i32 a%lld = 2;\n#endif\n", i, i, i);
+	}
+}
+
+static void _nested_conditionals(emitter* out, long long n) {
+	emit_string(out, "#define F\n");
+	for(long long i = 0; i < n; i++) {
+		emit_format(out, "%s\nlet const i32 a%lld = 1;\n", i % 2 ? "#ifdef F" : "#ifndef G", i);
+	}
+	for(long long i = 0; i < n; i++) {
+		emit_string(out, "#endif\n");
+	}
+}
+
+// n bytes without a single newline, mostly string literals
+static void _long_line(emitter* out, long long n) {
+	char literal[1024];
+	memset(literal, 'x', sizeof(literal) - 1);
+	literal[sizeof(literal) - 1] = '\0';
+
+	for(long long i = 0; out->size < (size_t) n; i++) {
+		emit_format(out, "let const str s%lld = \"%s\"; ", i, literal);
+	}
+}
+
+#define BLOCK_LETTERS 6
+#define BLOCK_SEEN_BITS 20
+
+// Each pair of blocks takes the unseeded FNV-1a state the previous blocks left to one
+// common state, so all 2^COLLIDING_BLOCKS names made of one block of every pair share
+// their hash: what an input crafted against the hash without knowing the seed looks like
+static char _blocks[COLLIDING_BLOCKS][2][BLOCK_LETTERS + 1];
+
+static unsigned int _fnv_block(unsigned int state, const char* block) {
+	for(int i = 0; i < BLOCK_LETTERS; i++) {
+		state = (state ^ (unsigned char) block[i]) * 16777619u;
+	}
+	return state;
+}
+
+// Short sequential blocks barely collide under FNV-1a, scrambled ones behave like random
+static void _block(unsigned int index, char* out) {
+	static const char letters[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
+	unsigned long long x = index * 0x9e3779b97f4a7c15ull;
+	x ^= x >> 29;
+	x *= 0xbf58476d1ce4e5b9ull;
+	x ^= x >> 32;
+	for(int i = 0; i < BLOCK_LETTERS; i++) {
+		out[i] = letters[x % 52];
+		x /= 52;
+	}
+	out[BLOCK_LETTERS] = '\0';
+}
+
+// A birthday search, the first two blocks that end in the same state make the pair.
+// About 2^16 blocks are tried for a 32 bit state, the table holds eight times as many.
+static int _find_pair(unsigned int* state, char pair[2][BLOCK_LETTERS + 1]) {
+	unsigned int mask = (1u << BLOCK_SEEN_BITS) - 1;
+	unsigned int* seen = calloc(mask + 1, sizeof(unsigned int));
+	char block[BLOCK_LETTERS + 1];
+	for(unsigned int i = 1; i < mask / 2; i++) {
+		_block(i, block);
+		unsigned int next = _fnv_block(*state, block);
+		unsigned int slot = (next * 2654435761u) >> (32 - BLOCK_SEEN_BITS);
+		while(seen[slot]) {
+			_block(seen[slot], pair[0]);
+			if(_fnv_block(*state, pair[0]) == next && strcmp(pair[0], block)) {
+				memcpy(pair[1], block, sizeof(block));
+				free(seen);
+				*state = next;
+				return 0;
+			}
+			slot = (slot + 1) & mask;
+		}
+		seen[slot] = i;
+	}
+	free(seen);
+	return 1;
+}
+
+static int _find_blocks() {
+	unsigned int state = 2166136261u;
+	for(int b = 0; b < COLLIDING_BLOCKS; b++) {
+		if(_find_pair(&state, _blocks[b])) {
+			return 1;
+		}
+	}
+
+	char first[COLLIDING_BLOCKS * BLOCK_LETTERS + 1] = "";
+	char last[COLLIDING_BLOCKS * BLOCK_LETTERS + 1] = "";
+	for(int b = 0; b < COLLIDING_BLOCKS; b++) {
+		strcat(first, _blocks[b][0]);
+		strcat(last, _blocks[b][1]);
+	}
+	return builtin_string_hash_seeded(first, 0) != builtin_string_hash_seeded(last, 0);
+}
+
+static void _colliding_name(emitter* out, long long i) {
+	for(int b = 0; b < COLLIDING_BLOCKS; b++) {
+		emit_string(out, _blocks[b][(i >> b) & 1]);
+	}
+}
+
+static void _collisions(emitter* out, long long n) {
+	for(long long i = 0; i < n; i += 2) {
+		emit_string(out, "#define ");
+		_colliding_name(out, i);
+		emit_string(out, " 1\n");
+	}
+	for(long long i = 1; i < n; i += 2) {
+		emit_string(out, "let const i32 ");
+		_colliding_name(out, i);
+		emit_string(out, " = 1;\n");
+	}
+}
+
+static void _nested_comments(emitter* out, long long n) {
+	for(long long i = 0; i < n; i++) {
+		emit_string(out, "/* ");
+	}
+	for(long long i = 0; i < n; i++) {
+		emit_string(out, "*/ ");
+	}
+	emit_string(out, "\nlet const i32 a = 1;\n");
+}
+
+static void _nested_parens(emitter* out, long long n) {
+	emit_string(out, "let const i32 a = ");
+	for(long long i = 0; i < n; i++) {
+		emit_char(out, '(');
+	}
+	emit_char(out, '1');
+	for(long long i = 0; i < n; i++) {
+		emit_char(out, ')');
+	}
+	emit_string(out, ";\n");
+}
+
+static scaling_case _cases[] = {
+	{ "defines",             "defines",      100000,    LINEAR_BOUND, 0, _defines },
+	{ "conditionals",        "conditionals", 10000,     LINEAR_BOUND, 0, _conditionals },
+	{ "nested-conditionals", "levels",       10000,     LINEAR_BOUND, 0, _nested_conditionals },
+	{ "long-line",           "bytes",        100 << 20, LINEAR_BOUND, 0, _long_line },
+	{ "collisions",          "identifiers",  1 << COLLIDING_BLOCKS, LINEAR_BOUND, 0, _collisions },
+	{ "nested-comments",     "levels",       1 << 20,   LINEAR_BOUND, 0, _nested_comments },
+	{ "nested-parens",       "levels",       1 << 20,   LINEAR_BOUND, 1, _nested_parens },
+};
+
+static void _count_diagnostic(void* ctx, source_position position, const char* level, const char* message) {
+	(void) position;
+	(void) message;
+	if(!strcmp(level, "error")) {
+		((diagnostic_counter*) ctx)->errors++;
+	}
+}
+
+// Returns the compile result, -1 if it failed without reporting an error
+static int _compile(const char* data, size_t size, preprocess_config* config, double* seconds) {
+	diagnostic_counter counter = {0};
+
+	source_manager* sm = source_manager_create();
+	sm->handler = _count_diagnostic;
+	sm->handler_ctx = &counter;
+	source_entry* file = source_add_buffer(sm, "scaling.dc", data, size, SOURCE_LOC_INVALID);
+	preprocessor* pp = preprocess_create(sm, config);
+	token_stream* tokens = lex_stream_create(sm);
+	syntax_tree* ast = syntax_tree_create();
+
+	double started = _now();
+	int code = lex(pp, file, tokens);
+	if(code == 0) {
+		code = syntax_build_tree(tokens, ast);
+	}
+	*seconds = _now() - started;
+
+	syntax_tree_free(ast);
+	lex_stream_free(tokens);
+	preprocess_free(pp);
+	source_manager_free(sm);
+
+	if(code && counter.errors == 0) {
+		return -1;
+	}
+	return code;
+}
+
+static int _measure(scaling_case* c, long long divisor, int repetitions, preprocess_config* config) {
+	long long sizes[STEPS];
+	double times[STEPS];
+
+	printf("%s\n", c->name);
+	for(int s = 0; s < STEPS; s++) {
+		sizes[s] = (c->largest / divisor) >> (STEPS - 1 - s);
+		if(sizes[s] < 1) {
+			sizes[s] = 1;
+		}
+
+		emitter* input = emitter_create_buffer();
+		c->generate(input, sizes[s]);
+		size_t length = input->size;
+		emit_char(input, '\0');
+
+		times[s] = INFINITY;
+		for(int r = 0; r < repetitions; r++) {
+			double seconds;
+			int code = _compile(input->data, length, config, &seconds);
+			int failed = c->rejected ? code <= 0 : code != 0;
+			if(failed) {
+				fprintf(stderr, "%s: %lld %s %s\n", c->name, sizes[s], c->unit,
+						code < 0 ? "failed without a diagnostic" : c->rejected ? "were accepted" : "failed to compile");
+				emitter_free(input);
+				return 1;
+			}
+			if(seconds < times[s]) {
+				times[s] = seconds;
+			}
+		}
+		emitter_free(input);
+
+		printf("  %12lld %-12s %12zu bytes %12.3f ms\n", sizes[s], c->unit, length, times[s] * 1e3);
+	}
+
+	// Timer resolution makes tiny runs meaningless, take at least a millisecond
+	double first = times[0] > 1e-3 ? times[0] : 1e-3;
+	double last = times[STEPS - 1] > first ? times[STEPS - 1] : first;
+	double exponent = sizes[STEPS - 1] > sizes[0] ? log(last / first) / log((double) sizes[STEPS - 1] / sizes[0]) : 0;
+	int passed = exponent <= c->bound;
+
+	printf("  growth n^%.2f, bound n^%.2f: %s\n\n", exponent, c->bound, passed ? "ok" : "FAILED");
+	return !passed;
+}
+
+static int _selected(scaling_case* c, const char** names, int amount) {
+	if(amount == 0) {
+		return 1;
+	}
+	for(int i = 0; i < amount; i++) {
+		if(!strcmp(names[i], c->name)) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+int main(int argc, const char** argv) {
+	int repetitions = DEFAULT_REPETITIONS;
+	long long divisor = 1;
+	const char* names[sizeof(_cases) / sizeof(_cases[0])];
+	int names_amount = 0;
+
+	for(int i = 1; i < argc; i++) {
+		if(!strcmp(argv[i], "-r") && i + 1 < argc) {
+			repetitions = atoi(argv[++i]);
+		} else if(!strcmp(argv[i], "-d") && i + 1 < argc) {
+			divisor = atoll(argv[++i]);
+		} else if(argv[i][0] != '-' && names_amount < (int) (sizeof(names) / sizeof(names[0]))) {
+			names[names_amount++] = argv[i];
+		} else {
+			help();
+			return 1;
+		}
+	}
+
+	if(repetitions < 1 || divisor < 1) {
+		help();
+		return 1;
+	}
+
+	hatch_init();
+
+	if(_find_blocks()) {
+		fprintf(stderr, "the names of the collisions case don't share a hash\n");
+		return 1;
+	}
+
+	preprocess_config* config = preprocess_config_create(0, NULL, 0, NULL);
+
+	int failures = 0;
+	for(size_t i = 0; i < sizeof(_cases) / sizeof(_cases[0]); i++) {
+		if(_selected(&_cases[i], names, names_amount)) {
+			failures += _measure(&_cases[i], divisor, repetitions, config);
+		}
+	}
+
+	preprocess_config_free(config);
+
+	if(failures) {
+		fprintf(stderr, "%d case(s) grow faster than their bound\n", failures);
+	}
+	return failures != 0;
+}
@@ -0,0 +1,364 @@
+#include "cache.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+#define CACHE_MAGIC "HATCHC1"
+#define CACHE_PATH_MAX 4096
+
+typedef struct {
+	char     magic[8];
+	int32_t  code;
+	uint32_t reserved;
+	uint64_t size;
+} entry_header;
+
+typedef struct {
+	long long hits;
+	long long misses;
+	long long stores;
+	long long evictions;
+	long long size;
+} cache_stats;
+
+typedef struct {
+	char* path;
+	long long size;
+	struct timespec mtime;
+} cache_file;
+
+static int _make_dir(const char* path) {
+	if(mkdir(path, 0755) < 0 && errno != EEXIST) {
+		return 1;
+	}
+	return 0;
+}
+
+compile_cache* cache_open(const char* dir, long long max_size) {
+	char* copy = strdup(dir);
+	for(char* p = copy + 1; *p; p++) {
+		if(*p == '/') {
+			*p = '\0';
+			_make_dir(copy);
+			*p = '/';
+		}
+	}
+	int failed = _make_dir(copy);
+	free(copy);
+
+	if(failed) {
+		perror("Error creating cache directory");
+		return NULL;
+	}
+
+	compile_cache* c = calloc(1, sizeof(compile_cache));
+	c->dir = strdup(dir);
+	c->max_size = max_size > 0 ? max_size : CACHE_DEFAULT_SIZE;
+	return c;
+}
+
+void cache_close(compile_cache* c) {
+	cache_flush(c);
+	free(c->dir);
+	free(c);
+}
+
+static void _entry_path(compile_cache* c, const char* key, char* path, size_t size, int dir_only) {
+	if(dir_only) {
+		snprintf(path, size, "%s/%.2s", c->dir, key);
+	} else {
+		snprintf(path, size, "%s/%.2s/%s", c->dir, key, key + 2);
+	}
+}
+
+static int _read_all(int fd, void* data, size_t size) {
+	char* p = data;
+	while(size) {
+		ssize_t r = read(fd, p, size);
+		if(r < 0 && errno == EINTR) {
+			continue;
+		}
+		if(r <= 0) {
+			return 1;
+		}
+		p += r;
+		size -= r;
+	}
+	return 0;
+}
+
+static int _write_all(int fd, const void* data, size_t size) {
+	const char* p = data;
+	while(size) {
+		ssize_t w = write(fd, p, size);
+		if(w < 0 && errno == EINTR) {
+			continue;
+		}
+		if(w <= 0) {
+			return 1;
+		}
+		p += w;
+		size -= w;
+	}
+	return 0;
+}
+
+int cache_lookup(compile_cache* c, const char* key, char** data_ptr, size_t* size_ptr, int* code_ptr) {
+	char path[CACHE_PATH_MAX];
+	_entry_path(c, key, path, sizeof(path), 0);
+
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if(fd < 0) {
+		atomic_fetch_add(&c->misses, 1);
+		return 1;
+	}
+
+	// A truncated or corrupted entry is a miss, its size has to match the file exactly
+	entry_header h;
+	struct stat st;
+	char* data = NULL;
+	if(fstat(fd, &st) < 0 || _read_all(fd, &h, sizeof(h)) || memcmp(h.magic, CACHE_MAGIC, sizeof(h.magic)) ||
+	   st.st_size < (off_t) sizeof(h) || h.size != (uint64_t) st.st_size - sizeof(h) ||
+	   (data = malloc(h.size + 1)) == NULL || _read_all(fd, data, h.size)) {
+		free(data);
+		close(fd);
+		atomic_fetch_add(&c->misses, 1);
+		return 1;
+	}
+	close(fd);
+
+	// Hits refresh the modification time, which is what eviction orders by
+	utimensat(AT_FDCWD, path, NULL, 0);
+
+	*data_ptr = data;
+	*size_ptr = h.size;
+	*code_ptr = h.code;
+
+	atomic_fetch_add(&c->hits, 1);
+
+	return 0;
+}
+
+void cache_store(compile_cache* c, const char* key, const char* data, size_t size, int code) {
+	char dir[CACHE_PATH_MAX];
+	char path[CACHE_PATH_MAX];
+	char tmp[CACHE_PATH_MAX + 16];
+
+	_entry_path(c, key, dir, sizeof(dir), 1);
+	_entry_path(c, key, path, sizeof(path), 0);
+	snprintf(tmp, sizeof(tmp), "%s/.tmp.XXXXXX", dir);
+
+	if(_make_dir(dir)) {
+		return;
+	}
+
+	int fd = mkstemp(tmp);
+	if(fd < 0) {
+		return;
+	}
+
+	entry_header h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, CACHE_MAGIC, sizeof(h.magic));
+	h.code = code;
+	h.size = size;
+
+	// Readers only ever see complete entries: the file appears under its key by rename
+	if(_write_all(fd, &h, sizeof(h)) || _write_all(fd, data, size) || close(fd) < 0 || rename(tmp, path) < 0) {
+		unlink(tmp);
+		return;
+	}
+
+	atomic_fetch_add(&c->stores, 1);
+	atomic_fetch_add(&c->stored_bytes, sizeof(h) + size);
+}
+
+static int _lock_stats(compile_cache* c) {
+	char path[CACHE_PATH_MAX];
+	snprintf(path, sizeof(path), "%s/stats", c->dir);
+
+	int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if(fd < 0) {
+		return -1;
+	}
+	if(flock(fd, LOCK_EX) < 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static void _read_stats(int fd, cache_stats* s) {
+	char buffer[512];
+	memset(s, 0, sizeof(*s));
+
+	ssize_t r = pread(fd, buffer, sizeof(buffer) - 1, 0);
+	if(r <= 0) {
+		return;
+	}
+	buffer[r] = '\0';
+
+	sscanf(buffer, "hits %lld\nmisses %lld\nstores %lld\nevictions %lld\nsize %lld\n",
+	       &s->hits, &s->misses, &s->stores, &s->evictions, &s->size);
+}
+
+static void _write_stats(int fd, cache_stats* s) {
+	char buffer[512];
+	int length = snprintf(buffer, sizeof(buffer), "hits %lld\nmisses %lld\nstores %lld\nevictions %lld\nsize %lld\n",
+	                      s->hits, s->misses, s->stores, s->evictions, s->size);
+	if(ftruncate(fd, 0) == 0) {
+		(void) !pwrite(fd, buffer, length, 0);
+	}
+}
+
+static int _compare_files(const void* a, const void* b) {
+	const cache_file* x = a;
+	const cache_file* y = b;
+	if(x->mtime.tv_sec != y->mtime.tv_sec) {
+		return x->mtime.tv_sec < y->mtime.tv_sec ? -1 : 1;
+	}
+	if(x->mtime.tv_nsec != y->mtime.tv_nsec) {
+		return x->mtime.tv_nsec < y->mtime.tv_nsec ? -1 : 1;
+	}
+	return 0;
+}
+
+// Walks every entry, recomputes the real total and drops the least recently used
+// entries until the cache is 10% under its limit
+static void _evict(compile_cache* c, cache_stats* s) {
+	cache_file* files = NULL;
+	int amount = 0;
+	int capacity = 0;
+	long long total = 0;
+
+	DIR* root = opendir(c->dir);
+	if(root == NULL) {
+		return;
+	}
+
+	struct dirent* d;
+	while((d = readdir(root))) {
+		if(strlen(d->d_name) != 2) {
+			continue;
+		}
+
+		char dir[CACHE_PATH_MAX];
+		snprintf(dir, sizeof(dir), "%s/%s", c->dir, d->d_name);
+		DIR* sub = opendir(dir);
+		if(sub == NULL) {
+			continue;
+		}
+
+		struct dirent* e;
+		while((e = readdir(sub))) {
+			if(e->d_name[0] == '.') {
+				continue;
+			}
+
+			char path[CACHE_PATH_MAX + 256];
+			struct stat st;
+			snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+			if(stat(path, &st) < 0 || !S_ISREG(st.st_mode)) {
+				continue;
+			}
+
+			if(amount == capacity) {
+				capacity = capacity ? capacity * 2 : 256;
+				files = realloc(files, sizeof(cache_file) * capacity);
+			}
+			files[amount].path = strdup(path);
+			files[amount].size = st.st_size;
+			files[amount].mtime = st.st_mtim;
+			amount++;
+			total += st.st_size;
+		}
+		closedir(sub);
+	}
+	closedir(root);
+
+	qsort(files, amount, sizeof(cache_file), _compare_files);
+
+	long long target = c->max_size / 10 * 9;
+	for(int i = 0; i < amount; i++) {
+		if(total > target && unlink(files[i].path) == 0) {
+			total -= files[i].size;
+			s->evictions++;
+		}
+		free(files[i].path);
+	}
+	free(files);
+
+	s->size = total;
+}
+
+void cache_flush(compile_cache* c) {
+	long long hits = atomic_exchange(&c->hits, 0);
+	long long misses = atomic_exchange(&c->misses, 0);
+	long long stores = atomic_exchange(&c->stores, 0);
+	long long stored_bytes = atomic_exchange(&c->stored_bytes, 0);
+
+	if(!hits && !misses && !stores) {
+		return;
+	}
+
+	int fd = _lock_stats(c);
+	if(fd < 0) {
+		return;
+	}
+
+	cache_stats s;
+	_read_stats(fd, &s);
+	s.hits += hits;
+	s.misses += misses;
+	s.stores += stores;
+	s.size += stored_bytes;
+
+	if(s.size > c->max_size) {
+		_evict(c, &s);
+	}
+
+	_write_stats(fd, &s);
+	close(fd);
+}
+
+void cache_print_stats(compile_cache* c, FILE* out) {
+	cache_flush(c);
+
+	cache_stats s;
+	int fd = _lock_stats(c);
+	if(fd < 0) {
+		memset(&s, 0, sizeof(s));
+	} else {
+		_read_stats(fd, &s);
+		close(fd);
+	}
+
+	long long lookups = s.hits + s.misses;
+
+	fprintf(out, "cache directory  %s\n", c->dir);
+	fprintf(out, "hits             %lld\n", s.hits);
+	fprintf(out, "misses           %lld\n", s.misses);
+	fprintf(out, "hit rate         %.1f%%\n", lookups ? 100.0 * s.hits / lookups : 0.0);
+	fprintf(out, "stores           %lld\n", s.stores);
+	fprintf(out, "evictions        %lld\n", s.evictions);
+	fprintf(out, "size             %.1f / %.1f MB\n", s.size / 1048576.0, c->max_size / 1048576.0);
+}
+
+long long cache_parse_size(const char* s) {
+	char* end;
+	long long size = strtoll(s, &end, 10);
+	switch(*end) {
+		case 'k': case 'K': size <<= 10; break;
+		case 'm': case 'M': size <<= 20; break;
+		case 'g': case 'G': size <<= 30; break;
+		default: break;
+	}
+	return size;
+}
@@ -0,0 +1,29 @@
+#ifndef _CACHE_H
+#define _CACHE_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#define CACHE_DEFAULT_SIZE (1LL << 30)
+
+typedef struct {
+	char*      dir;
+	long long  max_size;
+	atomic_llong hits;
+	atomic_llong misses;
+	atomic_llong stores;
+	atomic_llong stored_bytes;
+} compile_cache;
+
+compile_cache* cache_open(const char* dir, long long max_size);
+void cache_close(compile_cache* c);
+
+int  cache_lookup(compile_cache* c, const char* key, char** data_ptr, size_t* size_ptr, int* code_ptr);
+void cache_store(compile_cache* c, const char* key, const char* data, size_t size, int code);
+void cache_flush(compile_cache* c);
+void cache_print_stats(compile_cache* c, FILE* out);
+
+long long cache_parse_size(const char* s);
+
+#endif
@@ -2,6 +2,7 @@
 #include "lex.h"
 #include "list.h"
 #include "syntax.h"
+#include "alloc.h"
 
 LIST_IMPL(q_stmt, qualified_statement*);
 
@@ -17,43 +18,72 @@ static enum access_qualifiers _tok_to_qualifier(token* t) {
 	}	
 }
 
-q_stmt_list* class_body(token_stream* s) {
-	q_stmt_list* l = q_stmt_list_create();
-	while(!syntax_match_token(s, RBRACE)) {
-		qualified_statement* qs = malloc(sizeof(qualified_statement));
-		qs->qualifier = A_PRIVATE;
-		token* t = match_access_qualifier(s);
+q_stmt_list* class_body(parser* p) {
+	SYNTAX_RULE(p);
+	q_stmt_list* l = syntax_building(p) ? syntax_track_list(p, q_stmt_list_create()) : NULL;
+	while(!syntax_match_token(p, RBRACE)) {
+		enum access_qualifiers qualifier = A_PRIVATE;
+		int is_static = 0;
+		stmt* declaration = NULL;
+		token* t = match_access_qualifier(p);
 		if(t) {
-			qs->qualifier = _tok_to_qualifier(t);
+			qualifier = _tok_to_qualifier(t);
 		}
-		if(syntax_match_token(s, STATIC)) {
-			qs->is_static = 1;
+		if(syntax_match_token(p, STATIC)) {
+			is_static = 1;
 		}
-		if(syntax_match_token(s, LET)) {
-			qs->declaration = var_decl(s);
-		} else if(syntax_match_token(s, FUN)) {
-			qs->declaration = fun_decl(s);
+		if(syntax_match_token(p, LET)) {
+			declaration = var_decl(p);
+		} else if(syntax_match_token(p, FUN)) {
+			declaration = fun_decl(p);
 		} else {
-			free(qs);
-			q_stmt_list_free(l);
-			syntax_error_on_current(s, "unexpected token");
+			syntax_error_on_current(p, "unexpected token");
+		}
+		if(l) {
+			qualified_statement* qs = syntax_alloc(p, sizeof(qualified_statement));
+			qs->qualifier = qualifier;
+			qs->is_static = is_static;
+			qs->declaration = declaration;
+			q_stmt_list_append(l, qs);
 		}
-		q_stmt_list_append(l, qs);
 	}
 	return l;
 }
 
-class_info* class(token_stream* s) {
-	class_info* ci = malloc(sizeof(class_info));
-	ci->identifier = syntax_consume_token(s, IDENTIFIER, "identifier required after 'class'");
-	if(syntax_match_token(s, LBRACE)) {
-		ci->body = class_body(s);
-	} else {
-		ci->body = NULL;
+class_info* class(parser* p) {
+	SYNTAX_RULE(p);
+	token* identifier = syntax_consume_token(p, IDENTIFIER, "identifier required after 'class'");
+	q_stmt_list* body = NULL;
+	if(syntax_match_token(p, LBRACE)) {
+		body = class_body(p);
 	}
+	SYNTAX_NODE_END(p, SN_STMT, ST_CLASS, identifier)
+	class_info* ci = syntax_alloc(p, sizeof(class_info));
+	ci->identifier = identifier;
+	ci->body = body;
 	return ci;
 }
 
+// Member declarations are released separately, see stmt_release
+void class_release(class_info* c) {
+	if(c->body) {
+		for(int i = 0; i < c->body->size; i++) {
+			hatch_free(ALLOC_PARSER, c->body->data[i]);
+		}
+		q_stmt_list_free(c->body);
+	}
+	hatch_free(ALLOC_PARSER, c);
+}
+
+void class_free(class_info* c) {
+	if(c->body) {
+		for(int i = 0; i < c->body->size; i++) {
+			stmt_free(c->body->data[i]->declaration);
+		}
+	}
+	class_release(c);
+}
+
 const char* access_qualifier_to_string(enum access_qualifiers ac) {
 	switch(ac) {
 		case A_PUBLIC:
@@ -25,12 +25,14 @@ typedef struct _class_info {
 	q_stmt_list* body;
 } class_info;
 
-q_stmt_list* class_body(token_stream* s);
-class_info*  class(token_stream* s); 
+q_stmt_list* class_body(parser* p);
+class_info*  class(parser* p); 
+void class_release(class_info* c);
+void class_free(class_info* c);
 
 const char* access_qualifier_to_string(enum access_qualifiers ac);
 
-#define match_access_qualifier(s) \
-	(syntax_match_tokens(s, 3, PUBLIC, PRIVATE, PROTECTED))
+#define match_access_qualifier(p) \
+	(syntax_match_tokens(p, 3, PUBLIC, PRIVATE, PROTECTED))
 
 #endif
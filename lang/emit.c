@@ -0,0 +1,155 @@
+#include "emit.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+emitter* emitter_create(int fd) {
+	emitter* e = calloc(1, sizeof(emitter));
+	e->fd = fd;
+	e->capacity = EMIT_BUFFER_SIZE;
+	e->data = malloc(e->capacity);
+	return e;
+}
+
+emitter* emitter_create_buffer() {
+	return emitter_create(-1);
+}
+
+emitter* emitter_open(const char* path) {
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if(fd < 0) {
+		return NULL;
+	}
+	emitter* e = emitter_create(fd);
+	e->own = 1;
+	return e;
+}
+
+// Writes the pending buffer followed by data with as few syscalls as possible
+static void _write(emitter* e, const void* data, size_t size) {
+	struct iovec iov[2] = {
+		{ .iov_base = e->data,       .iov_len = e->size },
+		{ .iov_base = (void*) data,  .iov_len = size }
+	};
+	struct iovec* v = iov;
+	int count = size ? 2 : 1;
+
+	while(count && !e->error) {
+		ssize_t w = writev(e->fd, v, count);
+		if(w < 0 && errno == EINTR) {
+			continue;
+		}
+		if(w < 0) {
+			e->error = errno;
+			break;
+		}
+		while(count && (size_t) w >= v->iov_len) {
+			w -= v->iov_len;
+			v++;
+			count--;
+		}
+		if(count) {
+			v->iov_base = (char*) v->iov_base + w;
+			v->iov_len -= w;
+		}
+	}
+
+	e->size = 0;
+}
+
+static void _reserve(emitter* e, size_t size) {
+	while(e->capacity < e->size + size) {
+		e->capacity *= 2;
+	}
+	e->data = realloc(e->data, e->capacity);
+}
+
+void emit(emitter* e, const void* data, size_t size) {
+	if(e->size + size <= e->capacity) {
+		memcpy(e->data + e->size, data, size);
+		e->size += size;
+	} else if(e->fd < 0) {
+		_reserve(e, size);
+		memcpy(e->data + e->size, data, size);
+		e->size += size;
+	} else {
+		_write(e, data, size);
+	}
+}
+
+void emit_string(emitter* e, const char* s) {
+	emit(e, s, strlen(s));
+}
+
+void emit_char(emitter* e, char c) {
+	if(e->size == e->capacity) {
+		emit(e, &c, 1);
+	} else {
+		e->data[e->size++] = c;
+	}
+}
+
+void emit_int(emitter* e, long long v) {
+	char buf[24];
+	char* p = buf + sizeof(buf);
+	unsigned long long u = v < 0 ? -(unsigned long long) v : (unsigned long long) v;
+	do {
+		*--p = '0' + u % 10;
+		u /= 10;
+	} while(u);
+	if(v < 0) {
+		*--p = '-';
+	}
+	emit(e, p, buf + sizeof(buf) - p);
+}
+
+void emit_format(emitter* e, const char* fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	size_t room = e->capacity - e->size;
+	int length = vsnprintf(e->data + e->size, room, fmt, args);
+	va_end(args);
+
+	if(length < 0) {
+		return;
+	}
+	if((size_t) length < room) {
+		e->size += length;
+		return;
+	}
+
+	char* buf = malloc(length + 1);
+	va_start(args, fmt);
+	vsnprintf(buf, length + 1, fmt, args);
+	va_end(args);
+	emit(e, buf, length);
+	free(buf);
+}
+
+int emitter_flush(emitter* e) {
+	if(e->fd >= 0 && e->size) {
+		_write(e, NULL, 0);
+	}
+	return e->error != 0;
+}
+
+int emitter_close(emitter* e) {
+	int code = emitter_flush(e);
+	if(e->own && close(e->fd) < 0 && !code) {
+		code = 1;
+	}
+	free(e->data);
+	free(e);
+	return code;
+}
+
+void emitter_free(emitter* e) {
+	free(e->data);
+	free(e);
+}
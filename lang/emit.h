@@ -0,0 +1,32 @@
+#ifndef _EMIT_H
+#define _EMIT_H
+
+#include <stddef.h>
+
+#define EMIT_BUFFER_SIZE (1 << 18)
+
+// Buffered output sink. With fd >= 0 the buffer is written out whenever it fills up,
+// otherwise it grows and keeps everything in memory.
+typedef struct {
+	int    fd;
+	int    own;
+	char*  data;
+	size_t size;
+	size_t capacity;
+	int    error;
+} emitter;
+
+emitter* emitter_create(int fd);
+emitter* emitter_create_buffer();
+emitter* emitter_open(const char* path);
+int  emitter_flush(emitter* e);
+int  emitter_close(emitter* e);
+void emitter_free(emitter* e);
+
+void emit(emitter* e, const void* data, size_t size);
+void emit_string(emitter* e, const char* s);
+void emit_char(emitter* e, char c);
+void emit_int(emitter* e, long long v);
+void emit_format(emitter* e, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+
+#endif
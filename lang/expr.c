@@ -3,397 +3,443 @@
 #include "syntax.h"
 #include "util.h"
 #include <stdlib.h>
+#include "alloc.h"
 
 LIST_IMPL(args, expr*)
 
-void expr_accept(expr* e, ast_visitor visitor) {
+int expr_visit(expr* e, const ast_visitor* v, void* ctx) {
 	switch(e->type) {
 		case ET_BINARY:
-			SAFE_CALL(visitor.visit_binary_expr, e->data)
+			return VISIT(v->visit_binary_expr, ctx, e->data);
+		case ET_UNARY:
+			return VISIT(v->visit_unary_expr, ctx, e->data);
+		case ET_GROUP:
+			return VISIT(v->visit_group_expr, ctx, e->data);
+		case ET_LITERAL:
+			return VISIT(v->visit_literal_expr, ctx, e->data);
+		case ET_ASSIGNMENT:
+			return VISIT(v->visit_assignment_expr, ctx, e->data);
+		case ET_CALL:
+			return VISIT(v->visit_call_expr, ctx, e->data);
+		case ET_SUBSCRIPT:
+			return VISIT(v->visit_subscript_expr, ctx, e->data);
+		case ET_SIZEOF:
+			return VISIT(v->visit_sizeof_expr, ctx, e->data);
+	}
+	return VISIT_CONTINUE;
+}
+
+int expr_child(expr* e, int slot, enum syntax_node_kind* kind, void** child) {
+	switch(e->type) {
+		case ET_BINARY: {
+			binary_expr* b = e->data;
+			if(slot < 2) WALK_CHILD(SN_EXPR, slot ? b->right : b->left)
 			break;
+		}
 		case ET_UNARY:
-			SAFE_CALL(visitor.visit_unary_expr, e->data)
+			if(slot < 1) WALK_CHILD(SN_EXPR, ((unary_expr*) e->data)->right)
 			break;
 		case ET_GROUP:
-			SAFE_CALL(visitor.visit_group_expr, e->data)
+			if(slot < 1) WALK_CHILD(SN_EXPR, ((group_expr*) e->data)->expr)
 			break;
 		case ET_LITERAL:
-			SAFE_CALL(visitor.visit_literal_expr, e->data)
 			break;
-		case ET_ASSIGNMENT:
-			SAFE_CALL(visitor.visit_assignment_expr, e->data)
+		case ET_ASSIGNMENT: {
+			assignment_expr* a = e->data;
+			if(slot < 2) WALK_CHILD(SN_EXPR, slot ? a->rvalue : a->lvalue)
 			break;
-		case ET_CALL:
-			SAFE_CALL(visitor.visit_call_expr, e->data)
+		}
+		case ET_CALL: {
+			call_expr* c = e->data;
+			if(slot == 0) WALK_CHILD(SN_EXPR, c->callee)
+			if(slot <= c->args->size) WALK_CHILD(SN_EXPR, c->args->data[slot - 1])
 			break;
-		case ET_SUBSCRIPT:
-			SAFE_CALL(visitor.visit_subscript_expr, e->data)
+		}
+		case ET_SUBSCRIPT: {
+			subscript_expr* s = e->data;
+			if(slot < 2) WALK_CHILD(SN_EXPR, slot ? s->index : s->array)
+			break;
+		}
+		case ET_SIZEOF: {
+			sizeof_expr* s = e->data;
+			if(slot < 1 && s->expr) WALK_CHILD(SN_EXPR, s->expr)
+			if(slot < 1) WALK_CHILD(SN_TYPE, s->type)
 			break;
+		}
 	}
-	SAFE_CALL(visitor.visit_expr, e)
+	return 0;
+}
+
+int expr_accept(expr* e, const ast_visitor* v, void* ctx) {
+	return syntax_walk(SN_EXPR, e, v, ctx);
 }
 
-static expr* _make_expr(enum expr_type type, void* data) {
-	expr* e = malloc(sizeof(expr));
+static expr* _make_expr(parser* p, enum expr_type type, void* data) {
+	expr* e = syntax_alloc(p, sizeof(expr));
 	e->type = type;
 	e->data = data;
 	return e;
 }
 
-static expr* _make_binary_expr(expr* a, enum lexem op, expr* b) {
-	binary_expr* e = malloc(sizeof(binary_expr));
+static expr* _make_binary_expr(parser* p, expr* a, enum lexem op, expr* b) {
+	SYNTAX_NODE_END(p, SN_EXPR, ET_BINARY, NULL)
+	binary_expr* e = syntax_alloc(p, sizeof(binary_expr));
 	e->left = a;
 	e->op = op;
 	e->right = b;
-	return _make_expr(ET_BINARY, e);
+	return _make_expr(p, ET_BINARY, e);
 }
 
-static expr* _make_unary_expr(enum lexem op, expr* b, int postfix) {
-	unary_expr* e = malloc(sizeof(unary_expr));
+static expr* _make_unary_expr(parser* p, enum lexem op, expr* b, int postfix) {
+	SYNTAX_NODE_END(p, SN_EXPR, ET_UNARY, NULL)
+	unary_expr* e = syntax_alloc(p, sizeof(unary_expr));
 	e->op = op;
 	e->right = b;
 	e->postfix = postfix;
-	return _make_expr(ET_UNARY, e);
+	return _make_expr(p, ET_UNARY, e);
 }
 
-static expr* _make_literal_expr(token* l) {
-	literal_expr* e = malloc(sizeof(literal_expr));
+static expr* _make_literal_expr(parser* p, token* l) {
+	SYNTAX_NODE_END(p, SN_EXPR, ET_LITERAL, NULL)
+	literal_expr* e = syntax_alloc(p, sizeof(literal_expr));
 	e->value = l;
-	return _make_expr(ET_LITERAL, e);
+	e->symbol = NULL;
+	return _make_expr(p, ET_LITERAL, e);
 }
 
-static expr* _make_group_expr(expr* inner) {
-	group_expr* e = malloc(sizeof(group_expr));
+static expr* _make_group_expr(parser* p, expr* inner) {
+	SYNTAX_NODE_END(p, SN_EXPR, ET_GROUP, NULL)
+	group_expr* e = syntax_alloc(p, sizeof(group_expr));
 	e->expr = inner;
-	return _make_expr(ET_GROUP, e);
+	return _make_expr(p, ET_GROUP, e);
 }
 
-static expr* _make_assignment_expr(expr* a, enum lexem op, expr* b) {
-	assignment_expr* e = malloc(sizeof(assignment_expr));
+static expr* _make_assignment_expr(parser* p, expr* a, enum lexem op, expr* b) {
+	SYNTAX_NODE_END(p, SN_EXPR, ET_ASSIGNMENT, NULL)
+	assignment_expr* e = syntax_alloc(p, sizeof(assignment_expr));
 	e->lvalue = a;
 	e->op = op;
 	e->rvalue = b;
-	return _make_expr(ET_ASSIGNMENT, e);
+	return _make_expr(p, ET_ASSIGNMENT, e);
 }
 
-static expr* _make_call_expr(expr* callee, args_list* args) {
-	call_expr* e = malloc(sizeof(call_expr));
+static expr* _make_call_expr(parser* p, expr* callee, args_list* args) {
+	SYNTAX_NODE_END(p, SN_EXPR, ET_CALL, NULL)
+	call_expr* e = syntax_alloc(p, sizeof(call_expr));
 	e->callee = callee;
 	e->args = args;
-	return _make_expr(ET_CALL, e);
+	return _make_expr(p, ET_CALL, e);
 }
 
-static expr* _make_subscript_expr(expr* array, expr* subs) {
-	subscript_expr* e = malloc(sizeof(subscript_expr));
+static expr* _make_subscript_expr(parser* p, expr* array, expr* subs) {
+	SYNTAX_NODE_END(p, SN_EXPR, ET_SUBSCRIPT, NULL)
+	subscript_expr* e = syntax_alloc(p, sizeof(subscript_expr));
 	e->array = array;
 	e->index = subs;
-	return _make_expr(ET_SUBSCRIPT, e);
-}
-
-static void _free_expr(expr*);
-
-static void _free_binary_expr(binary_expr* e) {
-	_free_expr(e->right);
-	_free_expr(e->left);
-	free(e);
-}
-
-static void _free_unary_expr(unary_expr* e) {
-	_free_expr(e->right);
-	free(e);
-}
-
-static void _free_group_expr(group_expr* e) {
-	_free_expr(e->expr);
-	free(e);
-}
-
-static void _free_literal_expr(literal_expr* e) {
-	free(e);
+	return _make_expr(p, ET_SUBSCRIPT, e);
 }
 
-static void _free_assignment_expr(assignment_expr* e) {
-	_free_expr(e->rvalue);
-	_free_expr(e->lvalue);
-	free(e);
+// Children are released by the walk in syntax_free before their parent
+void expr_release(expr* e) {
+	if(e->type == ET_CALL) {
+		args_list_free(((call_expr*) e->data)->args);
+	}
+	hatch_free(ALLOC_PARSER, e->data);
+	hatch_free(ALLOC_PARSER, e);
 }
 
-static void _free_call_expr(call_expr* e) {
-	_free_expr(e->callee);
-	for(int i = 0; i < e->args->size; i++) {
-		_free_expr(e->args->data[i]);
+void expr_free(expr* e) {
+	if(e) {
+		syntax_free(SN_EXPR, e);
 	}
-	args_list_free(e->args);
-	free(e);
-}
-
-static void _free_subscript_expr(subscript_expr* e) {
-	_free_expr(e->array);
-	_free_expr(e->index);
-	free(e);
-}
-
-static void _free_expr(expr* e) {
-	if(e->data) {
-		switch(e->type) {
-			case ET_BINARY:
-				_free_binary_expr(e->data);
-				break;
-			case ET_UNARY:
-				_free_unary_expr(e->data);
-				break;
-			case ET_GROUP:
-				_free_group_expr(e->data);
-				break;
-			case ET_LITERAL:
-				_free_literal_expr(e->data);
-				break;
-			case ET_ASSIGNMENT:
-				_free_assignment_expr(e->data);
-				break;
-			case ET_CALL:
-				_free_call_expr(e->data);
-				break;
-			case ET_SUBSCRIPT:
-				_free_subscript_expr(e->data);
-				break;
-		}
-	}
-	free(e);
 }
 
-expr* term(token_stream* s) {
-	if(syntax_match_tokens(s, 8, 
+expr* term(parser* p) {
+	SYNTAX_RULE(p);
+	token* t = NULL;
+	if((t = syntax_match_tokens(p, 8, 
 				STRING, INTEGER, NUMERIC, 
-				NIL, FALSE, TRUE, IDENTIFIER, THIS)) {
-		return _make_literal_expr(lex_stream_previous(s));
-	} else if(syntax_match_token(s, LPAREN)) {
-		expr* e = expression(s);
-		syntax_consume_token(s, RPAREN, "expected ')' after group expression");
-		return _make_group_expr(e);
+				NIL, FALSE, TRUE, IDENTIFIER, THIS))) {
+		syntax_begin(p, SN_EXPR, ET_LITERAL, t);
+		return _make_literal_expr(p, t);
+	} else if((t = syntax_match_token(p, LPAREN))) {
+		syntax_begin(p, SN_EXPR, ET_GROUP, t);
+		expr* e = expression(p);
+		syntax_consume_token(p, RPAREN, "expected ')' after group expression");
+		return _make_group_expr(p, e);
 	}
 
-	syntax_error(lex_stream_current(s), "expression expected");
+	syntax_error_on_current(p, "expression expected");
 }
 
-expr* unary_postfix(token_stream* s) {
-	token* next = lex_stream_next(s);
-	expr* t = subscript(s);
+expr* unary_postfix(parser* p) {
+	SYNTAX_RULE(p);
+	token* next = syntax_next(p);
+	expr* t = subscript(p);
 
 	if(next && (next->type == DOUBLE_PLUS || next->type == DOUBLE_MINUS)) {
-		syntax_consume_token(s, next->type, "expected operator after postfix");
-		return _make_unary_expr(next->type, t, 1);
+		syntax_consume_token(p, next->type, "expected operator after postfix");
+		syntax_begin(p, SN_EXPR, ET_UNARY, next);
+		return _make_unary_expr(p, next->type, t, 1);
 	}
 
 	return t;
 }
 
-expr* size_of(token_stream* s) {
-	sizeof_expr* e = malloc(sizeof(sizeof_expr));	
-	e->type = type(s);
-	return _make_expr(ET_SIZEOF, e);
+expr* size_of(parser* p) {
+	SYNTAX_RULE(p);
+	type_info* t = type(p);
+	SYNTAX_NODE_END(p, SN_EXPR, ET_SIZEOF, NULL)
+	sizeof_expr* e = syntax_alloc(p, sizeof(sizeof_expr));	
+	e->expr = NULL;
+	e->type = t;
+	return _make_expr(p, ET_SIZEOF, e);
 }
 
-expr* unary(token_stream* s) {
+expr* unary(parser* p) {
+	SYNTAX_RULE(p);
 	token* t = NULL;
-	if((t = syntax_match_tokens(s, 9, 
+	if((t = syntax_match_tokens(p, 9, 
 				BANG, MINUS, PLUS, 
 				TILDA, DOUBLE_PLUS, DOUBLE_MINUS,
 				ASTERISK, AMPERSAND, SIZEOF))) {
-		token* op = lex_stream_previous(s);
-		if(op->type == SIZEOF && syntax_match_token(s, LPAREN)) {
-			expr* r = size_of(s);	
-			syntax_consume_token(s, RPAREN, "')' required after type sizeof");
+		token* op = syntax_previous(p);
+		if(op->type == SIZEOF && syntax_match_token(p, LPAREN)) {
+			syntax_begin(p, SN_EXPR, ET_SIZEOF, op);
+			expr* r = size_of(p);	
+			syntax_consume_token(p, RPAREN, "')' required after type sizeof");
 			return r;
 		}
-		expr* b = unary(s);
-		return _make_unary_expr(op->type, b, 0);
+		syntax_begin(p, SN_EXPR, ET_UNARY, op);
+		syntax_descend(p);
+		expr* b = unary(p);
+		syntax_ascend(p);
+		return _make_unary_expr(p, op->type, b, 0);
 	}
 
-	return unary_postfix(s);
+	return unary_postfix(p);
 }
 
-expr* access(token_stream* s) {
-	expr* r = unary(s);
+expr* access(parser* p) {
+	SYNTAX_RULE(p);
+	expr* r = unary(p);
 
-	while(syntax_match_tokens(s, 2, DOT, POINTER)) {
-		token* op = lex_stream_previous(s);
-		expr* b = unary(s);
-		r = _make_binary_expr(r, op->type, b);
+	while(syntax_match_tokens(p, 2, DOT, POINTER)) {
+		token* op = syntax_previous(p);
+		syntax_begin(p, SN_EXPR, ET_BINARY, op);
+		expr* b = unary(p);
+		r = _make_binary_expr(p, r, op->type, b);
 	}
 
 	return r;
 }
 
-expr* multiplication(token_stream* s) {
-	expr* r = access(s);
+expr* multiplication(parser* p) {
+	SYNTAX_RULE(p);
+	expr* r = access(p);
 
-	while(syntax_match_tokens(s, 2, SLASH, ASTERISK)) {
-		token* op = lex_stream_previous(s);
-		expr* b = access(s);
-		r = _make_binary_expr(r, op->type, b);
+	while(syntax_match_tokens(p, 2, SLASH, ASTERISK)) {
+		token* op = syntax_previous(p);
+		syntax_begin(p, SN_EXPR, ET_BINARY, op);
+		expr* b = access(p);
+		r = _make_binary_expr(p, r, op->type, b);
 	}
 
 	return r;
 }
 
-expr* addition(token_stream* s) {
-	expr* r = multiplication(s);
+expr* addition(parser* p) {
+	SYNTAX_RULE(p);
+	expr* r = multiplication(p);
 
-	while(syntax_match_tokens(s, 2, PLUS, MINUS)) {
-		token* op = lex_stream_previous(s);
-		expr* b = multiplication(s);
-		r = _make_binary_expr(r, op->type, b);
+	while(syntax_match_tokens(p, 2, PLUS, MINUS)) {
+		token* op = syntax_previous(p);
+		syntax_begin(p, SN_EXPR, ET_BINARY, op);
+		expr* b = multiplication(p);
+		r = _make_binary_expr(p, r, op->type, b);
 	}
 
 	return r;
 }
 
-expr* shifts(token_stream* s) {
-	expr* r = addition(s);
+expr* shifts(parser* p) {
+	SYNTAX_RULE(p);
+	expr* r = addition(p);
 
-	while(syntax_match_tokens(s, 2, 
+	while(syntax_match_tokens(p, 2, 
 				DOUBLE_LESS, DOUBLE_GREATER)) {
-		token* op = lex_stream_previous(s);
-		expr* b = addition(s);
-		r = _make_binary_expr(r, op->type, b);
+		token* op = syntax_previous(p);
+		syntax_begin(p, SN_EXPR, ET_BINARY, op);
+		expr* b = addition(p);
+		r = _make_binary_expr(p, r, op->type, b);
 	}
 
 	return r;
 }
 
-expr* comparison(token_stream* s) {
-	expr* r = shifts(s);
+expr* comparison(parser* p) {
+	SYNTAX_RULE(p);
+	expr* r = shifts(p);
 
-	while(syntax_match_tokens(s, 4, 
+	while(syntax_match_tokens(p, 4, 
 				LESS, LESS_EQUAL, GREATER, GREATER_EQUAL)) {
-		token* op = lex_stream_previous(s);
-		expr* b = shifts(s);
-		r = _make_binary_expr(r, op->type, b);
+		token* op = syntax_previous(p);
+		syntax_begin(p, SN_EXPR, ET_BINARY, op);
+		expr* b = shifts(p);
+		r = _make_binary_expr(p, r, op->type, b);
 	}
 
 	return r;
 }
 
-expr* equality(token_stream* s) {
-	expr* r = logic_or(s);
+expr* equality(parser* p) {
+	SYNTAX_RULE(p);
+	expr* r = logic_or(p);
 
-	while(syntax_match_tokens(s, 2, BANG_EQUAL, EQUAL_EQUAL)) {
-		token* op = lex_stream_previous(s);
-		expr* b = logic_or(s);
-		r = _make_binary_expr(r, op->type, b);
+	while(syntax_match_tokens(p, 2, BANG_EQUAL, EQUAL_EQUAL)) {
+		token* op = syntax_previous(p);
+		syntax_begin(p, SN_EXPR, ET_BINARY, op);
+		expr* b = logic_or(p);
+		r = _make_binary_expr(p, r, op->type, b);
 	}
 
 	return r;
 }
 
-expr* bit_and(token_stream* s) {
-	expr* r = comparison(s);
+expr* bit_and(parser* p) {
+	SYNTAX_RULE(p);
+	expr* r = comparison(p);
 
-	while(syntax_match_tokens(s, 1, AMPERSAND)) {
-		token* op = lex_stream_previous(s);
-		expr* b = comparison(s);
-		r = _make_binary_expr(r, op->type, b);
+	while(syntax_match_tokens(p, 1, AMPERSAND)) {
+		token* op = syntax_previous(p);
+		syntax_begin(p, SN_EXPR, ET_BINARY, op);
+		expr* b = comparison(p);
+		r = _make_binary_expr(p, r, op->type, b);
 	}
 
 	return r;
 }
 
-expr* bit_xor(token_stream* s) {
-	expr* r = bit_and(s);
+expr* bit_xor(parser* p) {
+	SYNTAX_RULE(p);
+	expr* r = bit_and(p);
 
-	while(syntax_match_tokens(s, 1, XOR)) {
-		token* op = lex_stream_previous(s);
-		expr* b = bit_and(s);
-		r = _make_binary_expr(r, op->type, b);
+	while(syntax_match_tokens(p, 1, XOR)) {
+		token* op = syntax_previous(p);
+		syntax_begin(p, SN_EXPR, ET_BINARY, op);
+		expr* b = bit_and(p);
+		r = _make_binary_expr(p, r, op->type, b);
 	}
 
 	return r;
 }
 
-expr* bit_or(token_stream* s) {
-	expr* r = bit_xor(s);
+expr* bit_or(parser* p) {
+	SYNTAX_RULE(p);
+	expr* r = bit_xor(p);
 
-	while(syntax_match_tokens(s, 1, OR)) {
-		token* op = lex_stream_previous(s);
-		expr* b = bit_xor(s);
-		r = _make_binary_expr(r, op->type, b);
+	while(syntax_match_tokens(p, 1, OR)) {
+		token* op = syntax_previous(p);
+		syntax_begin(p, SN_EXPR, ET_BINARY, op);
+		expr* b = bit_xor(p);
+		r = _make_binary_expr(p, r, op->type, b);
 	}
 
 	return r;
 }
 
-expr* logic_and(token_stream* s) {
-	expr* r = bit_or(s);
+expr* logic_and(parser* p) {
+	SYNTAX_RULE(p);
+	expr* r = bit_or(p);
 
-	while(syntax_match_tokens(s, 1, DOUBLE_AMPERSAND)) {
-		token* op = lex_stream_previous(s);
-		expr* b = bit_or(s);
-		r = _make_binary_expr(r, op->type, b);
+	while(syntax_match_tokens(p, 1, DOUBLE_AMPERSAND)) {
+		token* op = syntax_previous(p);
+		syntax_begin(p, SN_EXPR, ET_BINARY, op);
+		expr* b = bit_or(p);
+		r = _make_binary_expr(p, r, op->type, b);
 	}
 
 	return r;
 }
 
-expr* logic_or(token_stream* s) {
-	expr* r = logic_and(s);
+expr* logic_or(parser* p) {
+	SYNTAX_RULE(p);
+	expr* r = logic_and(p);
 
-	while(syntax_match_tokens(s, 1, DOUBLE_OR)) {
-		token* op = lex_stream_previous(s);
-		expr* b = logic_and(s);
-		r = _make_binary_expr(r, op->type, b);
+	while(syntax_match_tokens(p, 1, DOUBLE_OR)) {
+		token* op = syntax_previous(p);
+		syntax_begin(p, SN_EXPR, ET_BINARY, op);
+		expr* b = logic_and(p);
+		r = _make_binary_expr(p, r, op->type, b);
 	}
 
 	return r;
 }
 
-expr* assignment(token_stream* s) {
-	expr* l = equality(s);
+expr* assignment(parser* p) {
+	SYNTAX_RULE(p);
+	expr* l = equality(p);
 
-	while(syntax_match_tokens(s, 5, 
+	while(syntax_match_tokens(p, 5, 
 				EQUAL, PLUS_EQUAL, MINUS_EQUAL, 
 				SLASH_EQUAL, ASTERISK_EQUAL)) {
-		token* op = lex_stream_previous(s);
-		expr* r = assignment(s);
-		l = _make_assignment_expr(l, op->type, r);
+		token* op = syntax_previous(p);
+		syntax_begin(p, SN_EXPR, ET_ASSIGNMENT, op);
+		syntax_descend(p);
+		expr* r = assignment(p);
+		syntax_ascend(p);
+		l = _make_assignment_expr(p, l, op->type, r);
 	}
 
 	return l;
 }
 
-static expr* _finalize_call(token_stream* s, expr* callee) {
-	args_list* args = args_list_create();
+static expr* _finalize_call(parser* p, expr* callee) {
+	args_list* args = syntax_building(p) ? syntax_track_list(p, args_list_create()) : NULL;
 
-	if(!syntax_check_token(s, RPAREN)) {
+	if(!syntax_check_token(p, RPAREN)) {
 		do {
-			args_list_append(args, expression(s));
-		} while(syntax_match_token(s, COMMA));
+			expr* arg = expression(p);
+			if(args) {
+				args_list_append(args, arg);
+			}
+		} while(syntax_match_token(p, COMMA));
 	}
 
-	syntax_consume_token(s, RPAREN, "')' expected after function arg list");
+	syntax_consume_token(p, RPAREN, "')' expected after function arg list");
 
-	return _make_call_expr(callee, args);
+	return _make_call_expr(p, callee, args);
 }
 
-expr* subscript(token_stream* s) {
-	expr* array = call(s);
+expr* subscript(parser* p) {
+	SYNTAX_RULE(p);
+	expr* array = call(p);
 
-	while(syntax_match_token(s, LSQBRACE)) {
-		array = _make_subscript_expr(array, expression(s));
-		syntax_consume_token(s, RSQBRACE, "']' required after array subscription");
+	token* t = NULL;
+	while((t = syntax_match_token(p, LSQBRACE))) {
+		syntax_begin(p, SN_EXPR, ET_SUBSCRIPT, t);
+		array = _make_subscript_expr(p, array, expression(p));
+		syntax_consume_token(p, RSQBRACE, "']' required after array subscription");
 	}
 
 	return array;
 }
 
-expr* call(token_stream* s) {
-	expr* t = term(s);
-	while(syntax_match_token(s, LPAREN)) {
-		t = _finalize_call(s, t);
+expr* call(parser* p) {
+	SYNTAX_RULE(p);
+	expr* t = term(p);
+	token* paren = NULL;
+	while((paren = syntax_match_token(p, LPAREN))) {
+		syntax_begin(p, SN_EXPR, ET_CALL, paren);
+		t = _finalize_call(p, t);
 	}
 	return t;
 }
 
-expr* expression(token_stream* s) {
-	return assignment(s);
+expr* expression(parser* p) {
+	SYNTAX_RULE(p);
+	syntax_descend(p);
+	expr* e = assignment(p);
+	syntax_ascend(p);
+	return e;
 }
@@ -40,6 +40,8 @@ typedef struct _group_expr {
 
 typedef struct _literal_expr {
 	token* value;
+	// What an identifier names, set by resolve_tree
+	struct _symbol* symbol;
 } literal_expr;
 
 typedef struct _assignment_expr {
@@ -65,26 +67,30 @@ typedef struct _sizeof_expr {
 	type_info* type;
 } sizeof_expr;
 
-void expr_accept(expr* e, ast_visitor visitor);
+int  expr_accept(expr* e, const ast_visitor* visitor, void* ctx);
+int  expr_visit(expr* e, const ast_visitor* visitor, void* ctx);
+int  expr_child(expr* e, int slot, enum syntax_node_kind* kind, void** child);
+void expr_release(expr* e);
+void expr_free(expr* e);
 
-expr* term(token_stream* s);
-expr* unary_postfix(token_stream* s);
-expr* unary(token_stream* s);
-expr* access(token_stream* s);
-expr* multiplication(token_stream* s);
-expr* addition(token_stream* s);
-expr* bit_and(token_stream* s);
-expr* bit_xor(token_stream* s);
-expr* bit_or(token_stream* s);
-expr* logic_and(token_stream* s);
-expr* logic_or(token_stream* s);
-expr* shifts(token_stream* s);
-expr* comparison(token_stream* s);
-expr* equality(token_stream* s);
-expr* assignment(token_stream* s);
-expr* call(token_stream* s);
-expr* subscript(token_stream* s);
-expr* expression(token_stream* s);
-expr* size_of(token_stream* s);
+expr* term(parser* p);
+expr* unary_postfix(parser* p);
+expr* unary(parser* p);
+expr* access(parser* p);
+expr* multiplication(parser* p);
+expr* addition(parser* p);
+expr* bit_and(parser* p);
+expr* bit_xor(parser* p);
+expr* bit_or(parser* p);
+expr* logic_and(parser* p);
+expr* logic_or(parser* p);
+expr* shifts(parser* p);
+expr* comparison(parser* p);
+expr* equality(parser* p);
+expr* assignment(parser* p);
+expr* call(parser* p);
+expr* subscript(parser* p);
+expr* expression(parser* p);
+expr* size_of(parser* p);
 
 #endif
@@ -0,0 +1,172 @@
+#include "file.h"
+#include "map.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+int file_map(const char* path, const char** buffer_ptr, size_t* size_ptr) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return errno;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        int error = errno;
+        close(fd);
+        return error;
+    }
+
+    const char* buffer = "";
+    if (st.st_size) {
+        buffer = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (buffer == MAP_FAILED) {
+            int error = errno;
+            close(fd);
+            return error;
+        }
+    }
+
+    close(fd);
+
+    *buffer_ptr = buffer;
+    *size_ptr = st.st_size;
+
+    return 0;
+}
+
+void file_unmap(const char* buffer, size_t size) {
+    if (size) {
+        munmap((void*) buffer, size);
+    }
+}
+
+int file_exists(const char* path) {
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISREG(st.st_mode);
+}
+
+typedef struct {
+    const char* data;
+    size_t size;
+    struct timespec mtime;
+} cached_file;
+
+DEFINE_MAP_TYPE(file_cache, const char*, cached_file*)
+MAP_IMPL(file_cache, const char*, cached_file*, builtin_string_hash, builtin_string_comparator)
+
+static file_cache_map* _cache = NULL;
+static int _cache_amount = 0;
+static int _track_fd = -1;
+
+static void _cache_key(char* key, size_t size, struct stat* st) {
+    snprintf(key, size, "%lx:%lx", (unsigned long) st->st_dev, (unsigned long) st->st_ino);
+}
+
+static int _is_current(cached_file* f, struct stat* st) {
+    return f->size == (size_t) st->st_size &&
+           f->mtime.tv_sec == st->st_mtim.tv_sec &&
+           f->mtime.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+int file_cache_lookup(const char* path, const char** buffer_ptr, size_t* size_ptr) {
+    if (_cache == NULL) {
+        return 1;
+    }
+
+    struct stat st;
+    if (stat(path, &st) < 0) {
+        return 1;
+    }
+
+    char key[64];
+    _cache_key(key, sizeof(key), &st);
+
+    cached_file** f = file_cache_map_get(_cache, key);
+    if (f == NULL || !_is_current(*f, &st)) {
+        return 1;
+    }
+
+    *buffer_ptr = (*f)->data;
+    *size_ptr = (*f)->size;
+
+    return 0;
+}
+
+int file_cache_insert(const char* path) {
+    struct stat st;
+    if (stat(path, &st) < 0 || !S_ISREG(st.st_mode)) {
+        return 1;
+    }
+
+    if (_cache == NULL) {
+        _cache = file_cache_map_create();
+    }
+
+    char key[64];
+    _cache_key(key, sizeof(key), &st);
+
+    cached_file** existing = file_cache_map_get(_cache, key);
+    if (existing && _is_current(*existing, &st)) {
+        return 0;
+    }
+    if (existing == NULL && _cache_amount >= MAX_CACHED_FILES) {
+        return 1;
+    }
+
+    const char* data = NULL;
+    size_t size = 0;
+    if (file_map(path, &data, &size)) {
+        return 1;
+    }
+
+    if (existing) {
+        file_unmap((*existing)->data, (*existing)->size);
+        (*existing)->data = data;
+        (*existing)->size = size;
+        (*existing)->mtime = st.st_mtim;
+        return 0;
+    }
+
+    cached_file* f = malloc(sizeof(cached_file));
+    f->data = data;
+    f->size = size;
+    f->mtime = st.st_mtim;
+
+    file_cache_map_insert(_cache, strdup(key), f);
+    _cache_amount++;
+
+    return 0;
+}
+
+void file_cache_track(int fd) {
+    _track_fd = fd;
+}
+
+void file_cache_note(const char* path) {
+    if (_track_fd < 0) {
+        return;
+    }
+
+    char resolved[PATH_MAX + 1];
+    if (realpath(path, resolved) == NULL) {
+        return;
+    }
+
+    // One write per line keeps reports from concurrent workers intact on the pipe
+    int length = strlen(resolved);
+    if (length + 1 > PIPE_BUF) {
+        return;
+    }
+    resolved[length] = '\n';
+    if (write(_track_fd, resolved, length + 1) < 0) {
+        _track_fd = -1;
+    }
+}
@@ -0,0 +1,18 @@
+#ifndef _FILE_H
+#define _FILE_H
+
+#include <stddef.h>
+
+// Returns 0 or the errno of the failure, reporting it is up to the caller
+int  file_map(const char* path, const char** buffer_ptr, size_t* size_ptr);
+void file_unmap(const char* buffer, size_t size);
+int  file_exists(const char* path);
+
+#define MAX_CACHED_FILES 4096
+
+int  file_cache_lookup(const char* path, const char** buffer_ptr, size_t* size_ptr);
+int  file_cache_insert(const char* path);
+void file_cache_track(int fd);
+void file_cache_note(const char* path);
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef _HASH_H
+#define _HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHA256_SIZE 32
+#define SHA256_HEX_SIZE (SHA256_SIZE * 2 + 1)
+
+typedef struct {
+	uint32_t state[8];
+	uint64_t length;
+	uint8_t  block[64];
+	size_t   used;
+} sha256;
+
+void sha256_init(sha256* h);
+void sha256_update(sha256* h, const void* data, size_t size);
+void sha256_update_string(sha256* h, const char* s);
+void sha256_final(sha256* h, uint8_t digest[SHA256_SIZE]);
+void sha256_hex(sha256* h, char hex[SHA256_HEX_SIZE]);
+
+#endif
@@ -1,29 +1,169 @@
+#include "hatch.h"
+#include "alloc.h"
+#include "emit.h"
 #include "preprocess.h"
+#include "resolve.h"
+#include "sema.h"
 #include "util.h"
+#include "cache.h"
+#include "hash.h"
+#include "file.h"
+#include "syntax_ast_binary.h"
+#include "timing.h"
+#include "trace.h"
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "jobserver.h"
+#include "server.h"
+#include "source.h"
+#include <pthread.h>
+#include <unistd.h>
+#include <stdatomic.h>
 #include <lex.h>
 #include <syntax.h>
 
-#define ARG_INVALID_FLAG -1
-#define ARG_OUTPUT_FLAG   1
-#define ARG_DEF_FLAG      2
+#define ARG_INVALID_FLAG   -1
+#define ARG_OUTPUT_FLAG     1
+#define ARG_DEF_FLAG        2
+#define ARG_INCLUDE_FLAG    3
+#define ARG_DEPS_FILE_FLAG  4
+#define ARG_DEPS_FLAG       5
+#define ARG_DEPS_ONLY_FLAG  6
+#define ARG_JOBS_FLAG       7
+#define ARG_CACHE_DIR_FLAG  8
+#define ARG_CACHE_SIZE_FLAG 9
+#define ARG_CACHE_STATS_FLAG 10
+#define ARG_EMIT_AST_FLAG   11
+#define ARG_PREPROCESS_FLAG 12
+#define ARG_DUMP_TOKENS_FLAG 13
+#define ARG_DUMP_AST_FLAG   14
+#define ARG_SYNTAX_ONLY_FLAG 15
+#define ARG_DUMP_JSON_FLAG  16
+#define ARG_DUMP_JSON_LINES_FLAG 17
+#define ARG_TIME_REPORT_FLAG 18
+#define ARG_TIME_REPORT_JSON_FLAG 19
+#define ARG_MEM_STATS_FLAG  20
+#define ARG_RULE_PROFILE_FLAG 21
+#define ARG_DUMP_SYMBOLS_FLAG 22
+#define ARG_CHECK_FLAG      23
+#define ARG_CHECK_THREADS_FLAG 24
+
+#define DUMP_PREPROCESSED (1 << 0)
+#define DUMP_TOKENS       (1 << 1)
+#define DUMP_AST          (1 << 2)
+#define DUMP_JSON         (1 << 3)
+#define DUMP_JSON_LINES   (1 << 4)
+#define DUMP_SYMBOLS      (1 << 5)
+
+#define DUMP_TREE (DUMP_AST | DUMP_JSON | DUMP_JSON_LINES | DUMP_SYMBOLS)
 
 #define MAX_INPUTS 128
 
 void help() {
-    printf("usage: hatch [flags] <files>");
+    printf("usage: hatch [flags] <files>\n"
+           "  -o <file>   write the selected output to <file> instead of stdout\n"
+           "  -E          print the preprocessed token stream\n"
+           "  -D <name>   define preprocessor macro\n"
+           "  -I <dir>    add include search directory\n"
+           "  -M          only scan directives and print make dependencies\n"
+           "  -MD         write make dependencies while compiling\n"
+           "  -MF <file>  write dependencies to <file>\n"
+           "  -j <n>      compile up to <n> files in parallel\n"
+           "              (under a make jobserver, extra workers wait for job tokens)\n"
+           "  --cache-dir <dir>    reuse results of unchanged inputs from <dir>\n"
+           "                       (default $HATCH_CACHE_DIR, unset disables the cache)\n"
+           "  --cache-size <size>  evict least recently used results above <size>\n"
+           "                       (K, M or G suffix, default $HATCH_CACHE_SIZE or 1G)\n"
+           "  --cache-stats        print cache hit and miss statistics\n"
+           "  --dump-tokens        print the token kinds of each input\n"
+           "  --dump-ast           print the syntax tree of each input\n"
+           "  --dump-json          write the syntax tree of each input as one JSON object\n"
+           "  --dump-json-lines    write one JSON object per top-level declaration and line\n"
+           "  --dump-symbols       print the declaration every identifier resolves to\n"
+           "  --syntax-only        only check that the inputs parse\n"
+           "                       (without any of the above nothing is printed)\n"
+           "  --check              resolve names and check function bodies, errors\n"
+           "                       fail the input\n"
+           "  --check-threads <n>  check the bodies of one input on <n> threads\n"
+           "                       (default the online CPUs shared by the -j workers;\n"
+           "                       under a make jobserver each extra thread needs a\n"
+           "                       free job token)\n"
+           "  --emit-ast           write the syntax tree of each input to <input>.ast\n"
+           "                       (or -o with a single input); .ast inputs are loaded\n"
+           "                       instead of parsed\n"
+           "  --time-report        print wall and CPU time, input size, throughput and\n"
+           "                       peak RSS of every stage, per input and in total\n"
+           "                       (lex includes the preprocessor, which runs inside it)\n"
+           "  --time-report-json <file>\n"
+           "                       write the same report to <file> as JSON\n"
+           "  --trace=<file>       write spans of every input, stage and top-level\n"
+           "                       declaration per thread to <file> as Chrome trace events\n"
+           "  --mem-stats          print allocations, bytes, live and peak bytes of the\n"
+           "                       lexer, preprocessor, parser, lists, maps and semantic\n"
+           "                       analysis\n"
+           "  --rule-profile       print entries, tokens, time and failed probes of every\n"
+           "                       grammar rule (needs a -DHATCH_RULE_PROFILE=ON build)\n"
+           "\n"
+           "       hatch --server [socket]\n"
+           "  run a compile server; hatch forwards its invocations to it when\n"
+           "  HATCH_SERVER names the socket (default $XDG_RUNTIME_DIR/hatch.sock or\n"
+           "  /tmp/hatch-<uid>/server.sock); the socket's directory must be private\n"
+           "  and only requests of the same user are served\n");
 }
 
-int flag(char c) {
-    switch(c) {
-        case 'o':
-            return ARG_OUTPUT_FLAG;
-		case 'D':
-			return ARG_DEF_FLAG;
-        default:
-            return ARG_INVALID_FLAG;
+int flag(const char* f) {
+    if(!strcmp(f, "-o")) {
+        return ARG_OUTPUT_FLAG;
+    } else if(!strcmp(f, "-D")) {
+        return ARG_DEF_FLAG;
+    } else if(!strcmp(f, "-I")) {
+        return ARG_INCLUDE_FLAG;
+    } else if(!strcmp(f, "-M")) {
+        return ARG_DEPS_ONLY_FLAG;
+    } else if(!strcmp(f, "-MD")) {
+        return ARG_DEPS_FLAG;
+    } else if(!strcmp(f, "-MF")) {
+        return ARG_DEPS_FILE_FLAG;
+    } else if(!strcmp(f, "-j")) {
+        return ARG_JOBS_FLAG;
+    } else if(!strcmp(f, "--cache-dir")) {
+        return ARG_CACHE_DIR_FLAG;
+    } else if(!strcmp(f, "--cache-size")) {
+        return ARG_CACHE_SIZE_FLAG;
+    } else if(!strcmp(f, "--cache-stats")) {
+        return ARG_CACHE_STATS_FLAG;
+    } else if(!strcmp(f, "--emit-ast")) {
+        return ARG_EMIT_AST_FLAG;
+    } else if(!strcmp(f, "-E")) {
+        return ARG_PREPROCESS_FLAG;
+    } else if(!strcmp(f, "--dump-tokens")) {
+        return ARG_DUMP_TOKENS_FLAG;
+    } else if(!strcmp(f, "--dump-ast")) {
+        return ARG_DUMP_AST_FLAG;
+    } else if(!strcmp(f, "--dump-json")) {
+        return ARG_DUMP_JSON_FLAG;
+    } else if(!strcmp(f, "--dump-json-lines")) {
+        return ARG_DUMP_JSON_LINES_FLAG;
+    } else if(!strcmp(f, "--dump-symbols")) {
+        return ARG_DUMP_SYMBOLS_FLAG;
+    } else if(!strcmp(f, "--syntax-only")) {
+        return ARG_SYNTAX_ONLY_FLAG;
+    } else if(!strcmp(f, "--check")) {
+        return ARG_CHECK_FLAG;
+    } else if(!strcmp(f, "--check-threads")) {
+        return ARG_CHECK_THREADS_FLAG;
+    } else if(!strcmp(f, "--time-report")) {
+        return ARG_TIME_REPORT_FLAG;
+    } else if(!strcmp(f, "--time-report-json")) {
+        return ARG_TIME_REPORT_JSON_FLAG;
+    } else if(!strcmp(f, "--mem-stats")) {
+        return ARG_MEM_STATS_FLAG;
+    } else if(!strcmp(f, "--rule-profile")) {
+        return ARG_RULE_PROFILE_FLAG;
+    } else {
+        return ARG_INVALID_FLAG;
     }
 }
 
@@ -32,16 +172,85 @@ int inputs_amount = 0;
 const char*  output = NULL;
 const char** defs = NULL;
 int def_amount = 0;
+const char** include_paths = NULL;
+int include_paths_amount = 0;
+const char*  deps_file = NULL;
+int deps_mode = 0;
+int jobs_amount = 0;
+const char*  cache_dir = NULL;
+long long cache_size = 0;
+int cache_stats = 0;
+int emit_ast = 0;
+int dumps = 0;
+int syntax_only = 0;
+int check = 0;
+int check_threads = 0;
+int time_report_enabled = 0;
+const char*  time_report_json = NULL;
+const char*  trace_file = NULL;
+int mem_stats = 0;
+int rule_profile = 0;
+
+static compile_cache* _cache = NULL;
+static preprocess_config* _config = NULL;
+static emitter* _output = NULL;
 
 int parse_arguments(int argc, const char** argv) {
     int last_flag = 0;
     inputs = malloc(sizeof(char*) * argc);
 	defs = malloc(sizeof(char*) * argc);
+	include_paths = malloc(sizeof(char*) * argc);
     for(int i = 1; i < argc; i++) {
-        if(argv[i][0] == '-') {
-            last_flag = flag(argv[i][1]);
+        if(!strncmp(argv[i], "-j", 2) && argv[i][2]) {
+            jobs_amount = atoi(&argv[i][2]);
+        } else if(!strncmp(argv[i], "--trace=", 8)) {
+            trace_file = &argv[i][8];
+        } else if(argv[i][0] == '-') {
+            last_flag = flag(argv[i]);
             if(last_flag == ARG_INVALID_FLAG) {
                 return 1;
+            } else if(last_flag == ARG_DEPS_FLAG || last_flag == ARG_DEPS_ONLY_FLAG) {
+                deps_mode = last_flag;
+                last_flag = 0;
+            } else if(last_flag == ARG_CACHE_STATS_FLAG) {
+                cache_stats = 1;
+                last_flag = 0;
+            } else if(last_flag == ARG_EMIT_AST_FLAG) {
+                emit_ast = 1;
+                last_flag = 0;
+            } else if(last_flag == ARG_PREPROCESS_FLAG) {
+                dumps |= DUMP_PREPROCESSED;
+                last_flag = 0;
+            } else if(last_flag == ARG_DUMP_TOKENS_FLAG) {
+                dumps |= DUMP_TOKENS;
+                last_flag = 0;
+            } else if(last_flag == ARG_DUMP_AST_FLAG) {
+                dumps |= DUMP_AST;
+                last_flag = 0;
+            } else if(last_flag == ARG_DUMP_JSON_FLAG) {
+                dumps |= DUMP_JSON;
+                last_flag = 0;
+            } else if(last_flag == ARG_DUMP_JSON_LINES_FLAG) {
+                dumps |= DUMP_JSON_LINES;
+                last_flag = 0;
+            } else if(last_flag == ARG_DUMP_SYMBOLS_FLAG) {
+                dumps |= DUMP_SYMBOLS;
+                last_flag = 0;
+            } else if(last_flag == ARG_SYNTAX_ONLY_FLAG) {
+                syntax_only = 1;
+                last_flag = 0;
+            } else if(last_flag == ARG_CHECK_FLAG) {
+                check = 1;
+                last_flag = 0;
+            } else if(last_flag == ARG_TIME_REPORT_FLAG) {
+                time_report_enabled = 1;
+                last_flag = 0;
+            } else if(last_flag == ARG_MEM_STATS_FLAG) {
+                mem_stats = 1;
+                last_flag = 0;
+            } else if(last_flag == ARG_RULE_PROFILE_FLAG) {
+                rule_profile = 1;
+                last_flag = 0;
             }
         } else {
 			if(last_flag == ARG_OUTPUT_FLAG) {
@@ -49,6 +258,21 @@ int parse_arguments(int argc, const char** argv) {
 			} else if(last_flag == ARG_DEF_FLAG) {
 				defs[def_amount] = argv[i];
 				def_amount++;	
+			} else if(last_flag == ARG_INCLUDE_FLAG) {
+				include_paths[include_paths_amount] = argv[i];
+				include_paths_amount++;
+			} else if(last_flag == ARG_DEPS_FILE_FLAG) {
+				deps_file = argv[i];
+			} else if(last_flag == ARG_JOBS_FLAG) {
+				jobs_amount = atoi(argv[i]);
+			} else if(last_flag == ARG_CHECK_THREADS_FLAG) {
+				check_threads = atoi(argv[i]);
+			} else if(last_flag == ARG_CACHE_DIR_FLAG) {
+				cache_dir = argv[i];
+			} else if(last_flag == ARG_CACHE_SIZE_FLAG) {
+				cache_size = cache_parse_size(argv[i]);
+			} else if(last_flag == ARG_TIME_REPORT_JSON_FLAG) {
+				time_report_json = argv[i];
 			} else {
                 inputs[inputs_amount] = argv[i];
                 inputs_amount++;
@@ -59,70 +283,623 @@ int parse_arguments(int argc, const char** argv) {
     return 0;
 }
 
-int read_file(const char* path, char** buffer_ptr) {
-    FILE *fp = fopen(path, "r");
-    if (fp == NULL) {
-        perror("Error opening file");
-        return 1;
+static char* _replace_extension(const char* path, const char* ext) {
+    const char* base = strrchr(path, '/');
+    base = base ? base + 1 : path;
+    const char* dot = strrchr(base, '.');
+    int stem = dot ? dot - path : (int) strlen(path);
+    char* r = malloc(stem + strlen(ext) + 1);
+    memcpy(r, path, stem);
+    strcpy(r + stem, ext);
+    return r;
+}
+
+int write_dependencies(preprocessor* pp, const char* path, FILE* deps) {
+    char* target = (output && inputs_amount == 1) ? strdup(output) : _replace_extension(path, ".o");
+    int own = deps == NULL;
+
+    if(own) {
+        char* name = _replace_extension(output && inputs_amount == 1 ? output : path, ".d");
+        deps = fopen(name, "w");
+        free(name);
+        if(deps == NULL) {
+            perror("Error opening dependency file");
+            free(target);
+            return 1;
+        }
     }
-    
-    fseek(fp, 0, SEEK_END);
-    size_t file_size = ftell(fp);
-    fseek(fp, 0, SEEK_SET);
-
-    char* buffer = (char *)malloc(file_size + 1);
-    if (buffer == NULL) {
-        perror("Error allocating memory");
-        fclose(fp);
-        return 1;
+
+    preprocess_write_dependencies(pp, deps, target, path);
+
+    if(own) {
+        fclose(deps);
     }
 
-    size_t bytes_read = fread(buffer, 1, file_size, fp);
-    if (bytes_read != file_size) {
-        perror("Error reading file");
-        free(buffer);
-        fclose(fp);
+    free(target);
+
+    return 0;
+}
+
+int scan(const char* path, FILE* log, FILE* deps) {
+    int code = 0;
+
+    source_manager* sm = source_manager_create();
+    preprocessor* pp = preprocess_create(sm, _config);
+    source_entry* file = NULL;
+
+    sm->diagnostics = log;
+
+    WITH_CODE_GOTO_TO(log, source_load_file(sm, path, SOURCE_LOC_INVALID, &file), "Failed to read file. Code: %d\n");
+    WITH_CODE_GOTO_TO(log, preprocess_scan(pp, file), "Preprocessor failure. Code: %d\n");
+    WITH_CODE_GOTO_TO(log, preprocess_finish(pp), "Preprocessor failure. Code: %d\n");
+
+    WITH_CODE_GOTO_TO(log, write_dependencies(pp, path, deps), "Failed to write dependencies. Code: %d\n");
+
+error:
+    preprocess_free(pp);
+    source_manager_free(sm);
+
+    return code;
+}
+
+static int _has_extension(const char* path, const char* ext) {
+    size_t length = strlen(path);
+    size_t ext_length = strlen(ext);
+    return length > ext_length && !strcmp(path + length - ext_length, ext);
+}
+
+int write_ast(syntax_tree* ast, const char* path) {
+    char* name = (output && inputs_amount == 1) ? strdup(output) : _replace_extension(path, ".ast");
+    FILE* f = fopen(name, "wb");
+    free(name);
+
+    if(f == NULL) {
+        perror("Error opening AST file");
         return 1;
     }
 
-    buffer[file_size] = '\0';
-    fclose(fp);
+    int code = syntax_write_binary(ast, f);
+    if(fclose(f) && !code) {
+        code = 1;
+    }
 
-    *buffer_ptr = buffer;
+    return code;
+}
 
-    return 0;
+static void _emit_number(emitter* out, double v) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%.17g", v);
+    if(strchr(buf, 'e') || strchr(buf, 'n') || strchr(buf, 'i')) {
+        snprintf(buf, sizeof(buf), "%f", v);
+    } else if(strchr(buf, '.') == NULL) {
+        strcat(buf, ".0");
+    }
+    emit_string(out, buf);
+}
+
+// Spells the token stream back as source, one line per line of the input
+void emit_preprocessed(token_stream* tokens, emitter* out) {
+    const char* path = NULL;
+    int line = 0;
+
+    for(int i = 0; i < tokens->size; i++) {
+        token* t = tokens->tokens[i];
+
+        source_position p = source_resolve(tokens->sources, t->loc);
+        if(i) {
+            emit_char(out, p.line != line || p.path != path ? '\n' : ' ');
+        }
+        path = p.path;
+        line = p.line;
+
+        switch(t->type) {
+            case IDENTIFIER:
+                emit_string(out, t->string_value);
+                break;
+            case STRING:
+                emit_char(out, '"');
+                emit_string(out, t->string_value);
+                emit_char(out, '"');
+                break;
+            case INTEGER:
+                emit_int(out, t->integer_value);
+                break;
+            case NUMERIC:
+                _emit_number(out, t->double_value);
+                break;
+            default:
+                emit_string(out, lex_lexem_spelling(t->type));
+                break;
+        }
+    }
+
+    if(tokens->size) {
+        emit_char(out, '\n');
+    }
+}
+
+void emit_tokens(token_stream* tokens, emitter* out) {
+	for(int i = 0; i < tokens->size; i++) {
+		emit_string(out, lex_lexem_to_string(tokens->tokens[i]->type));
+		emit_char(out, ' ');
+	}
+	emit_string(out, "\n\n");
+}
+
+// symbols is what --check resolved, NULL without it
+void emit_tree(syntax_tree* ast, resolution* symbols, const char* path, source_manager* sm, emitter* out) {
+    if(dumps & DUMP_AST) {
+        syntax_print_tree(ast, out);
+    }
+    if(dumps & DUMP_JSON) {
+        syntax_write_json(ast, path, sm, out, 0);
+    }
+    if(dumps & DUMP_JSON_LINES) {
+        syntax_write_json(ast, path, sm, out, SYNTAX_JSON_LINES);
+    }
+    if((dumps & DUMP_SYMBOLS) && symbols) {
+        resolve_print(ast, sm, out);
+    } else if(dumps & DUMP_SYMBOLS) {
+        resolution* r = resolve_create();
+        resolve_tree(r, ast);
+        resolve_print(ast, sm, out);
+        resolve_free(r);
+    }
+}
+
+// Under a jobserver every extra check thread holds a token, one that finds none free
+// is not started and its bodies are checked by the threads already running
+static const sema_admission _check_admission = {
+    .acquire = jobserver_try_acquire,
+    .release = jobserver_release
+};
+
+// Every error is reported before the input fails
+static int _check_tree(syntax_tree* ast, source_manager* sm, FILE* log, resolution* symbols) {
+    int errors = sema_check(symbols, ast, sm, check_threads, jobserver_is_active() ? &_check_admission : NULL);
+    if(errors) {
+        fprintf(log, "Semantic check failed. Errors: %d\n", errors);
+    }
+    return errors != 0;
+}
+
+// Only -E and --dump-tokens were asked for, the parser has nothing to do
+static int _stops_after_lex() {
+    return dumps && !(dumps & DUMP_TREE) && !syntax_only && !emit_ast && !check;
+}
+
+// Nothing needs the tree, so the parser only reports events to a sink that ignores them
+static int _parses_without_tree() {
+    return syntax_only && !(dumps & DUMP_TREE) && !emit_ast && !check;
+}
+
+// Bytes of every file read for an input, includes too
+static long long _source_bytes(source_manager* sm) {
+    long long bytes = 0;
+    for(int i = 0; i < sm->size; i++) {
+        if(sm->entries[i]->kind == SOURCE_FILE) {
+            bytes += sm->entries[i]->size;
+        }
+    }
+    return bytes;
 }
 
-int compile(char* const _in) {
+int load_ast(const char* path, emitter* out, FILE* log, time_report* timing) {
+    int code = 0;
+
+    source_manager* sm = source_manager_create();
+    token_stream* tokens = lex_stream_create(sm);
+    syntax_tree* ast = syntax_tree_create();
+    resolution* symbols = NULL;
+    const char* data = NULL;
+    size_t size = 0;
+
+    sm->diagnostics = log;
+
+    time_report_begin(timing, STAGE_LOAD);
+    int read_error = file_map(path, &data, &size);
+    if(read_error) {
+        source_error(sm, SOURCE_LOC_INVALID, "cannot read %s: %s", path, strerror(read_error));
+    }
+    WITH_CODE_GOTO_TO(log, read_error, "Failed to read file. Code: %d\n");
+    WITH_CODE_GOTO_TO(log, syntax_load_binary(data, size, tokens, ast), "Malformed AST file. Code: %d\n");
+    time_report_end(timing, size, tokens->size);
+
+    if(dumps & (DUMP_PREPROCESSED | DUMP_TOKENS)) {
+        time_report_begin(timing, STAGE_DUMP_TOKENS);
+        if(dumps & DUMP_PREPROCESSED) {
+            emit_preprocessed(tokens, out);
+        }
+        if(dumps & DUMP_TOKENS) {
+            emit_tokens(tokens, out);
+        }
+        time_report_end(timing, size, tokens->size);
+    }
+
+    if(check) {
+        time_report_begin(timing, STAGE_CHECK);
+        symbols = resolve_create();
+        code = _check_tree(ast, sm, log, symbols);
+        time_report_end(timing, size, tokens->size);
+        if(code) {
+            goto error;
+        }
+    }
+
+    time_report_begin(timing, STAGE_PRINT);
+    emit_tree(ast, symbols, path, sm, out);
+    time_report_end(timing, size, tokens->size);
+
+error:
+    time_report_end(timing, 0, 0);
+    if(data) {
+        file_unmap(data, size);
+    }
+    if(symbols) {
+        resolve_free(symbols);
+    }
+    lex_stream_free(tokens);
+	syntax_tree_free(ast);
+    source_manager_free(sm);
+
+    return code;
+}
+
+int compile_source(const char* path, emitter* out, FILE* log, FILE* deps, time_report* timing) {
     int code = 0;
     
-    token_stream* tokens = lex_stream_create();
+    source_manager* sm = source_manager_create();
+    preprocessor* pp = preprocess_create(sm, _config);
+    token_stream* tokens = lex_stream_create(sm);
     syntax_tree* ast = syntax_tree_create();
-	char* in = NULL;
+    resolution* symbols = NULL;
+    source_entry* file = NULL;
 
-	WITH_CODE_GOTO(preprocess(_in, &in), "Preprocessor failure. Code: %d\n");
-	printf("%s\n", in);
+    sm->diagnostics = log;
 
-    WITH_CODE_GOTO(lex(in, tokens), "Failed to parse tokens. Code: %d\n");
+    long long bytes = 0;
 
-	for(int i = 0; i < tokens->size; i++) {
-		printf("%s ", lex_lexem_to_string(tokens->tokens[i]->type));
+    time_report_begin(timing, STAGE_LOAD);
+    WITH_CODE_GOTO_TO(log, source_load_file(sm, path, SOURCE_LOC_INVALID, &file), "Failed to read file. Code: %d\n");
+    time_report_end(timing, file->size, 0);
+
+    time_report_begin(timing, STAGE_LEX);
+    WITH_CODE_GOTO_TO(log, lex(pp, file, tokens), "Failed to parse tokens. Code: %d\n");
+    bytes = _source_bytes(sm);
+    time_report_end(timing, bytes, tokens->size);
+
+	if(deps_mode == ARG_DEPS_FLAG) {
+		time_report_begin(timing, STAGE_DEPS);
+		WITH_CODE_GOTO_TO(log, write_dependencies(pp, path, deps), "Failed to write dependencies. Code: %d\n");
+		time_report_end(timing, 0, 0);
+	}
+
+	if(dumps & (DUMP_PREPROCESSED | DUMP_TOKENS)) {
+		time_report_begin(timing, STAGE_DUMP_TOKENS);
+		if(dumps & DUMP_PREPROCESSED) {
+			emit_preprocessed(tokens, out);
+		}
+		if(dumps & DUMP_TOKENS) {
+			emit_tokens(tokens, out);
+		}
+		time_report_end(timing, bytes, tokens->size);
+	}
+	if(_stops_after_lex()) {
+		goto error;
 	}
-	printf("\n\n");
 
-    WITH_CODE_GOTO(syntax_build_tree(tokens, ast), "Failed to build syntax tree. Code: %d\n");
+	time_report_begin(timing, STAGE_PARSE);
+	if(_parses_without_tree()) {
+		syntax_sink check = { 0 };
+		WITH_CODE_GOTO_TO(log, syntax_parse_events(tokens, &check), "Failed to build syntax tree. Code: %d\n");
+		time_report_end(timing, bytes, tokens->size);
+		goto error;
+	}
+
+    WITH_CODE_GOTO_TO(log, syntax_build_tree(tokens, ast), "Failed to build syntax tree. Code: %d\n");
+	time_report_end(timing, bytes, tokens->size);
+
+	if(emit_ast) {
+		time_report_begin(timing, STAGE_EMIT_AST);
+		WITH_CODE_GOTO_TO(log, write_ast(ast, path), "Failed to write syntax tree. Code: %d\n");
+		time_report_end(timing, bytes, tokens->size);
+	}
 
-	syntax_print_tree(ast);
+	if(check) {
+		time_report_begin(timing, STAGE_CHECK);
+		symbols = resolve_create();
+		code = _check_tree(ast, sm, log, symbols);
+		time_report_end(timing, bytes, tokens->size);
+		if(code) {
+			goto error;
+		}
+	}
+
+	time_report_begin(timing, STAGE_PRINT);
+	emit_tree(ast, symbols, path, sm, out);
+	time_report_end(timing, bytes, tokens->size);
     
 error:
-	free(in);
+    // A failed stage still counts up to the failure
+    time_report_end(timing, 0, 0);
+    if(symbols) {
+        resolve_free(symbols);
+    }
+    preprocess_free(pp);
     lex_stream_free(tokens);
 	syntax_tree_free(ast);
+    source_manager_free(sm);
 
     return code;
 }
 
-int main(int argc, const char** argv) {
+// The key covers everything the output depends on: compiler version, the selected
+// outputs and --check, the path as given (it appears in diagnostics), -D and -I, and every file
+// the directive scan pulled in, by content
+static void _cache_key(source_manager* sm, const char* path, char key[SHA256_HEX_SIZE]) {
+    sha256 h;
+    sha256_init(&h);
+
+    sha256_update_string(&h, "hatch " HATCH_VERSION);
+    sha256_update(&h, &dumps, sizeof(dumps));
+    sha256_update(&h, &check, sizeof(check));
+    sha256_update_string(&h, path);
+    sha256_update(&h, &def_amount, sizeof(def_amount));
+    for(int i = 0; i < def_amount; i++) {
+        sha256_update_string(&h, defs[i]);
+    }
+    sha256_update(&h, &include_paths_amount, sizeof(include_paths_amount));
+    for(int i = 0; i < include_paths_amount; i++) {
+        sha256_update_string(&h, include_paths[i]);
+    }
+
+    for(int i = 0; i < sm->size; i++) {
+        source_entry* e = sm->entries[i];
+        if(e->kind != SOURCE_FILE) {
+            continue;
+        }
+        sha256_update_string(&h, e->name);
+        sha256_update(&h, &e->size, sizeof(e->size));
+        sha256_update(&h, e->data, e->size);
+    }
+
+    sha256_hex(&h, key);
+}
+
+// Cached results keep diagnostics and output apart: u32 diagnostics size, diagnostics, output
+static void _store_result(const char* key, const char* log, size_t log_size, emitter* capture, int code) {
+    uint32_t header = log_size;
+    size_t size = sizeof(header) + log_size + capture->size;
+    char* data = malloc(size);
+
+    memcpy(data, &header, sizeof(header));
+    memcpy(data + sizeof(header), log, log_size);
+    memcpy(data + sizeof(header) + log_size, capture->data, capture->size);
+
+    cache_store(_cache, key, data, size, code);
+    free(data);
+}
+
+static int _replay_result(const char* data, size_t size, emitter* out, FILE* log) {
+    uint32_t header;
+    if(size < sizeof(header)) {
+        return 1;
+    }
+    memcpy(&header, data, sizeof(header));
+    if(header > size - sizeof(header)) {
+        return 1;
+    }
+
+    fwrite(data + sizeof(header), 1, header, log);
+    emit(out, data + sizeof(header) + header, size - sizeof(header) - header);
+
+    return 0;
+}
+
+int compile(const char* path, emitter* out, FILE* log, FILE* deps, time_report* timing) {
+    if(_has_extension(path, ".ast")) {
+        return load_ast(path, out, log, timing);
+    }
+
+    // A cache hit would skip writing the .ast file
+    if(_cache == NULL || emit_ast) {
+        return compile_source(path, out, log, deps, timing);
+    }
+
+    int code = 0;
+
+    source_manager* sm = source_manager_create();
+    preprocessor* pp = preprocess_create(sm, _config);
+    source_entry* file = NULL;
+
+    // Whatever the scan reports is reported again by the real compile
+    char*  scratch = NULL;
+    size_t scratch_size = 0;
+    sm->diagnostics = open_memstream(&scratch, &scratch_size);
+
+    time_report_begin(timing, STAGE_CACHE);
+    if(source_load_file(sm, path, SOURCE_LOC_INVALID, &file) || preprocess_scan(pp, file) || preprocess_finish(pp)) {
+        time_report_end(timing, 0, 0);
+        code = compile_source(path, out, log, deps, timing);
+        goto error;
+    }
+
+    char key[SHA256_HEX_SIZE];
+    _cache_key(sm, path, key);
+
+    char*  result = NULL;
+    size_t result_size = 0;
+
+    int hit = cache_lookup(_cache, key, &result, &result_size, &code) == 0;
+    time_report_end(timing, _source_bytes(sm), 0);
+
+    if(hit && _replay_result(result, result_size, out, log) == 0) {
+        if(deps_mode == ARG_DEPS_FLAG && write_dependencies(pp, path, deps) && !code) {
+            code = 1;
+        }
+    } else {
+        char*  captured_log = NULL;
+        size_t captured_log_size = 0;
+        FILE* capture_log = open_memstream(&captured_log, &captured_log_size);
+        emitter* capture = emitter_create_buffer();
+
+        code = compile_source(path, capture, capture_log, deps, timing);
+        fclose(capture_log);
+
+        fwrite(captured_log, 1, captured_log_size, log);
+        emit(out, capture->data, capture->size);
+        _store_result(key, captured_log, captured_log_size, capture, code);
+
+        emitter_free(capture);
+        free(captured_log);
+    }
+
+    free(result);
+
+error:
+    fclose(sm->diagnostics);
+    free(scratch);
+    preprocess_free(pp);
+    source_manager_free(sm);
+
+    return code;
+}
+
+typedef struct {
+    const char* path;
+    emitter* out;
+    char*  log;
+    size_t log_size;
+    char*  deps;
+    size_t deps_size;
+    int    code;
+    int    done;
+    time_report timing;
+} job;
+
+static job* _jobs = NULL;
+static atomic_int _next_job = 0;
+static pthread_mutex_t _jobs_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  _jobs_cond = PTHREAD_COND_INITIALIZER;
+
+static void _run_job(job* j) {
+    FILE* log = open_memstream(&j->log, &j->log_size);
+    FILE* deps = NULL;
+
+    if(j->out == NULL) {
+        j->out = emitter_create_buffer();
+    }
+
+    if(deps_file || deps_mode == ARG_DEPS_ONLY_FLAG) {
+        deps = open_memstream(&j->deps, &j->deps_size);
+    }
+
+    if(deps_mode == ARG_DEPS_ONLY_FLAG) {
+        if((j->code = scan(j->path, log, deps))) {
+            fprintf(log, "Failed to scan file. Code: %d\n", j->code);
+        }
+    } else {
+        time_report* timing = time_report_enabled || time_report_json || trace_file ? &j->timing : NULL;
+        trace_time start = TRACE_NOW();
+        if((j->code = compile(j->path, j->out, log, deps, timing))) {
+            fprintf(log, "Failed to compile file. Code: %d\n", j->code);
+        }
+        trace_span("compile", j->path, start);
+    }
+
+    fclose(log);
+    if(deps) {
+        fclose(deps);
+    }
+
+    pthread_mutex_lock(&_jobs_lock);
+    j->done = 1;
+    pthread_cond_broadcast(&_jobs_cond);
+    pthread_mutex_unlock(&_jobs_lock);
+}
+
+static void* _worker(void* arg) {
+    int implicit = arg == NULL;
+    trace_thread_name("worker");
+    while(atomic_load(&_next_job) < inputs_amount) {
+        if(!implicit && jobserver_acquire()) {
+            break;
+        }
+        int i = atomic_fetch_add(&_next_job, 1);
+        if(i < inputs_amount) {
+            _run_job(&_jobs[i]);
+        }
+        if(!implicit) {
+            jobserver_release();
+        }
+    }
+    return NULL;
+}
+
+static int _flush_job(job* j, FILE* deps) {
+    pthread_mutex_lock(&_jobs_lock);
+    while(!j->done) {
+        pthread_cond_wait(&_jobs_cond, &_jobs_lock);
+    }
+    pthread_mutex_unlock(&_jobs_lock);
+
+    fwrite(j->log, 1, j->log_size, stderr);
+    if(j->out != _output) {
+        emit(_output, j->out->data, j->out->size);
+        emitter_free(j->out);
+    }
+    if(deps && j->deps) {
+        fwrite(j->deps, 1, j->deps_size, deps);
+    }
+
+    free(j->log);
+    free(j->deps);
+
+    return j->code;
+}
+
+static int _write_time_report() {
+    if(inputs_amount <= 0) {
+        return 0;
+    }
+
+    time_report total;
+    time_report_init(&total, NULL);
+    const time_report** reports = calloc((size_t) inputs_amount, sizeof *reports);
+
+    for(int i = 0; i < inputs_amount; i++) {
+        reports[i] = &_jobs[i].timing;
+        time_report_add(&total, reports[i]);
+        if(time_report_enabled) {
+            time_report_print(&_jobs[i].timing, stderr);
+        }
+    }
+    if(time_report_enabled && inputs_amount > 1) {
+        time_report_print(&total, stderr);
+    }
+
+    int code = 0;
+
+    if(time_report_json) {
+        FILE* f = fopen(time_report_json, "w");
+        if(f == NULL) {
+            perror("Error opening time report file");
+            code = 1;
+        } else {
+            time_report_write_json(reports, inputs_amount, &total, f);
+            if(fclose(f)) {
+                perror("Error writing time report file");
+                code = 1;
+            }
+        }
+    }
+
+    free(reports);
+
+    return code;
+}
+
+int run(int argc, const char** argv) {
     int code = 0;
     
     if((code = parse_arguments(argc, argv))) {
@@ -130,17 +907,167 @@ int main(int argc, const char** argv) {
         return 0;
     }
 
-	preprocess_init(def_amount, defs);
-    lex_init();
+    if(mem_stats) {
+        alloc_stats_start();
+    }
+
+    if(trace_file) {
+        trace_start();
+        trace_thread_name("main");
+    }
+
+    if(jobserver_init() && jobs_amount == 0) {
+        jobs_amount = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if(jobs_amount < 1) {
+        jobs_amount = 1;
+    }
+
+    // The -D table is built once here and only read by the workers
+	_config = preprocess_config_create(def_amount, defs, include_paths_amount, include_paths);
+
+    if(cache_dir == NULL) {
+        cache_dir = getenv("HATCH_CACHE_DIR");
+    }
+    if(cache_size == 0 && getenv("HATCH_CACHE_SIZE")) {
+        cache_size = cache_parse_size(getenv("HATCH_CACHE_SIZE"));
+    }
+    if(cache_dir && *cache_dir) {
+        _cache = cache_open(cache_dir, cache_size);
+    }
+
+    FILE* deps = NULL;
+    if(deps_file) {
+        deps = fopen(deps_file, "w");
+        if(deps == NULL) {
+            perror("Error opening dependency file");
+            return 1;
+        }
+    } else if(deps_mode == ARG_DEPS_ONLY_FLAG) {
+        deps = stdout;
+    }
+
+    // With --emit-ast and a single input -o names the .ast file
+    if(output && !(emit_ast && inputs_amount == 1)) {
+        if((_output = emitter_open(output)) == NULL) {
+            perror("Error opening output file");
+            return 1;
+        }
+    } else {
+        _output = emitter_create(STDOUT_FILENO);
+    }
 
+    int workers_amount = jobs_amount < inputs_amount ? jobs_amount : inputs_amount;
+
+    // Inputs checked at once split the CPUs between them
+    if(check_threads < 1) {
+        check_threads = sysconf(_SC_NPROCESSORS_ONLN) / (workers_amount > 1 ? workers_amount : 1);
+    }
+    if(check_threads < 1) {
+        check_threads = 1;
+    }
+
+    // A single worker writes straight into the output, parallel ones collect it per input
+    _jobs = calloc(inputs_amount, sizeof(job));
     for(int i = 0; i < inputs_amount; i++) {
-        char* buffer = NULL;
+        _jobs[i].path = inputs[i];
+        time_report_init(&_jobs[i].timing, inputs[i]);
+        if(workers_amount <= 1) {
+            _jobs[i].out = _output;
+        }
+    }
+
+    pthread_t* workers = calloc(workers_amount, sizeof(pthread_t));
+
+    if(workers_amount > 1) {
+        for(int i = 0; i < workers_amount; i++) {
+            pthread_create(&workers[i], NULL, _worker, i ? &workers[i] : NULL);
+        }
+    }
 
-        WITH_CODE(read_file(inputs[i], &buffer), "Failed to read file. Code: %d\n");
-        WITH_CODE(compile(buffer), "Failed to compile file. Code: %d\n");
-        
-        free(buffer);
+    for(int i = 0; i < inputs_amount; i++) {
+        if(workers_amount <= 1) {
+            _run_job(&_jobs[i]);
+        }
+        int r = _flush_job(&_jobs[i], deps);
+        if(r && !code) {
+            code = r;
+        }
     }
 
-    return 0;
+    if(workers_amount > 1) {
+        jobserver_cancel();
+        for(int i = 0; i < workers_amount; i++) {
+            pthread_join(workers[i], NULL);
+        }
+    }
+
+    jobserver_close();
+
+    free(workers);
+
+    if((time_report_enabled || time_report_json) && _write_time_report() && !code) {
+        code = 1;
+    }
+
+    free(_jobs);
+
+    if(trace_file && trace_write(trace_file)) {
+        perror("Error writing trace file");
+        if(!code) {
+            code = 1;
+        }
+    }
+
+    if(emitter_close(_output)) {
+        fprintf(stderr, "Error writing output\n");
+        if(!code) {
+            code = 1;
+        }
+    }
+
+    if(deps && deps != stdout) {
+        fclose(deps);
+    }
+
+    if(cache_stats) {
+        if(_cache) {
+            cache_print_stats(_cache, stdout);
+        } else {
+            printf("compile cache is disabled\n");
+        }
+    }
+    if(_cache) {
+        cache_close(_cache);
+    }
+
+    preprocess_config_free(_config);
+
+    if(mem_stats) {
+        alloc_stats_print(stdout);
+    }
+    if(rule_profile) {
+        syntax_rule_profile_print(stderr);
+    }
+
+    return code;
+}
+
+int main(int argc, const char** argv) {
+    if(argc > 1 && !strcmp(argv[1], "--server")) {
+        hatch_init();
+        return server_run(argc > 2 ? argv[2] : server_default_path(), run);
+    }
+
+    const char* server = getenv("HATCH_SERVER");
+    if(server && *server) {
+        int code = client_run(server, argc, argv);
+        if(code >= 0) {
+            return code;
+        }
+    }
+
+    hatch_init();
+
+    return run(argc, argv);
 }
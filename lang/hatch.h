@@ -2,12 +2,57 @@
 #define _HATCH_H
 
 #include "lex.h"
+#include "preprocess.h"
+#include "source.h"
 #include "syntax.h"
 
+#include <stddef.h>
+
+// A diagnostic without a location carries the path of the compiled file and 0 for line and column
+typedef struct {
+	const char* path;
+	int line;
+	int column;
+	const char* level;
+	const char* message;
+} hatch_diagnostic;
+
+// Tokens and the tree stay owned by the context; they are valid until the next compile.
+// With a syntax sink no tree is built, the parser reports its nodes there instead of on_ast
+typedef struct {
+	void (*on_diagnostic)(void* user, const hatch_diagnostic* d);
+	void (*on_tokens)(void* user, token_stream* tokens);
+	void (*on_ast)(void* user, syntax_tree* ast);
+	const syntax_sink* syntax;
+} hatch_callbacks;
+
 typedef struct {
 	const char*   path;
 	token_stream* tokens;
 	syntax_tree*  ast;
+	source_manager*    sources;
+	preprocess_config* config;
+	path_list*  defs;
+	path_list*  include_paths;
+	virtual_files_map* files;
+	char*       buffer;
+	hatch_callbacks callbacks;
+	void*       user;
+	int         lazy_bodies;
 } compilation_context;
 
+void hatch_init();
+
+compilation_context* hatch_context_create(const hatch_callbacks* callbacks, void* user);
+void hatch_context_free(compilation_context* ctx);
+
+void hatch_define(compilation_context* ctx, const char* name);
+void hatch_add_include_path(compilation_context* ctx, const char* dir);
+void hatch_add_file(compilation_context* ctx, const char* path, const char* data, size_t size);
+// Function bodies are parsed when first reached (fun_def_body or a walk), not while compiling
+void hatch_lazy_bodies(compilation_context* ctx, int enable);
+
+int  hatch_compile(compilation_context* ctx, const char* path, const char* data, size_t size);
+void hatch_reset(compilation_context* ctx);
+
 #endif
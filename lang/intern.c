@@ -0,0 +1,97 @@
+#include "intern.h"
+#include "map.h"
+#include "alloc.h"
+
+#include <string.h>
+
+#define INTERN_INITIAL_CAPACITY 256
+#define INTERN_CHUNK_SIZE (1 << 16)
+
+intern_table* intern_table_create() {
+	intern_table* t = hatch_calloc(ALLOC_SEMANTIC, 1, sizeof(intern_table));
+	t->capacity = INTERN_INITIAL_CAPACITY;
+	t->slots = hatch_calloc(ALLOC_SEMANTIC, t->capacity, sizeof(const char*));
+	t->hashes = hatch_calloc(ALLOC_SEMANTIC, t->capacity, sizeof(unsigned int));
+	return t;
+}
+
+void intern_table_free(intern_table* t) {
+	while(t->chunks) {
+		intern_chunk* next = t->chunks->next;
+		hatch_free(ALLOC_SEMANTIC, t->chunks);
+		t->chunks = next;
+	}
+	hatch_free(ALLOC_SEMANTIC, t->slots);
+	hatch_free(ALLOC_SEMANTIC, t->hashes);
+	hatch_free(ALLOC_SEMANTIC, t);
+}
+
+// Linear probing, the slot of s or the empty one it would go to
+static unsigned int _probe(intern_table* t, const char* s, unsigned int hash) {
+	unsigned int i = hash & (t->capacity - 1);
+	while(t->slots[i] && (t->hashes[i] != hash || strcmp(t->slots[i], s))) {
+		i = (i + 1) & (t->capacity - 1);
+	}
+	return i;
+}
+
+static void _grow(intern_table* t) {
+	const char**  slots = t->slots;
+	unsigned int* hashes = t->hashes;
+	unsigned int  capacity = t->capacity;
+
+	t->capacity *= 2;
+	t->slots = hatch_calloc(ALLOC_SEMANTIC, t->capacity, sizeof(const char*));
+	t->hashes = hatch_calloc(ALLOC_SEMANTIC, t->capacity, sizeof(unsigned int));
+	for(unsigned int i = 0; i < capacity; i++) {
+		if(slots[i]) {
+			unsigned int j = hashes[i] & (t->capacity - 1);
+			while(t->slots[j]) {
+				j = (j + 1) & (t->capacity - 1);
+			}
+			t->slots[j] = slots[i];
+			t->hashes[j] = hashes[i];
+		}
+	}
+	hatch_free(ALLOC_SEMANTIC, slots);
+	hatch_free(ALLOC_SEMANTIC, hashes);
+}
+
+static char* _copy(intern_table* t, const char* s, size_t length) {
+	intern_chunk* c = t->chunks;
+	if(c == NULL || c->size - c->used < length + 1) {
+		size_t size = length + 1 > INTERN_CHUNK_SIZE ? length + 1 : INTERN_CHUNK_SIZE;
+		c = hatch_malloc(ALLOC_SEMANTIC, sizeof(intern_chunk) + size);
+		c->used = 0;
+		c->size = size;
+		c->next = t->chunks;
+		t->chunks = c;
+	}
+	char* copy = c->data + c->used;
+	memcpy(copy, s, length + 1);
+	c->used += length + 1;
+	return copy;
+}
+
+const char* intern(intern_table* t, const char* s) {
+	unsigned int hash = builtin_string_hash(s);
+	unsigned int i = _probe(t, s, hash);
+	if(t->slots[i]) {
+		return t->slots[i];
+	}
+
+	// Kept at most half full, so probes stay short
+	if(2 * (t->size + 1) > t->capacity) {
+		_grow(t);
+		i = _probe(t, s, hash);
+	}
+
+	t->slots[i] = _copy(t, s, strlen(s));
+	t->hashes[i] = hash;
+	t->size++;
+	return t->slots[i];
+}
+
+const char* intern_find(intern_table* t, const char* s) {
+	return t->slots[_probe(t, s, builtin_string_hash(s))];
+}
@@ -0,0 +1,39 @@
+#ifndef _INTERN_H
+#define _INTERN_H
+
+#include <stddef.h>
+
+// Equal strings interned into one table share a single copy, so interned names
+// compare and hash by pointer. The copies live until the table is freed.
+typedef struct _intern_chunk {
+	struct _intern_chunk* next;
+	size_t used;
+	size_t size;
+	char   data[];
+} intern_chunk;
+
+typedef struct {
+	const char**  slots;
+	unsigned int* hashes;
+	unsigned int  capacity;
+	unsigned int  size;
+	intern_chunk* chunks;
+} intern_table;
+
+intern_table* intern_table_create();
+void intern_table_free(intern_table* t);
+
+const char* intern(intern_table* t, const char* s);
+// NULL when s was never interned
+const char* intern_find(intern_table* t, const char* s);
+
+// Spreads the bits of an interned pointer for tables keyed by it
+static inline unsigned int intern_hash(const char* name) {
+	unsigned long long h = (unsigned long long) (size_t) name;
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdull;
+	h ^= h >> 33;
+	return (unsigned int) h;
+}
+
+#endif
@@ -0,0 +1,177 @@
+#include "jobserver.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MAX_HELD_TOKENS 256
+
+static int _read_fd  = -1;
+static int _write_fd = -1;
+static int _own_write = 0;
+static int _wake[2]  = { -1, -1 };
+
+static char _held[MAX_HELD_TOKENS];
+static int  _held_amount = 0;
+static pthread_mutex_t _held_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int _open_nonblocking(int fd) {
+	char path[64];
+	snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+	return open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+}
+
+static int _parse_fds(const char* auth, int* r, int* w) {
+	if(sscanf(auth, "%d,%d", r, w) != 2) {
+		return 1;
+	}
+	if(fcntl(*r, F_GETFD) < 0 || fcntl(*w, F_GETFD) < 0) {
+		return 1;
+	}
+	return 0;
+}
+
+int jobserver_init() {
+	const char* flags = getenv("MAKEFLAGS");
+	if(flags == NULL) {
+		return 0;
+	}
+
+	const char* auth = NULL;
+	const char* found = NULL;
+	const char* p = flags;
+	while((found = strstr(p, "--jobserver-auth=")) || (found = strstr(p, "--jobserver-fds="))) {
+		auth = strchr(found, '=') + 1;
+		p = auth;
+	}
+
+	if(auth == NULL) {
+		return 0;
+	}
+
+	int length = strcspn(auth, " ");
+	char* value = strndup(auth, length);
+
+	if(!strncmp(value, "fifo:", 5)) {
+		_read_fd = open(value + 5, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+		_write_fd = open(value + 5, O_WRONLY | O_CLOEXEC);
+		_own_write = 1;
+	} else {
+		int r, w;
+		if(_parse_fds(value, &r, &w) == 0) {
+			_read_fd = _open_nonblocking(r);
+			_write_fd = w;
+		}
+	}
+
+	free(value);
+
+	if(_read_fd < 0 || _write_fd < 0 || pipe(_wake) < 0) {
+		jobserver_close();
+		return 0;
+	}
+
+	return 1;
+}
+
+int jobserver_is_active() {
+	return _read_fd >= 0;
+}
+
+static void _hold(char c) {
+	pthread_mutex_lock(&_held_lock);
+	if(_held_amount < MAX_HELD_TOKENS) {
+		_held[_held_amount] = c;
+	}
+	_held_amount++;
+	pthread_mutex_unlock(&_held_lock);
+}
+
+int jobserver_acquire() {
+	if(!jobserver_is_active()) {
+		return 0;
+	}
+
+	struct pollfd fds[2] = {
+		{ .fd = _read_fd, .events = POLLIN },
+		{ .fd = _wake[0], .events = POLLIN }
+	};
+
+	while(1) {
+		char c;
+		ssize_t r = read(_read_fd, &c, 1);
+		if(r == 1) {
+			_hold(c);
+			return 0;
+		}
+		if(r < 0 && errno != EAGAIN && errno != EINTR) {
+			return 1;
+		}
+		if(poll(fds, 2, -1) < 0 && errno != EINTR) {
+			return 1;
+		}
+		if(fds[1].revents) {
+			return 1;
+		}
+	}
+}
+
+int jobserver_try_acquire() {
+	if(!jobserver_is_active()) {
+		return 0;
+	}
+	char c;
+	ssize_t r;
+	while((r = read(_read_fd, &c, 1)) < 0 && errno == EINTR);
+	if(r != 1) {
+		return 1;
+	}
+	_hold(c);
+	return 0;
+}
+
+void jobserver_release() {
+	if(!jobserver_is_active()) {
+		return;
+	}
+
+	pthread_mutex_lock(&_held_lock);
+	char c = '+';
+	if(_held_amount) {
+		_held_amount--;
+		if(_held_amount < MAX_HELD_TOKENS) {
+			c = _held[_held_amount];
+		}
+	}
+	pthread_mutex_unlock(&_held_lock);
+
+	while(write(_write_fd, &c, 1) < 0 && errno == EINTR);
+}
+
+void jobserver_cancel() {
+	if(_wake[1] >= 0) {
+		while(write(_wake[1], "x", 1) < 0 && errno == EINTR);
+	}
+}
+
+void jobserver_close() {
+	if(_read_fd >= 0) {
+		close(_read_fd);
+	}
+	if(_own_write && _write_fd >= 0) {
+		close(_write_fd);
+	}
+	if(_wake[0] >= 0) {
+		close(_wake[0]);
+		close(_wake[1]);
+	}
+	_read_fd = -1;
+	_write_fd = -1;
+	_own_write = 0;
+	_wake[0] = _wake[1] = -1;
+}
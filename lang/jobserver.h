@@ -0,0 +1,13 @@
+#ifndef _JOBSERVER_H
+#define _JOBSERVER_H
+
+int  jobserver_init();
+int  jobserver_is_active();
+int  jobserver_acquire();
+// Takes a token only if one is free right away, nonzero when none is
+int  jobserver_try_acquire();
+void jobserver_release();
+void jobserver_cancel();
+void jobserver_close();
+
+#endif
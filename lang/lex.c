@@ -5,9 +5,9 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "alloc.h"
 #include "map.h"
 #include "preprocess.h"
-#include "util.h"
 
 #define STREAM_EOF (1 << 0)
 
@@ -16,26 +16,22 @@ MAP_IMPL(token, const char*, enum lexem, builtin_string_hash, builtin_string_com
 
 token_map* _reserved_words;
 
-static token _eof_token = {.type = _EOF};
-
 static void _lex_stream_append(token_stream* stream, token* s) {
     if(!stream->capacity) {
         stream->capacity = 1;
-        stream->tokens = malloc(sizeof(token*) * stream->capacity);
+        stream->tokens = hatch_malloc(ALLOC_LEXER, sizeof(token*) * stream->capacity);
     } else if (stream->capacity <= stream->size) {
         stream->capacity *= 2; 
-        stream->tokens = realloc(stream->tokens, sizeof(token*) * stream->capacity);
+        stream->tokens = hatch_realloc(ALLOC_LEXER, stream->tokens, sizeof(token*) * stream->capacity);
     }
     stream->tokens[stream->size] = s;
     stream->size++;
 }
 
-token* _lex_create_token(token_stream* s, enum lexem type, int line) {
-    token* l = malloc(sizeof(token));
+token* _lex_create_token(token_stream* s, enum lexem type, source_loc loc) {
+    token* l = hatch_malloc(ALLOC_LEXER, sizeof(token));
     l->type = type;
-	l->line = line;
-    l->string_value = NULL;
-    l->integer_value = 0;
+	l->loc = loc;
     l->double_value = 0;
     _lex_stream_append(s, l);
     return l;
@@ -43,7 +39,7 @@ token* _lex_create_token(token_stream* s, enum lexem type, int line) {
 
 #define SIMPLE_MATCH(char, type) \
     case char: \
-        _lex_create_token(stream, type, is->line); \
+        _lex_create_token(stream, type, loc); \
         break;
 
 #define DOUBLE_MATCH(start, next, type1, type2) \
@@ -58,40 +54,53 @@ token* _lex_create_token(token_stream* s, enum lexem type, int line) {
     } else
 
 #define SUBMATCH(char, type) \
-    SUBMATCH_CALL(char, _lex_create_token(stream, type, is->line);)
+    SUBMATCH_CALL(char, _lex_create_token(stream, type, loc);)
 
 #define FALLBACK(type) \
     { \
-        _lex_create_token(stream, type, is->line); \
+        _lex_create_token(stream, type, loc); \
     }
 
 #define IGNORE(char) \
     case char: \
         break;
 
-#define NEWLINE() \
-    case '\n': \
-        is->line++; \
-        break;
+#define LEX_ERROR(c, loc, message) \
+    if((code = c)) { \
+        source_error(stream->sources, loc, message); \
+        return code; \
+    }
 
 #define STRING() \
     case '"': \
-        WITH_CODE(string(is, stream), "Unterminated string. Code: %d"); \
+        LEX_ERROR(string(is, stream, loc), loc, "unterminated string"); \
         break;
 
 #define NUMBER() \
-    WITH_CODE(number(is, stream), "Ill-formed number. Code: %d")
+    LEX_ERROR(number(is, stream, loc), loc, "ill-formed number")
 
+// The only failure of identifier is an expansion without locations, which reports itself
 #define IDENTIFIER() \
-    WITH_CODE(identifier(is, stream) , "Ill-formed identifier. Code: %d")
+    if((code = identifier(lx, loc))) { \
+        return code; \
+    }
 
-typedef struct {
-    char* data;
+typedef struct _input_stream {
+    const char* data;
     int ptr;
     int size;
-    int line;
+    source_loc base;
+    source_entry* file;
+    macro* expansion;
+    struct _input_stream* parent;
 } input_stream;
 
+typedef struct {
+    input_stream*  input;
+    token_stream*  tokens;
+    preprocessor*  pp;
+} lexer;
+
 static char _is_eof(input_stream* s) {
     return s->ptr >= s->size;
 }
@@ -104,7 +113,7 @@ static char _current(input_stream* s) {
 }
 
 static char _next(input_stream* s) {
-    if(_is_eof(s)) {
+    if(s->ptr + 1 >= s->size) {
         return '\0';
     }
     return s->data[s->ptr + 1];
@@ -127,33 +136,45 @@ static int _match(input_stream* s, char c) {
 
 static char* _slice(input_stream* s, int start) {
     int size = s->ptr - start + 1;
-    char* buf = calloc(size + 1, 1);
+    char* buf = hatch_calloc(ALLOC_LEXER, size + 1, 1);
     strncpy(buf, &s->data[start - 1], size);
     return buf;
 }
 
-static int _stream_from_input(char* const input, input_stream** result) {
-    input_stream* s = malloc(sizeof(input_stream));
-    if(s == NULL) {
-        return 1;
-    }
-    s->data = input; 
+static input_stream* _push_input(lexer* lx, const char* data, int size, source_loc base, macro* expansion) {
+    input_stream* s = hatch_malloc(ALLOC_LEXER, sizeof(input_stream));
+    s->data = data;
     s->ptr = 0;
-    s->size = strlen(input);
-	s->line = 0;
-    *result = s;
-    return 0;
+    s->size = size;
+    s->base = base;
+    s->file = NULL;
+    s->expansion = expansion;
+    s->parent = lx->input;
+    if(expansion) {
+        expansion->expanding = 1;
+    }
+    lx->input = s;
+    return s;
+}
+
+static void _pop_input(lexer* lx) {
+    input_stream* s = lx->input;
+    if(s->expansion) {
+        s->expansion->expanding = 0;
+    }
+    if(s->file && s->parent) {
+        lx->pp->include_depth--;
+    }
+    lx->input = s->parent;
+    hatch_free(ALLOC_LEXER, s);
 }
 
-static int string(input_stream* input, token_stream* stream) {
+static int string(input_stream* input, token_stream* stream, source_loc loc) {
     _advance(input);
 
     int start = input->ptr;
 
     while(_current(input) != '"' && !_is_eof(input)) {
-        if(_current(input) == '\n') {
-            input->line++;
-        }
         _advance(input);
     }
 
@@ -161,7 +182,7 @@ static int string(input_stream* input, token_stream* stream) {
         return 1;
     }
 
-    token* l = _lex_create_token(stream, STRING, input->line);
+    token* l = _lex_create_token(stream, STRING, loc);
     l->string_value = _slice(input, start);
 
     _advance(input);
@@ -169,7 +190,7 @@ static int string(input_stream* input, token_stream* stream) {
     return 0;
 }
 
-static int number(input_stream* input, token_stream* stream) {
+static int number(input_stream* input, token_stream* stream, source_loc loc) {
     int start = input->ptr;
 
     int d = 0;
@@ -189,7 +210,7 @@ static int number(input_stream* input, token_stream* stream) {
     char* tmp = _slice(input, start);
 
     if(d == 0) {
-        token* s = _lex_create_token(stream, INTEGER, input->line);
+        token* s = _lex_create_token(stream, INTEGER, loc);
 		if(tmp[0] == '0' && (tmp[1] == 'x' || tmp[1] == 'X')) {
         	s->integer_value = strtol(&tmp[2], NULL, 16);
 		} else if(tmp[0] == '0' && (tmp[1] == 'o' || tmp[1] == 'O')) {
@@ -198,16 +219,18 @@ static int number(input_stream* input, token_stream* stream) {
         	s->integer_value = atoi(tmp);
 		}
     } else {
-        token* s = _lex_create_token(stream, NUMERIC, input->line);
+        token* s = _lex_create_token(stream, NUMERIC, loc);
         s->double_value = atof(tmp);
     }
 
-    free(tmp);
+    hatch_free(ALLOC_LEXER, tmp);
 
     return 0;
 }
 
-static int identifier(input_stream* input, token_stream* stream) {
+static int identifier(lexer* lx, source_loc loc) {
+    input_stream* input = lx->input;
+    token_stream* stream = lx->tokens;
 
     int start = input->ptr;
 
@@ -217,71 +240,71 @@ static int identifier(input_stream* input, token_stream* stream) {
 
     char* ident = _slice(input, start);
 
+    macro* m = preprocess_get_macro(lx->pp, ident);
+    if(m && !m->expanding) {
+        hatch_free(ALLOC_LEXER, ident);
+        if(m->body) {
+            int size = strlen(m->body);
+            source_entry* e = source_add_expansion(stream->sources, m->name, size, m->loc, loc);
+            if(e == NULL) {
+                return 1;
+            }
+            _push_input(lx, m->body, size, e->base, m);
+        }
+        return 0;
+    }
+
     enum lexem* type = token_map_get(_reserved_words, ident);
 
     token* l = NULL;
 
     if(type) {
-        l = _lex_create_token(stream, *type, input->line);
+        l = _lex_create_token(stream, *type, loc);
+        hatch_free(ALLOC_LEXER, ident);
     } else {
-        l = _lex_create_token(stream, IDENTIFIER, input->line);
+        l = _lex_create_token(stream, IDENTIFIER, loc);
+        l->string_value = ident;
     }
 
-    l->string_value = ident;
-
     return 0;
 }
 
-static int directive(input_stream* input) {
-	_advance(input);
-
-	int start = input->ptr;
+static int directive(lexer* lx) {
+    input_stream* input = lx->input;
 
-    while(_current(input) != '\n' && !_is_eof(input)) {
-        _advance(input);
+    if(input->file == NULL) {
+        source_error(lx->tokens->sources, input->base + input->ptr - 1, "directive inside macro expansion");
+        return 1;
     }
 
-    char* line  = _slice(input, start);
-	char* direc = strtok(line, " "); 
-	char* args  = strtok(NULL, "\0");
-
-	enum directives* d = preprocess_get_directive(direc);
-
-	int code = 0;
-
-	if(d) {
-		if(*d == D_ERROR) {
-			printf("#error at line %d: %s\n", input->line, args);	
-			code = 1;
-		} else if (*d == D_WARNING) {
-			printf("#warning at line %d: %s\n", input->line, args);	
-		} else if (*d == D_LINE) {
-			input->line = atoi(args);
-		}
-	}
+    if(preprocess_line(lx->pp, input->file, &input->ptr)) {
+        return 1;
+    }
 
-	free(line);
+    if(lx->pp->include) {
+        source_entry* file = lx->pp->include;
+        lx->pp->include = NULL;
+        _push_input(lx, file->data, file->size, file->base, NULL)->file = file;
+        lx->pp->include_depth++;
+    }
 
-	return code;
+    return 0;
 }
 
 static int comment(input_stream* input, int multiline) {
     if(multiline) {
-        while((_current(input) != '*' || _next(input) != '/') && !_is_eof(input)) {
-            char c = _advance(input);
-			if(c == '\n') {
-				input->line++;
-			}
-            if(c == '/' && _match(input, '*')) {
-                comment(input, 1);
+        // Nested comments only need a counter, not a recursion level each
+        int depth = 1;
+        while(depth && !_is_eof(input)) {
+            if(_current(input) == '*' && _next(input) == '/') {
+                _advance(input);
+                _advance(input);
+                depth--;
+            } else if(_advance(input) == '/' && _match(input, '*')) {
+                depth++;
             }
         }
-        if(_is_eof(input)) {
-            return 1;
-        } else {
-            _advance(input);
-            _advance(input);
-        }
+        return depth != 0;
     } else {
         while(_current(input) != '\n' && !_is_eof(input)) {
             _advance(input);
@@ -331,13 +354,18 @@ void lex_init() {
 	token_map_insert(_reserved_words, "this", THIS);
 }
 
-int lex(char* const input, token_stream* stream) {
-    input_stream* is;
+static int _lex_input(lexer* lx) {
+    token_stream* stream = lx->tokens;
 
     int code = 0;
-    WITH_CODE(_stream_from_input(input, &is), "Failed to create input stream. Code: %d");
 
-    while(!_is_eof(is)) {
+    while(lx->input) {
+        input_stream* is = lx->input;
+        if(_is_eof(is)) {
+            _pop_input(lx);
+            continue;
+        }
+        source_loc loc = is->base + is->ptr;
         char c = _advance(is);
         switch(c) {
         SIMPLE_MATCH(';', SEMILOCON)
@@ -393,18 +421,18 @@ int lex(char* const input, token_stream* stream) {
         case '/':
             SUBMATCH('=', SLASH_EQUAL)
             SUBMATCH_CALL('/', comment(is, 0);)
-            SUBMATCH_CALL('*', WITH_CODE(comment(is, 1), "Unterminated multiline comment. Code: %d");)
+            SUBMATCH_CALL('*', LEX_ERROR(comment(is, 1), loc, "unterminated multiline comment");)
             FALLBACK(SLASH)
 		break;
 		case '#':
-			if(directive(is)) {
+			if(directive(lx)) {
 				return 1;
 			}
 			break;
         IGNORE(' ')
         IGNORE('\t')
         IGNORE('\r')
-        NEWLINE()
+        IGNORE('\n')
         STRING()
         default:
 			if(isdigit(c)) {
@@ -412,21 +440,46 @@ int lex(char* const input, token_stream* stream) {
             } else if (isalpha(c) || c == '_') {
                 IDENTIFIER();
             } else {
-                printf("Unexpected token: %c at line %d\n", c, is->line);
+                source_error(stream->sources, loc, "unexpected character '%c'", c);
                 return 1;
             }
         }
     }
 
+    return 0;
+}
+
+int lex(preprocessor* pp, source_entry* file, token_stream* stream) {
+    lexer lx = {
+        .input  = NULL,
+        .tokens = stream,
+        .pp     = pp
+    };
+
+    _push_input(&lx, file->data, file->size, file->base, NULL)->file = file;
+
+    int code = _lex_input(&lx);
+
+    while(lx.input) {
+        _pop_input(&lx);
+    }
+
+    if(code == 0) {
+        code = preprocess_finish(lx.pp);
+    }
+
 	if(stream->size) {
-		stream->last_line = stream->tokens[stream->size - 1]->line;	
+		stream->eof.loc = stream->tokens[stream->size - 1]->loc;
 	}
 
-    return 0;
+    return code;
 }
 
-token_stream* lex_stream_create() {
-    return calloc(1, sizeof(token_stream));
+token_stream* lex_stream_create(source_manager* sources) {
+    token_stream* s = hatch_calloc(ALLOC_LEXER, 1, sizeof(token_stream));
+    s->sources = sources;
+    s->eof.type = _EOF;
+    return s;
 }
 
 void lex_stream_advance(token_stream* stream) {
@@ -440,47 +493,47 @@ void lex_stream_advance(token_stream* stream) {
 }
 
 token* lex_stream_current(token_stream* stream) {
-    if(stream->flags & STREAM_EOF) {
-        return &_eof_token;
+    if(stream->flags & STREAM_EOF || stream->ptr >= stream->size) {
+        return &stream->eof;
     }
     return stream->tokens[stream->ptr];
 }
 
 token* lex_stream_previous(token_stream* stream) {
-	_eof_token.line = stream->last_line;
-
 	if(stream->ptr == 0) {
-        return &_eof_token;
+        return &stream->eof;
 	}
 
 	return stream->tokens[stream->ptr - 1];
 }
 
 token* lex_stream_next(token_stream* stream) {
-	_eof_token.line = stream->last_line;
-
-	if(stream->flags & EOF) {
-		return &_eof_token;
+	if(stream->flags & STREAM_EOF) {
+		return &stream->eof;
 	}
 
 	if(stream->ptr == stream->size - 1) {
-		return &_eof_token;
+		return &stream->eof;
 	}
 
 	return stream->tokens[stream->ptr + 1];
 }
 
+token* lex_stream_append_token(token_stream* stream, enum lexem type, source_loc loc) {
+    return _lex_create_token(stream, type, loc);
+}
+
 void lex_stream_free(token_stream* stream) {
     for(int i = 0; i < stream->size; i++) {
 		if(stream->tokens[i]) {
-        	if(stream->tokens[i]->string_value) {
-        	    free(stream->tokens[i]->string_value);
+        	if(stream->tokens[i]->type == STRING || stream->tokens[i]->type == IDENTIFIER) {
+        	    hatch_free(ALLOC_LEXER, stream->tokens[i]->string_value);
         	}
-        	free(stream->tokens[i]);
+        	hatch_free(ALLOC_LEXER, stream->tokens[i]);
 		}
     }
-    free(stream->tokens);
-    free(stream);
+    hatch_free(ALLOC_LEXER, stream->tokens);
+    hatch_free(ALLOC_LEXER, stream);
 }
 
 void lex_stream_rewind(token_stream* stream) {
@@ -488,6 +541,11 @@ void lex_stream_rewind(token_stream* stream) {
 	stream->flags = 0;
 }
 
+void lex_stream_seek(token_stream* stream, int ptr) {
+	stream->ptr = ptr;
+	stream->flags = ptr >= stream->size ? STREAM_EOF : 0;
+}
+
 #define LT(x) \
 	case x: \
 		return #x;
@@ -580,6 +638,94 @@ const char* lex_lexem_to_string(enum lexem t) {
 	}
 }
 
+#define LS(x, s) \
+	case x: \
+		return s;
+
+// Source text of tokens that carry no value, NULL for the rest
+const char* lex_lexem_spelling(enum lexem t) {
+	switch(t) {
+	LS(SEMILOCON, ";")
+	LS(COLON, ":")
+	LS(COMMA, ",")
+	LS(DOT, ".")
+	LS(PLUS, "+")
+	LS(DOUBLE_PLUS, "++")
+	LS(MINUS, "-")
+	LS(DOUBLE_MINUS, "--")
+	LS(SLASH, "/")
+	LS(ASTERISK, "*")
+	LS(RBRACE, "}")
+	LS(LBRACE, "{")
+	LS(RSQBRACE, "]")
+	LS(LSQBRACE, "[")
+	LS(RSQBRACE_DOUBLE, "]]")
+	LS(LSQBRACE_DOUBLE, "[[")
+	LS(RPAREN, ")")
+	LS(LPAREN, "(")
+	LS(LESS, "<")
+	LS(GREATER, ">")
+	LS(EQUAL, "=")
+	LS(EQUAL_EQUAL, "==")
+	LS(LESS_EQUAL, "<=")
+	LS(GREATER_EQUAL, ">=")
+	LS(PLUS_EQUAL, "+=")
+	LS(MINUS_EQUAL, "-=")
+	LS(ASTERISK_EQUAL, "*=")
+	LS(SLASH_EQUAL, "/=")
+	LS(DOUBLE_GREATER, ">>")
+	LS(DOUBLE_LESS, "<<")
+	LS(BANG, "!")
+	LS(BANG_EQUAL, "!=")
+	LS(AMPERSAND, "&")
+	LS(DOUBLE_AMPERSAND, "&&")
+	LS(OR, "|")
+	LS(DOUBLE_OR, "||")
+	LS(XOR, "^")
+	LS(POINTER, "->")
+	LS(TILDA, "~")
+	LS(TILDA_EQUAL, "~=")
+	LS(WHILE, "while")
+	LS(IF, "if")
+	LS(ELSE, "else")
+	LS(FOR, "for")
+	LS(DO, "do")
+	LS(SWITCH, "switch")
+	LS(RETURN, "return")
+	LS(CONTINUE, "continue")
+	LS(BREAK, "break")
+	LS(U8, "u8")
+	LS(U16, "u16")
+	LS(U32, "u32")
+	LS(U64, "u64")
+	LS(I8, "i8")
+	LS(I16, "i16")
+	LS(I32, "i32")
+	LS(I64, "i64")
+	LS(FLOAT, "float")
+	LS(DOUBLE, "double")
+	LS(STR, "str")
+	LS(VOID, "void")
+	LS(CONST, "const")
+	LS(NIL, "null")
+	LS(TRUE, "true")
+	LS(FALSE, "false")
+	LS(CLASS, "class")
+	LS(UNION, "union")
+	LS(LET, "let")
+	LS(FUN, "fun")
+	LS(TYPEDEF, "typedef")
+	LS(SIZEOF, "sizeof")
+	LS(PUBLIC, "public")
+	LS(PRIVATE, "private")
+	LS(PROTECTED, "protected")
+	LS(STATIC, "static")
+	LS(THIS, "this")
+	default:
+		return NULL;
+	}
+}
+
 int lex_stream_is_eof(token_stream* stream) {
-	return stream->flags & EOF;
+	return stream->flags & STREAM_EOF || stream->ptr >= stream->size;
 }
@@ -1,6 +1,9 @@
 #ifndef _LEX_H
 #define _LEX_H 1
 
+#include "preprocess.h"
+#include "source.h"
+
 enum lexem {
 	_EOF,
     SEMILOCON,
@@ -87,10 +90,12 @@ enum lexem {
 
 typedef struct {
     enum lexem type;
-	int line;
-    char*  string_value;
-    int    integer_value;
-    double double_value;
+	source_loc loc;
+	union {
+		char*  string_value;
+		int    integer_value;
+		double double_value;
+	};
 } token;
 
 typedef struct {
@@ -99,23 +104,27 @@ typedef struct {
     int size;
     int ptr;
     int flags;
-	int last_line;
+	token eof;
+	source_manager* sources;
 } token_stream;
 
-int lex(char* const input,  token_stream* stream);
+int lex(preprocessor* pp, source_entry* file, token_stream* stream);
 
 void lex_init();
 
-token_stream* lex_stream_create();
+token_stream* lex_stream_create(source_manager* sources);
 void lex_stream_free(token_stream* stream);
+token* lex_stream_append_token(token_stream* stream, enum lexem type, source_loc loc);
 void lex_stream_advance(token_stream* stream);
 token* lex_stream_current(token_stream* stream);
 token* lex_stream_previous(token_stream* stream);
 token* lex_stream_next(token_stream* stream);
 void lex_stream_rewind(token_stream* stream);
+void lex_stream_seek(token_stream* stream, int ptr);
 int lex_stream_is_eof(token_stream* stream);
 
 const char* lex_lexem_to_string(enum lexem t);
+const char* lex_lexem_spelling(enum lexem t);
 #define lex_current_to_string(s) lex_lexem_to_string(lex_stream_current(s)->type)
 
 #endif
@@ -0,0 +1,198 @@
+#include "hatch.h"
+#include "lex.h"
+#include "map.h"
+#include "preprocess.h"
+#include "source.h"
+#include "syntax.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+static pthread_once_t _init_once = PTHREAD_ONCE_INIT;
+
+static void _init() {
+	map_init();
+	preprocess_init();
+	lex_init();
+}
+
+void hatch_init() {
+	pthread_once(&_init_once, _init);
+}
+
+compilation_context* hatch_context_create(const hatch_callbacks* callbacks, void* user) {
+	hatch_init();
+
+	compilation_context* ctx = calloc(1, sizeof(compilation_context));
+	if(callbacks) {
+		ctx->callbacks = *callbacks;
+	}
+	ctx->user = user;
+	ctx->defs = path_list_create();
+	ctx->include_paths = path_list_create();
+	ctx->files = virtual_files_map_create();
+	return ctx;
+}
+
+static void _free_strings(path_list* l) {
+	for(int i = 0; i < l->size; i++) {
+		free(l->data[i]);
+	}
+	path_list_free(l);
+}
+
+static void _invalidate_config(compilation_context* ctx) {
+	if(ctx->config) {
+		preprocess_config_free(ctx->config);
+		ctx->config = NULL;
+	}
+}
+
+void hatch_context_free(compilation_context* ctx) {
+	hatch_reset(ctx);
+	_invalidate_config(ctx);
+
+	_free_strings(ctx->defs);
+	_free_strings(ctx->include_paths);
+
+	for(unsigned int i = 0; i < ctx->files->capacity; i++) {
+		for(virtual_files_val_wrapper* w = ctx->files->data[i]; w; w = w->next) {
+			free((char*) w->key);
+			free((char*) w->value.data);
+		}
+	}
+	virtual_files_map_free(ctx->files);
+
+	free(ctx);
+}
+
+void hatch_define(compilation_context* ctx, const char* name) {
+	path_list_append(ctx->defs, strdup(name));
+	_invalidate_config(ctx);
+}
+
+void hatch_add_include_path(compilation_context* ctx, const char* dir) {
+	path_list_append(ctx->include_paths, strdup(dir));
+	_invalidate_config(ctx);
+}
+
+void hatch_add_file(compilation_context* ctx, const char* path, const char* data, size_t size) {
+	virtual_file* old = virtual_files_map_get(ctx->files, path);
+
+	char* copy = malloc(size + 1);
+	memcpy(copy, data, size);
+	copy[size] = '\0';
+
+	if(old) {
+		free((char*) old->data);
+		old->data = copy;
+		old->size = size;
+	} else {
+		virtual_file f = { .data = copy, .size = size };
+		virtual_files_map_insert(ctx->files, strdup(path), f);
+	}
+}
+
+void hatch_lazy_bodies(compilation_context* ctx, int enable) {
+	ctx->lazy_bodies = enable;
+}
+
+void hatch_reset(compilation_context* ctx) {
+	if(ctx->ast) {
+		syntax_tree_free(ctx->ast);
+		ctx->ast = NULL;
+	}
+	if(ctx->tokens) {
+		lex_stream_free(ctx->tokens);
+		ctx->tokens = NULL;
+	}
+	if(ctx->sources) {
+		source_manager_free(ctx->sources);
+		ctx->sources = NULL;
+	}
+	free(ctx->buffer);
+	ctx->buffer = NULL;
+	ctx->path = NULL;
+}
+
+static void _on_diagnostic(void* user, source_position position, const char* level, const char* message) {
+	compilation_context* ctx = user;
+	if(ctx->callbacks.on_diagnostic == NULL) {
+		return;
+	}
+
+	hatch_diagnostic d = {
+		.path = position.path ? position.path : ctx->path,
+		.line = position.line,
+		.column = position.column,
+		.level = level,
+		.message = message
+	};
+	ctx->callbacks.on_diagnostic(ctx->user, &d);
+}
+
+int hatch_compile(compilation_context* ctx, const char* path, const char* data, size_t size) {
+	hatch_reset(ctx);
+
+	if(ctx->config == NULL) {
+		ctx->config = preprocess_config_create(ctx->defs->size, (const char**) ctx->defs->data,
+		                                       ctx->include_paths->size, (const char**) ctx->include_paths->data);
+	}
+
+	ctx->sources = source_manager_create();
+	ctx->sources->handler = _on_diagnostic;
+	ctx->sources->handler_ctx = ctx;
+	ctx->sources->files = ctx->files;
+
+	ctx->tokens = lex_stream_create(ctx->sources);
+
+	// Until the file is loaded, diagnostics without a location are reported against the path given
+	ctx->path = path;
+
+	source_entry* file = NULL;
+	if(data) {
+		ctx->buffer = malloc(size + 1);
+		memcpy(ctx->buffer, data, size);
+		ctx->buffer[size] = '\0';
+		file = source_add_buffer(ctx->sources, path, ctx->buffer, size, SOURCE_LOC_INVALID);
+		if(file == NULL) {
+			ctx->path = NULL;
+			return 1;
+		}
+	} else if(source_load_file(ctx->sources, path, SOURCE_LOC_INVALID, &file)) {
+		ctx->path = NULL;
+		return 1;
+	}
+	ctx->path = file->name;
+
+	preprocessor* pp = preprocess_create(ctx->sources, ctx->config);
+	int code = lex(pp, file, ctx->tokens);
+	preprocess_free(pp);
+
+	if(code) {
+		return code;
+	}
+
+	if(ctx->callbacks.on_tokens) {
+		ctx->callbacks.on_tokens(ctx->user, ctx->tokens);
+	}
+
+	if(ctx->callbacks.syntax) {
+		return syntax_parse_events(ctx->tokens, ctx->callbacks.syntax);
+	}
+
+	ctx->ast = syntax_tree_create();
+	if(ctx->lazy_bodies) {
+		ctx->ast->flags |= SYNTAX_TREE_LAZY_BODIES;
+	}
+	if((code = syntax_build_tree(ctx->tokens, ctx->ast))) {
+		return code;
+	}
+
+	if(ctx->callbacks.on_ast) {
+		ctx->callbacks.on_ast(ctx->user, ctx->ast);
+	}
+
+	return 0;
+}
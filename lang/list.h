@@ -1,7 +1,7 @@
 #ifndef _LIST_H
 #define _LIST_H
 
-#include <stdlib.h>
+#include "alloc.h"
 
 #define DEFINE_LIST_TYPE(name, el_type) \
 typedef struct _##name##_list { \
@@ -15,18 +15,19 @@ void name##_list_append(name##_list* l, el_type el);
 
 #define LIST_IMPL(name, el_type) \
 	name##_list* name##_list_create() { \
-		name##_list* l = calloc(1, sizeof(name##_list));\
+		name##_list* l = hatch_calloc(ALLOC_LISTS, 1, sizeof(name##_list));\
 		l->capacity = 4; \
-		l->data = calloc(4, sizeof(el_type)); \
+		l->data = hatch_calloc(ALLOC_LISTS, 4, sizeof(el_type)); \
 		return l; \
 	}\
 	void name##_list_free(name##_list* l) { \
-		free(l); \
+		hatch_free(ALLOC_LISTS, l->data); \
+		hatch_free(ALLOC_LISTS, l); \
 	} \
 	void name##_list_append(name##_list* l, el_type el) { \
 		if(l->size == l->capacity) { \
 			l->capacity *= 2; \
-			l->data = reallocarray(l->data, l->capacity, sizeof(el_type)); \
+			l->data = hatch_reallocarray(ALLOC_LISTS, l->data, l->capacity, sizeof(el_type)); \
 		} \
 		l->data[l->size] = el; \
 		l->size++; \
@@ -1,12 +1,41 @@
 #include <map.h>
 #include <string.h>
+#include <sys/random.h>
+#include <time.h>
+#include <unistd.h>
 
+static unsigned int _seed = 0;
+
+// Random for every process, so inputs can't be crafted against the hash
+void map_init() {
+    if(getrandom(&_seed, sizeof(_seed), GRND_NONBLOCK) != sizeof(_seed)) {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        _seed = (unsigned int) ts.tv_nsec ^ ((unsigned int) getpid() << 16);
+    }
+}
+
+// FNV-1a with a final avalanche, unlike djb2 equal length pairs like "Ez" and "FY" don't
+// collide. FNV-1a alone still has chained collisions from a known start, the seed of the
+// process takes that start away from crafted identifiers.
 unsigned int builtin_string_hash(const char* str) {
-    unsigned long hash = 5381;
-    int c;
+    return builtin_string_hash_seeded(str, _seed);
+}
+
+unsigned int builtin_string_hash_seeded(const char* str, unsigned int seed) {
+    unsigned int hash = 2166136261u ^ seed;
+    unsigned char c;
+
+    while ((c = *str++)) {
+        hash ^= c;
+        hash *= 16777619u;
+    }
 
-    while ((c = *str++))
-        hash = ((hash << 5) + hash) + c; /* hash * 33 + c */
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bu;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35u;
+    hash ^= hash >> 16;
 
     return hash;
 }
@@ -1,16 +1,22 @@
 #ifndef _MAP_H
 #define _MAP_H
 
+#include "alloc.h"
+
+// Initial amount of buckets, the table doubles whenever it holds more entries than buckets
 #define MAP_SIZE 64
 
 #define DEFINE_MAP_TYPE(name, key_type, value_type) \
     typedef struct _##name##_val_wrapper { \
         key_type key; \
         value_type value; \
+        unsigned int hash; \
         struct _##name##_val_wrapper* next; \
     } name##_val_wrapper; \
     typedef struct { \
-        name##_val_wrapper* data[MAP_SIZE]; \
+        name##_val_wrapper** data; \
+        unsigned int capacity; \
+        unsigned int size; \
     } name##_map; \
     unsigned int name##_hash(key_type key); \
     name##_map* name##_map_create(); \
@@ -23,85 +29,87 @@
 
 #define MAP_IMPL(name, key_type, value_type, hash_function, key_comparator) \
     unsigned int name##_hash(key_type key) { \
-        return hash_function(key) % MAP_SIZE; \
+        return hash_function(key); \
     } \
     name##_map* name##_map_create() { \
-        name##_map* m = calloc(1, sizeof(name##_map)); \
+        name##_map* m = hatch_calloc(ALLOC_MAPS, 1, sizeof(name##_map)); \
+        m->capacity = MAP_SIZE; \
+        m->data = hatch_calloc(ALLOC_MAPS, MAP_SIZE, sizeof(name##_val_wrapper*)); \
         return m; \
     } \
     void _##name##_wrapper_free(name##_val_wrapper* wrapper) { \
         while(wrapper) { \
             name##_val_wrapper* next = wrapper->next; \
-            free(wrapper); \
+            hatch_free(ALLOC_MAPS, wrapper); \
             wrapper = next; \
         } \
     } \
     void name##_map_free(name##_map* map) { \
-        for(int i = 0; i < MAP_SIZE; i++) { \
+        for(unsigned int i = 0; i < map->capacity; i++) { \
             _##name##_wrapper_free(map->data[i]); \
         } \
-        free(map); \
+        hatch_free(ALLOC_MAPS, map->data); \
+        hatch_free(ALLOC_MAPS, map); \
     } \
-    value_type* name##_map_get(name##_map* map, key_type key) { \
-        int hash = name##_hash(key); \
-        name##_val_wrapper* wrapper = map->data[hash]; \
-        if (wrapper) { \
-            if(wrapper->next == NULL) { \
-				if(key_comparator(wrapper->key, key)) { \
-                	return &wrapper->value; \
-				} else { \
-					return NULL; \
-				} \
-            } else { \
-                while(wrapper && key_comparator(wrapper->key, key) == 0) { \
-                    wrapper = wrapper->next; \
-                } \
-                if(wrapper) { \
-                    return &wrapper->value; \
-                } else { \
-                    return NULL; \
-                } \
-            } \
-        } else { \
-            return NULL; \
+    static name##_val_wrapper* _##name##_find(name##_map* map, key_type key, unsigned int hash) { \
+        name##_val_wrapper* wrapper = map->data[hash & (map->capacity - 1)]; \
+        while(wrapper && (wrapper->hash != hash || key_comparator(wrapper->key, key) == 0)) { \
+            wrapper = wrapper->next; \
         } \
+        return wrapper; \
+    } \
+    value_type* name##_map_get(name##_map* map, key_type key) { \
+        name##_val_wrapper* wrapper = _##name##_find(map, key, name##_hash(key)); \
+        return wrapper ? &wrapper->value : NULL; \
     } \
     int name##_map_contains(name##_map* map, key_type key) { \
         return name##_map_get(map, key) != NULL; \
     } \
     name##_val_wrapper* name##_create_wrapper(key_type key, value_type value) { \
-        name##_val_wrapper* wrapper = calloc(1, sizeof(name##_val_wrapper)); \
+        name##_val_wrapper* wrapper = hatch_calloc(ALLOC_MAPS, 1, sizeof(name##_val_wrapper)); \
         wrapper->key = key; \
         wrapper->value = value; \
+        wrapper->hash = name##_hash(key); \
         wrapper->next = NULL; \
         return wrapper; \
     } \
-    int name##_map_insert(name##_map* map, key_type key, value_type value) { \
-        int hash = name##_hash(key); \
-        name##_val_wrapper* wrapper = map->data[hash];\
-        if(wrapper == NULL) { \
-            wrapper = name##_create_wrapper(key, value); \
-        } else { \
-            name##_val_wrapper* parent = NULL; \
-            while(wrapper && key_comparator(wrapper->key, key) == 0) { \
-                parent = wrapper; \
-                wrapper = wrapper->next; \
-            } \
-            if(wrapper) { \
-                wrapper->value = value; \
-            } else { \
-                wrapper = name##_create_wrapper(key, value); \
-                if(parent) { \
-                    parent->next = wrapper; \
-					wrapper = parent; \
-                } \
+    static void _##name##_grow(name##_map* map) { \
+        unsigned int capacity = map->capacity * 2; \
+        name##_val_wrapper** data = hatch_calloc(ALLOC_MAPS, capacity, sizeof(name##_val_wrapper*)); \
+        for(unsigned int i = 0; i < map->capacity; i++) { \
+            name##_val_wrapper* wrapper = map->data[i]; \
+            while(wrapper) { \
+                name##_val_wrapper* next = wrapper->next; \
+                wrapper->next = data[wrapper->hash & (capacity - 1)]; \
+                data[wrapper->hash & (capacity - 1)] = wrapper; \
+                wrapper = next; \
             } \
         } \
-        map->data[hash] = wrapper; \
+        hatch_free(ALLOC_MAPS, map->data); \
+        map->data = data; \
+        map->capacity = capacity; \
+    } \
+    int name##_map_insert(name##_map* map, key_type key, value_type value) { \
+        unsigned int hash = name##_hash(key); \
+        name##_val_wrapper* wrapper = _##name##_find(map, key, hash); \
+        if(wrapper) { \
+            wrapper->value = value; \
+            return 0; \
+        } \
+        if(map->size >= map->capacity) { \
+            _##name##_grow(map); \
+        } \
+        wrapper = name##_create_wrapper(key, value); \
+        wrapper->next = map->data[hash & (map->capacity - 1)]; \
+        map->data[hash & (map->capacity - 1)] = wrapper; \
+        map->size++; \
         return 0; \
     } 
 
+// Seeds builtin_string_hash, before any map is created
+void map_init();
 unsigned int builtin_string_hash(const char* str);
+unsigned int builtin_string_hash_seeded(const char* str, unsigned int seed);
 int builtin_string_comparator(const char* a, const char* b);
 
 #endif
@@ -1,148 +1,426 @@
 #include "preprocess.h"
+#include "list.h"
 #include "map.h"
+#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "alloc.h"
 
-MAP_IMPL(compile_defs, const char*, int, builtin_string_hash, builtin_string_comparator)
+#define COND_ACTIVE  0
+#define COND_PENDING 1
+#define COND_SKIPPED 2
+
+MAP_IMPL(compile_defs, const char*, macro*, builtin_string_hash, builtin_string_comparator)
+MAP_IMPL(included_files, const char*, int, builtin_string_hash, builtin_string_comparator)
+LIST_IMPL(path, char*)
 
 DEFINE_MAP_TYPE(known_directives, const char*, enum directives);
 MAP_IMPL(known_directives, const char*, enum directives, builtin_string_hash, builtin_string_comparator);
 
-static compile_defs_map* _global_compile_defs = NULL;
 static known_directives_map* _known_directives = NULL;
 
-int preprocess_is_defined(compile_defs_map* local_defines, const char* key) {
-	return compile_defs_map_contains(_global_compile_defs, key) ||
-		   compile_defs_map_contains(local_defines, key);
+static macro* _make_macro(const char* name, const char* body) {
+	macro* m = hatch_malloc(ALLOC_PREPROCESSOR, sizeof(macro));
+	m->name = hatch_strdup(ALLOC_PREPROCESSOR, name);
+	m->body = body ? hatch_strdup(ALLOC_PREPROCESSOR, body) : NULL;
+	m->expanding = 0;
+	m->loc = SOURCE_LOC_INVALID;
+	return m;
 }
 
-static char* _replace_substring(const char* original, const char* oldSub, const char* newSub) {
-    char* foundPos;
-    int oldSubLen = strlen(oldSub);
-    int newSubLen = strlen(newSub);
-    int originalLen = strlen(original);
-
-	char* result = strdup(original);
+static void _free_macros(compile_defs_map* m) {
+	for(unsigned int i = 0; i < m->capacity; i++) {
+		for(compile_defs_val_wrapper* w = m->data[i]; w; w = w->next) {
+			hatch_free(ALLOC_PREPROCESSOR, w->value->name);
+			hatch_free(ALLOC_PREPROCESSOR, w->value->body);
+			hatch_free(ALLOC_PREPROCESSOR, w->value);
+		}
+	}
+	compile_defs_map_free(m);
+}
 
-	while(1) {
-    	foundPos = strstr(result, oldSub);
+preprocess_config* preprocess_config_create(int count, const char** extra, int include_count, const char** include_paths) {
+	preprocess_config* c = hatch_calloc(ALLOC_PREPROCESSOR, 1, sizeof(preprocess_config));
 
-    	if (foundPos == NULL) {
-    	    return result;
-    	}
+	c->defines = compile_defs_map_create();
+	for(int i = 0; i < count; i++) {
+		macro* m = _make_macro(extra[i], NULL);
+		compile_defs_map_insert(c->defines, m->name, m);
+	}
 
-    	int newLen = originalLen - oldSubLen + newSubLen;
-    	char* new_result = (char*)malloc(newLen + 1);
-    	if (new_result == NULL) return NULL;
+	c->include_paths = hatch_malloc(ALLOC_PREPROCESSOR, sizeof(char*) * (include_count + 1));
+	for(int i = 0; i < include_count; i++) {
+		c->include_paths[i] = hatch_strdup(ALLOC_PREPROCESSOR, include_paths[i]);
+	}
+	c->include_paths_amount = include_count;
 
-    	strncpy(new_result, result, foundPos - result);
-    	new_result[foundPos - result] = '\0';
-    	strcat(new_result, newSub);
-    	strcat(new_result, foundPos + oldSubLen);
+	return c;
+}
 
-		result = new_result;
-		originalLen = strlen(result);
+void preprocess_config_free(preprocess_config* c) {
+	_free_macros(c->defines);
+	for(int i = 0; i < c->include_paths_amount; i++) {
+		hatch_free(ALLOC_PREPROCESSOR, c->include_paths[i]);
 	}
+	hatch_free(ALLOC_PREPROCESSOR, c->include_paths);
+	hatch_free(ALLOC_PREPROCESSOR, c);
+}
+
+preprocessor* preprocess_create(source_manager* sources, preprocess_config* config) {
+	preprocessor* p = hatch_calloc(ALLOC_PREPROCESSOR, 1, sizeof(preprocessor));
+	p->sources = sources;
+	p->config = config;
+	p->defines = compile_defs_map_create();
+	p->deps = path_list_create();
+	p->included = included_files_map_create();
+	return p;
 }
 
-void expand_macro(const char* name, const char* value, size_t i, char** out) {
-	if(value == NULL) {
-		value = "";
+void preprocess_free(preprocessor* p) {
+	_free_macros(p->defines);
+	hatch_free(ALLOC_PREPROCESSOR, p->conditions);
+	for(int i = 0; i < p->deps->size; i++) {
+		hatch_free(ALLOC_PREPROCESSOR, p->deps->data[i]);
 	}
+	path_list_free(p->deps);
+	included_files_map_free(p->included);
+	hatch_free(ALLOC_PREPROCESSOR, p);
+}
+
+int preprocess_is_defined(preprocessor* p, const char* key) {
+	return (p->config && compile_defs_map_contains(p->config->defines, key)) ||
+		   compile_defs_map_contains(p->defines, key);
+}
 
-	char* part = _replace_substring(&(*out)[i], name, value);
-	char* res  = malloc(strlen(part) + i);
+macro* preprocess_get_macro(preprocessor* p, const char* name) {
+	macro** m = compile_defs_map_get(p->defines, name);
+	return m ? *m : NULL;
+}
 
-	strncpy(res, *out, i);
-	strncpy(res + i, part, strlen(part));
+int preprocess_is_skipping(preprocessor* p) {
+	return p->depth && p->conditions[p->depth - 1].state != COND_ACTIVE;
+}
 
-	free(part);
-	free(*out);
+static void _push_condition(preprocessor* p, int state, source_loc loc) {
+	if(p->depth == p->capacity) {
+		p->capacity = p->capacity ? p->capacity * 2 : 8;
+		p->conditions = hatch_realloc(ALLOC_PREPROCESSOR, p->conditions, sizeof(condition) * p->capacity);
+	}
+	p->conditions[p->depth].state = state;
+	p->conditions[p->depth].loc = loc;
+	p->depth++;
+}
+
+static char* _trim(char* s) {
+	while(isspace(*s)) {
+		s++;
+	}
+	char* end = s + strlen(s);
+	while(end > s && isspace(end[-1])) {
+		end--;
+	}
+	*end = '\0';
+	return s;
+}
 
-	*out = res;
+static int _conditional(preprocessor* p, enum directives dir, const char* args, source_loc loc) {
+	switch(dir) {
+		case D_IFDEF:
+		case D_IFNDEF:
+			if(preprocess_is_skipping(p)) {
+				_push_condition(p, COND_SKIPPED, loc);
+			} else if(preprocess_is_defined(p, args) == (dir == D_IFDEF)) {
+				_push_condition(p, COND_ACTIVE, loc);
+			} else {
+				_push_condition(p, COND_PENDING, loc);
+			}
+			return 0;
+		case D_ELSE:
+			if(!p->depth) {
+				source_error(p->sources, loc, "#else without #ifdef");
+				return 1;
+			}
+			if(p->conditions[p->depth - 1].state == COND_ACTIVE) {
+				p->conditions[p->depth - 1].state = COND_SKIPPED;
+			} else if(p->conditions[p->depth - 1].state == COND_PENDING) {
+				p->conditions[p->depth - 1].state = COND_ACTIVE;
+			}
+			return 0;
+		case D_ENDIF:
+			if(!p->depth) {
+				source_error(p->sources, loc, "#endif without #ifdef");
+				return 1;
+			}
+			p->depth--;
+			return 0;
+		default:
+			return 0;
+	}
 }
 
-void _remove(int from, int to, char* out) {
-	for(;from < to;from++) {
-		out[from] = ' ';
-	}	
+static char* _join_path(const char* dir, int dir_length, const char* name) {
+	char* path = hatch_malloc(ALLOC_PREPROCESSOR, dir_length + strlen(name) + 2);
+	memcpy(path, dir, dir_length);
+	path[dir_length] = '/';
+	strcpy(path + dir_length + 1, name);
+	return path;
 }
 
-void conditional(char** out, size_t i, int success, char* branch, char* end) {
-	if(success) {
-		if(branch) {
-			_remove(branch - *out + 6, end - *out - 1, *out);
+static char* _resolve_include(preprocessor* p, const char* from, const char* name, int quoted) {
+	if(name[0] == '/') {
+		return source_file_exists(p->sources, name) ? hatch_strdup(ALLOC_PREPROCESSOR, name) : NULL;
+	}
+
+	if(quoted) {
+		const char* slash = from ? strrchr(from, '/') : NULL;
+		char* path = slash ? _join_path(from, slash - from, name) : hatch_strdup(ALLOC_PREPROCESSOR, name);
+		if(source_file_exists(p->sources, path)) {
+			return path;
 		}
-	} else {
-		if(branch) {
-			_remove(i + 2, branch - *out - 1, *out);
-		} else {
-			_remove(i + 2, end - *out - 1, *out);
+		hatch_free(ALLOC_PREPROCESSOR, path);
+	}
+
+	int amount = p->config ? p->config->include_paths_amount : 0;
+	for(int i = 0; i < amount; i++) {
+		const char* dir = p->config->include_paths[i];
+		char* path = _join_path(dir, strlen(dir), name);
+		if(source_file_exists(p->sources, path)) {
+			return path;
 		}
+		hatch_free(ALLOC_PREPROCESSOR, path);
 	}
+
+	return NULL;
 }
 
-int directive(char** out, size_t* i, compile_defs_map* m) {
-	char* copy = strdup(*out);
-	char* directive = strtok(&copy[*i], " \n");	
+static int _include(preprocessor* p, const char* from, char* args, source_loc loc) {
+	int quoted = args[0] == '"';
+	char* end = NULL;
 
-	*i += strlen(directive);
+	if(quoted) {
+		end = strchr(args + 1, '"');
+	} else if(args[0] == '<') {
+		end = strchr(args + 1, '>');
+	}
 
-	char* args = strtok(NULL, "\n");
+	if(end == NULL) {
+		source_error(p->sources, loc, "malformed #include %s", args);
+		return 1;
+	}
 
-	*i += strlen(args);
+	*end = '\0';
 
-	enum directives* dir = known_directives_map_get(_known_directives, directive);
+	if(p->include_depth >= MAX_INCLUDE_DEPTH) {
+		source_error(p->sources, loc, "#include nested too deeply: %s", args + 1);
+		return 1;
+	}
 
-	if(dir) {
-		enum directives actual_dir = *dir;
-		if (actual_dir == D_DEFINE) {
-			char* name  = strtok(args, " ");
-			char* value = strtok(NULL, "\n");
-			compile_defs_map_insert(m, name, 1);
-			expand_macro(name, value, *i, out);
-		} else if (actual_dir == D_IFDEF || actual_dir == D_IFNDEF) {
-			char* name   = strtok(args, "\n");
-			char* end    = strstr(*out, "#endif");
-			char* branch = strstr(*out, "#else");
-			if(actual_dir == D_IFDEF) {
-				conditional(out, *i, preprocess_is_defined(m, name), branch, end);
-			} else {
-				conditional(out, *i, !preprocess_is_defined(m, name), branch, end);
-			}
-		} else if(actual_dir == D_INCLUDE) {
-			// TODO
-		}
+	char* path = _resolve_include(p, from, args + 1, quoted);
+	if(path == NULL) {
+		source_warning(p->sources, loc, "include not found: %s", args + 1);
+		return 0;
+	}
+
+	if(!included_files_map_contains(p->included, path)) {
+		path_list_append(p->deps, path);
+		included_files_map_insert(p->included, path, p->deps->size - 1);
 	} else {
-		printf("Preprocessor warning: unknown directive: %s\n", directive);
+		char* known = p->deps->data[*included_files_map_get(p->included, path)];
+		hatch_free(ALLOC_PREPROCESSOR, path);
+		path = known;
+	}
+
+	return source_load_file(p->sources, path, loc, &p->include);
+}
+
+int preprocess_directive(preprocessor* p, const char* path, const char* text, int length, source_loc loc) {
+	char* copy = hatch_strndup(ALLOC_PREPROCESSOR, text, length);
+	char* name = _trim(copy);
+	char* args = name;
+
+	while(*args && !isspace(*args)) {
+		args++;
+	}
+	if(*args) {
+		*args = '\0';
+		args = _trim(args + 1);
 	}
 
-	free(copy);
+	enum directives* dir = known_directives_map_get(_known_directives, name);
 
-	return 0;
+	int code = 0;
+
+	if(dir == NULL) {
+		if(!preprocess_is_skipping(p)) {
+			source_warning(p->sources, loc - 1, "unknown directive: %s", name);
+		}
+	} else if(*dir == D_IFDEF || *dir == D_IFNDEF || *dir == D_ELSE || *dir == D_ENDIF) {
+		code = _conditional(p, *dir, args, loc - 1);
+	} else if(preprocess_is_skipping(p)) {
+		// Only conditionals are tracked inside a skipped branch
+	} else if(*dir == D_DEFINE) {
+		char* body = args;
+		while(*body && !isspace(*body)) {
+			body++;
+		}
+		if(*body) {
+			*body = '\0';
+			body = _trim(body + 1);
+		}
+		macro** old = compile_defs_map_get(p->defines, args);
+		macro* m = _make_macro(args, *body ? body : NULL);
+		m->loc = loc + (body - copy);
+		if(old) {
+			// The map keeps the key it was inserted with, so the new macro takes over the old name
+			hatch_free(ALLOC_PREPROCESSOR, m->name);
+			m->name = (*old)->name;
+			hatch_free(ALLOC_PREPROCESSOR, (*old)->body);
+			hatch_free(ALLOC_PREPROCESSOR, *old);
+			*old = m;
+		} else {
+			compile_defs_map_insert(p->defines, m->name, m);
+		}
+	} else if(*dir == D_ERROR) {
+		source_error(p->sources, loc - 1, "#error %s", args);
+		code = 1;
+	} else if(*dir == D_WARNING) {
+		source_warning(p->sources, loc - 1, "#warning %s", args);
+	} else if(*dir == D_LINE) {
+		source_add_line_mark(p->sources, loc + length + 1, atoi(args));
+	} else if(*dir == D_INCLUDE) {
+		code = _include(p, path, args, loc - 1);
+	}
+
+	hatch_free(ALLOC_PREPROCESSOR, copy);
+
+	return code;
 }
 
-int preprocess(const char* in, char** _out) {
-	char* out = strdup(in);
+int preprocess_line(preprocessor* p, source_entry* file, int* ptr) {
+	const char* path = file->name;
+	const char* data = file->data;
+	int size = file->size;
+	int start = *ptr;
+	const char* eol = memchr(&data[start], '\n', size - start);
+	*ptr = eol ? eol - data : size;
+
+	if(preprocess_directive(p, path, &data[start], *ptr - start, file->base + start)) {
+		return 1;
+	}
+
+	while(preprocess_is_skipping(p) && *ptr < size) {
+		(*ptr)++;
+		while(*ptr < size && (data[*ptr] == ' ' || data[*ptr] == '\t')) {
+			(*ptr)++;
+		}
+		if(*ptr < size && data[*ptr] == '#') {
+			start = ++(*ptr);
+			eol = memchr(&data[start], '\n', size - start);
+			*ptr = eol ? eol - data : size;
+			if(preprocess_directive(p, path, &data[start], *ptr - start, file->base + start)) {
+				return 1;
+			}
+		} else {
+			eol = memchr(&data[*ptr], '\n', size - *ptr);
+			*ptr = eol ? eol - data : size;
+		}
+	}
 
-	compile_defs_map* defs = compile_defs_map_create();
+	return 0;
+}
 
-	for(size_t i = 0; i <= strlen(out); i++) {
-		if(out[i] == '#') {
-			i++;
-			int r;
-			if((r = directive(&out, &i, defs))) {
-				return r;
+static int _skip_comment(const char* data, int size, int ptr) {
+	int depth = 1;
+	while(ptr + 1 < size) {
+		if(data[ptr] == '*' && data[ptr + 1] == '/') {
+			if(--depth == 0) {
+				return ptr + 2;
 			}
+			ptr += 2;
+		} else if(data[ptr] == '/' && data[ptr + 1] == '*') {
+			depth++;
+			ptr += 2;
+		} else {
+			ptr++;
+		}
+	}
+	return size;
+}
+
+int preprocess_scan(preprocessor* p, source_entry* file) {
+	const char* data = file->data;
+	int size = file->size;
+	int ptr = 0;
+
+	while(ptr < size) {
+		switch(data[ptr++]) {
+			case '"':
+				while(ptr < size && data[ptr] != '"') {
+					ptr++;
+				}
+				ptr++;
+				break;
+			case '/':
+				if(ptr < size && data[ptr] == '/') {
+					const char* eol = memchr(&data[ptr], '\n', size - ptr);
+					ptr = eol ? eol - data : size;
+				} else if(ptr < size && data[ptr] == '*') {
+					ptr = _skip_comment(data, size, ptr + 1);
+				}
+				break;
+			case '#':
+				if(preprocess_line(p, file, &ptr)) {
+					return 1;
+				}
+				if(p->include) {
+					source_entry* include = p->include;
+					p->include = NULL;
+					p->include_depth++;
+					int code = preprocess_scan(p, include);
+					p->include_depth--;
+					if(code) {
+						return code;
+					}
+				}
+				break;
+		}
+	}
+
+	return 0;
+}
+
+static void _write_escaped(FILE* out, const char* path) {
+	for(; *path; path++) {
+		if(*path == ' ' || *path == '#') {
+			fputc('\\', out);
+		} else if(*path == '$') {
+			fputc('$', out);
 		}
+		fputc(*path, out);
 	}
+}
 
-	*_out = out;
+void preprocess_write_dependencies(preprocessor* p, FILE* out, const char* target, const char* source) {
+	_write_escaped(out, target);
+	fputs(": ", out);
+	_write_escaped(out, source);
+	for(int i = 0; i < p->deps->size; i++) {
+		fputs(" \\\n ", out);
+		_write_escaped(out, p->deps->data[i]);
+	}
+	fputc('\n', out);
+}
+
+int preprocess_finish(preprocessor* p) {
+	if(p->depth) {
+		source_error(p->sources, p->conditions[p->depth - 1].loc, "unterminated conditional directive");
+		return 1;
+	}
 	return 0;
 }
 
-void preprocess_init(int count, const char** extra) {
+void preprocess_init() {
 	_known_directives = known_directives_map_create();
 	known_directives_map_insert(_known_directives, "define", D_DEFINE);
 	known_directives_map_insert(_known_directives, "ifdef", D_IFDEF);
@@ -153,11 +431,6 @@ void preprocess_init(int count, const char** extra) {
 	known_directives_map_insert(_known_directives, "error", D_ERROR);
 	known_directives_map_insert(_known_directives, "warning", D_WARNING);
 	known_directives_map_insert(_known_directives, "line", D_LINE);
-
-	_global_compile_defs = compile_defs_map_create();
-	for(int i = 0; i < count; i++) {
-		compile_defs_map_insert(_global_compile_defs, extra[i], 1);
-	}
 }
 
 enum directives* preprocess_get_directive(const char* key) {
@@ -1,9 +1,24 @@
 #ifndef _PREPROCESS_H
 #define _PREPROCESS_H
 
+#include "list.h"
 #include "map.h"
+#include "source.h"
 
-DEFINE_MAP_TYPE(compile_defs, const char*, int)
+#include <stdio.h>
+
+#define MAX_INCLUDE_DEPTH 200
+
+typedef struct {
+	char* name;
+	char* body;
+	int   expanding;
+	source_loc loc;
+} macro;
+
+DEFINE_MAP_TYPE(compile_defs, const char*, macro*)
+DEFINE_MAP_TYPE(included_files, const char*, int)
+DEFINE_LIST_TYPE(path, char*)
 
 enum directives {
 	D_INCLUDE,
@@ -17,10 +32,46 @@ enum directives {
 	D_LINE
 };
 
-int preprocess(const char* in, char** out);
-int preprocess_is_defined(compile_defs_map* local_defines, const char* key);
+typedef struct {
+	int state;
+	source_loc loc;
+} condition;
+
+typedef struct {
+	compile_defs_map* defines;
+	char** include_paths;
+	int    include_paths_amount;
+} preprocess_config;
+
+typedef struct {
+	source_manager* sources;
+	preprocess_config* config;
+	compile_defs_map* defines;
+	condition* conditions;
+	int  depth;
+	int  capacity;
+	int  include_depth;
+	source_entry* include;
+	path_list* deps;
+	included_files_map* included;
+} preprocessor;
+
+preprocess_config* preprocess_config_create(int count, const char** extra_defs, int include_count, const char** include_paths);
+void preprocess_config_free(preprocess_config* c);
+
+preprocessor* preprocess_create(source_manager* sources, preprocess_config* config);
+void preprocess_free(preprocessor* p);
+
+int preprocess_directive(preprocessor* p, const char* path, const char* text, int length, source_loc loc);
+int preprocess_line(preprocessor* p, source_entry* file, int* ptr);
+int preprocess_scan(preprocessor* p, source_entry* file);
+void preprocess_write_dependencies(preprocessor* p, FILE* out, const char* target, const char* source);
+int preprocess_finish(preprocessor* p);
+int preprocess_is_skipping(preprocessor* p);
+int preprocess_is_defined(preprocessor* p, const char* key);
+macro* preprocess_get_macro(preprocessor* p, const char* name);
 enum directives* preprocess_get_directive(const char* key);
 
-void preprocess_init(int count, const char** extra_defs);
+void preprocess_init();
 
 #endif
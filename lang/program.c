@@ -3,25 +3,85 @@
 #include "statement.h"
 #include "syntax.h"
 #include "list.h"
+#include "trace.h"
+#include "class.h"
 #include "util.h"
+#include "alloc.h"
 
 #include <stdlib.h>
 
-static prog* _create_program() {
-	prog* p = malloc(sizeof(prog));
-	p->statements = stmt_list_create();
-	return p;
+static prog* _create_program(parser* p) {
+	if(!syntax_building(p)) {
+		return NULL;
+	}
+	prog* prg = hatch_malloc(ALLOC_PARSER, sizeof(prog));
+	prg->statements = stmt_list_create();
+	p->program = prg;
+	return prg;
 }
 
-prog* program(token_stream* s) {
-	prog* p = _create_program();
-	while(!lex_stream_is_eof(s)) {
-		stmt* st = declaration(s);
-		stmt_list_append(p->statements, st);
+// Labels the trace span of a top-level declaration, nodes are not built in event mode
+static const char* _declaration_name(stmt* st) {
+	if(st == NULL || st == SYNTAX_EVENT_NODE) {
+		return NULL;
+	}
+	token* name = NULL;
+	switch(st->type) {
+		case ST_DECL:
+			name = ((decl*) st->data)->identifier;
+			break;
+		case ST_FUN_DEF:
+			name = ((fun_def*) st->data)->identifier;
+			break;
+		case ST_CLASS:
+			name = ((class_info*) st->data)->identifier;
+			break;
+		case ST_TYPEDEF:
+			name = ((typedef_stmt*) st->data)->alias;
+			break;
+		default:
+			break;
 	}
-	return p;
+	return name ? name->string_value : NULL;
+}
+
+prog* program(parser* p) {
+	SYNTAX_RULE(p);
+	syntax_begin(p, SN_PROGRAM, 0, syntax_current(p));
+	prog* prg = _create_program(p);
+	while(!syntax_is_eof(p)) {
+		trace_time start = TRACE_NOW();
+		stmt* st = declaration(p);
+		if(trace_enabled) {
+			trace_span("declaration", _declaration_name(st), start);
+		}
+		if(prg) {
+			stmt_list_append(prg->statements, st);
+			syntax_commit(p);
+		}
+	}
+	SYNTAX_NODE_END(p, SN_PROGRAM, 0, NULL)
+	return prg;
+}
+
+int program_visit(prog* p, const ast_visitor* v, void* ctx) {
+	return VISIT(v->visit_program, ctx, p);
 }
 
-void program_accept(prog* p, ast_visitor visitor) {
-	SAFE_CALL(visitor.visit_program, p)
-} 
+int program_child(prog* p, int slot, enum syntax_node_kind* kind, void** child) {
+	if(slot < p->statements->size) WALK_CHILD(SN_STMT, p->statements->data[slot])
+	return 0;
+}
+
+int program_accept(prog* p, const ast_visitor* v, void* ctx) {
+	return syntax_walk(SN_PROGRAM, p, v, ctx);
+}
+
+void program_release(prog* p) {
+	stmt_list_free(p->statements);
+	hatch_free(ALLOC_PARSER, p);
+}
+
+void program_free(prog* p) {
+	syntax_free(SN_PROGRAM, p);
+}
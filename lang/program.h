@@ -10,8 +10,12 @@ typedef struct _prog {
 	struct _stmt_list* statements;
 } prog;
 
-prog* program(token_stream* s);
+prog* program(parser* p);
 
-void program_accept(prog* p, ast_visitor visitor);
+int  program_accept(prog* p, const ast_visitor* visitor, void* ctx);
+int  program_visit(prog* p, const ast_visitor* visitor, void* ctx);
+int  program_child(prog* p, int slot, enum syntax_node_kind* kind, void** child);
+void program_release(prog* p);
+void program_free(prog* p);
 
 #endif
@@ -0,0 +1,734 @@
+#include "resolve.h"
+#include "class.h"
+#include "expr.h"
+#include "statement.h"
+#include "type.h"
+#include "program.h"
+#include "alloc.h"
+
+#include <string.h>
+
+#define SYMBOL_CHUNK_SIZE 256
+#define SCOPE_INITIAL_SLOTS 256
+#define SCOPE_INITIAL_DEPTH 64
+#define SCOPE_INITIAL_LOG 256
+#define TYPE_INITIAL_CHAIN 16
+#define BODIES_INITIAL_CAPACITY 64
+
+struct _symbol_chunk {
+	struct _symbol_chunk* next;
+	int used;
+	symbol symbols[SYMBOL_CHUNK_SIZE];
+};
+
+static const char* _kind_names[] = {
+	[SYMBOL_VARIABLE]  = "variable",
+	[SYMBOL_PARAMETER] = "parameter",
+	[SYMBOL_FUNCTION]  = "function",
+	[SYMBOL_CLASS]     = "class",
+	[SYMBOL_TYPEDEF]   = "typedef",
+	[SYMBOL_MEMBER]    = "member",
+	[SYMBOL_METHOD]    = "method",
+};
+
+enum scope_kind {
+	SCOPE_PROGRAM,
+	SCOPE_CLASS,
+	SCOPE_FUNCTION,
+	SCOPE_BLOCK
+};
+
+typedef struct {
+	enum scope_kind kind;
+	int mark;
+	class_info* owner;
+} scope;
+
+typedef struct {
+	const char* name;
+	symbol* binding;
+} scope_slot;
+
+typedef struct {
+	symbol* bound;
+	symbol* hidden;
+} scope_entry;
+
+// A single flat table maps every declared name to its innermost binding, a scope is
+// a mark in the log of bindings made since and what each of them hid. Popping one puts
+// that back; a name left without any keeps its slot with NULL, so nothing is ever
+// removed. All arrays only grow, push and pop allocate nothing once they fit the
+// deepest nesting.
+struct _resolver {
+	resolution* r;
+	// r->names for the globals, a table of its own for a resolver of function bodies
+	intern_table* names;
+	// Consulted when none of this resolver's scopes binds a name
+	resolver* globals;
+	// Where resolve_globals puts the bodies it leaves out
+	resolve_bodies* bodies;
+	int binds;
+	int deferred_binds;
+	symbol_chunk* symbols;
+	int bound;
+	int unbound;
+	scope_slot* slots;
+	unsigned int capacity;
+	unsigned int size;
+	scope_entry* log;
+	int log_size;
+	int log_capacity;
+	scope* scopes;
+	int depth;
+	int scopes_capacity;
+	// Head of the right operand of the last . or ->, a member name
+	literal_expr* member;
+	// Pointer and array nodes above the base type being canonicalized
+	type_info** chain;
+	int chain_size;
+	int chain_capacity;
+	type_cache types;
+};
+
+const char* symbol_kind_name(enum symbol_kind kind) {
+	return _kind_names[kind];
+}
+
+static resolver* _resolver_create(resolution* r, intern_table* names) {
+	resolver* res = hatch_calloc(ALLOC_SEMANTIC, 1, sizeof(resolver));
+	res->r = r;
+	res->names = names;
+	res->capacity = SCOPE_INITIAL_SLOTS;
+	res->log_capacity = SCOPE_INITIAL_LOG;
+	res->scopes_capacity = SCOPE_INITIAL_DEPTH;
+	res->chain_capacity = TYPE_INITIAL_CHAIN;
+	res->slots = hatch_calloc(ALLOC_SEMANTIC, res->capacity, sizeof(scope_slot));
+	res->log = hatch_malloc(ALLOC_SEMANTIC, sizeof(scope_entry) * res->log_capacity);
+	res->scopes = hatch_malloc(ALLOC_SEMANTIC, sizeof(scope) * res->scopes_capacity);
+	res->chain = hatch_malloc(ALLOC_SEMANTIC, sizeof(type_info*) * res->chain_capacity);
+	return res;
+}
+
+static void _resolver_free(resolver* res) {
+	hatch_free(ALLOC_SEMANTIC, res->slots);
+	hatch_free(ALLOC_SEMANTIC, res->log);
+	hatch_free(ALLOC_SEMANTIC, res->scopes);
+	hatch_free(ALLOC_SEMANTIC, res->chain);
+	hatch_free(ALLOC_SEMANTIC, res);
+}
+
+resolution* resolve_create() {
+	resolution* r = hatch_calloc(ALLOC_SEMANTIC, 1, sizeof(resolution));
+	r->names = intern_table_create();
+	r->types = type_table_create();
+	return r;
+}
+
+void resolve_free(resolution* r) {
+	while(r->symbols) {
+		symbol_chunk* next = r->symbols->next;
+		hatch_free(ALLOC_SEMANTIC, r->symbols);
+		r->symbols = next;
+	}
+	if(r->globals) {
+		_resolver_free(r->globals);
+	}
+	for(int i = 0; i < r->worker_names_size; i++) {
+		intern_table_free(r->worker_names[i]);
+	}
+	hatch_free(ALLOC_SEMANTIC, r->worker_names);
+	intern_table_free(r->names);
+	type_table_free(r->types);
+	hatch_free(ALLOC_SEMANTIC, r);
+}
+
+// The shared table is only read once the globals are done, a name already there keeps
+// its pointer so it still meets the global binding
+static const char* _name(resolver* res, const char* spelling) {
+	if(res->names != res->r->names) {
+		const char* name = intern_find(res->r->names, spelling);
+		if(name) {
+			return name;
+		}
+	}
+	return intern(res->names, spelling);
+}
+
+static const char* _find_name(resolver* res, const char* spelling) {
+	const char* name = intern_find(res->r->names, spelling);
+	if(name == NULL && res->names != res->r->names) {
+		name = intern_find(res->names, spelling);
+	}
+	return name;
+}
+
+static symbol* _new_symbol(resolver* res, enum symbol_kind kind, token* identifier, stmt* declaration, class_info* owner) {
+	if(res->symbols == NULL || res->symbols->used == SYMBOL_CHUNK_SIZE) {
+		symbol_chunk* c = hatch_malloc(ALLOC_SEMANTIC, sizeof(symbol_chunk));
+		c->used = 0;
+		c->next = res->symbols;
+		res->symbols = c;
+	}
+	symbol* s = &res->symbols->symbols[res->symbols->used++];
+	s->kind = kind;
+	s->name = _name(res, identifier->string_value);
+	s->identifier = identifier;
+	s->declaration = declaration;
+	s->owner = owner;
+	s->type = NULL;
+	return s;
+}
+
+static unsigned int _probe(resolver* res, const char* name) {
+	unsigned int i = intern_hash(name) & (res->capacity - 1);
+	while(res->slots[i].name && res->slots[i].name != name) {
+		i = (i + 1) & (res->capacity - 1);
+	}
+	return i;
+}
+
+static void _grow_slots(resolver* res) {
+	scope_slot* slots = res->slots;
+	unsigned int capacity = res->capacity;
+
+	res->capacity *= 2;
+	res->slots = hatch_calloc(ALLOC_SEMANTIC, res->capacity, sizeof(scope_slot));
+	for(unsigned int i = 0; i < capacity; i++) {
+		if(slots[i].name) {
+			res->slots[_probe(res, slots[i].name)] = slots[i];
+		}
+	}
+	hatch_free(ALLOC_SEMANTIC, slots);
+}
+
+static scope_slot* _slot(resolver* res, const char* name) {
+	unsigned int i = _probe(res, name);
+	if(res->slots[i].name == NULL) {
+		if(2 * (res->size + 1) > res->capacity) {
+			_grow_slots(res);
+			i = _probe(res, name);
+		}
+		res->slots[i].name = name;
+		res->size++;
+	}
+	return &res->slots[i];
+}
+
+// A later declaration in the same scope replaces the earlier one, a prototype is
+// followed by its definition
+static void _bind(resolver* res, symbol* s) {
+	scope_slot* slot = _slot(res, s->name);
+
+	if(res->log_size == res->log_capacity) {
+		res->log_capacity *= 2;
+		res->log = hatch_realloc(ALLOC_SEMANTIC, res->log, sizeof(scope_entry) * res->log_capacity);
+	}
+	res->log[res->log_size++] = (scope_entry) { s, slot->binding };
+	slot->binding = s;
+	res->binds++;
+}
+
+static symbol* _lookup(resolver* res, const char* spelling) {
+	// A name that was never interned can't have a binding
+	const char* name = _find_name(res, spelling);
+	if(name == NULL) {
+		return NULL;
+	}
+	scope_slot* slot = &res->slots[_probe(res, name)];
+	if(slot->name && slot->binding) {
+		return slot->binding;
+	}
+	if(res->globals) {
+		slot = &res->globals->slots[_probe(res->globals, name)];
+		return slot->name ? slot->binding : NULL;
+	}
+	return NULL;
+}
+
+static void _push(resolver* res, enum scope_kind kind, class_info* owner) {
+	if(res->depth == res->scopes_capacity) {
+		res->scopes_capacity *= 2;
+		res->scopes = hatch_realloc(ALLOC_SEMANTIC, res->scopes, sizeof(scope) * res->scopes_capacity);
+	}
+	res->scopes[res->depth++] = (scope) { kind, res->log_size, owner };
+}
+
+static void _pop(resolver* res) {
+	scope* s = &res->scopes[--res->depth];
+	while(res->log_size > s->mark) {
+		scope_entry* e = &res->log[--res->log_size];
+		_slot(res, e->bound->name)->binding = e->hidden;
+	}
+}
+
+static scope* _current(resolver* res) {
+	return &res->scopes[res->depth - 1];
+}
+
+// Names in program and class scopes are bound up front, see _hoist
+static int _hoisting(resolver* res) {
+	enum scope_kind kind = _current(res)->kind;
+	return kind == SCOPE_PROGRAM || kind == SCOPE_CLASS;
+}
+
+static token* _declared_name(stmt* st) {
+	switch(st->type) {
+		case ST_DECL:
+			return ((decl*) st->data)->identifier;
+		case ST_FUN_DEF:
+			return ((fun_def*) st->data)->identifier;
+		case ST_CLASS:
+			return ((class_info*) st->data)->identifier;
+		case ST_TYPEDEF:
+			return ((typedef_stmt*) st->data)->alias;
+		default:
+			return NULL;
+	}
+}
+
+static enum symbol_kind _symbol_kind(stmt* st, enum scope_kind scope) {
+	switch(st->type) {
+		case ST_DECL:
+			return scope == SCOPE_CLASS ? SYMBOL_MEMBER : scope == SCOPE_FUNCTION ? SYMBOL_PARAMETER : SYMBOL_VARIABLE;
+		case ST_FUN_DEF:
+			return scope == SCOPE_CLASS ? SYMBOL_METHOD : SYMBOL_FUNCTION;
+		case ST_CLASS:
+			return SYMBOL_CLASS;
+		default:
+			return SYMBOL_TYPEDEF;
+	}
+}
+
+static canon_type* _symbol_type(resolver* res, symbol* s);
+
+static canon_type* _named_type(resolver* res, token* t) {
+	type_table* types = res->r->types;
+	if(t->type != IDENTIFIER) {
+		return type_builtin(types, &res->types, t->type);
+	}
+	symbol* s = _lookup(res, t->string_value);
+	if(s && (s->kind == SYMBOL_TYPEDEF || s->kind == SYMBOL_CLASS)) {
+		return _symbol_type(res, s);
+	}
+	return type_unresolved(types, &res->types, _name(res, t->string_value));
+}
+
+// Pointers and arrays wrap their base type, so the chain down to it is collected first
+// and wrapped back up. The chain is a stack, typedefs met on the way nest on top of it.
+static canon_type* _canonical(resolver* res, type_info* t) {
+	int base = res->chain_size;
+	while(t) {
+		if(res->chain_size == res->chain_capacity) {
+			res->chain_capacity *= 2;
+			res->chain = hatch_realloc(ALLOC_SEMANTIC, res->chain, sizeof(type_info*) * res->chain_capacity);
+		}
+		res->chain[res->chain_size++] = t;
+		if(t->type == T_TRIVIAL) {
+			break;
+		}
+		t = t->type == T_POINTER ? ((pointer*) t->data)->value : ((array*) t->data)->value;
+	}
+
+	canon_type* c = NULL;
+	while(res->chain_size > base) {
+		type_info* n = res->chain[--res->chain_size];
+		switch(n->type) {
+			case T_TRIVIAL:
+				c = _named_type(res, n->data);
+				break;
+			case T_POINTER:
+				c = type_pointer_to(res->r->types, &res->types, c);
+				break;
+			case T_ARRAY:
+				c = type_array_of(res->r->types, &res->types, c, ((array*) n->data)->size);
+				break;
+		}
+		n->canonical = c;
+	}
+	return c;
+}
+
+static canon_type* _symbol_type(resolver* res, symbol* s) {
+	if(s->type) {
+		return s->type;
+	}
+	stmt* st = s->declaration;
+	switch(st->type) {
+		case ST_DECL:
+			s->type = _canonical(res, ((decl*) st->data)->type);
+			break;
+		case ST_FUN_DEF:
+			s->type = _canonical(res, ((fun_def*) st->data)->ret_type);
+			break;
+		case ST_CLASS:
+			s->type = type_class_of(res->r->types, &res->types, st->data, s->name);
+			break;
+		case ST_TYPEDEF:
+			// Set first so a typedef cycle ends at an unresolved name
+			s->type = type_unresolved(res->r->types, &res->types, s->name);
+			s->type = _canonical(res, ((typedef_stmt*) st->data)->type);
+			break;
+		default:
+			break;
+	}
+	return s->type;
+}
+
+static symbol* _declare(resolver* res, stmt* st) {
+	token* name = st ? _declared_name(st) : NULL;
+	if(name == NULL || name->type != IDENTIFIER) {
+		return NULL;
+	}
+	scope* s = _current(res);
+	symbol* sym = _new_symbol(res, _symbol_kind(st, s->kind), name, st, s->kind == SCOPE_CLASS ? s->owner : NULL);
+	_bind(res, sym);
+	return sym;
+}
+
+static void _declare_local(resolver* res, stmt* st) {
+	symbol* s = _declare(res, st);
+	if(s) {
+		_symbol_type(res, s);
+	}
+}
+
+// Types of hoisted names are taken once all of them are bound, in the scope they are
+// declared in, so a typedef may name one declared after it
+static void _type_hoisted(resolver* res) {
+	for(int i = _current(res)->mark; i < res->log_size; i++) {
+		_symbol_type(res, res->log[i].bound);
+	}
+}
+
+static void _hoist(resolver* res, stmt** statements, int size) {
+	for(int i = 0; i < size; i++) {
+		_declare(res, statements[i]);
+	}
+	_type_hoisted(res);
+}
+
+static void _hoist_members(resolver* res, class_info* c) {
+	for(int i = 0; c->body && i < c->body->size; i++) {
+		_declare(res, c->body->data[i]->declaration);
+	}
+	_type_hoisted(res);
+}
+
+// What the body sees above the program scope are the class scopes around it, they are
+// all hoisted, so their bindings now are their bindings for the whole body. Methods of
+// one class share a single copy of them. Lazy bodies are parsed here: they are parsed
+// from the token stream of the whole file, which must not be shared between threads.
+static void _defer(resolver* res, stmt* st) {
+	resolve_bodies* b = res->bodies;
+	fun_def_body(st->data);
+
+	int begin = res->depth > 1 ? res->scopes[1].mark : res->log_size;
+	int count = res->log_size - begin;
+	int shared = b->size && res->deferred_binds == res->binds &&
+		b->tasks[b->size - 1].members_end - b->tasks[b->size - 1].members_begin == count;
+
+	if(b->size == b->capacity) {
+		b->capacity = b->capacity ? b->capacity * 2 : BODIES_INITIAL_CAPACITY;
+		b->tasks = hatch_realloc(ALLOC_SEMANTIC, b->tasks, sizeof(resolve_task) * b->capacity);
+	}
+	resolve_task* t = &b->tasks[b->size++];
+	t->function = st;
+	if(shared) {
+		t->members_begin = t[-1].members_begin;
+		t->members_end = t[-1].members_end;
+		return;
+	}
+
+	if(b->members_size + count > b->members_capacity) {
+		while(b->members_size + count > b->members_capacity) {
+			b->members_capacity = b->members_capacity ? b->members_capacity * 2 : BODIES_INITIAL_CAPACITY;
+		}
+		b->members = hatch_realloc(ALLOC_SEMANTIC, b->members, sizeof(symbol*) * b->members_capacity);
+	}
+	t->members_begin = b->members_size;
+	for(int i = begin; i < res->log_size; i++) {
+		b->members[b->members_size++] = res->log[i].bound;
+	}
+	t->members_end = b->members_size;
+	res->deferred_binds = res->binds;
+}
+
+static int _enter(void* ctx, enum syntax_node_kind kind, void* node) {
+	resolver* res = ctx;
+
+	// The whole chain below a type is done at once
+	if(kind == SN_TYPE) {
+		_canonical(res, node);
+		return VISIT_SKIP;
+	}
+	if(kind == SN_PROGRAM) {
+		prog* p = node;
+		_push(res, SCOPE_PROGRAM, NULL);
+		_hoist(res, p->statements->data, p->statements->size);
+		return VISIT_CONTINUE;
+	}
+	if(kind != SN_STMT) {
+		return VISIT_CONTINUE;
+	}
+
+	stmt* st = node;
+	switch(st->type) {
+		case ST_BLOCK:
+		case ST_FOR:
+			_push(res, SCOPE_BLOCK, NULL);
+			break;
+		case ST_FUN_DEF:
+			if(res->bodies && _hoisting(res)) {
+				_defer(res, st);
+				// Leave still pops it
+				_push(res, SCOPE_FUNCTION, NULL);
+				return VISIT_SKIP;
+			}
+			// A local function can call itself
+			if(!_hoisting(res)) {
+				_declare_local(res, st);
+			}
+			_push(res, SCOPE_FUNCTION, NULL);
+			break;
+		case ST_CLASS:
+			if(!_hoisting(res)) {
+				_declare_local(res, st);
+			}
+			_push(res, SCOPE_CLASS, st->data);
+			_hoist_members(res, st->data);
+			break;
+		default:
+			break;
+	}
+	return VISIT_CONTINUE;
+}
+
+static int _leave(void* ctx, enum syntax_node_kind kind, void* node) {
+	resolver* res = ctx;
+
+	// The program scope is kept for the function bodies
+	if(kind != SN_STMT) {
+		return VISIT_CONTINUE;
+	}
+
+	stmt* st = node;
+	switch(st->type) {
+		case ST_BLOCK:
+		case ST_FOR:
+		case ST_FUN_DEF:
+		case ST_CLASS:
+			_pop(res);
+			break;
+		case ST_DECL:
+		case ST_TYPEDEF:
+			// Visible after the initializer, let i32 x = x; reads the outer x
+			if(!_hoisting(res)) {
+				_declare_local(res, st);
+			}
+			break;
+		default:
+			break;
+	}
+	return VISIT_CONTINUE;
+}
+
+// The name a member access selects: b in a.b, a.b(c), a.b[c] and a.b++
+static literal_expr* _member_head(expr* e) {
+	while(e) {
+		switch(e->type) {
+			case ET_LITERAL:
+				return e->data;
+			case ET_CALL:
+				e = ((call_expr*) e->data)->callee;
+				break;
+			case ET_SUBSCRIPT:
+				e = ((subscript_expr*) e->data)->array;
+				break;
+			case ET_UNARY:
+				if(!((unary_expr*) e->data)->postfix) {
+					return NULL;
+				}
+				e = ((unary_expr*) e->data)->right;
+				break;
+			default:
+				return NULL;
+		}
+	}
+	return NULL;
+}
+
+// Marked when the walk reaches the right operand, the left one is done by then and the
+// head is the first literal walked below, so one pending member is enough
+static literal_expr* _selected_member(enum syntax_node_kind kind, void* node, int slot) {
+	if(kind != SN_EXPR || slot != 1 || ((expr*) node)->type != ET_BINARY) {
+		return NULL;
+	}
+	binary_expr* b = ((expr*) node)->data;
+	return b->op == DOT || b->op == POINTER ? _member_head(b->right) : NULL;
+}
+
+static int _child(void* ctx, enum syntax_node_kind kind, void* node, int slot, void* child) {
+	(void) child;
+	literal_expr* member = _selected_member(kind, node, slot);
+	if(member) {
+		((resolver*) ctx)->member = member;
+	}
+	return VISIT_CONTINUE;
+}
+
+static int _visit_literal(void* ctx, literal_expr* e) {
+	resolver* res = ctx;
+	if(e->value->type != IDENTIFIER) {
+		return VISIT_CONTINUE;
+	}
+	if(e == res->member) {
+		res->member = NULL;
+		e->symbol = NULL;
+		return VISIT_CONTINUE;
+	}
+	e->symbol = _lookup(res, e->value->string_value);
+	if(e->symbol) {
+		res->bound++;
+	} else {
+		res->unbound++;
+	}
+	return VISIT_CONTINUE;
+}
+
+static const ast_visitor _resolve_visitor = {
+	.enter = _enter,
+	.child = _child,
+	.leave = _leave,
+	.visit_literal_expr = _visit_literal,
+};
+
+static void _hand_over(resolution* r, resolver* res) {
+	while(res->symbols) {
+		symbol_chunk* next = res->symbols->next;
+		res->symbols->next = r->symbols;
+		r->symbols = res->symbols;
+		res->symbols = next;
+	}
+	r->bound += res->bound;
+	r->unbound += res->unbound;
+	res->bound = 0;
+	res->unbound = 0;
+}
+
+int resolve_globals(resolution* r, syntax_tree* tree, resolve_bodies* bodies) {
+	resolver* res = _resolver_create(r, r->names);
+	res->bodies = bodies;
+	syntax_walk_tree(tree, &_resolve_visitor, res);
+	res->bodies = NULL;
+	_hand_over(r, res);
+	r->globals = res;
+	return 0;
+}
+
+resolver* resolver_create(resolution* r) {
+	resolver* res = _resolver_create(r, intern_table_create());
+	res->globals = r->globals;
+	return res;
+}
+
+void resolve_function(resolver* res, resolve_bodies* bodies, int task) {
+	resolve_task* t = &bodies->tasks[task];
+	_push(res, SCOPE_PROGRAM, NULL);
+	for(int i = t->members_begin; i < t->members_end; i++) {
+		_bind(res, bodies->members[i]);
+	}
+	syntax_walk(SN_STMT, t->function, &_resolve_visitor, res);
+	_pop(res);
+}
+
+void resolver_finish(resolution* r, resolver* res) {
+	_hand_over(r, res);
+	r->worker_names = hatch_realloc(ALLOC_SEMANTIC, r->worker_names, sizeof(intern_table*) * (r->worker_names_size + 1));
+	r->worker_names[r->worker_names_size++] = res->names;
+	_resolver_free(res);
+}
+
+void resolve_bodies_free(resolve_bodies* bodies) {
+	hatch_free(ALLOC_SEMANTIC, bodies->tasks);
+	hatch_free(ALLOC_SEMANTIC, bodies->members);
+}
+
+int resolve_tree(resolution* r, syntax_tree* tree) {
+	resolve_bodies bodies = { 0 };
+	resolve_globals(r, tree, &bodies);
+
+	resolver* res = resolver_create(r);
+	for(int i = 0; i < bodies.size; i++) {
+		resolve_function(res, &bodies, i);
+	}
+	resolver_finish(r, res);
+	resolve_bodies_free(&bodies);
+
+	type_table_layout(r->types);
+	return 0;
+}
+
+typedef struct {
+	source_manager* sources;
+	emitter* out;
+	literal_expr* member;
+} binding_printer;
+
+static void _print_position(binding_printer* p, token* t) {
+	source_position pos = source_resolve(p->sources, t->loc);
+	emit_format(p->out, "%s:%d:%d", pos.path ? pos.path : "?", pos.line, pos.column);
+}
+
+static int _print_child(void* ctx, enum syntax_node_kind kind, void* node, int slot, void* child) {
+	(void) child;
+	literal_expr* member = _selected_member(kind, node, slot);
+	if(member) {
+		((binding_printer*) ctx)->member = member;
+	}
+	return VISIT_CONTINUE;
+}
+
+static int _print_literal(void* ctx, literal_expr* e) {
+	binding_printer* p = ctx;
+	if(e->value->type != IDENTIFIER || e == p->member) {
+		return VISIT_CONTINUE;
+	}
+
+	_print_position(p, e->value);
+	emit_format(p->out, " %s -> ", e->value->string_value);
+	symbol* s = e->symbol;
+	if(s == NULL) {
+		emit_string(p->out, "unbound\n");
+		return VISIT_CONTINUE;
+	}
+	emit_string(p->out, symbol_kind_name(s->kind));
+	if(s->owner) {
+		emit_format(p->out, " of %s", s->owner->identifier->string_value);
+	}
+	emit_char(p->out, ' ');
+	_print_position(p, s->identifier);
+	if(s->type) {
+		emit_char(p->out, ' ');
+		type_print(s->type, p->out);
+		emit_format(p->out, " (size %zu, align %zu)", s->type->size, s->type->align);
+	}
+	emit_char(p->out, '\n');
+	return VISIT_CONTINUE;
+}
+
+static int _print_skip_types(void* ctx, enum syntax_node_kind kind, void* node) {
+	(void) ctx;
+	(void) node;
+	return kind == SN_TYPE ? VISIT_SKIP : VISIT_CONTINUE;
+}
+
+static const ast_visitor _print_visitor = {
+	.enter = _print_skip_types,
+	.child = _print_child,
+	.visit_literal_expr = _print_literal,
+};
+
+void resolve_print(syntax_tree* tree, source_manager* sources, emitter* out) {
+	binding_printer p = { sources, out, NULL };
+	syntax_walk_tree(tree, &_print_visitor, &p);
+}
@@ -0,0 +1,94 @@
+#ifndef _RESOLVE_H
+#define _RESOLVE_H
+
+#include "emit.h"
+#include "intern.h"
+#include "lex.h"
+#include "source.h"
+#include "syntax.h"
+#include "types.h"
+
+enum symbol_kind {
+	SYMBOL_VARIABLE,
+	SYMBOL_PARAMETER,
+	SYMBOL_FUNCTION,
+	SYMBOL_CLASS,
+	SYMBOL_TYPEDEF,
+	SYMBOL_MEMBER,
+	SYMBOL_METHOD
+};
+
+// declaration is the ST_DECL, ST_FUN_DEF, ST_CLASS or ST_TYPEDEF statement, owner
+// the class of members and methods. type is the declared type, the return type of
+// functions, the class itself or the type a typedef names.
+typedef struct _symbol {
+	enum symbol_kind    kind;
+	const char*         name;
+	token*              identifier;
+	struct _stmt*       declaration;
+	struct _class_info* owner;
+	canon_type*         type;
+} symbol;
+
+typedef struct _symbol_chunk symbol_chunk;
+typedef struct _resolver resolver;
+
+// Owns the symbols the tree's identifiers point to, so it has to outlive every pass
+// that reads literal_expr.symbol. Names declared inside function bodies are interned
+// by the resolver that did the body and kept in one of worker_names.
+typedef struct {
+	intern_table*  names;
+	intern_table** worker_names;
+	int            worker_names_size;
+	type_table*    types;
+	symbol_chunk*  symbols;
+	// Program scope bindings, left by resolve_globals for the function bodies
+	resolver*      globals;
+	int bound;
+	int unbound;
+} resolution;
+
+// A function body resolve_globals left out, members are the class scope bindings it
+// sees on top of the program scope
+typedef struct {
+	struct _stmt* function;
+	int members_begin;
+	int members_end;
+} resolve_task;
+
+typedef struct {
+	resolve_task* tasks;
+	int size;
+	int capacity;
+	symbol** members;
+	int members_size;
+	int members_capacity;
+} resolve_bodies;
+
+resolution* resolve_create();
+void resolve_free(resolution* r);
+
+// Binds every identifier literal_expr to the declaration it names. Top-level and class
+// members are visible in their whole scope, locals from their declaration on. Names
+// after . and -> need types and, like undeclared names, are left NULL. Every type_info
+// gets its canonical type and every canonical type its size and alignment.
+int  resolve_tree(resolution* r, syntax_tree* tree);
+
+// resolve_tree in parts. resolve_globals does everything but the functions declared in
+// program and class scopes, whose bodies it parses if they are lazy and appends to
+// bodies. Those only read what it leaves, so each can then be resolved on any thread by
+// resolve_function, as long as one resolver serves one thread. Once every body is done
+// resolver_finish hands what the resolvers made to r and type_table_layout can run.
+int  resolve_globals(resolution* r, syntax_tree* tree, resolve_bodies* bodies);
+resolver* resolver_create(resolution* r);
+void resolve_function(resolver* res, resolve_bodies* bodies, int task);
+void resolver_finish(resolution* r, resolver* res);
+void resolve_bodies_free(resolve_bodies* bodies);
+
+// One line per identifier literal: where it is, what it names, where that is declared
+// and its type
+void resolve_print(syntax_tree* tree, source_manager* sources, emitter* out);
+
+const char* symbol_kind_name(enum symbol_kind kind);
+
+#endif
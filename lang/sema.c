@@ -0,0 +1,449 @@
+#include "sema.h"
+#include "expr.h"
+#include "statement.h"
+#include "type.h"
+#include "emit.h"
+#include "alloc.h"
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SEMA_INITIAL_DIAGNOSTICS 16
+#define SEMA_INITIAL_FUNCTIONS 8
+#define SEMA_MESSAGE_SIZE 256
+
+// seq orders the diagnostics of one worker, a body is only ever checked by one, so
+// (body, seq) is the order a serial check reports them in
+typedef struct {
+	source_loc loc;
+	int    body;
+	int    seq;
+	int    worker;
+	size_t offset;
+} sema_diagnostic;
+
+typedef struct {
+	fun_def* function;
+	int loops;
+} sema_function;
+
+typedef struct _sema_pool sema_pool;
+
+// The bodies of a worker are the range [front, back) of the tasks. The worker takes
+// from the front, one that ran out steals the back half of someone else's.
+typedef struct {
+	sema_pool* pool;
+	int index;
+	pthread_mutex_t lock;
+	int front;
+	int back;
+	resolver* res;
+	int body;
+	sema_function* functions;
+	int depth;
+	int functions_capacity;
+	// Messages end with a NUL, diagnostics point into it by offset
+	emitter* messages;
+	sema_diagnostic* diagnostics;
+	int size;
+	int capacity;
+} sema_worker;
+
+struct _sema_pool {
+	resolve_bodies bodies;
+	sema_worker* workers;
+	int count;
+	const sema_admission* admission;
+};
+
+static void _error(sema_worker* w, token* at, const char* fmt, ...) __attribute__((format(printf, 3, 4)));
+
+static void _error(sema_worker* w, token* at, const char* fmt, ...) {
+	char message[SEMA_MESSAGE_SIZE];
+	va_list args;
+	va_start(args, fmt);
+	vsnprintf(message, sizeof(message), fmt, args);
+	va_end(args);
+
+	if(w->size == w->capacity) {
+		w->capacity = w->capacity ? w->capacity * 2 : SEMA_INITIAL_DIAGNOSTICS;
+		w->diagnostics = hatch_realloc(ALLOC_SEMANTIC, w->diagnostics, sizeof(sema_diagnostic) * w->capacity);
+	}
+	w->diagnostics[w->size] = (sema_diagnostic) { at->loc, w->body, w->size, w->index, w->messages->size };
+	w->size++;
+	emit(w->messages, message, strlen(message) + 1);
+}
+
+// Where an expression starts, for the diagnostics about it
+static token* _first_token(expr* e) {
+	while(e) {
+		switch(e->type) {
+			case ET_LITERAL:
+				return ((literal_expr*) e->data)->value;
+			case ET_UNARY:
+				e = ((unary_expr*) e->data)->right;
+				break;
+			case ET_BINARY:
+				e = ((binary_expr*) e->data)->left;
+				break;
+			case ET_GROUP:
+				e = ((group_expr*) e->data)->expr;
+				break;
+			case ET_ASSIGNMENT:
+				e = ((assignment_expr*) e->data)->lvalue;
+				break;
+			case ET_CALL:
+				e = ((call_expr*) e->data)->callee;
+				break;
+			case ET_SUBSCRIPT:
+				e = ((subscript_expr*) e->data)->array;
+				break;
+			case ET_SIZEOF:
+				e = ((sizeof_expr*) e->data)->expr;
+				break;
+		}
+	}
+	return NULL;
+}
+
+// Names after . and -> are never bound, so this is a plain name or nothing
+static symbol* _named(expr* e) {
+	return e && e->type == ET_LITERAL ? ((literal_expr*) e->data)->symbol : NULL;
+}
+
+static int _is_value(symbol* s) {
+	return s->kind == SYMBOL_VARIABLE || s->kind == SYMBOL_PARAMETER || s->kind == SYMBOL_MEMBER;
+}
+
+static int _is_const(symbol* s) {
+	spec_list* specs = ((decl*) s->declaration->data)->specifiers;
+	for(int i = 0; specs && i < specs->size; i++) {
+		if(specs->data[i] == CONST) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static sema_function* _function(sema_worker* w) {
+	return &w->functions[w->depth - 1];
+}
+
+static void _check_return(sema_worker* w, expr* value) {
+	fun_def* f = _function(w)->function;
+	canon_type* ret = f->ret_type ? f->ret_type->canonical : NULL;
+	if(ret == NULL || ret->kind == CK_UNRESOLVED) {
+		return;
+	}
+	int is_void = ret->kind == CK_BUILTIN && ret->builtin == VOID;
+	if(value && is_void) {
+		token* at = _first_token(value);
+		_error(w, at ? at : f->identifier, "void function '%s' returns a value", f->identifier->string_value);
+	} else if(value == NULL && !is_void) {
+		_error(w, f->identifier, "function '%s' returns no value in a return statement", f->identifier->string_value);
+	}
+}
+
+static void _check_call(sema_worker* w, call_expr* call) {
+	symbol* s = _named(call->callee);
+	if(s == NULL) {
+		return;
+	}
+	token* at = ((literal_expr*) call->callee->data)->value;
+	int count = call->args ? call->args->size : 0;
+
+	if(s->kind == SYMBOL_FUNCTION || s->kind == SYMBOL_METHOD) {
+		stmt_list* params = ((fun_def*) s->declaration->data)->params;
+		int max = params ? params->size : 0;
+		int min = 0;
+		for(int i = 0; i < max; i++) {
+			if(((decl*) params->data[i]->data)->initializer == NULL) {
+				min++;
+			}
+		}
+		if(count < min) {
+			_error(w, at, "too few arguments to %s '%s', expected %s%d, have %d", symbol_kind_name(s->kind), s->name,
+				min == max ? "" : "at least ", min, count);
+		} else if(count > max) {
+			_error(w, at, "too many arguments to %s '%s', expected %s%d, have %d", symbol_kind_name(s->kind), s->name,
+				min == max ? "" : "at most ", max, count);
+		}
+	} else if(_is_value(s) && s->type && s->type->kind != CK_POINTER && s->type->kind != CK_UNRESOLVED) {
+		_error(w, at, "called %s '%s' is neither a function nor a pointer", symbol_kind_name(s->kind), s->name);
+	}
+}
+
+static void _check_modified(sema_worker* w, expr* target, const char* action) {
+	symbol* s = _named(target);
+	if(s == NULL) {
+		return;
+	}
+	token* at = ((literal_expr*) target->data)->value;
+	if(!_is_value(s)) {
+		_error(w, at, "cannot %s %s '%s'", action, symbol_kind_name(s->kind), s->name);
+	} else if(s->type && s->type->kind != CK_POINTER && _is_const(s)) {
+		_error(w, at, "cannot %s constant %s '%s'", action, symbol_kind_name(s->kind), s->name);
+	}
+}
+
+static void _check_subscript(sema_worker* w, subscript_expr* e) {
+	symbol* s = _named(e->array);
+	if(s == NULL || !_is_value(s) || s->type == NULL) {
+		return;
+	}
+	if((s->type->kind == CK_BUILTIN && s->type->builtin != STR) || s->type->kind == CK_CLASS) {
+		_error(w, ((literal_expr*) e->array->data)->value,
+			"subscripted %s '%s' is neither an array nor a pointer", symbol_kind_name(s->kind), s->name);
+	}
+}
+
+static int _enter(void* ctx, enum syntax_node_kind kind, void* node) {
+	sema_worker* w = ctx;
+	if(kind == SN_TYPE) {
+		return VISIT_SKIP;
+	}
+	if(kind != SN_STMT) {
+		return VISIT_CONTINUE;
+	}
+
+	stmt* st = node;
+	switch(st->type) {
+		case ST_FUN_DEF:
+			if(w->depth == w->functions_capacity) {
+				w->functions_capacity = w->functions_capacity ? w->functions_capacity * 2 : SEMA_INITIAL_FUNCTIONS;
+				w->functions = hatch_realloc(ALLOC_SEMANTIC, w->functions, sizeof(sema_function) * w->functions_capacity);
+			}
+			w->functions[w->depth++] = (sema_function) { st->data, 0 };
+			break;
+		case ST_FOR:
+		case ST_WHILE:
+			_function(w)->loops++;
+			break;
+		case ST_RETURN:
+			_check_return(w, st->data);
+			break;
+		case ST_LOOP_CTRL:
+			if(_function(w)->loops == 0) {
+				token* t = st->data;
+				_error(w, t, "'%s' outside of a loop", lex_lexem_spelling(t->type));
+			}
+			break;
+		default:
+			break;
+	}
+	return VISIT_CONTINUE;
+}
+
+static int _leave(void* ctx, enum syntax_node_kind kind, void* node) {
+	sema_worker* w = ctx;
+	if(kind != SN_STMT) {
+		return VISIT_CONTINUE;
+	}
+	switch(((stmt*) node)->type) {
+		case ST_FUN_DEF:
+			w->depth--;
+			break;
+		case ST_FOR:
+		case ST_WHILE:
+			_function(w)->loops--;
+			break;
+		default:
+			break;
+	}
+	return VISIT_CONTINUE;
+}
+
+static int _visit_call(void* ctx, call_expr* e) {
+	_check_call(ctx, e);
+	return VISIT_CONTINUE;
+}
+
+static int _visit_subscript(void* ctx, subscript_expr* e) {
+	_check_subscript(ctx, e);
+	return VISIT_CONTINUE;
+}
+
+static int _visit_assignment(void* ctx, assignment_expr* e) {
+	_check_modified(ctx, e->lvalue, "assign to");
+	return VISIT_CONTINUE;
+}
+
+static int _visit_unary(void* ctx, unary_expr* e) {
+	if(e->op == DOUBLE_PLUS) {
+		_check_modified(ctx, e->right, "increment");
+	} else if(e->op == DOUBLE_MINUS) {
+		_check_modified(ctx, e->right, "decrement");
+	}
+	return VISIT_CONTINUE;
+}
+
+static const ast_visitor _check_visitor = {
+	.enter = _enter,
+	.leave = _leave,
+	.visit_call_expr = _visit_call,
+	.visit_subscript_expr = _visit_subscript,
+	.visit_assignment_expr = _visit_assignment,
+	.visit_unary_expr = _visit_unary,
+};
+
+static void _check_body(sema_worker* w, int task) {
+	resolve_bodies* bodies = &w->pool->bodies;
+	w->body = task;
+	resolve_function(w->res, bodies, task);
+	syntax_walk(SN_STMT, bodies->tasks[task].function, &_check_visitor, w);
+}
+
+static int _take(sema_worker* w) {
+	int task = -1;
+	pthread_mutex_lock(&w->lock);
+	if(w->front < w->back) {
+		task = w->front++;
+	}
+	pthread_mutex_unlock(&w->lock);
+	return task;
+}
+
+// No bodies are ever added, so once every other worker looked empty there is nothing
+// left to steal
+static int _steal(sema_worker* w) {
+	sema_pool* pool = w->pool;
+	for(int i = 1; i < pool->count; i++) {
+		sema_worker* victim = &pool->workers[(w->index + i) % pool->count];
+
+		pthread_mutex_lock(&victim->lock);
+		int begin = victim->front + (victim->back - victim->front) / 2;
+		int end = victim->back;
+		victim->back = begin;
+		pthread_mutex_unlock(&victim->lock);
+
+		if(begin < end) {
+			pthread_mutex_lock(&w->lock);
+			w->front = begin + 1;
+			w->back = end;
+			pthread_mutex_unlock(&w->lock);
+			return begin;
+		}
+	}
+	return -1;
+}
+
+static void* _work(void* arg) {
+	sema_worker* w = arg;
+	int task;
+	while((task = _take(w)) >= 0 || (task = _steal(w)) >= 0) {
+		_check_body(w, task);
+	}
+	return NULL;
+}
+
+// An admitted thread gives its admission back as soon as its share of the bodies is done
+static void* _work_admitted(void* arg) {
+	sema_worker* w = arg;
+	_work(w);
+	w->pool->admission->release();
+	return NULL;
+}
+
+static int _compare(const void* a, const void* b) {
+	const sema_diagnostic* x = a;
+	const sema_diagnostic* y = b;
+	if(x->body != y->body) {
+		return x->body < y->body ? -1 : 1;
+	}
+	return x->seq < y->seq ? -1 : x->seq > y->seq;
+}
+
+static int _report(sema_pool* pool, source_manager* sm) {
+	int total = 0;
+	for(int i = 0; i < pool->count; i++) {
+		total += pool->workers[i].size;
+	}
+	if(total == 0) {
+		return 0;
+	}
+
+	sema_diagnostic* all = hatch_malloc(ALLOC_SEMANTIC, sizeof(sema_diagnostic) * total);
+	int size = 0;
+	for(int i = 0; i < pool->count; i++) {
+		sema_worker* w = &pool->workers[i];
+		memcpy(all + size, w->diagnostics, sizeof(sema_diagnostic) * w->size);
+		size += w->size;
+	}
+	qsort(all, total, sizeof(sema_diagnostic), _compare);
+
+	for(int i = 0; i < total; i++) {
+		const char* message = pool->workers[all[i].worker].messages->data + all[i].offset;
+		source_error(sm, all[i].loc, "%s", message);
+	}
+	hatch_free(ALLOC_SEMANTIC, all);
+	return total;
+}
+
+int sema_check(resolution* r, syntax_tree* tree, source_manager* sm, int threads, const sema_admission* admission) {
+	sema_pool pool = { .admission = admission };
+	resolve_globals(r, tree, &pool.bodies);
+
+	int size = pool.bodies.size;
+	pool.count = threads < size ? threads : size;
+	if(pool.count < 1) {
+		pool.count = 1;
+	}
+	pool.workers = hatch_calloc(ALLOC_SEMANTIC, pool.count, sizeof(sema_worker));
+	for(int i = 0; i < pool.count; i++) {
+		sema_worker* w = &pool.workers[i];
+		w->pool = &pool;
+		w->index = i;
+		pthread_mutex_init(&w->lock, NULL);
+		w->front = (int) ((long long) size * i / pool.count);
+		w->back = (int) ((long long) size * (i + 1) / pool.count);
+		w->res = resolver_create(r);
+		w->messages = emitter_create_buffer();
+	}
+
+	// The caller is worker 0. A thread that fails to start or is not admitted leaves its
+	// bodies to be stolen, no further threads are tried after a refused admission.
+	pthread_t* ids = hatch_malloc(ALLOC_SEMANTIC, sizeof(pthread_t) * pool.count);
+	int* started = hatch_calloc(ALLOC_SEMANTIC, pool.count, sizeof(int));
+	for(int i = 1; i < pool.count; i++) {
+		if(admission == NULL) {
+			started[i] = pthread_create(&ids[i], NULL, _work, &pool.workers[i]) == 0;
+			continue;
+		}
+		if(admission->acquire()) {
+			break;
+		}
+		started[i] = pthread_create(&ids[i], NULL, _work_admitted, &pool.workers[i]) == 0;
+		if(!started[i]) {
+			admission->release();
+		}
+	}
+	_work(&pool.workers[0]);
+	for(int i = 1; i < pool.count; i++) {
+		if(started[i]) {
+			pthread_join(ids[i], NULL);
+		}
+	}
+	hatch_free(ALLOC_SEMANTIC, ids);
+	hatch_free(ALLOC_SEMANTIC, started);
+
+	for(int i = 0; i < pool.count; i++) {
+		resolver_finish(r, pool.workers[i].res);
+	}
+	type_table_layout(r->types);
+
+	int errors = _report(&pool, sm);
+
+	for(int i = 0; i < pool.count; i++) {
+		sema_worker* w = &pool.workers[i];
+		pthread_mutex_destroy(&w->lock);
+		emitter_free(w->messages);
+		hatch_free(ALLOC_SEMANTIC, w->functions);
+		hatch_free(ALLOC_SEMANTIC, w->diagnostics);
+	}
+	hatch_free(ALLOC_SEMANTIC, pool.workers);
+	resolve_bodies_free(&pool.bodies);
+	return errors;
+}
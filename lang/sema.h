@@ -0,0 +1,26 @@
+#ifndef _SEMA_H
+#define _SEMA_H
+
+#include "resolve.h"
+#include "source.h"
+#include "syntax.h"
+
+// Admits the check threads beyond the caller's: acquire is asked before each one
+// starts and refuses it with nonzero, release is called once by every admitted
+// thread when it finishes
+typedef struct {
+	int  (*acquire)();
+	void (*release)();
+} sema_admission;
+
+// Resolves tree into r like resolve_tree and checks the bodies of its functions:
+// break and continue outside loops, returns that don't match a void or non-void
+// function, calls with the wrong number of arguments or of something that is no
+// function, assignments to functions, types and constants, and subscripts of values
+// that are neither arrays nor pointers. Bodies are spread over up to threads threads,
+// the diagnostics come out in the order of the bodies in the source whatever the count.
+// With an admission only the threads it admits are started, NULL starts all of them.
+// Returns the number of errors.
+int sema_check(resolution* r, syntax_tree* tree, source_manager* sm, int threads, const sema_admission* admission);
+
+#endif
@@ -0,0 +1,460 @@
+#define _GNU_SOURCE
+#include "server.h"
+#include "file.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+extern char** environ;
+
+static volatile sig_atomic_t _stopping = 0;
+
+static void _stop(int sig) {
+	(void) sig;
+	_stopping = 1;
+}
+
+// Without a runtime directory the socket goes into a directory of its own in /tmp,
+// server_run creates it
+const char* server_default_path() {
+	static char path[PATH_MAX];
+	const char* env = getenv("HATCH_SERVER");
+	if(env && *env) {
+		return env;
+	}
+	const char* runtime = getenv("XDG_RUNTIME_DIR");
+	if(runtime && *runtime) {
+		snprintf(path, sizeof(path), "%s/hatch.sock", runtime);
+	} else {
+		snprintf(path, sizeof(path), "/tmp/hatch-%d/server.sock", (int) getuid());
+	}
+	return path;
+}
+
+// Anyone who can write to the directory of the socket could replace it, so it has to
+// belong to us and be closed to everyone else. A missing one is created that way.
+static int _private_directory(const char* path) {
+	char dir[PATH_MAX];
+	const char* slash = strrchr(path, '/');
+	if(slash == NULL) {
+		slash = path;
+		strcpy(dir, ".");
+	} else if(slash == path) {
+		strcpy(dir, "/");
+	} else {
+		snprintf(dir, sizeof(dir), "%.*s", (int) (slash - path), path);
+	}
+
+	if(mkdir(dir, 0700) < 0 && errno != EEXIST) {
+		perror("Error creating socket directory");
+		return 1;
+	}
+	struct stat st;
+	if(lstat(dir, &st) < 0) {
+		perror("Error checking socket directory");
+		return 1;
+	}
+	if(!S_ISDIR(st.st_mode) || st.st_uid != geteuid() || (st.st_mode & 077)) {
+		fprintf(stderr, "Socket directory %s must be owned by the user and accessible only to them\n", dir);
+		return 1;
+	}
+	return 0;
+}
+
+// Requests run with the server's rights, so only the user who started it may send them
+static int _same_user(int fd) {
+	struct ucred cred;
+	socklen_t size = sizeof(cred);
+	return getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &size) == 0 && cred.uid == geteuid();
+}
+
+static int _write_all(int fd, const void* data, size_t size) {
+	const char* p = data;
+	while(size) {
+		ssize_t w = write(fd, p, size);
+		if(w < 0 && errno == EINTR) {
+			continue;
+		}
+		if(w <= 0) {
+			return 1;
+		}
+		p += w;
+		size -= w;
+	}
+	return 0;
+}
+
+static int _read_all(int fd, void* data, size_t size) {
+	char* p = data;
+	while(size) {
+		ssize_t r = read(fd, p, size);
+		if(r < 0 && errno == EINTR) {
+			continue;
+		}
+		if(r <= 0) {
+			return 1;
+		}
+		p += r;
+		size -= r;
+	}
+	return 0;
+}
+
+static int _address(const char* path, struct sockaddr_un* addr) {
+	memset(addr, 0, sizeof(*addr));
+	addr->sun_family = AF_UNIX;
+	if(strlen(path) >= sizeof(addr->sun_path)) {
+		fprintf(stderr, "Socket path too long: %s\n", path);
+		return 1;
+	}
+	strcpy(addr->sun_path, path);
+	return 0;
+}
+
+// Request layout: u32 body size (sent together with the stdout/stderr descriptors),
+// then u32 argc, argv, cwd, u32 envc, environment. Strings are u32 length + bytes including the NUL.
+
+static void _put_u32(FILE* f, uint32_t v) {
+	fwrite(&v, sizeof(v), 1, f);
+}
+
+static void _put_string(FILE* f, const char* s) {
+	uint32_t length = strlen(s) + 1;
+	_put_u32(f, length);
+	fwrite(s, 1, length, f);
+}
+
+static int _get_u32(char** cursor, char* end, uint32_t* v) {
+	if(end - *cursor < (long) sizeof(uint32_t)) {
+		return 1;
+	}
+	memcpy(v, *cursor, sizeof(uint32_t));
+	*cursor += sizeof(uint32_t);
+	return 0;
+}
+
+static const char* _get_string(char** cursor, char* end) {
+	uint32_t length;
+	if(_get_u32(cursor, end, &length) || length == 0 || end - *cursor < (long) length) {
+		return NULL;
+	}
+	const char* s = *cursor;
+	if(s[length - 1] != '\0') {
+		return NULL;
+	}
+	*cursor += length;
+	return s;
+}
+
+static int _send_header(int fd, uint32_t size, int* fds, int fds_amount) {
+	struct iovec iov = { .iov_base = &size, .iov_len = sizeof(size) };
+	char control[CMSG_SPACE(sizeof(int) * 2)];
+	memset(control, 0, sizeof(control));
+
+	struct msghdr msg = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = control,
+		.msg_controllen = CMSG_SPACE(sizeof(int) * fds_amount)
+	};
+
+	struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fds_amount);
+	memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * fds_amount);
+
+	return sendmsg(fd, &msg, 0) != sizeof(size);
+}
+
+static int _receive_header(int fd, uint32_t* size, int* fds, int fds_amount) {
+	struct iovec iov = { .iov_base = size, .iov_len = sizeof(*size) };
+	char control[CMSG_SPACE(sizeof(int) * 2)];
+
+	struct msghdr msg = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = control,
+		.msg_controllen = sizeof(control)
+	};
+
+	if(recvmsg(fd, &msg, MSG_CMSG_CLOEXEC) != sizeof(*size)) {
+		return 1;
+	}
+
+	struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+	if(cmsg == NULL || cmsg->cmsg_type != SCM_RIGHTS || cmsg->cmsg_len != CMSG_LEN(sizeof(int) * fds_amount)) {
+		return 1;
+	}
+	memcpy(fds, CMSG_DATA(cmsg), sizeof(int) * fds_amount);
+
+	return 0;
+}
+
+int client_run(const char* path, int argc, const char** argv) {
+	struct sockaddr_un addr;
+	if(_address(path, &addr)) {
+		return -1;
+	}
+
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if(fd < 0) {
+		return -1;
+	}
+	if(connect(fd, (struct sockaddr*) &addr, sizeof(addr)) < 0 || !_same_user(fd)) {
+		close(fd);
+		return -1;
+	}
+
+	char* cwd = getcwd(NULL, 0);
+	if(cwd == NULL) {
+		close(fd);
+		return -1;
+	}
+
+	char* body = NULL;
+	size_t size = 0;
+	FILE* f = open_memstream(&body, &size);
+
+	_put_u32(f, argc);
+	for(int i = 0; i < argc; i++) {
+		_put_string(f, argv[i]);
+	}
+	_put_string(f, cwd);
+
+	uint32_t envc = 0;
+	while(environ[envc]) {
+		envc++;
+	}
+	_put_u32(f, envc);
+	for(uint32_t i = 0; i < envc; i++) {
+		_put_string(f, environ[i]);
+	}
+
+	fclose(f);
+	free(cwd);
+
+	fflush(stdout);
+	fflush(stderr);
+
+	int fds[2] = { STDOUT_FILENO, STDERR_FILENO };
+	if(_send_header(fd, size, fds, 2) || _write_all(fd, body, size)) {
+		free(body);
+		close(fd);
+		return -1;
+	}
+	free(body);
+
+	int32_t code;
+	if(_read_all(fd, &code, sizeof(code))) {
+		fprintf(stderr, "Compile server closed the connection\n");
+		code = 1;
+	}
+
+	close(fd);
+
+	return code;
+}
+
+// A jobserver passed as inherited descriptors belongs to the client process, not to us
+static void _strip_jobserver() {
+	const char* flags = getenv("MAKEFLAGS");
+	if(flags == NULL) {
+		return;
+	}
+	if(strstr(flags, "--jobserver-fds=") || (strstr(flags, "--jobserver-auth=") && !strstr(flags, "fifo:"))) {
+		unsetenv("MAKEFLAGS");
+	}
+}
+
+static void _serve(int conn, int report, server_handler handler) {
+	signal(SIGINT, SIG_DFL);
+	signal(SIGTERM, SIG_DFL);
+	signal(SIGPIPE, SIG_DFL);
+	signal(SIGCHLD, SIG_DFL);
+
+	uint32_t size;
+	int fds[2];
+	if(_receive_header(conn, &size, fds, 2)) {
+		exit(1);
+	}
+
+	char* body = malloc(size);
+	if(_read_all(conn, body, size)) {
+		exit(1);
+	}
+
+	char* cursor = body;
+	char* end = body + size;
+
+	uint32_t argc;
+	if(_get_u32(&cursor, end, &argc) || argc > size) {
+		exit(1);
+	}
+	const char** argv = calloc(argc + 1, sizeof(char*));
+	for(uint32_t i = 0; i < argc; i++) {
+		if((argv[i] = _get_string(&cursor, end)) == NULL) {
+			exit(1);
+		}
+	}
+
+	const char* cwd = _get_string(&cursor, end);
+	uint32_t envc;
+	if(cwd == NULL || _get_u32(&cursor, end, &envc)) {
+		exit(1);
+	}
+
+	clearenv();
+	for(uint32_t i = 0; i < envc; i++) {
+		const char* var = _get_string(&cursor, end);
+		if(var == NULL) {
+			exit(1);
+		}
+		putenv((char*) var);
+	}
+	_strip_jobserver();
+
+	dup2(fds[0], STDOUT_FILENO);
+	dup2(fds[1], STDERR_FILENO);
+	close(fds[0]);
+	close(fds[1]);
+
+	int32_t code = 1;
+	if(chdir(cwd) < 0) {
+		perror("Error changing directory");
+	} else {
+		file_cache_track(report);
+		code = handler(argc, argv);
+	}
+
+	fflush(stdout);
+	fflush(stderr);
+
+	_write_all(conn, &code, sizeof(code));
+
+	exit(code);
+}
+
+static void _read_reports(int fd, char* pending, int* pending_size) {
+	ssize_t r = read(fd, pending + *pending_size, PIPE_BUF * 2 - *pending_size);
+	if(r <= 0) {
+		return;
+	}
+	*pending_size += r;
+
+	char* line = pending;
+	char* newline;
+	while((newline = memchr(line, '\n', pending + *pending_size - line))) {
+		*newline = '\0';
+		file_cache_insert(line);
+		line = newline + 1;
+	}
+
+	*pending_size -= line - pending;
+	memmove(pending, line, *pending_size);
+}
+
+int server_run(const char* path, server_handler handler) {
+	struct sockaddr_un addr;
+	if(_address(path, &addr)) {
+		return 1;
+	}
+
+	if(_private_directory(path)) {
+		return 1;
+	}
+
+	int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if(listener < 0) {
+		perror("Error creating socket");
+		return 1;
+	}
+
+	unlink(path);
+	if(bind(listener, (struct sockaddr*) &addr, sizeof(addr)) < 0 || listen(listener, SOMAXCONN) < 0) {
+		perror("Error binding socket");
+		close(listener);
+		return 1;
+	}
+
+	int report[2];
+	if(pipe2(report, O_CLOEXEC) < 0) {
+		perror("Error creating pipe");
+		close(listener);
+		unlink(path);
+		return 1;
+	}
+
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = _stop;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	signal(SIGPIPE, SIG_IGN);
+	signal(SIGCHLD, SIG_IGN);
+
+	// Every request runs in a child forked from this process, so the tables built before
+	// server_run and the headers mapped into the file cache are inherited without copying.
+	// Children report the files they had to map themselves and the cache picks them up.
+	char pending[PIPE_BUF * 2];
+	int pending_size = 0;
+
+	while(!_stopping) {
+		struct pollfd fds[2] = {
+			{ .fd = listener,  .events = POLLIN },
+			{ .fd = report[0], .events = POLLIN }
+		};
+
+		if(poll(fds, 2, -1) < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+			perror("Error waiting for requests");
+			break;
+		}
+
+		if(fds[1].revents & POLLIN) {
+			_read_reports(report[0], pending, &pending_size);
+		}
+
+		if(fds[0].revents & POLLIN) {
+			int conn = accept4(listener, NULL, NULL, SOCK_CLOEXEC);
+			if(conn < 0) {
+				continue;
+			}
+			if(!_same_user(conn)) {
+				close(conn);
+				continue;
+			}
+
+			pid_t pid = fork();
+			if(pid == 0) {
+				close(listener);
+				close(report[0]);
+				_serve(conn, report[1], handler);
+			} else if(pid < 0) {
+				perror("Error forking request handler");
+			}
+
+			close(conn);
+		}
+	}
+
+	close(listener);
+	close(report[0]);
+	close(report[1]);
+	unlink(path);
+
+	return 0;
+}
@@ -0,0 +1,10 @@
+#ifndef _SERVER_H
+#define _SERVER_H
+
+typedef int (*server_handler)(int argc, const char** argv);
+
+const char* server_default_path();
+int server_run(const char* path, server_handler handler);
+int client_run(const char* path, int argc, const char** argv);
+
+#endif
@@ -0,0 +1,268 @@
+#include "source.h"
+#include "file.h"
+#include "map.h"
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+MAP_IMPL(virtual_files, const char*, virtual_file, builtin_string_hash, builtin_string_comparator)
+
+source_manager* source_manager_create() {
+	source_manager* sm = calloc(1, sizeof(source_manager));
+	sm->next = SOURCE_LOC_INVALID + 1;
+	sm->diagnostics = stderr;
+	return sm;
+}
+
+void source_manager_free(source_manager* sm) {
+	for(int i = 0; i < sm->size; i++) {
+		source_entry* e = sm->entries[i];
+		if(e->mapped) {
+			file_unmap(e->data, e->size);
+		}
+		free(e->name);
+		free(e->lines);
+		free(e->marks);
+		free(e);
+	}
+	free(sm->entries);
+	free(sm);
+}
+
+// Reports running out of locations at parent and returns NULL
+static source_entry* _add_entry(source_manager* sm, enum source_kind kind, const char* name, int size, source_loc parent) {
+	if((uint64_t) sm->next + size + 1 > UINT32_MAX) {
+		source_error(sm, parent, "source location space exhausted at %s", name);
+		return NULL;
+	}
+
+	if(sm->size == sm->capacity) {
+		sm->capacity = sm->capacity ? sm->capacity * 2 : 16;
+		sm->entries = realloc(sm->entries, sizeof(source_entry*) * sm->capacity);
+	}
+
+	source_entry* e = calloc(1, sizeof(source_entry));
+	e->kind = kind;
+	e->base = sm->next;
+	e->size = size;
+	e->name = strdup(name);
+
+	sm->entries[sm->size] = e;
+	sm->size++;
+	sm->next += size + 1;
+
+	return e;
+}
+
+source_entry* source_add_buffer(source_manager* sm, const char* path, const char* data, int size, source_loc included_from) {
+	source_entry* e = _add_entry(sm, SOURCE_FILE, path, size, included_from);
+	if(e == NULL) {
+		return NULL;
+	}
+	e->data = data;
+	e->parent = included_from;
+	return e;
+}
+
+int source_file_exists(source_manager* sm, const char* path) {
+	return (sm->files && virtual_files_map_contains(sm->files, path)) || file_exists(path);
+}
+
+int source_load_file(source_manager* sm, const char* path, source_loc included_from, source_entry** result) {
+	const char* data = NULL;
+	size_t size = 0;
+
+	virtual_file* v = sm->files ? virtual_files_map_get(sm->files, path) : NULL;
+	if(v) {
+		*result = source_add_buffer(sm, path, v->data, v->size, included_from);
+		return *result == NULL;
+	}
+
+	int cached = file_cache_lookup(path, &data, &size) == 0;
+
+	if(!cached) {
+		int error = file_map(path, &data, &size);
+		if(error) {
+			source_error(sm, included_from, "cannot read %s: %s", path, strerror(error));
+			return 1;
+		}
+		file_cache_note(path);
+	}
+
+	source_entry* e = source_add_buffer(sm, path, data, size, included_from);
+	if(e == NULL) {
+		if(!cached) {
+			file_unmap(data, size);
+		}
+		return 1;
+	}
+	e->mapped = !cached;
+
+	*result = e;
+
+	return 0;
+}
+
+source_entry* source_add_expansion(source_manager* sm, const char* name, int size, source_loc spelling, source_loc expanded_at) {
+	source_entry* e = _add_entry(sm, SOURCE_EXPANSION, name, size, expanded_at);
+	if(e == NULL) {
+		return NULL;
+	}
+	e->spelling = spelling;
+	e->parent = expanded_at;
+	return e;
+}
+
+source_entry* source_lookup(source_manager* sm, source_loc loc) {
+	int lo = 0;
+	int hi = sm->size - 1;
+
+	while(lo <= hi) {
+		int mid = (lo + hi) / 2;
+		source_entry* e = sm->entries[mid];
+		if(loc < e->base) {
+			hi = mid - 1;
+		} else if(loc > e->base + e->size) {
+			lo = mid + 1;
+		} else {
+			return e;
+		}
+	}
+
+	return NULL;
+}
+
+static void _build_lines(source_entry* e) {
+	int capacity = 64;
+	e->lines = malloc(sizeof(int) * capacity);
+	e->lines[0] = 0;
+	e->lines_amount = 1;
+
+	const char* p = e->data;
+	const char* end = e->data + e->size;
+	while((p = memchr(p, '\n', end - p))) {
+		p++;
+		if(e->lines_amount == capacity) {
+			capacity *= 2;
+			e->lines = realloc(e->lines, sizeof(int) * capacity);
+		}
+		e->lines[e->lines_amount] = p - e->data;
+		e->lines_amount++;
+	}
+}
+
+static int _line_index(source_entry* e, int offset) {
+	if(e->lines == NULL) {
+		_build_lines(e);
+	}
+
+	int lo = 0;
+	int hi = e->lines_amount - 1;
+
+	while(lo < hi) {
+		int mid = (lo + hi + 1) / 2;
+		if(e->lines[mid] <= offset) {
+			lo = mid;
+		} else {
+			hi = mid - 1;
+		}
+	}
+
+	return lo;
+}
+
+void source_add_line_mark(source_manager* sm, source_loc loc, int line) {
+	source_entry* e = source_lookup(sm, loc);
+	if(e == NULL || e->kind != SOURCE_FILE) {
+		return;
+	}
+
+	if(e->marks_amount == e->marks_capacity) {
+		e->marks_capacity = e->marks_capacity ? e->marks_capacity * 2 : 4;
+		e->marks = realloc(e->marks, sizeof(line_mark) * e->marks_capacity);
+	}
+
+	e->marks[e->marks_amount].offset = loc - e->base;
+	e->marks[e->marks_amount].line = line;
+	e->marks_amount++;
+}
+
+source_position source_resolve(source_manager* sm, source_loc loc) {
+	source_position p = { .path = NULL, .line = 0, .column = 0 };
+	source_entry* e = source_lookup(sm, loc);
+
+	while(e && e->kind == SOURCE_EXPANSION) {
+		loc = e->parent;
+		e = source_lookup(sm, loc);
+	}
+
+	if(e == NULL) {
+		return p;
+	}
+
+	int offset = loc - e->base;
+	int index = _line_index(e, offset);
+
+	p.path = e->name;
+	p.line = index + 1;
+	p.column = offset - e->lines[index] + 1;
+
+	for(int i = e->marks_amount - 1; i >= 0; i--) {
+		if(e->marks[i].offset <= offset) {
+			p.line = e->marks[i].line + index - _line_index(e, e->marks[i].offset);
+			break;
+		}
+	}
+
+	return p;
+}
+
+static void _report(source_manager* sm, source_position p, const char* level, const char* message) {
+	if(sm->handler) {
+		sm->handler(sm->handler_ctx, p, level, message);
+		return;
+	}
+
+	if(p.path) {
+		fprintf(sm->diagnostics, "%s:%d:%d: ", p.path, p.line, p.column);
+	}
+	fprintf(sm->diagnostics, "%s: %s\n", level, message);
+}
+
+void source_diagnostic(source_manager* sm, source_loc loc, const char* level, const char* fmt, ...) {
+	char buffer[1024];
+	char* message = buffer;
+
+	va_list args;
+	va_start(args, fmt);
+	int length = vsnprintf(buffer, sizeof(buffer), fmt, args);
+	va_end(args);
+
+	if(length >= (int) sizeof(buffer)) {
+		message = malloc(length + 1);
+		va_start(args, fmt);
+		vsnprintf(message, length + 1, fmt, args);
+		va_end(args);
+	}
+
+	_report(sm, source_resolve(sm, loc), level, message);
+
+	if(message != buffer) {
+		free(message);
+	}
+
+	source_entry* e = source_lookup(sm, loc);
+
+	while(e && e->kind == SOURCE_EXPANSION) {
+		snprintf(buffer, sizeof(buffer), "expanded from macro '%s'", e->name);
+		_report(sm, source_resolve(sm, e->spelling + (loc - e->base)), "note", buffer);
+		loc = e->parent;
+		e = source_lookup(sm, loc);
+	}
+
+	while(e && e->parent != SOURCE_LOC_INVALID) {
+		_report(sm, source_resolve(sm, e->parent), "note", "included from here");
+		e = source_lookup(sm, e->parent);
+	}
+}
@@ -0,0 +1,86 @@
+#ifndef _SOURCE_H
+#define _SOURCE_H
+
+#include "map.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+typedef uint32_t source_loc;
+
+#define SOURCE_LOC_INVALID 0
+
+enum source_kind {
+	SOURCE_FILE,
+	SOURCE_EXPANSION
+};
+
+typedef struct {
+	int offset;
+	int line;
+} line_mark;
+
+typedef struct {
+	enum source_kind kind;
+	source_loc base;
+	int size;
+	const char* data;
+	char* name;
+	int mapped;
+	source_loc parent;
+	source_loc spelling;
+	int* lines;
+	int  lines_amount;
+	line_mark* marks;
+	int  marks_amount;
+	int  marks_capacity;
+} source_entry;
+
+typedef struct {
+	const char* data;
+	size_t size;
+} virtual_file;
+
+DEFINE_MAP_TYPE(virtual_files, const char*, virtual_file)
+
+typedef struct {
+	const char* path;
+	int line;
+	int column;
+} source_position;
+
+typedef void (*diagnostic_handler)(void* ctx, source_position position, const char* level, const char* message);
+
+typedef struct {
+	source_entry** entries;
+	int size;
+	int capacity;
+	source_loc next;
+	FILE* diagnostics;
+	diagnostic_handler handler;
+	void* handler_ctx;
+	virtual_files_map* files;
+} source_manager;
+
+source_manager* source_manager_create();
+void source_manager_free(source_manager* sm);
+
+// These report their failures as diagnostics at included_from or expanded_at: files
+// that can't be read and running out of locations, where the add functions return NULL
+int source_load_file(source_manager* sm, const char* path, source_loc included_from, source_entry** result);
+int source_file_exists(source_manager* sm, const char* path);
+source_entry* source_add_buffer(source_manager* sm, const char* path, const char* data, int size, source_loc included_from);
+source_entry* source_add_expansion(source_manager* sm, const char* name, int size, source_loc spelling, source_loc expanded_at);
+void source_add_line_mark(source_manager* sm, source_loc loc, int line);
+
+source_entry* source_lookup(source_manager* sm, source_loc loc);
+source_position source_resolve(source_manager* sm, source_loc loc);
+
+void source_diagnostic(source_manager* sm, source_loc loc, const char* level, const char* fmt, ...)
+	__attribute__((format(printf, 4, 5)));
+
+#define source_error(sm, loc, ...)   source_diagnostic(sm, loc, "error", __VA_ARGS__)
+#define source_warning(sm, loc, ...) source_diagnostic(sm, loc, "warning", __VA_ARGS__)
+
+#endif
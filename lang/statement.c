@@ -8,318 +8,508 @@
 #include "util.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include "alloc.h"
 
-static stmt* _make_statement(enum stmt_type type, void* data) {
-	stmt* st = malloc(sizeof(stmt));
+static stmt* _make_statement(parser* p, enum stmt_type type, void* data) {
+	stmt* st = syntax_alloc(p, sizeof(stmt));
 	st->type = type;
 	st->data = data;
 	return st;
 }
 
-static stmt* _make_block_statement(stmt_list* stmts) {
-	return _make_statement(ST_BLOCK, stmts);
+static stmt* _make_block_statement(parser* p, stmt_list* stmts) {
+	SYNTAX_NODE_END(p, SN_STMT, ST_BLOCK, NULL)
+	return _make_statement(p, ST_BLOCK, stmts);
 }
 
-static stmt* _make_expr_statement(expr* e) {
-	return _make_statement(ST_EXPRESSION, e);
+static stmt* _make_expr_statement(parser* p, expr* e) {
+	SYNTAX_NODE_END(p, SN_STMT, ST_EXPRESSION, NULL)
+	return _make_statement(p, ST_EXPRESSION, e);
 }
 
-static stmt* _make_ret_statement(expr* e) {
-	return _make_statement(ST_RETURN, e);
+static stmt* _make_ret_statement(parser* p, expr* e) {
+	SYNTAX_NODE_END(p, SN_STMT, ST_RETURN, NULL)
+	return _make_statement(p, ST_RETURN, e);
 }
 
-static stmt* _make_decl_statement(spec_list* specs, type_info* type, token* ident, expr* initializer) {
-	decl* d = malloc(sizeof(decl));
+static stmt* _make_decl_statement(parser* p, spec_list* specs, type_info* type, token* ident, expr* initializer) {
+	SYNTAX_NODE_END(p, SN_STMT, ST_DECL, ident)
+	decl* d = syntax_alloc(p, sizeof(decl));
 	d->specifiers = specs;
 	d->type = type;
 	d->identifier = ident;
 	d->initializer = initializer;
-	return _make_statement(ST_DECL, d);
+	return _make_statement(p, ST_DECL, d);
 }
-static stmt* _make_fun_def_statement(spec_list* specs, type_info* type, token* ident, stmt_list* args, stmt* body) {
-	fun_def* d = malloc(sizeof(fun_def));
+
+static stmt* _make_fun_def_statement(parser* p, spec_list* specs, type_info* type, token* ident, stmt_list* args, stmt* body, int lazy_begin) {
+	SYNTAX_NODE_END(p, SN_STMT, ST_FUN_DEF, ident)
+	fun_def* d = syntax_alloc(p, sizeof(fun_def));
 	d->specifiers = specs;
 	d->ret_type = type;
 	d->identifier = ident;
 	d->params = args;
 	d->body = body;
-	return _make_statement(ST_FUN_DEF, d);
+	d->lazy_tokens = lazy_begin < 0 ? NULL : p->tokens;
+	d->lazy_begin = lazy_begin;
+	return _make_statement(p, ST_FUN_DEF, d);
 }
 
-static stmt* _make_if_statement(expr* cond, stmt* body, stmt* branch) {
-	conditional* c = malloc(sizeof(conditional));
+static stmt* _make_if_statement(parser* p, expr* cond, stmt* body, stmt* branch) {
+	SYNTAX_NODE_END(p, SN_STMT, ST_IF, NULL)
+	conditional* c = syntax_alloc(p, sizeof(conditional));
 	c->condition = cond;
 	c->body = body;
 	c->branch = branch;
-	return _make_statement(ST_IF, c);
+	return _make_statement(p, ST_IF, c);
 }
 
-static stmt* _make_for_statement(stmt* initializer, expr* condition, expr* increment, stmt* body) {
-	for_loop* c = malloc(sizeof(for_loop));
+static stmt* _make_for_statement(parser* p, stmt* initializer, expr* condition, expr* increment, stmt* body) {
+	SYNTAX_NODE_END(p, SN_STMT, ST_FOR, NULL)
+	for_loop* c = syntax_alloc(p, sizeof(for_loop));
 	c->initializer = initializer;
 	c->condition = condition;
 	c->increment = increment;
 	c->body = body;
-	return _make_statement(ST_FOR, c);
+	return _make_statement(p, ST_FOR, c);
 }
 
-static stmt* _make_while_statement(expr* cond, stmt* body, int prefix) {
-	while_loop* c = malloc(sizeof(while_loop));
+static stmt* _make_while_statement(parser* p, expr* cond, stmt* body, int prefix) {
+	SYNTAX_NODE_END(p, SN_STMT, ST_WHILE, NULL)
+	while_loop* c = syntax_alloc(p, sizeof(while_loop));
 	c->condition = cond;
 	c->body = body;
 	c->prefix = prefix;
-	return _make_statement(ST_WHILE, c);
+	return _make_statement(p, ST_WHILE, c);
 }
 
-static stmt* _make_loop_ctrl_statement(token* t) {
-	return _make_statement(ST_LOOP_CTRL, t);
+static stmt* _make_loop_ctrl_statement(parser* p, token* t) {
+	SYNTAX_NODE_END(p, SN_STMT, ST_LOOP_CTRL, NULL)
+	return _make_statement(p, ST_LOOP_CTRL, t);
 }
 
-static stmt* _make_class_statement(class_info* ci) {
-	return _make_statement(ST_CLASS, ci);
+// class() already reported the class, it needs the name
+static stmt* _make_class_statement(parser* p, class_info* ci) {
+	if(!syntax_building(p)) {
+		return SYNTAX_EVENT_NODE;
+	}
+	return _make_statement(p, ST_CLASS, ci);
 }
 
-stmt* statement(token_stream* s) {
-	if(syntax_match_token(s, FOR)) {
-		return for_stmt(s);
-	} else if (syntax_match_token(s, IF)) {
-		return if_stmt(s);
-	} else if (syntax_match_tokens(s, 2, DO, WHILE)) {
-		return while_stmt(s);
-	} else if (syntax_match_token(s, RETURN)) {
-		return return_stmt(s);
-	} else if (syntax_match_tokens(s, 2, CONTINUE, BREAK)) {
-		return loop_flow_stmt(s);
-	} else if (syntax_match_token(s, LBRACE)) {
-		return block(s);
-	} else if (syntax_match_token(s, TYPEDEF)) {
-		return type_def(s);
+static spec_list* _specifiers(parser* p) {
+	spec_list* l = syntax_building(p) ? syntax_track_list(p, spec_list_create()) : NULL;
+	token* tok = NULL;
+
+	while((tok = match_spec(p))) {
+		if(l) {
+			spec_list_append(l, tok->type);
+		}
+	}
+
+	return l;
+}
+
+static stmt* _statement(parser* p) {
+	if(syntax_match_token(p, FOR)) {
+		return for_stmt(p);
+	} else if (syntax_match_token(p, IF)) {
+		return if_stmt(p);
+	} else if (syntax_match_tokens(p, 2, DO, WHILE)) {
+		return while_stmt(p);
+	} else if (syntax_match_token(p, RETURN)) {
+		return return_stmt(p);
+	} else if (syntax_match_tokens(p, 2, CONTINUE, BREAK)) {
+		return loop_flow_stmt(p);
+	} else if (syntax_match_token(p, LBRACE)) {
+		return block(p);
+	} else if (syntax_match_token(p, TYPEDEF)) {
+		return type_def(p);
 	} else {
-		return expr_statement(s);
+		return expr_statement(p);
 	}
 }
 
-stmt* expr_statement(token_stream* s) {
-	expr* e = expression(s);
-	syntax_consume_token(s, SEMILOCON, "';' required after expression statement");
-	return _make_expr_statement(e);	
+stmt* statement(parser* p) {
+	SYNTAX_RULE(p);
+	syntax_descend(p);
+	stmt* s = _statement(p);
+	syntax_ascend(p);
+	return s;
+}
+
+stmt* expr_statement(parser* p) {
+	SYNTAX_RULE(p);
+	syntax_begin(p, SN_STMT, ST_EXPRESSION, syntax_current(p));
+	expr* e = expression(p);
+	syntax_consume_token(p, SEMILOCON, "';' required after expression statement");
+	return _make_expr_statement(p, e);	
 }
 
-stmt* block(token_stream* s) {
-	stmt_list* l = stmt_list_create();
-	while(!syntax_match_token(s, RBRACE)) {
-		stmt_list_append(l, declaration(s));
+stmt* block(parser* p) {
+	SYNTAX_RULE(p);
+	syntax_begin(p, SN_STMT, ST_BLOCK, syntax_previous(p));
+	stmt_list* l = syntax_building(p) ? syntax_track_list(p, stmt_list_create()) : NULL;
+	while(!syntax_match_token(p, RBRACE)) {
+		stmt* s = declaration(p);
+		if(l) {
+			stmt_list_append(l, s);
+		}
 	}
-	return _make_block_statement(l);
+	return _make_block_statement(p, l);
 }
 
-stmt* if_stmt(token_stream* s) {
-	syntax_consume_token(s, LPAREN, "'(' expected before if expression");
-	expr* condition = expression(s);
-	syntax_consume_token(s, RPAREN, "')' expected after if expression");
+stmt* if_stmt(parser* p) {
+	SYNTAX_RULE(p);
+	syntax_begin(p, SN_STMT, ST_IF, syntax_previous(p));
+	syntax_consume_token(p, LPAREN, "'(' expected before if expression");
+	expr* condition = expression(p);
+	syntax_consume_token(p, RPAREN, "')' expected after if expression");
 
-	stmt* body = statement(s);
+	stmt* body = statement(p);
 	stmt* branch = NULL;
 
-	if(syntax_match_token(s, ELSE)) {
-		branch = statement(s);
+	if(syntax_match_token(p, ELSE)) {
+		branch = statement(p);
 	}
 
-	return _make_if_statement(condition, body, branch);
+	return _make_if_statement(p, condition, body, branch);
 }
 
-stmt* for_stmt(token_stream* s) {
-	syntax_consume_token(s, LPAREN, "'(' exprected after for");
+stmt* for_stmt(parser* p) {
+	SYNTAX_RULE(p);
+	syntax_begin(p, SN_STMT, ST_FOR, syntax_previous(p));
+	syntax_consume_token(p, LPAREN, "'(' exprected after for");
 
 	stmt* initializer = NULL;
 	expr* condition = NULL;
 	expr* increment = NULL;
 
-	if(!syntax_match_token(s, SEMILOCON)) {
-		if(syntax_check_token(s, LET)) {
-			initializer = declaration(s);
+	if(!syntax_match_token(p, SEMILOCON)) {
+		if(syntax_check_token(p, LET)) {
+			initializer = declaration(p);
 		} else {
-			initializer = expr_statement(s);
+			initializer = expr_statement(p);
 		}
 	}
 
-	if(!syntax_match_token(s, SEMILOCON)) {
-		condition = expression(s);
-		syntax_consume_token(s, SEMILOCON, "';' required after condition");
+	if(!syntax_match_token(p, SEMILOCON)) {
+		condition = expression(p);
+		syntax_consume_token(p, SEMILOCON, "';' required after condition");
 	}
 
-	if(!syntax_match_token(s, RPAREN)) {
-		increment = expression(s);
-		syntax_consume_token(s, RPAREN, "')' exprected before for body");
+	if(!syntax_match_token(p, RPAREN)) {
+		increment = expression(p);
+		syntax_consume_token(p, RPAREN, "')' exprected before for body");
 	}
 
-	stmt* body = statement(s);
+	stmt* body = statement(p);
 
-	return _make_for_statement(initializer, condition, increment, body);
+	return _make_for_statement(p, initializer, condition, increment, body);
 }
 
-stmt* while_stmt(token_stream* s) {
+stmt* while_stmt(parser* p) {
+	SYNTAX_RULE(p);
+	syntax_begin(p, SN_STMT, ST_WHILE, syntax_previous(p));
 	int prefix = 0;
 	stmt* body = NULL;
 	expr* cond = NULL;
-	if(lex_stream_previous(s)->type == DO) {
+	if(syntax_previous(p)->type == DO) {
 		prefix = 1;
-		body = statement(s);
-		syntax_consume_token(s, WHILE, "'while' required after do block");
-		syntax_consume_token(s, LPAREN, "'(' required before while condition");
-		cond = expression(s);
-		syntax_consume_token(s, RPAREN, "')' required after while condition");
-		syntax_consume_token(s, SEMILOCON, "';' required after do-while");
+		body = statement(p);
+		syntax_consume_token(p, WHILE, "'while' required after do block");
+		syntax_consume_token(p, LPAREN, "'(' required before while condition");
+		cond = expression(p);
+		syntax_consume_token(p, RPAREN, "')' required after while condition");
+		syntax_consume_token(p, SEMILOCON, "';' required after do-while");
 	} else {
-		cond = expression(s);
-		body = statement(s);
+		cond = expression(p);
+		body = statement(p);
 	}
-	return _make_while_statement(cond, body, prefix);
+	return _make_while_statement(p, cond, body, prefix);
 }
 
-stmt* func_arg_decl(token_stream* s) {
-	token* tok = NULL;
-	spec_list* l = spec_list_create();
-
-	while((tok = match_spec(s))) {
-		spec_list_append(l, tok->type);
-	}
-
-	type_info* t = type(s);
-	token* ident = syntax_match_token(s, IDENTIFIER);
+stmt* func_arg_decl(parser* p) {
+	SYNTAX_RULE(p);
+	syntax_begin(p, SN_STMT, ST_DECL, syntax_current(p));
+	spec_list* l = _specifiers(p);
+	type_info* t = type(p);
+	token* ident = syntax_match_token(p, IDENTIFIER);
 
 	expr* initializer = NULL;
-	if(syntax_match_token(s, EQUAL)) {
-		initializer = expression(s);
+	if(syntax_match_token(p, EQUAL)) {
+		initializer = expression(p);
 	}
 
-	return _make_decl_statement(l, t, ident, initializer);
+	return _make_decl_statement(p, l, t, ident, initializer);
 }
 
-stmt* var_decl(token_stream* s) {
-	spec_list* l = spec_list_create();
-	token* tok = NULL;
-
-	while((tok = match_spec(s))) {
-		spec_list_append(l, tok->type);
-	}
-
-	type_info* t = type(s);
-	token* identifier = syntax_consume_token(s, IDENTIFIER, "identifier required");
+stmt* var_decl(parser* p) {
+	SYNTAX_RULE(p);
+	syntax_begin(p, SN_STMT, ST_DECL, syntax_previous(p));
+	spec_list* l = _specifiers(p);
+	type_info* t = type(p);
+	token* identifier = syntax_consume_token(p, IDENTIFIER, "identifier required");
 
 	expr* initializer = NULL;
-	if(syntax_match_token(s, EQUAL)) {
-		initializer = expression(s);
+	if(syntax_match_token(p, EQUAL)) {
+		initializer = expression(p);
 	}
-	syntax_consume_token(s, SEMILOCON, "';' required after declaration statement");
-	return _make_decl_statement(l, t, identifier, initializer);
+	syntax_consume_token(p, SEMILOCON, "';' required after declaration statement");
+	return _make_decl_statement(p, l, t, identifier, initializer);
 }
 
-stmt* fun_decl(token_stream* s) {
-	spec_list* l = spec_list_create();
-	token* tok = NULL;
+// Only matches braces, returns where the body starts
+static int _skip_block(parser* p) {
+	int begin = p->tokens->ptr;
+	int depth = 1;
 
-	while((tok = match_spec(s))) {
-		spec_list_append(l, tok->type);
+	while(depth) {
+		token* t = syntax_current(p);
+		if(t->type == _EOF) {
+			syntax_error(p, t, "'}' required after function body");
+		}
+		if(t->type == LBRACE) {
+			depth++;
+		} else if(t->type == RBRACE) {
+			depth--;
+		}
+		lex_stream_advance(p->tokens);
 	}
 
-	type_info* t = type(s);
-	token* identifier = syntax_consume_token(s, IDENTIFIER, "identifier required");
+	return begin;
+}
+
+stmt* fun_decl(parser* p) {
+	SYNTAX_RULE(p);
+	syntax_begin(p, SN_STMT, ST_FUN_DEF, syntax_previous(p));
+	spec_list* l = _specifiers(p);
+	type_info* t = type(p);
+	token* identifier = syntax_consume_token(p, IDENTIFIER, "identifier required");
 
-	syntax_consume_token(s, LPAREN, "'(' required before arg list");
+	syntax_consume_token(p, LPAREN, "'(' required before arg list");
 
-	stmt_list* args = stmt_list_create();
-	if(!syntax_match_token(s, RPAREN)) {
+	stmt_list* args = syntax_building(p) ? syntax_track_list(p, stmt_list_create()) : NULL;
+	if(!syntax_match_token(p, RPAREN)) {
 		do {
-			stmt_list_append(args, func_arg_decl(s));
-		} while(syntax_match_token(s, COMMA));
-		syntax_consume_token(s, RPAREN, "')' required after arg list");
+			stmt* arg = func_arg_decl(p);
+			if(args) {
+				stmt_list_append(args, arg);
+			}
+		} while(syntax_match_token(p, COMMA));
+		syntax_consume_token(p, RPAREN, "')' required after arg list");
 	}
 
 	stmt* body = NULL;
-	if(syntax_match_token(s, LBRACE)) {
-		body = block(s);
+	int lazy_begin = -1;
+	if(syntax_match_token(p, LBRACE)) {
+		if(p->lazy_bodies) {
+			lazy_begin = _skip_block(p);
+		} else {
+			syntax_descend(p);
+			body = block(p);
+			syntax_ascend(p);
+		}
 	} else {
-		syntax_consume_token(s, SEMILOCON, "';' required after declaration statement");
+		syntax_consume_token(p, SEMILOCON, "';' required after declaration statement");
 	}
 
-	return _make_fun_def_statement(l, t, identifier, args, body);
+	return _make_fun_def_statement(p, l, t, identifier, args, body, lazy_begin);
 }
 
-stmt* declaration(token_stream* s) {
-	if(syntax_match_token(s, CLASS)) {
-		return class_decl(s);
-	} else if (syntax_match_token(s, LET)){
-		return var_decl(s);
-	} else if (syntax_match_token(s, FUN)) {
-		return fun_decl(s);
+stmt* fun_def_body(fun_def* f) {
+	if(f->lazy_tokens) {
+		token_stream* tokens = f->lazy_tokens;
+		f->lazy_tokens = NULL;
+		// A body with syntax errors is reported like any other and left out
+		syntax_parse_block(tokens, f->lazy_begin, &f->body);
+	}
+	return f->body;
+}
+
+stmt* declaration(parser* p) {
+	SYNTAX_RULE(p);
+	if(syntax_match_token(p, CLASS)) {
+		return class_decl(p);
+	} else if (syntax_match_token(p, LET)){
+		return var_decl(p);
+	} else if (syntax_match_token(p, FUN)) {
+		return fun_decl(p);
 	} else {
-		return statement(s);
+		return statement(p);
 	}
 }
 
-stmt* return_stmt(token_stream* s) {
+stmt* return_stmt(parser* p) {
+	SYNTAX_RULE(p);
+	syntax_begin(p, SN_STMT, ST_RETURN, syntax_previous(p));
 	expr* val = NULL;
-	if(!syntax_match_token(s, SEMILOCON)) {
-		val = expression(s);
-	} 
-	syntax_consume_token(s, SEMILOCON, "';' required after return statement");
-	return _make_ret_statement(val);
+	if(!syntax_match_token(p, SEMILOCON)) {
+		val = expression(p);
+		syntax_consume_token(p, SEMILOCON, "';' required after return statement");
+	}
+	return _make_ret_statement(p, val);
 }
 
-stmt* class_decl(token_stream* s) {
-	return _make_class_statement(class(s));
+stmt* class_decl(parser* p) {
+	SYNTAX_RULE(p);
+	syntax_begin(p, SN_STMT, ST_CLASS, syntax_previous(p));
+	return _make_class_statement(p, class(p));
 }
 
-stmt* loop_flow_stmt(token_stream* s) {
-	stmt* st =  _make_loop_ctrl_statement(lex_stream_previous(s));
-	syntax_consume_token(s, SEMILOCON, "';' required after loop control statement");
+stmt* loop_flow_stmt(parser* p) {
+	SYNTAX_RULE(p);
+	syntax_begin(p, SN_STMT, ST_LOOP_CTRL, syntax_previous(p));
+	stmt* st =  _make_loop_ctrl_statement(p, syntax_previous(p));
+	syntax_consume_token(p, SEMILOCON, "';' required after loop control statement");
 	return st;
 }
 
-stmt* type_def(token_stream* s) {
-	typedef_stmt* st = malloc(sizeof(typedef_stmt));
-	st->type = type(s);
-	st->alias = syntax_consume_token(s, IDENTIFIER, "type alias required");
-	syntax_consume_token(s, SEMILOCON, "';' required after typedef statement");
-	return _make_statement(ST_TYPEDEF, st);
+stmt* type_def(parser* p) {
+	SYNTAX_RULE(p);
+	syntax_begin(p, SN_STMT, ST_TYPEDEF, syntax_previous(p));
+	type_info* t = type(p);
+	token* alias = syntax_consume_token(p, IDENTIFIER, "type alias required");
+	syntax_consume_token(p, SEMILOCON, "';' required after typedef statement");
+	SYNTAX_NODE_END(p, SN_STMT, ST_TYPEDEF, alias)
+	typedef_stmt* st = syntax_alloc(p, sizeof(typedef_stmt));
+	st->type = t;
+	st->alias = alias;
+	return _make_statement(p, ST_TYPEDEF, st);
 }
 
-void stmt_accept(stmt* statement, ast_visitor visitor) {
+int stmt_visit(stmt* statement, const ast_visitor* v, void* ctx) {
 	switch(statement->type) {
 		case ST_EXPRESSION:
-			SAFE_CALL(visitor.visit_expr_stmt, statement->data);
-			break;
+			return VISIT(v->visit_expr_stmt, ctx, statement->data);
 		case ST_DECL:
-			SAFE_CALL(visitor.visit_decl_stmt, statement->data);
-			break;
+			return VISIT(v->visit_decl_stmt, ctx, statement->data);
 		case ST_BLOCK:
-			SAFE_CALL(visitor.visit_block_stmt, statement->data);
-			break;
+			return VISIT(v->visit_block_stmt, ctx, statement->data);
 		case ST_IF:
-			SAFE_CALL(visitor.visit_if_stmt, statement->data);
-			break;
+			return VISIT(v->visit_if_stmt, ctx, statement->data);
 		case ST_FOR:
-			SAFE_CALL(visitor.visit_for_stmt, statement->data);
-			break;
+			return VISIT(v->visit_for_stmt, ctx, statement->data);
 		case ST_WHILE:
-			SAFE_CALL(visitor.visit_while_stmt, statement->data);
-			break;
+			return VISIT(v->visit_while_stmt, ctx, statement->data);
 		case ST_RETURN:
-			SAFE_CALL(visitor.visit_ret_stmt, statement->data);
-			break;
+			return VISIT(v->visit_ret_stmt, ctx, statement->data);
 		case ST_FUN_DEF:
-			SAFE_CALL(visitor.visit_fun_def_stmt, statement->data);
+			return VISIT(v->visit_fun_def_stmt, ctx, statement->data);
+		case ST_LOOP_CTRL:
+			return VISIT(v->visit_loop_ctrl_stmt, ctx, statement->data);
+		case ST_TYPEDEF:
+			return VISIT(v->visit_typedef, ctx, statement->data);
+		case ST_CLASS:
+			return VISIT(v->visit_class, ctx, statement->data);
+	}
+	return VISIT_CONTINUE;
+}
+
+// Optional children keep their slot and are reported as NULL
+int stmt_child(stmt* statement, int slot, enum syntax_node_kind* kind, void** child) {
+	switch(statement->type) {
+		case ST_EXPRESSION:
+		case ST_RETURN:
+			if(slot < 1) WALK_CHILD(SN_EXPR, statement->data)
+			break;
+		case ST_DECL: {
+			decl* d = statement->data;
+			if(slot == 0) WALK_CHILD(SN_TYPE, d->type)
+			if(slot == 1) WALK_CHILD(SN_EXPR, d->initializer)
+			break;
+		}
+		case ST_BLOCK: {
+			stmt_list* l = statement->data;
+			if(slot < l->size) WALK_CHILD(SN_STMT, l->data[slot])
+			break;
+		}
+		case ST_IF: {
+			conditional* c = statement->data;
+			if(slot == 0) WALK_CHILD(SN_EXPR, c->condition)
+			if(slot == 1) WALK_CHILD(SN_STMT, c->body)
+			if(slot == 2) WALK_CHILD(SN_STMT, c->branch)
+			break;
+		}
+		case ST_FOR: {
+			for_loop* f = statement->data;
+			if(slot == 0) WALK_CHILD(SN_STMT, f->initializer)
+			if(slot == 1) WALK_CHILD(SN_EXPR, f->condition)
+			if(slot == 2) WALK_CHILD(SN_EXPR, f->increment)
+			if(slot == 3) WALK_CHILD(SN_STMT, f->body)
+			break;
+		}
+		case ST_WHILE: {
+			while_loop* w = statement->data;
+			if(slot == 0) WALK_CHILD(SN_EXPR, w->condition)
+			if(slot == 1) WALK_CHILD(SN_STMT, w->body)
+			break;
+		}
+		case ST_FUN_DEF: {
+			fun_def* f = statement->data;
+			if(slot == 0) WALK_CHILD(SN_TYPE, f->ret_type)
+			if(slot <= f->params->size) WALK_CHILD(SN_STMT, f->params->data[slot - 1])
+			if(slot == f->params->size + 1) WALK_CHILD(SN_STMT, fun_def_body(f))
 			break;
+		}
 		case ST_LOOP_CTRL:
-			SAFE_CALL(visitor.visit_loop_ctrl_stmt, statement->data);
 			break;
 		case ST_TYPEDEF:
-			SAFE_CALL(visitor.visit_typedef, statement->data);
+			if(slot < 1) WALK_CHILD(SN_TYPE, ((typedef_stmt*) statement->data)->type)
+			break;
+		case ST_CLASS: {
+			class_info* c = statement->data;
+			if(c->body && slot < c->body->size) WALK_CHILD(SN_STMT, c->body->data[slot]->declaration)
+			break;
+		}
+	}
+	return 0;
+}
+
+int stmt_accept(stmt* statement, const ast_visitor* v, void* ctx) {
+	return syntax_walk(SN_STMT, statement, v, ctx);
+}
+
+void stmt_list_free_all(stmt_list* l) {
+	for(int i = 0; i < l->size; i++) {
+		stmt_free(l->data[i]);
+	}
+	stmt_list_free(l);
+}
+
+// Children are released by the walk in syntax_free before their parent
+void stmt_release(stmt* statement) {
+	switch(statement->type) {
+		case ST_EXPRESSION:
+		case ST_RETURN:
+		case ST_LOOP_CTRL:
+			break;
+		case ST_BLOCK:
+			stmt_list_free(statement->data);
+			break;
+		case ST_DECL:
+			spec_list_free(((decl*) statement->data)->specifiers);
+			hatch_free(ALLOC_PARSER, statement->data);
+			break;
+		case ST_FUN_DEF:
+			spec_list_free(((fun_def*) statement->data)->specifiers);
+			stmt_list_free(((fun_def*) statement->data)->params);
+			hatch_free(ALLOC_PARSER, statement->data);
 			break;
 		case ST_CLASS:
-			SAFE_CALL(visitor.visit_class, statement->data);
+			class_release(statement->data);
 			break;
+		case ST_IF:
+		case ST_FOR:
+		case ST_WHILE:
+		case ST_TYPEDEF:
+			hatch_free(ALLOC_PARSER, statement->data);
+			break;
+	}
+	hatch_free(ALLOC_PARSER, statement);
+}
+
+void stmt_free(stmt* statement) {
+	if(statement) {
+		syntax_free(SN_STMT, statement);
 	}
-	SAFE_CALL(visitor.visit_stmt, statement);
 }
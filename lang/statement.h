@@ -45,6 +45,9 @@ typedef struct _fun_def {
 	token* identifier;
 	stmt_list* params;
 	stmt* body;
+	// Set while the body is skipped by lazy parsing, see fun_def_body
+	token_stream* lazy_tokens;
+	int lazy_begin;
 } fun_def;
 
 typedef struct _for_stmt {
@@ -65,21 +68,27 @@ typedef struct _typedef_stmt {
 	token* alias;
 } typedef_stmt;
 
-void stmt_accept(stmt* statement, ast_visitor visitor);
+int  stmt_accept(stmt* statement, const ast_visitor* visitor, void* ctx);
+int  stmt_visit(stmt* statement, const ast_visitor* visitor, void* ctx);
+int  stmt_child(stmt* statement, int slot, enum syntax_node_kind* kind, void** child);
+void stmt_release(stmt* statement);
+void stmt_free(stmt* statement);
+void stmt_list_free_all(stmt_list* l);
+stmt* fun_def_body(fun_def* f);
 
-stmt* statement(token_stream* s); 
-stmt* expr_statement(token_stream* s);
-stmt* block(token_stream* s);
-stmt* declaration(token_stream* s);
-stmt* if_stmt(token_stream* s);
-stmt* for_stmt(token_stream* s);
-stmt* while_stmt(token_stream* s);
-stmt* return_stmt(token_stream* s);
-stmt* func_arg_decl(token_stream* s);
-stmt* class_decl(token_stream* s);
-stmt* loop_flow_stmt(token_stream* s);
-stmt* var_decl(token_stream* s);
-stmt* fun_decl(token_stream* s);
-stmt* type_def(token_stream* s);
+stmt* statement(parser* p); 
+stmt* expr_statement(parser* p);
+stmt* block(parser* p);
+stmt* declaration(parser* p);
+stmt* if_stmt(parser* p);
+stmt* for_stmt(parser* p);
+stmt* while_stmt(parser* p);
+stmt* return_stmt(parser* p);
+stmt* func_arg_decl(parser* p);
+stmt* class_decl(parser* p);
+stmt* loop_flow_stmt(parser* p);
+stmt* var_decl(parser* p);
+stmt* fun_decl(parser* p);
+stmt* type_def(parser* p);
 
 #endif
@@ -1,41 +1,233 @@
 #include <assert.h>
-#include <setjmp.h>
 #include <stdio.h>
 #include <syntax.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
 
+#include "alloc.h"
+#include "expr.h"
 #include "lex.h"
 #include "program.h"
-
-extern ast_visitor _ast_printer;
+#include "statement.h"
+#include "type.h"
 
 syntax_tree* syntax_tree_create() {
-    syntax_tree* r = malloc(sizeof(syntax_tree));
+    syntax_tree* r = hatch_calloc(ALLOC_PARSER, 1, sizeof(syntax_tree));
     return r;
 }
 
 void syntax_tree_free(syntax_tree* tree) {
-    free(tree);
+    if(tree->program) {
+        program_free(tree->program);
+    }
+    hatch_free(ALLOC_PARSER, tree);
 }
 
-static jmp_buf _error_restore_context;
+LIST_IMPL(syntax_allocation, syntax_allocation)
+
+// Frees what an error left unlinked, the declarations already in the program go with it
+static void _abandon(parser* p) {
+	for(int i = 0; i < p->allocations->size; i++) {
+		syntax_allocation* a = &p->allocations->data[i];
+		if(a->is_list) {
+			stmt_list_free(a->ptr);
+		} else {
+			hatch_free(ALLOC_PARSER, a->ptr);
+		}
+	}
+	if(p->program) {
+		program_free(p->program);
+	}
+}
 
 int syntax_build_tree(token_stream* stream, syntax_tree* tree) {
-	if(setjmp(_error_restore_context) == 0) {
-		tree->program = program(stream);
-    	return 0;
+	parser p = { .tokens = stream, .lazy_bodies = tree->flags & SYNTAX_TREE_LAZY_BODIES };
+	p.allocations = syntax_allocation_list_create();
+
+	if(setjmp(p.error_restore) == 0) {
+		tree->program = program(&p);
+		syntax_allocation_list_free(p.allocations);
+		return 0;
+	} else {
+		_abandon(&p);
+		syntax_allocation_list_free(p.allocations);
+		return 1;
+	}
+}
+
+int syntax_parse_events(token_stream* stream, const syntax_sink* sink) {
+	parser p = { .tokens = stream, .sink = sink };
+
+	if(setjmp(p.error_restore) == 0) {
+		program(&p);
+		return 0;
 	} else {
 		return 1;
 	}
 }
 
-void syntax_print_tree(syntax_tree* tree) {
-	syntax_walk_tree(tree, _ast_printer);
+// Parses the block whose '{' precedes the token at begin, leaving the stream where it was
+int syntax_parse_block(token_stream* stream, int begin, struct _stmt** result) {
+	parser p = { .tokens = stream };
+	int saved = stream->ptr;
+	p.allocations = syntax_allocation_list_create();
+
+	lex_stream_seek(stream, begin);
+	if(setjmp(p.error_restore) == 0) {
+		*result = block(&p);
+		lex_stream_seek(stream, saved);
+		syntax_allocation_list_free(p.allocations);
+		return 0;
+	} else {
+		lex_stream_seek(stream, saved);
+		_abandon(&p);
+		syntax_allocation_list_free(p.allocations);
+		return 1;
+	}
+}
+
+int syntax_walk_tree(syntax_tree* tree, const ast_visitor* visitor, void* ctx) {
+	return program_accept(tree->program, visitor, ctx);
+}
+
+#define WALK_INITIAL_FRAMES 64
+#define WALK_DONE -2
+#define WALK_NEW  -1
+
+typedef struct {
+	enum syntax_node_kind kind;
+	void* node;
+	int   slot;
+} walk_frame;
+
+static int _visit_node(walk_frame* f, const ast_visitor* v, void* ctx) {
+	switch(f->kind) {
+		case SN_PROGRAM:
+			return program_visit(f->node, v, ctx);
+		case SN_STMT:
+			return stmt_visit(f->node, v, ctx);
+		case SN_EXPR:
+			return expr_visit(f->node, v, ctx);
+		case SN_TYPE:
+			return type_visit(f->node, v, ctx);
+	}
+	return VISIT_CONTINUE;
+}
+
+static int _next_child(walk_frame* f, enum syntax_node_kind* kind, void** child) {
+	switch(f->kind) {
+		case SN_PROGRAM:
+			return program_child(f->node, f->slot, kind, child);
+		case SN_STMT:
+			return stmt_child(f->node, f->slot, kind, child);
+		case SN_EXPR:
+			return expr_child(f->node, f->slot, kind, child);
+		case SN_TYPE:
+			return type_child(f->node, f->slot, kind, child);
+	}
+	return 0;
+}
+
+int syntax_walk(enum syntax_node_kind kind, void* node, const ast_visitor* v, void* ctx) {
+	walk_frame  initial[WALK_INITIAL_FRAMES];
+	walk_frame* frames = initial;
+	int capacity = WALK_INITIAL_FRAMES;
+	int size = 0;
+	int r = VISIT_CONTINUE;
+
+	frames[size++] = (walk_frame) { kind, node, WALK_NEW };
+
+	while(size) {
+		walk_frame* f = &frames[size - 1];
+
+		if(f->slot == WALK_NEW) {
+			r = VISIT(v->enter, ctx, f->kind, f->node);
+			if(r == VISIT_CONTINUE) {
+				r = _visit_node(f, v, ctx);
+			}
+			if(r == VISIT_STOP) {
+				break;
+			}
+			f->slot = r == VISIT_SKIP ? WALK_DONE : 0;
+			continue;
+		}
+
+		enum syntax_node_kind child_kind;
+		void* child;
+		if(f->slot != WALK_DONE && _next_child(f, &child_kind, &child)) {
+			r = VISIT(v->child, ctx, f->kind, f->node, f->slot, child);
+			f->slot++;
+			if(r == VISIT_STOP) {
+				break;
+			}
+			if(r == VISIT_CONTINUE && child) {
+				if(size == capacity) {
+					capacity *= 2;
+					if(frames == initial) {
+						frames = hatch_malloc(ALLOC_PARSER, sizeof(walk_frame) * capacity);
+						memcpy(frames, initial, sizeof(initial));
+					} else {
+						frames = hatch_realloc(ALLOC_PARSER, frames, sizeof(walk_frame) * capacity);
+					}
+				}
+				frames[size++] = (walk_frame) { child_kind, child, WALK_NEW };
+			}
+			continue;
+		}
+
+		r = VISIT(v->leave, ctx, f->kind, f->node);
+		if(r == VISIT_STOP) {
+			break;
+		}
+		size--;
+	}
+
+	if(frames != initial) {
+		hatch_free(ALLOC_PARSER, frames);
+	}
+
+	return r == VISIT_STOP ? VISIT_STOP : VISIT_CONTINUE;
 }
 
-void syntax_walk_tree(syntax_tree* tree, ast_visitor visitor) {
-	program_accept(tree->program, visitor);
+// Post-order, so every node is released after everything below it
+static int _release_node(void* ctx, enum syntax_node_kind kind, void* node) {
+	(void) ctx;
+	switch(kind) {
+		case SN_PROGRAM:
+			program_release(node);
+			break;
+		case SN_STMT:
+			stmt_release(node);
+			break;
+		case SN_EXPR:
+			expr_release(node);
+			break;
+		case SN_TYPE:
+			type_release(node);
+			break;
+	}
+	return VISIT_CONTINUE;
+}
+
+// A body that was never parsed is dropped instead of being parsed just to free it
+static int _release_enter(void* ctx, enum syntax_node_kind kind, void* node) {
+	(void) ctx;
+	if(kind == SN_STMT && ((stmt*) node)->type == ST_FUN_DEF) {
+		((fun_def*) ((stmt*) node)->data)->lazy_tokens = NULL;
+	}
+	return VISIT_CONTINUE;
+}
+
+static const ast_visitor _release_visitor = {
+	.enter = _release_enter,
+	.leave = _release_node
+};
+
+void syntax_free(enum syntax_node_kind kind, void* node) {
+	syntax_walk(kind, node, &_release_visitor, NULL);
 }
 
 static int _va_check_token(token* tok, int count, va_list args) {
@@ -52,16 +244,16 @@ static int _va_check_token(token* tok, int count, va_list args) {
 	return r;
 }
 
-static token* _va_check_tokens(token_stream* s, int count, va_list args) {
-	token* current = lex_stream_current(s);
+static token* _va_check_tokens(parser* p, int count, va_list args) {
+	token* current = syntax_current(p);
 	return _va_check_token(current, count, args) ? current : NULL;
 }
 
-token* syntax_check_tokens(token_stream* stream, int count, ...) {
+token* syntax_check_tokens(parser* p, int count, ...) {
 	va_list args;
 	va_start(args, count);
 
-	token* current = _va_check_tokens(stream, count, args);
+	token* current = _va_check_tokens(p, count, args);
 
 	va_end(args);
 
@@ -80,39 +272,188 @@ int syntax_check_specific_token(token* tok, int count, ...) {
 	return r;
 }
 
-token* syntax_match_tokens(token_stream* stream, int count, ...) {
+token* syntax_match_tokens(parser* p, int count, ...) {
 	va_list args;
 	va_start(args, count);
 
-	token* c = _va_check_tokens(stream, count, args);
+	token* c = _va_check_tokens(p, count, args);
 
 	va_end(args);
 
 	if(c) {
-		lex_stream_advance(stream);
+		lex_stream_advance(p->tokens);
 		return c;
 	} else {
+#ifdef HATCH_RULE_PROFILE
+		if(p->rule) {
+			__atomic_fetch_add(&p->rule->stats->failed_probes, 1, __ATOMIC_RELAXED);
+		}
+#endif
 		return NULL;
 	}
 
 }
 
-token* syntax_consume_token(token_stream* stream, enum lexem required, const char* message) {
-	token* current = lex_stream_current(stream);
+token* syntax_consume_token(parser* p, enum lexem required, const char* message) {
+	token* current = syntax_current(p);
 
 	if(current->type == required) {
-		lex_stream_advance(stream);
+		lex_stream_advance(p->tokens);
 		return current;
 	} else {
-		syntax_error(current, message);
+		syntax_error(p, current, message);
+	}
+}
+
+void syntax_error(parser* p, token* l, const char* message) {
+	source_error(p->tokens->sources, l->loc, "unexpected %s: %s", lex_lexem_to_string(l->type), message);
+	longjmp(p->error_restore, 1);
+}
+
+void syntax_error_on_current(parser* p, const char* message) {
+	syntax_error(p, syntax_current(p), message);
+}
+
+void syntax_descend(parser* p) {
+	if(++p->depth > SYNTAX_MAX_DEPTH) {
+		token* current = syntax_current(p);
+		source_error(p->tokens->sources, current->loc, "nesting exceeds the maximum depth of %d", SYNTAX_MAX_DEPTH);
+		longjmp(p->error_restore, 1);
+	}
+}
+
+char syntax_event_node;
+
+void syntax_begin(parser* p, enum syntax_node_kind kind, int type, token* at) {
+	if(p->sink && p->sink->begin) {
+		p->sink->begin(p->sink->ctx, kind, type, at);
 	}
 }
 
-void syntax_error(token* l, const char* message) {
-	printf("Syntax error: unexpected %s at line %d: %s\n", lex_lexem_to_string(l->type), l->line + 1, message);
-	longjmp(_error_restore_context, 1);
+int syntax_end(parser* p, enum syntax_node_kind kind, int type, token* name) {
+	if(p->sink == NULL) {
+		return 0;
+	}
+	if(p->sink->end) {
+		p->sink->end(p->sink->ctx, kind, type, name);
+	}
+	return 1;
+}
+
+void* syntax_alloc(parser* p, size_t size) {
+	void* ptr = hatch_malloc(ALLOC_PARSER, size);
+	syntax_allocation_list_append(p->allocations, (syntax_allocation) { ptr, 0 });
+	return ptr;
 }
 
-void syntax_error_on_current(token_stream* s, const char* message) {
-	syntax_error(lex_stream_current(s), message);
+void* syntax_track_list(parser* p, void* list) {
+	syntax_allocation_list_append(p->allocations, (syntax_allocation) { list, 1 });
+	return list;
+}
+
+void syntax_commit(parser* p) {
+	p->allocations->size = 0;
+}
+
+#ifdef HATCH_RULE_PROFILE
+
+static syntax_rule_stats* _rules = NULL;
+static int _rules_amount = 0;
+static pthread_mutex_t _rules_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static long long _now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void _register_rule(syntax_rule_stats* stats) {
+	pthread_mutex_lock(&_rules_lock);
+	if(stats->id < 0) {
+		stats->next = _rules;
+		_rules = stats;
+		__atomic_store_n(&stats->id, _rules_amount++, __ATOMIC_RELEASE);
+	}
+	pthread_mutex_unlock(&_rules_lock);
 }
+
+void syntax_rule_enter(syntax_rule_frame* frame, parser* p, syntax_rule_stats* stats) {
+	if(__atomic_load_n(&stats->id, __ATOMIC_ACQUIRE) < 0) {
+		_register_rule(stats);
+	}
+	__atomic_fetch_add(&stats->entries, 1, __ATOMIC_RELAXED);
+
+	frame->stats = stats;
+	frame->p = p;
+	frame->ptr = p->tokens->ptr;
+	frame->outermost = stats->id >= SYNTAX_MAX_RULES || p->active_rules[stats->id]++ == 0;
+	frame->children = 0;
+	frame->parent = p->rule;
+	p->rule = frame;
+	frame->start = _now();
+}
+
+// Runs as the cleanup of the frame, a syntax error skips it together with the rule
+void syntax_rule_leave(syntax_rule_frame* frame) {
+	long long elapsed = _now() - frame->start;
+	syntax_rule_stats* stats = frame->stats;
+	parser* p = frame->p;
+
+	__atomic_fetch_add(&stats->self_time, elapsed - frame->children, __ATOMIC_RELAXED);
+	if(frame->outermost) {
+		__atomic_fetch_add(&stats->total_time, elapsed, __ATOMIC_RELAXED);
+		__atomic_fetch_add(&stats->tokens, p->tokens->ptr - frame->ptr, __ATOMIC_RELAXED);
+	}
+	if(stats->id < SYNTAX_MAX_RULES) {
+		p->active_rules[stats->id]--;
+	}
+	if(frame->parent) {
+		frame->parent->children += elapsed;
+	}
+	p->rule = frame->parent;
+}
+
+static int _by_self_time(const void* a, const void* b) {
+	const syntax_rule_stats* x = *(syntax_rule_stats* const*) a;
+	const syntax_rule_stats* y = *(syntax_rule_stats* const*) b;
+	if(x->self_time != y->self_time) {
+		return x->self_time < y->self_time ? 1 : -1;
+	}
+	return strcmp(x->name, y->name);
+}
+
+int syntax_rule_profile_print(FILE* out) {
+	pthread_mutex_lock(&_rules_lock);
+
+	syntax_rule_stats** sorted = malloc(sizeof(syntax_rule_stats*) * (_rules_amount + 1));
+	long long self_time = 0;
+	int amount = 0;
+	for(syntax_rule_stats* r = _rules; r; r = r->next) {
+		sorted[amount++] = r;
+		self_time += r->self_time;
+	}
+	qsort(sorted, amount, sizeof(syntax_rule_stats*), _by_self_time);
+
+	fprintf(out, "%-16s %12s %12s %14s %12s %7s %12s\n",
+			"rule", "entries", "tokens", "failed probes", "self ms", "self %", "total ms");
+	for(int i = 0; i < amount; i++) {
+		syntax_rule_stats* r = sorted[i];
+		fprintf(out, "%-16s %12lld %12lld %14lld %12.3f %6.1f%% %12.3f\n",
+				r->name, r->entries, r->tokens, r->failed_probes, r->self_time / 1e6,
+				self_time ? 100.0 * r->self_time / self_time : 0.0, r->total_time / 1e6);
+	}
+
+	free(sorted);
+	pthread_mutex_unlock(&_rules_lock);
+
+	return 0;
+}
+
+#else
+
+int syntax_rule_profile_print(FILE* out) {
+	fprintf(out, "grammar rule profiling is disabled, build with -DHATCH_RULE_PROFILE=ON\n");
+	return 1;
+}
+
+#endif
@@ -2,7 +2,10 @@
 #define _SYNTAX_H 1
 
 #include <lex.h>
+#include <setjmp.h>
+#include <stdio.h>
 
+#include "emit.h"
 #include "list.h"
 
 struct _expr;
@@ -19,57 +22,214 @@ struct _for_stmt;
 struct _while_stmt;
 struct _call_expr;
 struct _subscript_expr;
+struct _sizeof_expr;
 struct _fun_def;
 struct _type_info;
 struct _class_info;
 struct _typedef_stmt;
 
+enum visit_result {
+	VISIT_CONTINUE,
+	VISIT_SKIP,
+	VISIT_STOP
+};
+
+enum syntax_node_kind {
+	SN_PROGRAM,
+	SN_STMT,
+	SN_EXPR,
+	SN_TYPE
+};
+
+// A node is passed to enter, then to its visit_* callback, then child is called for
+// every child slot in a fixed order (with NULL for a missing optional child) before the
+// child is walked, and finally leave is called. VISIT_SKIP from enter or visit_* skips
+// the children (from enter also the visit_* callback), from child only that child.
+// VISIT_STOP ends the walk. Missing callbacks continue. The walk keeps its own stack,
+// so the depth of the tree is not limited by the C stack.
 typedef struct {
-	void (*visit_expr)(struct _expr* e);
-	void (*visit_unary_expr)(struct _unary_expr* e);
-	void (*visit_binary_expr)(struct _binary_expr* e);
-	void (*visit_group_expr)(struct _group_expr* e);
-	void (*visit_literal_expr)(struct _literal_expr* e);
-	void (*visit_assignment_expr)(struct _assignment_expr* e);
-	void (*visit_program)(struct _prog* p);
-	void (*visit_stmt)(struct _stmt* s);
-	void (*visit_expr_stmt)(struct _expr* s);
-	void (*visit_block_stmt)(stmt_list* s);
-	void (*visit_decl_stmt)(struct _decl* d);
-	void (*visit_if_stmt)(struct _if_stmt* s);
-	void (*visit_for_stmt)(struct _for_stmt* s);
-	void (*visit_while_stmt)(struct _while_stmt* s);
-	void (*visit_ret_stmt)(struct _expr* v);
-	void (*visit_call_expr)(struct _call_expr* s);
-	void (*visit_subscript_expr)(struct _subscript_expr* s);
-	void (*visit_fun_def_stmt)(struct _fun_def* s);
-	void (*visit_loop_ctrl_stmt)(token* s);
-	void (*visit_type)(struct _type_info* t);
-	void (*visit_class)(struct _class_info* c);
-	void (*visit_typedef)(struct _typedef_stmt* c);
+	int (*enter)(void* ctx, enum syntax_node_kind kind, void* node);
+	int (*child)(void* ctx, enum syntax_node_kind kind, void* node, int slot, void* child);
+	int (*leave)(void* ctx, enum syntax_node_kind kind, void* node);
+	int (*visit_unary_expr)(void* ctx, struct _unary_expr* e);
+	int (*visit_binary_expr)(void* ctx, struct _binary_expr* e);
+	int (*visit_group_expr)(void* ctx, struct _group_expr* e);
+	int (*visit_literal_expr)(void* ctx, struct _literal_expr* e);
+	int (*visit_assignment_expr)(void* ctx, struct _assignment_expr* e);
+	int (*visit_program)(void* ctx, struct _prog* p);
+	int (*visit_expr_stmt)(void* ctx, struct _expr* s);
+	int (*visit_block_stmt)(void* ctx, stmt_list* s);
+	int (*visit_decl_stmt)(void* ctx, struct _decl* d);
+	int (*visit_if_stmt)(void* ctx, struct _if_stmt* s);
+	int (*visit_for_stmt)(void* ctx, struct _for_stmt* s);
+	int (*visit_while_stmt)(void* ctx, struct _while_stmt* s);
+	int (*visit_ret_stmt)(void* ctx, struct _expr* v);
+	int (*visit_call_expr)(void* ctx, struct _call_expr* s);
+	int (*visit_subscript_expr)(void* ctx, struct _subscript_expr* s);
+	int (*visit_sizeof_expr)(void* ctx, struct _sizeof_expr* s);
+	int (*visit_fun_def_stmt)(void* ctx, struct _fun_def* s);
+	int (*visit_loop_ctrl_stmt)(void* ctx, token* s);
+	int (*visit_type)(void* ctx, struct _type_info* t);
+	int (*visit_class)(void* ctx, struct _class_info* c);
+	int (*visit_typedef)(void* ctx, struct _typedef_stmt* c);
 } ast_visitor;
 
+#define VISIT(f, ...) ((f) ? (f)(__VA_ARGS__) : VISIT_CONTINUE)
+
+// Used by the *_child functions to report the node in a slot
+#define WALK_CHILD(k, c) \
+	{ \
+		*kind = k; \
+		*child = c; \
+		return 1; \
+	}
+
+// With SYNTAX_TREE_LAZY_BODIES function bodies are only brace matched while parsing and
+// parsed on first access, the token stream has to outlive the tree then
+#define SYNTAX_TREE_LAZY_BODIES (1 << 0)
+
 typedef struct {
 	struct _prog* program;
+	int flags;
 } syntax_tree;
 
+// Every nesting level costs the recursive descent about a kilobyte of stack,
+// deeper input is rejected instead of overflowing it
+#ifndef SYNTAX_MAX_DEPTH
+#define SYNTAX_MAX_DEPTH 1024
+#endif
+
+// Event mode: instead of allocating nodes the grammar reports them to a sink. begin is
+// sent where a node starts; for infix nodes (binary, assignment, call, subscript, postfix
+// unary, array types) that is at the operator, so the operand reported just before it is
+// their first child. end carries the declared name for decls, functions, classes and
+// typedefs. type is the enum stmt_type, expr_type or type_type matching kind.
+// Missing callbacks are fine, a sink without any only checks that the input parses.
+typedef struct {
+	void (*begin)(void* ctx, enum syntax_node_kind kind, int type, token* at);
+	void (*end)(void* ctx, enum syntax_node_kind kind, int type, token* name);
+	void* ctx;
+} syntax_sink;
+
+// Built with HATCH_RULE_PROFILE every grammar rule starts with SYNTAX_RULE, which counts
+// entries, tokens consumed, time spent in the rule itself and in total, and the
+// syntax_match_tokens probes that failed while the rule was innermost. Total time and
+// tokens only count the outermost activation of a recursive rule.
+#ifndef SYNTAX_MAX_RULES
+#define SYNTAX_MAX_RULES 64
+#endif
+
+struct _syntax_rule_frame;
+
+// A node or list of the declaration being parsed, which is not linked into the tree
+// yet and is freed by itself when a syntax error abandons the declaration
+typedef struct {
+	void* ptr;
+	int   is_list;
+} syntax_allocation;
+
+DEFINE_LIST_TYPE(syntax_allocation, syntax_allocation)
+
+typedef struct {
+	token_stream* tokens;
+	jmp_buf error_restore;
+	int depth;
+	int lazy_bodies;
+	const syntax_sink* sink;
+	syntax_allocation_list* allocations;
+	struct _prog* program;
+#ifdef HATCH_RULE_PROFILE
+	struct _syntax_rule_frame* rule;
+	int active_rules[SYNTAX_MAX_RULES];
+#endif
+} parser;
+
+typedef struct _syntax_rule_stats {
+	const char* name;
+	int id;
+	long long entries;
+	long long tokens;
+	long long failed_probes;
+	long long self_time;
+	long long total_time;
+	struct _syntax_rule_stats* next;
+} syntax_rule_stats;
+
+typedef struct _syntax_rule_frame {
+	syntax_rule_stats* stats;
+	parser* p;
+	int ptr;
+	int outermost;
+	long long start;
+	long long children;
+	struct _syntax_rule_frame* parent;
+} syntax_rule_frame;
+
+#ifdef HATCH_RULE_PROFILE
+#define SYNTAX_RULE(p) \
+	static syntax_rule_stats _rule_stats = { .name = __func__, .id = -1 }; \
+	syntax_rule_frame _rule_frame __attribute__((cleanup(syntax_rule_leave))); \
+	syntax_rule_enter(&_rule_frame, p, &_rule_stats)
+#else
+#define SYNTAX_RULE(p)
+#endif
+
+void syntax_rule_enter(syntax_rule_frame* frame, parser* p, syntax_rule_stats* stats);
+void syntax_rule_leave(syntax_rule_frame* frame);
+int  syntax_rule_profile_print(FILE* out);
+
+#define syntax_current(p)  lex_stream_current((p)->tokens)
+#define syntax_previous(p) lex_stream_previous((p)->tokens)
+#define syntax_next(p)     lex_stream_next((p)->tokens)
+#define syntax_is_eof(p)   lex_stream_is_eof((p)->tokens)
+#define syntax_ascend(p)   ((p)->depth--)
+#define syntax_building(p) ((p)->sink == NULL)
+
+// What constructors return in event mode, it only tells the grammar a node was there
+extern char syntax_event_node;
+#define SYNTAX_EVENT_NODE ((void*) &syntax_event_node)
+
+// Constructors start with this, in event mode the node is reported instead of built
+#define SYNTAX_NODE_END(p, kind, type, name) \
+	if(syntax_end(p, kind, type, name)) { \
+		return SYNTAX_EVENT_NODE; \
+	}
+
 int syntax_build_tree(token_stream* stream, syntax_tree* result);
+int syntax_parse_events(token_stream* stream, const syntax_sink* sink);
+int syntax_parse_block(token_stream* stream, int begin, struct _stmt** result);
 syntax_tree* syntax_tree_create();
 void syntax_tree_free(syntax_tree* tree);
 
-void syntax_print_tree(syntax_tree* tree);
-void syntax_walk_tree(syntax_tree* tree, ast_visitor visitor);
+void syntax_print_tree(syntax_tree* tree, emitter* out);
 
-token* syntax_match_tokens(token_stream* stream, int count, ...);
+// One object per top-level statement and line instead of a single program object
+#define SYNTAX_JSON_LINES (1 << 0)
+
+void syntax_write_json(syntax_tree* tree, const char* file, source_manager* sources, emitter* out, int flags);
+int  syntax_walk_tree(syntax_tree* tree, const ast_visitor* visitor, void* ctx);
+int  syntax_walk(enum syntax_node_kind kind, void* node, const ast_visitor* visitor, void* ctx);
+void syntax_free(enum syntax_node_kind kind, void* node);
+
+token* syntax_match_tokens(parser* p, int count, ...);
 #define syntax_match_token(s, t) syntax_match_tokens(s, 1, t)
 
-token* syntax_check_tokens(token_stream* stream, int count, ...);
+token* syntax_check_tokens(parser* p, int count, ...);
 #define syntax_check_token(s, t) syntax_check_tokens(s, 1, t)
 
 int syntax_check_specific_token(token* tok, int count, ...);
 
-token* syntax_consume_token(token_stream* stream, enum lexem token, const char* message);
-void syntax_error(token* l, const char* message) __attribute__((noreturn));
-void syntax_error_on_current(token_stream* s, const char* message) __attribute__((noreturn));
+token* syntax_consume_token(parser* p, enum lexem token, const char* message);
+void syntax_error(parser* p, token* l, const char* message) __attribute__((noreturn));
+void syntax_error_on_current(parser* p, const char* message) __attribute__((noreturn));
+void syntax_descend(parser* p);
+void syntax_begin(parser* p, enum syntax_node_kind kind, int type, token* at);
+int  syntax_end(parser* p, enum syntax_node_kind kind, int type, token* name);
+
+// Constructors allocate through these, lists of every element type share one layout
+void* syntax_alloc(parser* p, size_t size);
+void* syntax_track_list(parser* p, void* list);
+// The declaration is linked into the program, an error no longer frees its nodes
+void  syntax_commit(parser* p);
 
 #endif
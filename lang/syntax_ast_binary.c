@@ -0,0 +1,960 @@
+#include "syntax_ast_binary.h"
+
+#include "alloc.h"
+#include "class.h"
+#include "expr.h"
+#include "list.h"
+#include "map.h"
+#include "program.h"
+#include "statement.h"
+#include "type.h"
+
+#include <setjmp.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NO_NODE UINT32_MAX
+
+DEFINE_MAP_TYPE(ast_strings, const char*, uint32_t)
+MAP_IMPL(ast_strings, const char*, uint32_t, builtin_string_hash, builtin_string_comparator)
+
+LIST_DEF_AND_IMPL(ast_offset, uint32_t)
+
+typedef struct {
+	char*  nodes;
+	size_t size;
+	size_t capacity;
+	char*  strings;
+	size_t strings_size;
+	size_t strings_capacity;
+	ast_strings_map* interned;
+	ast_offset_list* values;
+	ast_offset_list* bases;
+} ast_writer;
+
+static uint32_t _reserve(ast_writer* w, uint32_t kind, size_t size) {
+	size = (size + 7) & ~(size_t) 7;
+	if(w->size + size > w->capacity) {
+		w->capacity = w->capacity ? w->capacity * 2 : 4096;
+		while(w->size + size > w->capacity) {
+			w->capacity *= 2;
+		}
+		w->nodes = realloc(w->nodes, w->capacity);
+	}
+
+	uint32_t offset = w->size;
+	memset(w->nodes + offset, 0, size);
+	w->size += size;
+
+	ast_binary_node* n = (ast_binary_node*) (w->nodes + offset);
+	n->kind = kind;
+	n->size = size;
+
+	return offset;
+}
+
+#define NODE(w, type, offset) ((type*) ((w)->nodes + (offset)))
+
+static void _set_ref(ast_writer* w, ast_ref* slot, uint32_t target) {
+	if(target != NO_NODE) {
+		*slot = (int32_t) ((int64_t) target - ((char*) slot - w->nodes));
+	}
+}
+
+static ast_string _intern(ast_writer* w, const char* s) {
+	uint32_t* found = ast_strings_map_get(w->interned, s);
+	if(found) {
+		return *found;
+	}
+
+	size_t length = strlen(s) + 1;
+	if(w->strings_size + length > w->strings_capacity) {
+		w->strings_capacity = w->strings_capacity ? w->strings_capacity * 2 : 1024;
+		while(w->strings_size + length > w->strings_capacity) {
+			w->strings_capacity *= 2;
+		}
+		w->strings = realloc(w->strings, w->strings_capacity);
+	}
+
+	uint32_t offset = w->strings_size;
+	memcpy(w->strings + offset, s, length);
+	w->strings_size += length;
+
+	ast_strings_map_insert(w->interned, s, offset);
+
+	return offset;
+}
+
+// A missing name, like the one of an unnamed parameter, is written as _EOF
+static void _write_token(ast_writer* w, ast_binary_token* out, token* t) {
+	if(t == NULL) {
+		out->type = _EOF;
+		return;
+	}
+	out->type = t->type;
+	out->loc = t->loc;
+	switch(t->type) {
+		case STRING:
+		case IDENTIFIER:
+			out->string = _intern(w, t->string_value);
+			break;
+		case INTEGER:
+			out->integer = t->integer_value;
+			break;
+		case NUMERIC:
+			out->number = t->double_value;
+			break;
+		default:
+			break;
+	}
+}
+
+// Tokens are stored inline; the buffer may move while strings are interned, so go through the offset
+#define WRITE_TOKEN(w, type, offset, field, t) \
+	do { \
+		ast_binary_token _tok; \
+		memset(&_tok, 0, sizeof(_tok)); \
+		_write_token(w, &_tok, t); \
+		NODE(w, type, offset)->field = _tok; \
+	} while(0)
+
+static uint32_t _write_refs(ast_writer* w, uint32_t* items, int count) {
+	uint32_t offset = _reserve(w, AK_LIST, sizeof(ast_binary_list) + sizeof(ast_ref) * count);
+	ast_binary_list* l = NODE(w, ast_binary_list, offset);
+	l->count = count;
+	for(int i = 0; i < count; i++) {
+		_set_ref(w, &l->items[i], items[i]);
+	}
+	return offset;
+}
+
+static uint32_t _write_lexems(ast_writer* w, spec_list* l) {
+	uint32_t offset = _reserve(w, AK_LEXEMS, sizeof(ast_binary_lexems) + sizeof(uint32_t) * l->size);
+	ast_binary_lexems* n = NODE(w, ast_binary_lexems, offset);
+	n->count = l->size;
+	for(int i = 0; i < l->size; i++) {
+		n->lexems[i] = l->data[i];
+	}
+	return offset;
+}
+
+static uint32_t _write_ref_node(ast_writer* w, uint32_t kind, uint32_t target) {
+	uint32_t offset = _reserve(w, kind, sizeof(ast_binary_ref_node));
+	_set_ref(w, &NODE(w, ast_binary_ref_node, offset)->value, target);
+	return offset;
+}
+
+static uint32_t _write_token_node(ast_writer* w, uint32_t kind, token* t) {
+	uint32_t offset = _reserve(w, kind, sizeof(ast_binary_token_node));
+	WRITE_TOKEN(w, ast_binary_token_node, offset, token, t);
+	return offset;
+}
+
+static uint32_t _write_operator(ast_writer* w, uint32_t kind, uint32_t left, enum lexem op, uint32_t right, int postfix) {
+	uint32_t offset = _reserve(w, kind, sizeof(ast_binary_operator));
+	ast_binary_operator* n = NODE(w, ast_binary_operator, offset);
+	_set_ref(w, &n->left, left);
+	_set_ref(w, &n->right, right);
+	n->op = op;
+	n->postfix = postfix;
+	return offset;
+}
+
+static uint32_t _write_pair(ast_writer* w, uint32_t kind, uint32_t first, uint32_t second) {
+	uint32_t offset = _reserve(w, kind, sizeof(ast_binary_pair));
+	_set_ref(w, &NODE(w, ast_binary_pair, offset)->first, first);
+	_set_ref(w, &NODE(w, ast_binary_pair, offset)->second, second);
+	return offset;
+}
+
+static uint32_t _write_type(ast_writer* w, type_info* t, uint32_t* c) {
+	uint32_t offset;
+
+	switch(t->type) {
+		case T_TRIVIAL:
+			return _write_token_node(w, AK_TYPE_TRIVIAL, t->data);
+		case T_POINTER:
+			return _write_ref_node(w, AK_TYPE_POINTER, c[0]);
+		case T_ARRAY:
+			offset = _reserve(w, AK_TYPE_ARRAY, sizeof(ast_binary_array));
+			_set_ref(w, &NODE(w, ast_binary_array, offset)->value, c[0]);
+			NODE(w, ast_binary_array, offset)->size = ((array*) t->data)->size;
+			return offset;
+	}
+
+	return NO_NODE;
+}
+
+static uint32_t _write_expr(ast_writer* w, expr* e, uint32_t* c) {
+	switch(e->type) {
+		case ET_UNARY: {
+			unary_expr* u = e->data;
+			return _write_operator(w, AK_EXPR_UNARY, NO_NODE, u->op, c[0], u->postfix);
+		}
+		case ET_BINARY:
+			return _write_operator(w, AK_EXPR_BINARY, c[0], ((binary_expr*) e->data)->op, c[1], 0);
+		case ET_ASSIGNMENT:
+			return _write_operator(w, AK_EXPR_ASSIGNMENT, c[0], ((assignment_expr*) e->data)->op, c[1], 0);
+		case ET_GROUP:
+			return _write_ref_node(w, AK_EXPR_GROUP, c[0]);
+		case ET_LITERAL:
+			return _write_token_node(w, AK_EXPR_LITERAL, ((literal_expr*) e->data)->value);
+		case ET_CALL: {
+			uint32_t args = _write_refs(w, c + 1, ((call_expr*) e->data)->args->size);
+			return _write_pair(w, AK_EXPR_CALL, c[0], args);
+		}
+		case ET_SUBSCRIPT:
+			return _write_pair(w, AK_EXPR_SUBSCRIPT, c[0], c[1]);
+		case ET_SIZEOF:
+			if(((sizeof_expr*) e->data)->expr) {
+				return _write_pair(w, AK_EXPR_SIZEOF, c[0], NO_NODE);
+			}
+			return _write_pair(w, AK_EXPR_SIZEOF, NO_NODE, c[0]);
+	}
+
+	return NO_NODE;
+}
+
+static uint32_t _write_decl(ast_writer* w, decl* d, uint32_t* c) {
+	uint32_t offset = _reserve(w, AK_STMT_DECL, sizeof(ast_binary_decl));
+	ast_binary_decl* n = NODE(w, ast_binary_decl, offset);
+	_set_ref(w, &n->specifiers, c[0]);
+	_set_ref(w, &n->type, c[1]);
+	_set_ref(w, &n->initializer, c[2]);
+	WRITE_TOKEN(w, ast_binary_decl, offset, identifier, d->identifier);
+
+	return offset;
+}
+
+static uint32_t _write_fun_def(ast_writer* w, fun_def* f, uint32_t* c) {
+	uint32_t offset = _reserve(w, AK_STMT_FUN_DEF, sizeof(ast_binary_fun_def));
+	ast_binary_fun_def* n = NODE(w, ast_binary_fun_def, offset);
+	_set_ref(w, &n->specifiers, c[0]);
+	_set_ref(w, &n->ret_type, c[1]);
+	_set_ref(w, &n->params, c[2]);
+	_set_ref(w, &n->body, c[3]);
+	WRITE_TOKEN(w, ast_binary_fun_def, offset, identifier, f->identifier);
+
+	return offset;
+}
+
+// Replaces the declaration on top of the value stack with the member node wrapping it
+static void _write_member(ast_writer* w, qualified_statement* qs) {
+	uint32_t* top = &w->values->data[w->values->size - 1];
+	uint32_t declaration = *top;
+	*top = _reserve(w, AK_CLASS_MEMBER, sizeof(ast_binary_member));
+	ast_binary_member* m = NODE(w, ast_binary_member, *top);
+	m->is_static = qs->is_static;
+	m->qualifier = qs->qualifier;
+	_set_ref(w, &m->declaration, declaration);
+}
+
+static uint32_t _write_class(ast_writer* w, class_info* c, uint32_t* members) {
+	uint32_t body = NO_NODE;
+
+	if(c->body) {
+		body = _write_refs(w, members, c->body->size);
+	}
+
+	uint32_t offset = _reserve(w, AK_STMT_CLASS, sizeof(ast_binary_class));
+	_set_ref(w, &NODE(w, ast_binary_class, offset)->body, body);
+	WRITE_TOKEN(w, ast_binary_class, offset, identifier, c->identifier);
+
+	return offset;
+}
+
+static uint32_t _write_stmt(ast_writer* w, stmt* s, uint32_t* c) {
+	uint32_t offset;
+
+	switch(s->type) {
+		case ST_EXPRESSION:
+			return _write_ref_node(w, AK_STMT_EXPR, c[0]);
+		case ST_BLOCK:
+			return _write_ref_node(w, AK_STMT_BLOCK, _write_refs(w, c, ((stmt_list*) s->data)->size));
+		case ST_DECL:
+			return _write_decl(w, s->data, c);
+		case ST_IF: {
+			offset = _reserve(w, AK_STMT_IF, sizeof(ast_binary_if));
+			ast_binary_if* n = NODE(w, ast_binary_if, offset);
+			_set_ref(w, &n->condition, c[0]);
+			_set_ref(w, &n->body, c[1]);
+			_set_ref(w, &n->branch, c[2]);
+			return offset;
+		}
+		case ST_FOR: {
+			offset = _reserve(w, AK_STMT_FOR, sizeof(ast_binary_for));
+			ast_binary_for* n = NODE(w, ast_binary_for, offset);
+			_set_ref(w, &n->initializer, c[0]);
+			_set_ref(w, &n->condition, c[1]);
+			_set_ref(w, &n->increment, c[2]);
+			_set_ref(w, &n->body, c[3]);
+			return offset;
+		}
+		case ST_WHILE: {
+			offset = _reserve(w, AK_STMT_WHILE, sizeof(ast_binary_while));
+			ast_binary_while* n = NODE(w, ast_binary_while, offset);
+			_set_ref(w, &n->condition, c[0]);
+			_set_ref(w, &n->body, c[1]);
+			n->prefix = ((while_loop*) s->data)->prefix;
+			return offset;
+		}
+		case ST_RETURN:
+			return _write_ref_node(w, AK_STMT_RETURN, c[0]);
+		case ST_FUN_DEF:
+			return _write_fun_def(w, s->data, c);
+		case ST_LOOP_CTRL:
+			return _write_token_node(w, AK_STMT_LOOP_CTRL, s->data);
+		case ST_TYPEDEF: {
+			offset = _reserve(w, AK_STMT_TYPEDEF, sizeof(ast_binary_typedef));
+			_set_ref(w, &NODE(w, ast_binary_typedef, offset)->type, c[0]);
+			WRITE_TOKEN(w, ast_binary_typedef, offset, alias, ((typedef_stmt*) s->data)->alias);
+			return offset;
+		}
+		case ST_CLASS:
+			return _write_class(w, s->data, c);
+	}
+
+	return NO_NODE;
+}
+
+// Nodes are written on leave, once all of their children are. Each child leaves its
+// offset on the value stack, and bases records where the values of every open node start
+static int _writer_enter(void* ctx, enum syntax_node_kind kind, void* node) {
+	ast_writer* w = ctx;
+	ast_offset_list_append(w->bases, w->values->size);
+
+	if(kind == SN_STMT) {
+		stmt* s = node;
+		if(s->type == ST_DECL) {
+			ast_offset_list_append(w->values, _write_lexems(w, ((decl*) s->data)->specifiers));
+		} else if(s->type == ST_FUN_DEF) {
+			ast_offset_list_append(w->values, _write_lexems(w, ((fun_def*) s->data)->specifiers));
+		}
+	}
+
+	return VISIT_CONTINUE;
+}
+
+static int _writer_child(void* ctx, enum syntax_node_kind kind, void* node, int slot, void* child) {
+	ast_writer* w = ctx;
+
+	if(kind == SN_STMT) {
+		stmt* s = node;
+		if(s->type == ST_CLASS && slot) {
+			_write_member(w, ((class_info*) s->data)->body->data[slot - 1]);
+		} else if(s->type == ST_FUN_DEF && slot == ((fun_def*) s->data)->params->size + 1) {
+			// Parameters are collapsed into their list before the body is written
+			uint32_t params = w->bases->data[w->bases->size - 1] + 2;
+			uint32_t list = _write_refs(w, w->values->data + params, slot - 1);
+			w->values->size = params;
+			ast_offset_list_append(w->values, list);
+		}
+	}
+
+	if(child == NULL) {
+		ast_offset_list_append(w->values, NO_NODE);
+	}
+
+	return VISIT_CONTINUE;
+}
+
+static int _writer_leave(void* ctx, enum syntax_node_kind kind, void* node) {
+	ast_writer* w = ctx;
+	uint32_t base = w->bases->data[--w->bases->size];
+	uint32_t offset = NO_NODE;
+
+	switch(kind) {
+		case SN_PROGRAM:
+			offset = _write_refs(w, w->values->data + base, ((prog*) node)->statements->size);
+			offset = _write_ref_node(w, AK_PROGRAM, offset);
+			break;
+		case SN_STMT: {
+			stmt* s = node;
+			if(s->type == ST_CLASS && ((class_info*) s->data)->body && ((class_info*) s->data)->body->size) {
+				q_stmt_list* body = ((class_info*) s->data)->body;
+				_write_member(w, body->data[body->size - 1]);
+			}
+			offset = _write_stmt(w, s, w->values->data + base);
+			break;
+		}
+		case SN_EXPR:
+			offset = _write_expr(w, node, w->values->data + base);
+			break;
+		case SN_TYPE:
+			offset = _write_type(w, node, w->values->data + base);
+			break;
+	}
+
+	w->values->size = base;
+	ast_offset_list_append(w->values, offset);
+
+	return VISIT_CONTINUE;
+}
+
+static const ast_visitor _binary_writer = {
+	.enter = _writer_enter,
+	.child = _writer_child,
+	.leave = _writer_leave
+};
+
+int syntax_write_binary(syntax_tree* tree, FILE* out) {
+	ast_writer w;
+	memset(&w, 0, sizeof(w));
+	w.interned = ast_strings_map_create();
+	w.values = ast_offset_list_create();
+	w.bases = ast_offset_list_create();
+
+	syntax_walk_tree(tree, &_binary_writer, &w);
+	uint32_t root = w.values->data[0];
+
+	ast_binary_header h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, AST_BINARY_MAGIC, sizeof(h.magic));
+	h.version = AST_BINARY_VERSION;
+	h.nodes_offset = sizeof(h);
+	h.nodes_size = w.size;
+	h.root = h.nodes_offset + root;
+	h.strings_offset = h.nodes_offset + w.size;
+	h.strings_size = w.strings_size;
+
+	int code = 0;
+	if(fwrite(&h, sizeof(h), 1, out) != 1 ||
+	   fwrite(w.nodes, 1, w.size, out) != w.size ||
+	   fwrite(w.strings, 1, w.strings_size, out) != w.strings_size) {
+		code = 1;
+	}
+
+	free(w.nodes);
+	free(w.strings);
+	ast_strings_map_free(w.interned);
+	ast_offset_list_free(w.values);
+	ast_offset_list_free(w.bases);
+
+	return code;
+}
+
+const ast_binary_header* syntax_open_binary(const char* data, size_t size) {
+	const ast_binary_header* h = (const ast_binary_header*) data;
+
+	if(size < sizeof(ast_binary_header) || ((uintptr_t) data & 7) ||
+	   memcmp(h->magic, AST_BINARY_MAGIC, sizeof(h->magic)) || h->version != AST_BINARY_VERSION) {
+		return NULL;
+	}
+
+	if(h->nodes_offset < sizeof(ast_binary_header) || (h->nodes_offset & 7) ||
+	   (uint64_t) h->nodes_offset + h->nodes_size > size ||
+	   (uint64_t) h->strings_offset + h->strings_size > size ||
+	   h->root < h->nodes_offset || (h->root & 7) || (uint64_t) h->root + sizeof(ast_binary_ref_node) > (uint64_t) h->nodes_offset + h->nodes_size) {
+		return NULL;
+	}
+
+	return h;
+}
+
+typedef struct {
+	enum syntax_node_kind kind;
+	const ast_ref* ref;
+	void** dest;
+	int required;
+} load_item;
+
+LIST_DEF_AND_IMPL(load_item, load_item)
+
+// Every block and list the loader allocates, so a corrupt file frees what was loaded
+// before the error without walking a half-linked tree
+typedef struct {
+	void* ptr;
+	int is_list;
+} load_block;
+
+LIST_DEF_AND_IMPL(load_block, load_block)
+
+typedef struct {
+	const ast_binary_header* header;
+	const char* nodes;
+	const char* nodes_end;
+	token_stream* tokens;
+	load_item_list* pending;
+	load_block_list* blocks;
+	jmp_buf error_restore;
+} ast_loader;
+
+static void _corrupt(ast_loader* l) __attribute__((noreturn));
+static void _corrupt(ast_loader* l) {
+	longjmp(l->error_restore, 1);
+}
+
+static void* _alloc(ast_loader* l, size_t size) {
+	void* ptr = hatch_malloc(ALLOC_PARSER, size);
+	load_block_list_append(l->blocks, (load_block) { ptr, 0 });
+	return ptr;
+}
+
+// Lists of every element type share the layout of stmt_list
+static void* _track_list(ast_loader* l, void* list) {
+	load_block_list_append(l->blocks, (load_block) { list, 1 });
+	return list;
+}
+
+static void _free_loaded(ast_loader* l) {
+	for(int i = 0; i < l->blocks->size; i++) {
+		if(l->blocks->data[i].is_list) {
+			stmt_list_free(l->blocks->data[i].ptr);
+		} else {
+			hatch_free(ALLOC_PARSER, l->blocks->data[i].ptr);
+		}
+	}
+}
+
+// Refs must point backwards into the node section, which also rules out cycles
+static const ast_binary_node* _deref(ast_loader* l, const ast_ref* ref, size_t min_size) {
+	if(*ref == 0) {
+		return NULL;
+	}
+	if(*ref > 0) {
+		_corrupt(l);
+	}
+
+	const char* target = (const char*) ref + *ref;
+	if(target < l->nodes || target + sizeof(ast_binary_node) > l->nodes_end || ((target - l->nodes) & 7)) {
+		_corrupt(l);
+	}
+
+	const ast_binary_node* n = (const ast_binary_node*) target;
+	if(n->size < min_size || n->size > (size_t) (l->nodes_end - target)) {
+		_corrupt(l);
+	}
+
+	return n;
+}
+
+static const ast_binary_node* _require(ast_loader* l, const ast_ref* ref, size_t min_size) {
+	const ast_binary_node* n = _deref(l, ref, min_size);
+	if(n == NULL) {
+		_corrupt(l);
+	}
+	return n;
+}
+
+static const ast_binary_list* _list(ast_loader* l, const ast_ref* ref) {
+	const ast_binary_list* n = (const ast_binary_list*) _require(l, ref, sizeof(ast_binary_list));
+	if(n->node.kind != AK_LIST || n->node.size < sizeof(ast_binary_list) + (uint64_t) n->count * sizeof(ast_ref)) {
+		_corrupt(l);
+	}
+	return n;
+}
+
+static const char* _string(ast_loader* l, ast_string s) {
+	const ast_binary_header* h = l->header;
+	if(s >= h->strings_size) {
+		_corrupt(l);
+	}
+	const char* str = ast_binary_string(h, s);
+	if(memchr(str, '\0', h->strings_size - s) == NULL) {
+		_corrupt(l);
+	}
+	return str;
+}
+
+static token* _load_token(ast_loader* l, const ast_binary_token* t) {
+	if(t->type > THIS) {
+		_corrupt(l);
+	}
+	token* r = lex_stream_append_token(l->tokens, t->type, t->loc);
+	switch(t->type) {
+		case STRING:
+		case IDENTIFIER:
+			r->string_value = hatch_strdup(ALLOC_LEXER, _string(l, t->string));
+			break;
+		case INTEGER:
+			r->integer_value = t->integer;
+			break;
+		case NUMERIC:
+			r->double_value = t->number;
+			break;
+		default:
+			break;
+	}
+	return r;
+}
+
+// Operators and specifiers are printed by their spelling, which every keyword and
+// punctuator has
+static uint32_t _lexem(ast_loader* l, uint32_t lexem) {
+	if(lexem > THIS || lex_lexem_spelling(lexem) == NULL) {
+		_corrupt(l);
+	}
+	return lexem;
+}
+
+// Declared names are identifiers, only a parameter may have none
+static token* _load_name(ast_loader* l, const ast_binary_token* t, int optional) {
+	if(optional && t->type == _EOF) {
+		return NULL;
+	}
+	if(t->type != IDENTIFIER) {
+		_corrupt(l);
+	}
+	return _load_token(l, t);
+}
+
+static spec_list* _load_lexems(ast_loader* l, const ast_ref* ref) {
+	const ast_binary_lexems* n = (const ast_binary_lexems*) _require(l, ref, sizeof(ast_binary_lexems));
+	if(n->node.kind != AK_LEXEMS || n->node.size < sizeof(ast_binary_lexems) + (uint64_t) n->count * sizeof(uint32_t)) {
+		_corrupt(l);
+	}
+
+	spec_list* specs = _track_list(l, spec_list_create());
+	for(uint32_t i = 0; i < n->count; i++) {
+		spec_list_append(specs, _lexem(l, n->lexems[i]));
+	}
+	return specs;
+}
+
+// Children are not loaded in place but queued on l->pending together with the field
+// they belong in, so loading needs no C stack proportional to the depth of the tree
+static void _schedule(ast_loader* l, enum syntax_node_kind kind, const ast_ref* ref, void* dest, int required) {
+	load_item_list_append(l->pending, (load_item) { kind, ref, dest, required });
+}
+
+static type_info* _load_type(ast_loader* l, const ast_ref* ref) {
+	const ast_binary_node* n = _deref(l, ref, sizeof(ast_binary_ref_node));
+	if(n == NULL) {
+		return NULL;
+	}
+
+	type_info* t = _alloc(l, sizeof(type_info));
+	t->canonical = NULL;
+
+	switch(n->kind) {
+		case AK_TYPE_TRIVIAL:
+			if(n->size < sizeof(ast_binary_token_node)) {
+				_corrupt(l);
+			}
+			t->type = T_TRIVIAL;
+			t->data = _load_token(l, &((const ast_binary_token_node*) n)->token);
+			if(!check_token_trivial_type((token*) t->data)) {
+				_corrupt(l);
+			}
+			break;
+		case AK_TYPE_POINTER: {
+			pointer* ptr = _alloc(l, sizeof(pointer));
+			_schedule(l, SN_TYPE, &((const ast_binary_ref_node*) n)->value, &ptr->value, 1);
+			t->type = T_POINTER;
+			t->data = ptr;
+			break;
+		}
+		case AK_TYPE_ARRAY: {
+			const ast_binary_array* a = (const ast_binary_array*) n;
+			array* arr = _alloc(l, sizeof(array));
+			_schedule(l, SN_TYPE, &a->value, &arr->value, 1);
+			arr->size = a->size;
+			t->type = T_ARRAY;
+			t->data = arr;
+			break;
+		}
+		default:
+			_corrupt(l);
+	}
+
+	return t;
+}
+
+static expr* _make_node_expr(ast_loader* l, enum expr_type type, void* data) {
+	expr* e = _alloc(l, sizeof(expr));
+	e->type = type;
+	e->data = data;
+	return e;
+}
+
+static expr* _load_expr(ast_loader* l, const ast_ref* ref) {
+	const ast_binary_node* n = _deref(l, ref, sizeof(ast_binary_ref_node));
+	if(n == NULL) {
+		return NULL;
+	}
+
+	switch(n->kind) {
+		case AK_EXPR_UNARY:
+		case AK_EXPR_BINARY:
+		case AK_EXPR_ASSIGNMENT: {
+			if(n->size < sizeof(ast_binary_operator)) {
+				_corrupt(l);
+			}
+			const ast_binary_operator* o = (const ast_binary_operator*) n;
+			if(n->kind == AK_EXPR_UNARY) {
+				unary_expr* u = _alloc(l, sizeof(unary_expr));
+				u->op = _lexem(l, o->op);
+				_schedule(l, SN_EXPR, &o->right, &u->right, 1);
+				u->postfix = o->postfix;
+				return _make_node_expr(l, ET_UNARY, u);
+			} else if(n->kind == AK_EXPR_BINARY) {
+				binary_expr* b = _alloc(l, sizeof(binary_expr));
+				_schedule(l, SN_EXPR, &o->left, &b->left, 1);
+				b->op = _lexem(l, o->op);
+				_schedule(l, SN_EXPR, &o->right, &b->right, 1);
+				return _make_node_expr(l, ET_BINARY, b);
+			} else {
+				assignment_expr* a = _alloc(l, sizeof(assignment_expr));
+				_schedule(l, SN_EXPR, &o->left, &a->lvalue, 1);
+				a->op = _lexem(l, o->op);
+				_schedule(l, SN_EXPR, &o->right, &a->rvalue, 1);
+				return _make_node_expr(l, ET_ASSIGNMENT, a);
+			}
+		}
+		case AK_EXPR_GROUP: {
+			group_expr* g = _alloc(l, sizeof(group_expr));
+			_schedule(l, SN_EXPR, &((const ast_binary_ref_node*) n)->value, &g->expr, 1);
+			return _make_node_expr(l, ET_GROUP, g);
+		}
+		case AK_EXPR_LITERAL: {
+			if(n->size < sizeof(ast_binary_token_node)) {
+				_corrupt(l);
+			}
+			literal_expr* lit = _alloc(l, sizeof(literal_expr));
+			lit->value = _load_token(l, &((const ast_binary_token_node*) n)->token);
+			if(!syntax_check_specific_token(lit->value, 9, STRING, INTEGER, NUMERIC, NIL, FALSE, TRUE, IDENTIFIER, THIS)) {
+				_corrupt(l);
+			}
+			lit->symbol = NULL;
+			return _make_node_expr(l, ET_LITERAL, lit);
+		}
+		case AK_EXPR_CALL: {
+			const ast_binary_pair* p = (const ast_binary_pair*) n;
+			call_expr* c = _alloc(l, sizeof(call_expr));
+			_schedule(l, SN_EXPR, &p->first, &c->callee, 1);
+			c->args = _track_list(l, args_list_create());
+			const ast_binary_list* args = _list(l, &p->second);
+			for(uint32_t i = 0; i < args->count; i++) {
+				args_list_append(c->args, NULL);
+			}
+			for(uint32_t i = 0; i < args->count; i++) {
+				_schedule(l, SN_EXPR, &args->items[i], &c->args->data[i], 1);
+			}
+			return _make_node_expr(l, ET_CALL, c);
+		}
+		case AK_EXPR_SUBSCRIPT: {
+			const ast_binary_pair* p = (const ast_binary_pair*) n;
+			subscript_expr* s = _alloc(l, sizeof(subscript_expr));
+			_schedule(l, SN_EXPR, &p->first, &s->array, 1);
+			_schedule(l, SN_EXPR, &p->second, &s->index, 1);
+			return _make_node_expr(l, ET_SUBSCRIPT, s);
+		}
+		case AK_EXPR_SIZEOF: {
+			const ast_binary_pair* p = (const ast_binary_pair*) n;
+			sizeof_expr* s = _alloc(l, sizeof(sizeof_expr));
+			_schedule(l, SN_EXPR, &p->first, &s->expr, 0);
+			_schedule(l, SN_TYPE, &p->second, &s->type, 0);
+			return _make_node_expr(l, ET_SIZEOF, s);
+		}
+		default:
+			_corrupt(l);
+	}
+}
+
+static stmt* _make_node_stmt(ast_loader* l, enum stmt_type type, void* data) {
+	stmt* s = _alloc(l, sizeof(stmt));
+	s->type = type;
+	s->data = data;
+	return s;
+}
+
+static stmt_list* _load_stmts(ast_loader* l, const ast_ref* ref) {
+	const ast_binary_list* n = _list(l, ref);
+	stmt_list* list = _track_list(l, stmt_list_create());
+	for(uint32_t i = 0; i < n->count; i++) {
+		stmt_list_append(list, NULL);
+	}
+	// The list is not appended to anymore, so the slots stay where they are
+	for(uint32_t i = 0; i < n->count; i++) {
+		_schedule(l, SN_STMT, &n->items[i], &list->data[i], 1);
+	}
+	return list;
+}
+
+static class_info* _load_class(ast_loader* l, const ast_binary_class* n) {
+	class_info* c = _alloc(l, sizeof(class_info));
+	c->identifier = _load_name(l, &n->identifier, 0);
+	c->body = NULL;
+
+	if(n->body) {
+		const ast_binary_list* members = _list(l, &n->body);
+		c->body = _track_list(l, q_stmt_list_create());
+		for(uint32_t i = 0; i < members->count; i++) {
+			const ast_binary_member* m = (const ast_binary_member*) _require(l, &members->items[i], sizeof(ast_binary_member));
+			if(m->node.kind != AK_CLASS_MEMBER) {
+				_corrupt(l);
+			}
+			qualified_statement* qs = _alloc(l, sizeof(qualified_statement));
+			qs->is_static = m->is_static;
+			qs->qualifier = m->qualifier;
+			_schedule(l, SN_STMT, &m->declaration, &qs->declaration, 1);
+			q_stmt_list_append(c->body, qs);
+		}
+	}
+
+	return c;
+}
+
+static const size_t _stmt_sizes[] = {
+	[AK_STMT_EXPR]      = sizeof(ast_binary_ref_node),
+	[AK_STMT_BLOCK]     = sizeof(ast_binary_ref_node),
+	[AK_STMT_DECL]      = sizeof(ast_binary_decl),
+	[AK_STMT_IF]        = sizeof(ast_binary_if),
+	[AK_STMT_FOR]       = sizeof(ast_binary_for),
+	[AK_STMT_WHILE]     = sizeof(ast_binary_while),
+	[AK_STMT_RETURN]    = sizeof(ast_binary_ref_node),
+	[AK_STMT_FUN_DEF]   = sizeof(ast_binary_fun_def),
+	[AK_STMT_LOOP_CTRL] = sizeof(ast_binary_token_node),
+	[AK_STMT_TYPEDEF]   = sizeof(ast_binary_typedef),
+	[AK_STMT_CLASS]     = sizeof(ast_binary_class)
+};
+
+static stmt* _load_stmt(ast_loader* l, const ast_ref* ref) {
+	const ast_binary_node* n = _deref(l, ref, sizeof(ast_binary_ref_node));
+	if(n == NULL) {
+		return NULL;
+	}
+	if(n->kind < AK_STMT_EXPR || n->kind > AK_STMT_CLASS || n->size < _stmt_sizes[n->kind]) {
+		_corrupt(l);
+	}
+
+	switch(n->kind) {
+		case AK_STMT_EXPR: {
+			stmt* s = _make_node_stmt(l, ST_EXPRESSION, NULL);
+			_schedule(l, SN_EXPR, &((const ast_binary_ref_node*) n)->value, &s->data, 1);
+			return s;
+		}
+		case AK_STMT_BLOCK:
+			return _make_node_stmt(l, ST_BLOCK, _load_stmts(l, &((const ast_binary_ref_node*) n)->value));
+		case AK_STMT_DECL: {
+			const ast_binary_decl* b = (const ast_binary_decl*) n;
+			decl* d = _alloc(l, sizeof(decl));
+			d->specifiers = _load_lexems(l, &b->specifiers);
+			_schedule(l, SN_TYPE, &b->type, &d->type, 1);
+			d->identifier = _load_name(l, &b->identifier, 1);
+			_schedule(l, SN_EXPR, &b->initializer, &d->initializer, 0);
+			return _make_node_stmt(l, ST_DECL, d);
+		}
+		case AK_STMT_IF: {
+			const ast_binary_if* b = (const ast_binary_if*) n;
+			conditional* c = _alloc(l, sizeof(conditional));
+			_schedule(l, SN_EXPR, &b->condition, &c->condition, 1);
+			_schedule(l, SN_STMT, &b->body, &c->body, 1);
+			_schedule(l, SN_STMT, &b->branch, &c->branch, 0);
+			return _make_node_stmt(l, ST_IF, c);
+		}
+		case AK_STMT_FOR: {
+			const ast_binary_for* b = (const ast_binary_for*) n;
+			for_loop* f = _alloc(l, sizeof(for_loop));
+			_schedule(l, SN_STMT, &b->initializer, &f->initializer, 0);
+			_schedule(l, SN_EXPR, &b->condition, &f->condition, 0);
+			_schedule(l, SN_EXPR, &b->increment, &f->increment, 0);
+			_schedule(l, SN_STMT, &b->body, &f->body, 1);
+			return _make_node_stmt(l, ST_FOR, f);
+		}
+		case AK_STMT_WHILE: {
+			const ast_binary_while* b = (const ast_binary_while*) n;
+			while_loop* w = _alloc(l, sizeof(while_loop));
+			_schedule(l, SN_EXPR, &b->condition, &w->condition, 1);
+			_schedule(l, SN_STMT, &b->body, &w->body, 1);
+			w->prefix = b->prefix;
+			return _make_node_stmt(l, ST_WHILE, w);
+		}
+		case AK_STMT_RETURN: {
+			stmt* s = _make_node_stmt(l, ST_RETURN, NULL);
+			_schedule(l, SN_EXPR, &((const ast_binary_ref_node*) n)->value, &s->data, 0);
+			return s;
+		}
+		case AK_STMT_FUN_DEF: {
+			const ast_binary_fun_def* b = (const ast_binary_fun_def*) n;
+			fun_def* f = _alloc(l, sizeof(fun_def));
+			f->specifiers = _load_lexems(l, &b->specifiers);
+			_schedule(l, SN_TYPE, &b->ret_type, &f->ret_type, 1);
+			f->identifier = _load_name(l, &b->identifier, 0);
+			f->params = _load_stmts(l, &b->params);
+			_schedule(l, SN_STMT, &b->body, &f->body, 0);
+			f->lazy_tokens = NULL;
+			return _make_node_stmt(l, ST_FUN_DEF, f);
+		}
+		case AK_STMT_LOOP_CTRL: {
+			token* t = _load_token(l, &((const ast_binary_token_node*) n)->token);
+			if(!syntax_check_specific_token(t, 2, CONTINUE, BREAK)) {
+				_corrupt(l);
+			}
+			return _make_node_stmt(l, ST_LOOP_CTRL, t);
+		}
+		case AK_STMT_TYPEDEF: {
+			const ast_binary_typedef* b = (const ast_binary_typedef*) n;
+			typedef_stmt* t = _alloc(l, sizeof(typedef_stmt));
+			_schedule(l, SN_TYPE, &b->type, &t->type, 1);
+			t->alias = _load_name(l, &b->alias, 0);
+			return _make_node_stmt(l, ST_TYPEDEF, t);
+		}
+		case AK_STMT_CLASS:
+			return _make_node_stmt(l, ST_CLASS, _load_class(l, (const ast_binary_class*) n));
+		default:
+			_corrupt(l);
+	}
+}
+
+static void _load_pending(ast_loader* l) {
+	while(l->pending->size) {
+		load_item item = l->pending->data[--l->pending->size];
+		void* node = NULL;
+		switch(item.kind) {
+			case SN_STMT:
+				node = _load_stmt(l, item.ref);
+				break;
+			case SN_EXPR:
+				node = _load_expr(l, item.ref);
+				break;
+			case SN_TYPE:
+				node = _load_type(l, item.ref);
+				break;
+			case SN_PROGRAM:
+				_corrupt(l);
+		}
+		if(node == NULL && item.required) {
+			_corrupt(l);
+		}
+		*item.dest = node;
+	}
+}
+
+int syntax_load_binary(const char* data, size_t size, token_stream* tokens, syntax_tree* tree) {
+	const ast_binary_header* h = syntax_open_binary(data, size);
+	if(h == NULL) {
+		return 1;
+	}
+
+	ast_loader l = {
+		.header = h,
+		.nodes = data + h->nodes_offset,
+		.nodes_end = data + h->nodes_offset + h->nodes_size,
+		.tokens = tokens
+	};
+
+	const ast_binary_ref_node* root = ast_binary_root(h);
+	if(root->node.kind != AK_PROGRAM) {
+		return 1;
+	}
+
+	int code = 0;
+	l.pending = load_item_list_create();
+	l.blocks = load_block_list_create();
+
+	if(setjmp(l.error_restore) == 0) {
+		prog* p = _alloc(&l, sizeof(prog));
+		p->statements = _load_stmts(&l, &root->value);
+		_load_pending(&l);
+		tree->program = p;
+	} else {
+		_free_loaded(&l);
+		code = 1;
+	}
+
+	load_item_list_free(l.pending);
+	load_block_list_free(l.blocks);
+
+	return code;
+}
@@ -0,0 +1,204 @@
+#ifndef _SYNTAX_AST_BINARY_H
+#define _SYNTAX_AST_BINARY_H
+
+#include "lex.h"
+#include "syntax.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define AST_BINARY_MAGIC   "HAST"
+#define AST_BINARY_VERSION 1
+
+// Every node starts with ast_binary_node and is 8-byte aligned. Children are
+// referenced by ast_ref, the signed distance from the ref field itself to the
+// child node (0 means no child). Nodes are written children first, so refs
+// always point backwards. Strings are offsets into the interned string section.
+// Token locations are only meaningful together with the sources that produced them.
+
+enum ast_node_kind {
+	AK_PROGRAM = 1,
+	AK_LIST,
+	AK_LEXEMS,
+	AK_STMT_EXPR,
+	AK_STMT_BLOCK,
+	AK_STMT_DECL,
+	AK_STMT_IF,
+	AK_STMT_FOR,
+	AK_STMT_WHILE,
+	AK_STMT_RETURN,
+	AK_STMT_FUN_DEF,
+	AK_STMT_LOOP_CTRL,
+	AK_STMT_TYPEDEF,
+	AK_STMT_CLASS,
+	AK_CLASS_MEMBER,
+	AK_EXPR_UNARY,
+	AK_EXPR_BINARY,
+	AK_EXPR_GROUP,
+	AK_EXPR_LITERAL,
+	AK_EXPR_ASSIGNMENT,
+	AK_EXPR_CALL,
+	AK_EXPR_SUBSCRIPT,
+	AK_EXPR_SIZEOF,
+	AK_TYPE_TRIVIAL,
+	AK_TYPE_POINTER,
+	AK_TYPE_ARRAY
+};
+
+typedef int32_t  ast_ref;
+typedef uint32_t ast_string;
+
+typedef struct {
+	char     magic[4];
+	uint32_t version;
+	uint32_t root;
+	uint32_t nodes_offset;
+	uint32_t nodes_size;
+	uint32_t strings_offset;
+	uint32_t strings_size;
+	uint32_t reserved;
+} ast_binary_header;
+
+typedef struct {
+	uint32_t kind;
+	uint32_t size;
+} ast_binary_node;
+
+typedef struct {
+	uint32_t type;
+	uint32_t loc;
+	union {
+		int64_t    integer;
+		double     number;
+		ast_string string;
+	};
+} ast_binary_token;
+
+// AK_PROGRAM, AK_STMT_EXPR, AK_STMT_BLOCK, AK_STMT_RETURN, AK_EXPR_GROUP, AK_TYPE_POINTER
+typedef struct {
+	ast_binary_node node;
+	ast_ref value;
+	uint32_t reserved;
+} ast_binary_ref_node;
+
+// AK_STMT_LOOP_CTRL, AK_EXPR_LITERAL, AK_TYPE_TRIVIAL
+typedef struct {
+	ast_binary_node node;
+	ast_binary_token token;
+} ast_binary_token_node;
+
+// AK_LIST
+typedef struct {
+	ast_binary_node node;
+	uint32_t count;
+	ast_ref  items[];
+} ast_binary_list;
+
+// AK_LEXEMS
+typedef struct {
+	ast_binary_node node;
+	uint32_t count;
+	uint32_t lexems[];
+} ast_binary_lexems;
+
+typedef struct {
+	ast_binary_node node;
+	ast_ref specifiers;
+	ast_ref type;
+	ast_ref initializer;
+	uint32_t reserved;
+	ast_binary_token identifier;
+} ast_binary_decl;
+
+typedef struct {
+	ast_binary_node node;
+	ast_ref condition;
+	ast_ref body;
+	ast_ref branch;
+	uint32_t reserved;
+} ast_binary_if;
+
+typedef struct {
+	ast_binary_node node;
+	ast_ref initializer;
+	ast_ref condition;
+	ast_ref increment;
+	ast_ref body;
+} ast_binary_for;
+
+typedef struct {
+	ast_binary_node node;
+	ast_ref condition;
+	ast_ref body;
+	uint32_t prefix;
+	uint32_t reserved;
+} ast_binary_while;
+
+typedef struct {
+	ast_binary_node node;
+	ast_ref specifiers;
+	ast_ref ret_type;
+	ast_ref params;
+	ast_ref body;
+	ast_binary_token identifier;
+} ast_binary_fun_def;
+
+typedef struct {
+	ast_binary_node node;
+	ast_ref type;
+	uint32_t reserved;
+	ast_binary_token alias;
+} ast_binary_typedef;
+
+typedef struct {
+	ast_binary_node node;
+	ast_ref body;
+	uint32_t reserved;
+	ast_binary_token identifier;
+} ast_binary_class;
+
+typedef struct {
+	ast_binary_node node;
+	uint32_t is_static;
+	uint32_t qualifier;
+	ast_ref  declaration;
+	uint32_t reserved;
+} ast_binary_member;
+
+// AK_EXPR_UNARY (left unused), AK_EXPR_BINARY, AK_EXPR_ASSIGNMENT
+typedef struct {
+	ast_binary_node node;
+	ast_ref  left;
+	ast_ref  right;
+	uint32_t op;
+	uint32_t postfix;
+} ast_binary_operator;
+
+// AK_EXPR_CALL (callee, args), AK_EXPR_SUBSCRIPT (array, index), AK_EXPR_SIZEOF (expr, type)
+typedef struct {
+	ast_binary_node node;
+	ast_ref first;
+	ast_ref second;
+} ast_binary_pair;
+
+typedef struct {
+	ast_binary_node node;
+	ast_ref value;
+	int32_t size;
+} ast_binary_array;
+
+#define ast_binary_deref(ref) \
+	(*(ref) ? (const void*) ((const char*) (ref) + *(ref)) : NULL)
+
+#define ast_binary_root(header) \
+	((const ast_binary_ref_node*) ((const char*) (header) + (header)->root))
+
+#define ast_binary_string(header, s) \
+	((const char*) (header) + (header)->strings_offset + (s))
+
+int syntax_write_binary(syntax_tree* tree, FILE* out);
+const ast_binary_header* syntax_open_binary(const char* data, size_t size);
+int syntax_load_binary(const char* data, size_t size, token_stream* tokens, syntax_tree* tree);
+
+#endif
@@ -0,0 +1,505 @@
+#include <math.h>
+#include <stdio.h>
+
+#include "class.h"
+#include "emit.h"
+#include "expr.h"
+#include "lex.h"
+#include "program.h"
+#include "statement.h"
+#include "syntax.h"
+#include "type.h"
+
+// Nothing is kept besides the output position: every node is written as soon as it
+// is reached, and syntax_walk keeps its own stack, so deep trees are fine too
+typedef struct {
+	emitter* out;
+	source_manager* sources;
+	const char* file;
+} json_writer;
+
+static void _string(json_writer* w, const char* s) {
+	static const char hex[] = "0123456789abcdef";
+
+	emit_char(w->out, '"');
+	const char* run = s;
+	for(; *s; s++) {
+		unsigned char c = *s;
+		if(c >= 0x20 && c != '"' && c != '\\') {
+			continue;
+		}
+		emit(w->out, run, s - run);
+		run = s + 1;
+		switch(c) {
+			case '"':  emit_string(w->out, "\\\""); break;
+			case '\\': emit_string(w->out, "\\\\"); break;
+			case '\n': emit_string(w->out, "\\n");  break;
+			case '\t': emit_string(w->out, "\\t");  break;
+			case '\r': emit_string(w->out, "\\r");  break;
+			default: {
+				char u[6] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 15] };
+				emit(w->out, u, sizeof(u));
+			}
+		}
+	}
+	emit(w->out, run, s - run);
+	emit_char(w->out, '"');
+}
+
+static void _key(json_writer* w, const char* k) {
+	emit_char(w->out, ',');
+	_string(w, k);
+	emit_char(w->out, ':');
+}
+
+static void _begin(json_writer* w, const char* kind) {
+	emit_string(w->out, "{\"kind\":");
+	_string(w, kind);
+}
+
+static void _end(json_writer* w) {
+	emit_char(w->out, '}');
+}
+
+static void _position(json_writer* w, token* t) {
+	if(w->sources == NULL) {
+		return;
+	}
+	source_position p = source_resolve(w->sources, t->loc);
+	if(p.path == NULL) {
+		return;
+	}
+	_key(w, "line");
+	emit_int(w->out, p.line);
+	_key(w, "column");
+	emit_int(w->out, p.column);
+}
+
+// An unnamed parameter has no name token and is written as null
+static void _name(json_writer* w, const char* key, token* t) {
+	_key(w, key);
+	if(t == NULL) {
+		emit_string(w->out, "null");
+		return;
+	}
+	_string(w, t->string_value);
+	_position(w, t);
+}
+
+// Absent children are written as null here since the walk does not descend into them
+static void _child(json_writer* w, const char* key, void* child) {
+	_key(w, key);
+	if(child == NULL) {
+		emit_string(w->out, "null");
+	}
+}
+
+static void _item(json_writer* w, const char* key, int index) {
+	if(index) {
+		emit_char(w->out, ',');
+	} else {
+		_key(w, key);
+		emit_char(w->out, '[');
+	}
+}
+
+static void _items_end(json_writer* w, const char* key, int count) {
+	if(count == 0) {
+		_key(w, key);
+		emit_char(w->out, '[');
+	}
+	emit_char(w->out, ']');
+}
+
+static void _specifiers(json_writer* w, spec_list* l) {
+	_key(w, "specifiers");
+	emit_char(w->out, '[');
+	for(int i = 0; i < l->size; i++) {
+		if(i) {
+			emit_char(w->out, ',');
+		}
+		_string(w, lex_lexem_spelling(l->data[i]));
+	}
+	emit_char(w->out, ']');
+}
+
+static void _op(json_writer* w, enum lexem op) {
+	_key(w, "op");
+	const char* spelling = lex_lexem_spelling(op);
+	_string(w, spelling ? spelling : lex_lexem_to_string(op));
+}
+
+static void _enter_literal(json_writer* w, token* t) {
+	switch(t->type) {
+		case IDENTIFIER:
+			_begin(w, "identifier");
+			_name(w, "name", t);
+			return;
+		case THIS:
+			_begin(w, "this");
+			break;
+		default:
+			_begin(w, "literal");
+			break;
+	}
+
+	_key(w, "value");
+	switch(t->type) {
+		case STRING:
+			_string(w, t->string_value);
+			break;
+		case INTEGER:
+			emit_int(w->out, t->integer_value);
+			break;
+		case NUMERIC:
+			if(isfinite(t->double_value)) {
+				emit_format(w->out, "%.17g", t->double_value);
+			} else {
+				emit_string(w->out, "null");
+			}
+			break;
+		case TRUE:
+			emit_string(w->out, "true");
+			break;
+		case FALSE:
+			emit_string(w->out, "false");
+			break;
+		default:
+			emit_string(w->out, "null");
+			break;
+	}
+	_position(w, t);
+}
+
+static void _enter_expr(json_writer* w, expr* e) {
+	switch(e->type) {
+		case ET_UNARY: {
+			unary_expr* u = e->data;
+			_begin(w, "unary");
+			_op(w, u->op);
+			_key(w, "postfix");
+			emit_string(w->out, u->postfix ? "true" : "false");
+			break;
+		}
+		case ET_BINARY:
+			_begin(w, "binary");
+			_op(w, ((binary_expr*) e->data)->op);
+			break;
+		case ET_GROUP:
+			_begin(w, "group");
+			break;
+		case ET_LITERAL:
+			_enter_literal(w, ((literal_expr*) e->data)->value);
+			break;
+		case ET_ASSIGNMENT:
+			_begin(w, "assignment");
+			_op(w, ((assignment_expr*) e->data)->op);
+			break;
+		case ET_CALL:
+			_begin(w, "call");
+			break;
+		case ET_SUBSCRIPT:
+			_begin(w, "subscript");
+			break;
+		case ET_SIZEOF:
+			_begin(w, "sizeof");
+			break;
+	}
+}
+
+static void _child_expr(json_writer* w, expr* e, int slot, void* child) {
+	switch(e->type) {
+		case ET_UNARY:
+			_child(w, "operand", child);
+			break;
+		case ET_BINARY:
+			_child(w, slot ? "right" : "left", child);
+			break;
+		case ET_GROUP:
+			_child(w, "expr", child);
+			break;
+		case ET_LITERAL:
+			break;
+		case ET_ASSIGNMENT:
+			_child(w, slot ? "value" : "target", child);
+			break;
+		case ET_CALL:
+			if(slot == 0) {
+				_child(w, "callee", child);
+			} else {
+				_item(w, "args", slot - 1);
+			}
+			break;
+		case ET_SUBSCRIPT:
+			_child(w, slot ? "index" : "array", child);
+			break;
+		case ET_SIZEOF:
+			_child(w, ((sizeof_expr*) e->data)->expr ? "expr" : "type", child);
+			break;
+	}
+}
+
+static void _leave_expr(json_writer* w, expr* e) {
+	if(e->type == ET_CALL) {
+		_items_end(w, "args", ((call_expr*) e->data)->args->size);
+	}
+	_end(w);
+}
+
+static void _enter_stmt(json_writer* w, stmt* s) {
+	switch(s->type) {
+		case ST_EXPRESSION:
+			_begin(w, "expr_stmt");
+			break;
+		case ST_DECL: {
+			decl* d = s->data;
+			_begin(w, "decl");
+			_name(w, "name", d->identifier);
+			_specifiers(w, d->specifiers);
+			break;
+		}
+		case ST_BLOCK:
+			_begin(w, "block");
+			break;
+		case ST_IF:
+			_begin(w, "if");
+			break;
+		case ST_FOR:
+			_begin(w, "for");
+			break;
+		case ST_WHILE:
+			_begin(w, ((while_loop*) s->data)->prefix ? "do_while" : "while");
+			break;
+		case ST_RETURN:
+			_begin(w, "return");
+			break;
+		case ST_FUN_DEF: {
+			fun_def* f = s->data;
+			_begin(w, "fun_def");
+			_name(w, "name", f->identifier);
+			_specifiers(w, f->specifiers);
+			break;
+		}
+		case ST_LOOP_CTRL: {
+			token* t = s->data;
+			_begin(w, t->type == BREAK ? "break" : "continue");
+			_position(w, t);
+			break;
+		}
+		case ST_TYPEDEF:
+			_begin(w, "typedef");
+			_name(w, "alias", ((typedef_stmt*) s->data)->alias);
+			break;
+		case ST_CLASS:
+			_begin(w, "class");
+			_name(w, "name", ((class_info*) s->data)->identifier);
+			_key(w, "members");
+			emit_char(w->out, '[');
+			break;
+	}
+}
+
+static void _child_stmt(json_writer* w, stmt* s, int slot, void* child) {
+	static const char* const if_keys[]    = { "condition", "then", "else" };
+	static const char* const for_keys[]   = { "init", "condition", "increment", "body" };
+	static const char* const while_keys[] = { "condition", "body" };
+
+	switch(s->type) {
+		case ST_EXPRESSION:
+			_child(w, "expr", child);
+			break;
+		case ST_RETURN:
+			_child(w, "value", child);
+			break;
+		case ST_DECL:
+			_child(w, slot ? "init" : "type", child);
+			break;
+		case ST_BLOCK:
+			_item(w, "body", slot);
+			break;
+		case ST_IF:
+			_child(w, if_keys[slot], child);
+			break;
+		case ST_FOR:
+			_child(w, for_keys[slot], child);
+			break;
+		case ST_WHILE:
+			_child(w, while_keys[slot], child);
+			break;
+		case ST_FUN_DEF: {
+			int params = ((fun_def*) s->data)->params->size;
+			if(slot == 0) {
+				_child(w, "return_type", child);
+			} else if(slot <= params) {
+				_item(w, "params", slot - 1);
+			} else {
+				_items_end(w, "params", params);
+				_child(w, "body", child);
+			}
+			break;
+		}
+		case ST_LOOP_CTRL:
+			break;
+		case ST_TYPEDEF:
+			_child(w, "type", child);
+			break;
+		case ST_CLASS: {
+			qualified_statement* m = ((class_info*) s->data)->body->data[slot];
+			if(slot) {
+				emit_string(w->out, "},");
+			}
+			_begin(w, "member");
+			_key(w, "access");
+			_string(w, access_qualifier_to_string(m->qualifier));
+			_key(w, "static");
+			emit_string(w->out, m->is_static ? "true" : "false");
+			_child(w, "decl", child);
+			break;
+		}
+	}
+}
+
+static void _leave_stmt(json_writer* w, stmt* s) {
+	switch(s->type) {
+		case ST_BLOCK:
+			_items_end(w, "body", ((stmt_list*) s->data)->size);
+			break;
+		case ST_CLASS: {
+			class_info* c = s->data;
+			if(c->body && c->body->size) {
+				_end(w);
+			}
+			emit_char(w->out, ']');
+			break;
+		}
+		default:
+			break;
+	}
+	_end(w);
+}
+
+static void _enter_type(json_writer* w, type_info* e) {
+	switch(e->type) {
+		case T_TRIVIAL: {
+			token* t = e->data;
+			_begin(w, "type");
+			if(t->type == IDENTIFIER) {
+				_name(w, "name", t);
+			} else {
+				_key(w, "name");
+				_string(w, lex_lexem_spelling(t->type));
+			}
+			break;
+		}
+		case T_POINTER:
+			_begin(w, "pointer");
+			break;
+		case T_ARRAY:
+			_begin(w, "array");
+			break;
+	}
+}
+
+static void _leave_type(json_writer* w, type_info* e) {
+	if(e->type == T_ARRAY) {
+		_key(w, "size");
+		emit_int(w->out, ((array*) e->data)->size);
+	}
+	_end(w);
+}
+
+static int _json_enter(void* ctx, enum syntax_node_kind kind, void* node) {
+	json_writer* w = ctx;
+	switch(kind) {
+		case SN_PROGRAM:
+			_begin(w, "program");
+			if(w->file) {
+				_key(w, "file");
+				_string(w, w->file);
+			}
+			break;
+		case SN_STMT:
+			_enter_stmt(w, node);
+			break;
+		case SN_EXPR:
+			_enter_expr(w, node);
+			break;
+		case SN_TYPE:
+			_enter_type(w, node);
+			break;
+	}
+	return VISIT_CONTINUE;
+}
+
+static int _json_child(void* ctx, enum syntax_node_kind kind, void* node, int slot, void* child) {
+	json_writer* w = ctx;
+	switch(kind) {
+		case SN_PROGRAM:
+			_item(w, "body", slot);
+			break;
+		case SN_STMT:
+			_child_stmt(w, node, slot, child);
+			break;
+		case SN_EXPR:
+			_child_expr(w, node, slot, child);
+			break;
+		case SN_TYPE:
+			_child(w, ((type_info*) node)->type == T_POINTER ? "to" : "of", child);
+			break;
+	}
+	return VISIT_CONTINUE;
+}
+
+static int _json_leave(void* ctx, enum syntax_node_kind kind, void* node) {
+	json_writer* w = ctx;
+	switch(kind) {
+		case SN_PROGRAM:
+			_items_end(w, "body", ((prog*) node)->statements->size);
+			_end(w);
+			break;
+		case SN_STMT:
+			_leave_stmt(w, node);
+			break;
+		case SN_EXPR:
+			_leave_expr(w, node);
+			break;
+		case SN_TYPE:
+			_leave_type(w, node);
+			break;
+	}
+	return VISIT_CONTINUE;
+}
+
+static const ast_visitor _json_visitor = {
+	.enter = _json_enter,
+	.child = _json_child,
+	.leave = _json_leave
+};
+
+void syntax_write_json(syntax_tree* tree, const char* file, source_manager* sources, emitter* out, int flags) {
+	json_writer w = {
+		.out = out,
+		.sources = sources,
+		.file = file
+	};
+
+	if(flags & SYNTAX_JSON_LINES) {
+		stmt_list* l = tree->program->statements;
+		for(int i = 0; i < l->size; i++) {
+			emit_char(out, '{');
+			if(file) {
+				_string(&w, "file");
+				emit_char(out, ':');
+				_string(&w, file);
+				emit_char(out, ',');
+			}
+			_string(&w, "node");
+			emit_char(out, ':');
+			stmt_accept(l->data[i], &_json_visitor, &w);
+			emit_string(out, "}\n");
+		}
+	} else {
+		program_accept(tree->program, &_json_visitor, &w);
+		emit_char(out, '\n');
+	}
+}
@@ -1,6 +1,5 @@
-#include <stdio.h>
-
 #include "class.h"
+#include "emit.h"
 #include "expr.h"
 #include "lex.h"
 #include "program.h"
@@ -8,278 +7,359 @@
 #include "syntax.h"
 #include "type.h"
 
-static void _syntax_printer_visit_unary_expr(unary_expr* e);
-static void _syntax_printer_visit_bin_expr(binary_expr* e);
-static void _syntax_printer_visit_group_expr(group_expr* e);
-static void _syntax_printer_visit_literal_expr(literal_expr* e);
-static void _syntax_printer_visit_assignment_expr(assignment_expr* e);
-static void _syntax_printer_visit_program(prog* e);
-static void _syntax_printer_visit_decl_stmt(decl* e);
-static void _syntax_printer_visit_expr_stmt(expr* e);
-static void _syntax_printer_visit_block_stmt(stmt_list* e);
-static void _syntax_printer_visit_if_stmt(conditional* e);
-static void _syntax_printer_visit_for_stmt(for_loop* e);
-static void _syntax_printer_visit_while_stmt(while_loop* e);
-static void _syntax_printer_visit_ret_stmt(expr* e);
-static void _syntax_printer_visit_call_expr(call_expr* e);
-static void _syntax_printer_visit_subscript_expr(subscript_expr* e);
-static void _syntax_printer_visit_fun_def(fun_def* e);
-static void _syntax_printer_visit_loop_ctrl_stmt(token* e);
-static void _syntax_printer_visit_type(type_info* e);
-static void _syntax_printer_visit_class(class_info* e);
-static void _syntax_printer_visit_typedef(typedef_stmt* e);
-
-ast_visitor _ast_printer = {
-	.visit_expr = NULL,
-	.visit_binary_expr     = _syntax_printer_visit_bin_expr,
-	.visit_unary_expr      = _syntax_printer_visit_unary_expr,
-	.visit_group_expr      = _syntax_printer_visit_group_expr,
-	.visit_literal_expr    = _syntax_printer_visit_literal_expr,
-	.visit_assignment_expr = _syntax_printer_visit_assignment_expr,
-	.visit_program         = _syntax_printer_visit_program,
-	.visit_decl_stmt       = _syntax_printer_visit_decl_stmt,
-	.visit_expr_stmt       = _syntax_printer_visit_expr_stmt,
-	.visit_block_stmt      = _syntax_printer_visit_block_stmt,
-	.visit_for_stmt        = _syntax_printer_visit_for_stmt,
-	.visit_if_stmt         = _syntax_printer_visit_if_stmt,
-	.visit_while_stmt      = _syntax_printer_visit_while_stmt,
-	.visit_call_expr       = _syntax_printer_visit_call_expr,
-	.visit_ret_stmt        = _syntax_printer_visit_ret_stmt,
-	.visit_fun_def_stmt    = _syntax_printer_visit_fun_def,
-	.visit_subscript_expr  = _syntax_printer_visit_subscript_expr,
-	.visit_loop_ctrl_stmt  = _syntax_printer_visit_loop_ctrl_stmt,
-	.visit_type            = _syntax_printer_visit_type,
-	.visit_class           = _syntax_printer_visit_class,
-	.visit_typedef         = _syntax_printer_visit_typedef
-};
-
-static void _syntax_printer_visit_unary_expr(unary_expr* e) {
-	printf("[");
-	if(e->postfix) {
-		expr_accept(e->right, _ast_printer);
-		printf(" %s ", lex_lexem_to_string(e->op));
-	} else {
-		printf(" %s ", lex_lexem_to_string(e->op));
-		expr_accept(e->right, _ast_printer);
-	}
-	printf("]");
-}
+// The printer only writes the text around and between children,
+// syntax_walk does the descent so deep trees do not grow the C stack
 
-static void _syntax_printer_visit_bin_expr(binary_expr* e) {
-	printf("[");
-	expr_accept(e->left, _ast_printer);
-	printf(" %s ", lex_lexem_to_string(e->op));
-	expr_accept(e->right, _ast_printer);
-	printf("]");
+static void _print_spaced(emitter* out, const char* s) {
+	emit_char(out, ' ');
+	emit_string(out, s);
+	emit_char(out, ' ');
 }
 
-static void _syntax_printer_visit_group_expr(group_expr* e) {
-	printf("GROUP [");
-	expr_accept(e->expr, _ast_printer);
-	printf("]");
+static void _print_specifiers(emitter* out, spec_list* l) {
+	for(int i = 0; i < l->size; i++) {
+		emit_string(out, lex_lexem_to_string(l->data[i]));
+		emit_char(out, ' ');
+	}
 }
 
-static void _syntax_printer_visit_literal_expr(literal_expr* e) {
+static void _print_literal(emitter* out, literal_expr* e) {
 	switch(e->value->type) {
 		case NIL:
-			printf("NIL");
+			emit_string(out, "NIL");
 			break;
 		case TRUE:
-			printf("TRUE");
+			emit_string(out, "TRUE");
 			break;
 		case FALSE:
-			printf("FALSE");
+			emit_string(out, "FALSE");
 			break;
 		case NUMERIC:
-			printf("%f", e->value->double_value);
+			emit_format(out, "%f", e->value->double_value);
 			break;
 		case INTEGER:
-			printf("%d", e->value->integer_value);
+			emit_int(out, e->value->integer_value);
 			break;
 		case STRING:
 		case IDENTIFIER:
-			printf("%s", e->value->string_value);
+			emit_string(out, e->value->string_value);
 			break;
 		case THIS:
-			printf("THIS");
+			emit_string(out, "THIS");
 			break;
 		default:
-			printf("UNKNOWN");
+			emit_string(out, "UNKNOWN");
 			break;
 	}
 }
 
-static void _syntax_printer_visit_assignment_expr(assignment_expr* e) {
-	printf("ASSIGNMENT [");
-	expr_accept(e->lvalue, _ast_printer);
-	printf(" %s ", lex_lexem_to_string(e->op));
-	expr_accept(e->rvalue, _ast_printer);
-	printf("]");
-}
-
-static void _syntax_printer_visit_program(prog* e) {
-	printf("PROG [\n");
-	for(int i = 0; i < e->statements->size; i++) {
-		stmt_accept(e->statements->data[i], _ast_printer);
-		printf("\n");
+static void _enter_expr(emitter* out, expr* e) {
+	switch(e->type) {
+		case ET_UNARY: {
+			unary_expr* u = e->data;
+			emit_char(out, '[');
+			if(!u->postfix) {
+				_print_spaced(out, lex_lexem_to_string(u->op));
+			}
+			break;
+		}
+		case ET_BINARY:
+			emit_char(out, '[');
+			break;
+		case ET_GROUP:
+			emit_string(out, "GROUP [");
+			break;
+		case ET_LITERAL:
+			_print_literal(out, e->data);
+			break;
+		case ET_ASSIGNMENT:
+			emit_string(out, "ASSIGNMENT [");
+			break;
+		case ET_CALL:
+			emit_string(out, "CALL [");
+			break;
+		case ET_SUBSCRIPT:
+			emit_string(out, "SUBS [");
+			break;
+		case ET_SIZEOF:
+			emit_string(out, "SIZEOF [");
+			break;
 	}
-	printf("]\n");
 }
 
-static void _syntax_printer_visit_decl_stmt(decl* e) {
-	printf("DECL [");
-	for(int i = 0; i < e->specifiers->size; i++) {
-		printf("%s ", lex_lexem_to_string(e->specifiers->data[i]));
-	}
-	type_accept(e->type, _ast_printer);
-	printf(" %s ", e->identifier->string_value);
-	if(e->initializer) {
-		printf(" := ");
-		expr_accept(e->initializer, _ast_printer);
+static void _child_expr(emitter* out, expr* e, int slot) {
+	switch(e->type) {
+		case ET_BINARY:
+			if(slot == 1) {
+				_print_spaced(out, lex_lexem_to_string(((binary_expr*) e->data)->op));
+			}
+			break;
+		case ET_ASSIGNMENT:
+			if(slot == 1) {
+				_print_spaced(out, lex_lexem_to_string(((assignment_expr*) e->data)->op));
+			}
+			break;
+		case ET_CALL:
+			if(slot == 1) {
+				emit_string(out, " (");
+			} else if(slot > 1) {
+				emit_string(out, ", ");
+			}
+			break;
+		case ET_SUBSCRIPT:
+			if(slot == 1) {
+				emit_char(out, '[');
+			}
+			break;
+		default:
+			break;
 	}
-	printf("]");
 }
 
-static void _syntax_printer_visit_expr_stmt(expr* e) {
-	printf("EXPR [");
-	expr_accept(e, _ast_printer);
-	printf("]");
-}
-
-static void _syntax_printer_visit_block_stmt(stmt_list* e) {
-	printf("[");
-	for(int i = 0; i < e->size; i++) {
-		stmt_accept(e->data[i], _ast_printer);
-		printf("\n");
+static void _leave_expr(emitter* out, expr* e) {
+	switch(e->type) {
+		case ET_UNARY: {
+			unary_expr* u = e->data;
+			if(u->postfix) {
+				_print_spaced(out, lex_lexem_to_string(u->op));
+			}
+			emit_char(out, ']');
+			break;
+		}
+		case ET_LITERAL:
+			break;
+		case ET_CALL:
+			emit_string(out, ((call_expr*) e->data)->args->size ? ", )]" : " ()]");
+			break;
+		case ET_SUBSCRIPT:
+			emit_string(out, "]]");
+			break;
+		default:
+			emit_char(out, ']');
+			break;
 	}
-	printf("]");
 }
 
-static void _syntax_printer_visit_if_stmt(conditional* e) {
-	printf("IF [{");
-	expr_accept(e->condition, _ast_printer);
-	printf("}\n");
-	stmt_accept(e->body, _ast_printer);
-	printf("]");
-	if(e->branch) {
-		printf("\nELSE [\n");
-		stmt_accept(e->branch, _ast_printer);
-		printf("]");
+static void _enter_stmt(emitter* out, stmt* s) {
+	switch(s->type) {
+		case ST_EXPRESSION:
+			emit_string(out, "EXPR [");
+			break;
+		case ST_BLOCK:
+			emit_char(out, '[');
+			break;
+		case ST_DECL:
+			emit_string(out, "DECL [");
+			_print_specifiers(out, ((decl*) s->data)->specifiers);
+			break;
+		case ST_IF:
+			emit_string(out, "IF [{");
+			break;
+		case ST_FOR:
+			emit_string(out, "FOR [{");
+			break;
+		case ST_WHILE:
+			emit_string(out, ((while_loop*) s->data)->prefix ? "DO-WHILE [{" : "WHILE [{");
+			break;
+		case ST_RETURN:
+			emit_string(out, "RET ");
+			break;
+		case ST_FUN_DEF:
+			emit_string(out, "FUNC [");
+			_print_specifiers(out, ((fun_def*) s->data)->specifiers);
+			break;
+		case ST_LOOP_CTRL:
+			emit_format(out, "[%s]", lex_lexem_to_string(((token*) s->data)->type));
+			break;
+		case ST_TYPEDEF:
+			emit_string(out, "TYPEDEF ");
+			break;
+		case ST_CLASS:
+			emit_format(out, "CLASS %s [\n", ((class_info*) s->data)->identifier->string_value);
+			break;
 	}
 }
 
-static void _syntax_printer_visit_for_stmt(for_loop* e) {
-	printf("FOR [{");
-	if(e->initializer) {
-		stmt_accept(e->initializer, _ast_printer);
-	}
-	printf("}\n{");
-	if(e->condition) {
-		expr_accept(e->condition, _ast_printer);
-	}
-	printf("}\n{");
-	if(e->increment) {
-		expr_accept(e->increment, _ast_printer);
+static void _child_stmt(emitter* out, stmt* s, int slot, void* child) {
+	switch(s->type) {
+		case ST_BLOCK:
+			if(slot) {
+				emit_char(out, '\n');
+			}
+			break;
+		case ST_DECL:
+			if(slot == 1) {
+				token* name = ((decl*) s->data)->identifier;
+				if(name) {
+					_print_spaced(out, name->string_value);
+				}
+				if(child) {
+					emit_string(out, " := ");
+				}
+			}
+			break;
+		case ST_IF:
+			if(slot == 1) {
+				emit_string(out, "}\n");
+			} else if(slot == 2) {
+				emit_char(out, ']');
+				if(child) {
+					emit_string(out, "\nELSE [\n");
+				}
+			}
+			break;
+		case ST_FOR:
+			if(slot == 1 || slot == 2) {
+				emit_string(out, "}\n{");
+			} else if(slot == 3) {
+				emit_string(out, "}\n");
+			}
+			break;
+		case ST_WHILE:
+			if(slot == 1) {
+				emit_string(out, "}\n");
+			}
+			break;
+		case ST_FUN_DEF: {
+			fun_def* f = s->data;
+			if(slot == 1) {
+				_print_spaced(out, f->identifier->string_value);
+				emit_char(out, '(');
+			} else if(slot > 1) {
+				emit_string(out, ", ");
+			}
+			if(slot == f->params->size + 1) {
+				emit_string(out, ")\n");
+			}
+			break;
+		}
+		case ST_CLASS: {
+			qualified_statement* m = ((class_info*) s->data)->body->data[slot];
+			if(slot) {
+				emit_char(out, '\n');
+			}
+			emit_string(out, access_qualifier_to_string(m->qualifier));
+			emit_char(out, ' ');
+			if(m->is_static) {
+				emit_string(out, "STATIC ");
+			}
+			break;
+		}
+		default:
+			break;
 	}
-	printf("}\n");
-	stmt_accept(e->body, _ast_printer);
-	printf("]");
 }
 
-static void _syntax_printer_visit_while_stmt(while_loop* e) {
-	if(e->prefix) {
-		printf("DO-WHILE [{");
-	} else {
-		printf("WHILE [{");
+static void _leave_stmt(emitter* out, stmt* s) {
+	switch(s->type) {
+		case ST_BLOCK:
+			if(((stmt_list*) s->data)->size) {
+				emit_char(out, '\n');
+			}
+			emit_char(out, ']');
+			break;
+		case ST_IF:
+			if(((conditional*) s->data)->branch) {
+				emit_char(out, ']');
+			}
+			break;
+		case ST_RETURN:
+		case ST_LOOP_CTRL:
+			break;
+		case ST_TYPEDEF:
+			emit_format(out, " -> %s", ((typedef_stmt*) s->data)->alias->string_value);
+			break;
+		case ST_CLASS: {
+			class_info* c = s->data;
+			if(c->body && c->body->size) {
+				emit_char(out, '\n');
+			}
+			emit_char(out, ']');
+			break;
+		}
+		default:
+			emit_char(out, ']');
+			break;
 	}
-	expr_accept(e->condition, _ast_printer);
-	printf("}\n");
-	stmt_accept(e->body, _ast_printer);
-	printf("]");
 }
 
-static void _syntax_printer_visit_call_expr(call_expr* e) {
-	printf("CALL [");
-	expr_accept(e->callee, _ast_printer);
-	printf(" (");
-	for(int i = 0; i < e->args->size; i++) {
-		expr_accept(e->args->data[i], _ast_printer);
-		printf(", ");
+static int _syntax_printer_enter(void* ctx, enum syntax_node_kind kind, void* node) {
+	emitter* out = ctx;
+	switch(kind) {
+		case SN_PROGRAM:
+			emit_string(out, "PROG [\n");
+			break;
+		case SN_STMT:
+			_enter_stmt(out, node);
+			break;
+		case SN_EXPR:
+			_enter_expr(out, node);
+			break;
+		case SN_TYPE: {
+			type_info* t = node;
+			if(t->type == T_TRIVIAL) {
+				emit_string(out, lex_lexem_to_string(((token*) t->data)->type));
+			} else if(t->type == T_POINTER) {
+				emit_char(out, '*');
+			}
+			break;
+		}
 	}
-	printf(")]");
+	return VISIT_CONTINUE;
 }
 
-static void _syntax_printer_visit_subscript_expr(subscript_expr* e) {
-	printf("SUBS [");
-	expr_accept(e->array, _ast_printer);
-	printf("[");
-	expr_accept(e->index, _ast_printer);
-	printf("]]");
-}
-
-static void _syntax_printer_visit_ret_stmt(expr* v) {
-	printf("RET ");
-	if(v) {
-		expr_accept(v, _ast_printer);
-	} 
-}
-
-static void _syntax_printer_visit_fun_def(fun_def* e) {
-	printf("FUNC [");
-	for(int i = 0; i < e->specifiers->size; i++) {
-		printf("%s ", lex_lexem_to_string(e->specifiers->data[i]));
-	}
-	type_accept(e->ret_type, _ast_printer);
-	printf(" %s ", e->identifier->string_value);
-	printf("(");
-	for(int i = 0; i < e->params->size; i++) {
-		stmt_accept(e->params->data[i], _ast_printer);
-		printf(", ");
-	}
-	printf(")");
-	printf("\n");
-	if(e->body) {
-		stmt_accept(e->body, _ast_printer);
+static int _syntax_printer_child(void* ctx, enum syntax_node_kind kind, void* node, int slot, void* child) {
+	emitter* out = ctx;
+	switch(kind) {
+		case SN_PROGRAM:
+			if(slot) {
+				emit_char(out, '\n');
+			}
+			break;
+		case SN_STMT:
+			_child_stmt(out, node, slot, child);
+			break;
+		case SN_EXPR:
+			_child_expr(out, node, slot);
+			break;
+		case SN_TYPE:
+			break;
 	}
-	printf("]");
+	return VISIT_CONTINUE;
 }
 
-static void _syntax_printer_visit_loop_ctrl_stmt(token* e) {
-	printf("[%s]", lex_lexem_to_string(e->type));
-}
-
-static void _syntax_printer_visit_type(type_info* e) {
-	switch(e->type) {
-		case T_TRIVIAL:
-			printf("%s", lex_lexem_to_string(((token*) e->data)->type));
+static int _syntax_printer_leave(void* ctx, enum syntax_node_kind kind, void* node) {
+	emitter* out = ctx;
+	switch(kind) {
+		case SN_PROGRAM:
+			if(((prog*) node)->statements->size) {
+				emit_char(out, '\n');
+			}
+			emit_string(out, "]\n");
 			break;
-		case T_POINTER:
-			printf("*");
-			type_accept(((pointer*) e->data)->value, _ast_printer);
+		case SN_STMT:
+			_leave_stmt(out, node);
 			break;
-		case T_ARRAY:
-			type_accept(((array*) e->data)->value, _ast_printer);
-			printf("[%d]", ((array*) e->data)->size);
-	}	
-}
-
-static void _syntax_printer_visit_class(class_info* e) {
-	printf("CLASS %s [\n", e->identifier->string_value);
-	if(e->body) {
-		for(int i = 0; i < e->body->size; i++) {
-			printf("%s ", access_qualifier_to_string(e->body->data[i]->qualifier));
-			if(e->body->data[i]->is_static) {
-				printf("STATIC ");
+		case SN_EXPR:
+			_leave_expr(out, node);
+			break;
+		case SN_TYPE: {
+			type_info* t = node;
+			if(t->type == T_ARRAY) {
+				emit_format(out, "[%d]", ((array*) t->data)->size);
 			}
-			stmt_accept(e->body->data[i]->declaration, _ast_printer);	
-			printf("\n");
+			break;
 		}
 	}
-	printf("]");	
+	return VISIT_CONTINUE;
 }
 
-static void _syntax_printer_visit_typedef(typedef_stmt* e) {
-	printf("TYPEDEF ");
-	type_accept(e->type, _ast_printer);
-	printf(" -> %s", e->alias->string_value);
+static const ast_visitor _ast_printer = {
+	.enter = _syntax_printer_enter,
+	.child = _syntax_printer_child,
+	.leave = _syntax_printer_leave
+};
+
+void syntax_print_tree(syntax_tree* tree, emitter* out) {
+	syntax_walk_tree(tree, &_ast_printer, out);
 }
@@ -4,3 +4,5 @@ set -e
 
 ./build.sh
 build/hatch test/1.dc
+build/hatch -E test/redefine.dc
+test/stress.sh build/hatch
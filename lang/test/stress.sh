@@ -0,0 +1,59 @@
+#!/bin/bash
+
+# Generated inputs the parser, the walks and the .ast format have to survive: a chain
+# of a million terms through every output and back from .ast, and blocks, unary chains,
+# parenthesised expressions and pointer types nested a million deep, which have to end
+# in the depth diagnostic instead of a crash
+# usage: test/stress.sh [hatch]
+
+set -e
+
+hatch=${1:-build/hatch}
+terms=1000000
+depth=1000000
+
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+fail() {
+    echo "stress: $*" >&2
+    exit 1
+}
+
+repeat() {
+    yes "$1" | head -n "$2" | tr -d '\n'
+}
+
+count() {
+    grep -o "$1" "$2" | wc -l
+}
+
+{ printf 'let i32 a = 1;\nlet i32 b = a'; repeat ' + a' $((terms - 1)); printf ';\n'; } > "$dir/chain.dc"
+
+"$hatch" --dump-ast -o "$dir/chain.txt" "$dir/chain.dc"
+[ "$(count PLUS "$dir/chain.txt")" -eq $((terms - 1)) ] || fail "--dump-ast lost terms of the chain"
+
+"$hatch" --dump-json -o "$dir/chain.json" "$dir/chain.dc"
+[ "$(count '"kind":"binary"' "$dir/chain.json")" -eq $((terms - 1)) ] || fail "--dump-json lost terms of the chain"
+
+"$hatch" --check "$dir/chain.dc"
+
+"$hatch" --emit-ast -o "$dir/chain.ast" "$dir/chain.dc"
+"$hatch" --dump-ast -o "$dir/loaded.txt" "$dir/chain.ast"
+cmp -s "$dir/chain.txt" "$dir/loaded.txt" || fail "the chain loaded from .ast differs from the parsed one"
+
+{ printf 'fun i32 f() '; repeat '{' $depth; repeat '}' $depth; printf '\n'; } > "$dir/blocks.dc"
+{ printf 'let i32 a = 1;\nlet i32 b = '; repeat '-' $depth; printf 'a;\n'; } > "$dir/unary.dc"
+{ printf 'let i32 a = 1;\nlet i32 c = '; repeat '(' $depth; printf 'a'; repeat ')' $depth; printf ';\n'; } > "$dir/parens.dc"
+{ printf 'let '; repeat '*' $depth; printf 'i32 p;\n'; } > "$dir/pointers.dc"
+
+for input in blocks unary parens pointers; do
+    for mode in --dump-ast --dump-json --emit-ast --check; do
+        code=0
+        "$hatch" $mode -o "$dir/out" "$dir/$input.dc" > /dev/null 2> "$dir/errors" || code=$?
+        [ $code -eq 1 ] || fail "$mode on $input nested $depth deep exited with $code"
+        grep -q "nesting exceeds the maximum depth" "$dir/errors" || fail "$mode on $input nested $depth deep has no depth diagnostic"
+    done
+done
+
+echo "stress: ok"
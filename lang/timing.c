@@ -0,0 +1,196 @@
+#include "timing.h"
+
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+static const char* _stage_names[STAGE_COUNT] = {
+	[STAGE_CACHE]       = "cache",
+	[STAGE_LOAD]        = "load",
+	[STAGE_LEX]         = "lex",
+	[STAGE_DEPS]        = "deps",
+	[STAGE_DUMP_TOKENS] = "dump-tokens",
+	[STAGE_PARSE]       = "parse",
+	[STAGE_EMIT_AST]    = "emit-ast",
+	[STAGE_CHECK]       = "check",
+	[STAGE_PRINT]       = "print",
+};
+
+const char* timing_stage_name(enum timing_stage stage) {
+	return _stage_names[stage];
+}
+
+static double _clock(clockid_t id) {
+	struct timespec ts;
+	clock_gettime(id, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static long _peak_rss() {
+	struct rusage u;
+	getrusage(RUSAGE_SELF, &u);
+	return u.ru_maxrss;
+}
+
+void time_report_init(time_report* r, const char* path) {
+	memset(r, 0, sizeof(time_report));
+	r->path = path;
+	r->current = -1;
+}
+
+void time_report_begin(time_report* r, enum timing_stage stage) {
+	if(r == NULL) {
+		return;
+	}
+	r->current = stage;
+	r->started_trace = TRACE_NOW();
+	r->started_cpu  = _clock(CLOCK_THREAD_CPUTIME_ID);
+	r->started_wall = _clock(CLOCK_MONOTONIC);
+}
+
+void time_report_end(time_report* r, long long bytes, long long tokens) {
+	if(r == NULL || r->current < 0) {
+		return;
+	}
+	double wall = _clock(CLOCK_MONOTONIC);
+	double cpu  = _clock(CLOCK_THREAD_CPUTIME_ID);
+
+	stage_time* s = &r->stages[r->current];
+	s->wall   += wall - r->started_wall;
+	s->cpu    += cpu - r->started_cpu;
+	s->bytes  += bytes;
+	s->tokens += tokens;
+	s->runs++;
+
+	long rss = _peak_rss();
+	if(rss > s->peak_rss) {
+		s->peak_rss = rss;
+	}
+
+	if(trace_enabled) {
+		trace_span(_stage_names[r->current], r->path, r->started_trace);
+	}
+
+	r->current = -1;
+}
+
+void time_report_add(time_report* total, const time_report* r) {
+	for(int i = 0; i < STAGE_COUNT; i++) {
+		stage_time* t = &total->stages[i];
+		const stage_time* s = &r->stages[i];
+		t->wall   += s->wall;
+		t->cpu    += s->cpu;
+		t->bytes  += s->bytes;
+		t->tokens += s->tokens;
+		t->runs   += s->runs;
+		if(s->peak_rss > t->peak_rss) {
+			t->peak_rss = s->peak_rss;
+		}
+	}
+}
+
+static double _rate(double amount, double seconds) {
+	return seconds > 0 ? amount / seconds : 0.0;
+}
+
+// Stages add up their time, the input is counted once: the most any stage processed
+static stage_time _sum(const time_report* r) {
+	stage_time sum;
+	memset(&sum, 0, sizeof(sum));
+	for(int i = 0; i < STAGE_COUNT; i++) {
+		const stage_time* s = &r->stages[i];
+		sum.wall += s->wall;
+		sum.cpu  += s->cpu;
+		sum.runs += s->runs;
+		if(s->bytes > sum.bytes) {
+			sum.bytes = s->bytes;
+		}
+		if(s->tokens > sum.tokens) {
+			sum.tokens = s->tokens;
+		}
+		if(s->peak_rss > sum.peak_rss) {
+			sum.peak_rss = s->peak_rss;
+		}
+	}
+	return sum;
+}
+
+static void _print_stage(const char* name, const stage_time* s, FILE* out) {
+	fprintf(out, "  %-12s %10.3f %10.3f %12lld %10lld %9.1f %12.0f %9.1f\n",
+			name, s->wall * 1e3, s->cpu * 1e3, s->bytes, s->tokens,
+			_rate(s->bytes / 1048576.0, s->wall), _rate(s->tokens, s->wall), s->peak_rss / 1024.0);
+}
+
+void time_report_print(const time_report* r, FILE* out) {
+	fprintf(out, "time report: %s\n", r->path ? r->path : "all inputs");
+	fprintf(out, "  %-12s %10s %10s %12s %10s %9s %12s %9s\n",
+			"stage", "wall ms", "cpu ms", "bytes", "tokens", "MB/s", "tokens/s", "rss MB");
+	for(int i = 0; i < STAGE_COUNT; i++) {
+		if(r->stages[i].runs) {
+			_print_stage(_stage_names[i], &r->stages[i], out);
+		}
+	}
+	stage_time sum = _sum(r);
+	_print_stage("total", &sum, out);
+}
+
+static void _json_string(const char* s, FILE* out) {
+	fputc('"', out);
+	for(; *s; s++) {
+		unsigned char c = *s;
+		if(c == '"' || c == '\\') {
+			fprintf(out, "\\%c", c);
+		} else if(c < 0x20) {
+			fprintf(out, "\\u%04x", c);
+		} else {
+			fputc(c, out);
+		}
+	}
+	fputc('"', out);
+}
+
+static void _json_stage(const stage_time* s, FILE* out) {
+	fprintf(out, "{\"wall\":%.9f,\"cpu\":%.9f,\"bytes\":%lld,\"tokens\":%lld,"
+			"\"mb_per_s\":%.3f,\"tokens_per_s\":%.1f,\"peak_rss_kb\":%ld,\"runs\":%d}",
+			s->wall, s->cpu, s->bytes, s->tokens,
+			_rate(s->bytes / 1048576.0, s->wall), _rate(s->tokens, s->wall), s->peak_rss, s->runs);
+}
+
+static void _json_report(const time_report* r, FILE* out) {
+	fputc('{', out);
+	if(r->path) {
+		fputs("\"file\":", out);
+		_json_string(r->path, out);
+		fputc(',', out);
+	}
+	fputs("\"stages\":{", out);
+	int first = 1;
+	for(int i = 0; i < STAGE_COUNT; i++) {
+		if(r->stages[i].runs == 0) {
+			continue;
+		}
+		if(!first) {
+			fputc(',', out);
+		}
+		first = 0;
+		fprintf(out, "\"%s\":", _stage_names[i]);
+		_json_stage(&r->stages[i], out);
+	}
+	stage_time sum = _sum(r);
+	fputs("},\"total\":", out);
+	_json_stage(&sum, out);
+	fputc('}', out);
+}
+
+void time_report_write_json(const time_report** files, int count, const time_report* total, FILE* out) {
+	fputs("{\"files\":[", out);
+	for(int i = 0; i < count; i++) {
+		if(i) {
+			fputc(',', out);
+		}
+		_json_report(files[i], out);
+	}
+	fputs("],\"aggregate\":", out);
+	_json_report(total, out);
+	fputs("}\n", out);
+}
@@ -0,0 +1,53 @@
+#ifndef _TIMING_H
+#define _TIMING_H
+
+#include <stdio.h>
+
+#include "trace.h"
+
+enum timing_stage {
+	STAGE_CACHE,
+	STAGE_LOAD,
+	STAGE_LEX,
+	STAGE_DEPS,
+	STAGE_DUMP_TOKENS,
+	STAGE_PARSE,
+	STAGE_EMIT_AST,
+	STAGE_CHECK,
+	STAGE_PRINT,
+	STAGE_COUNT
+};
+
+typedef struct {
+	double    wall;
+	double    cpu;
+	long long bytes;
+	long long tokens;
+	long      peak_rss;
+	int       runs;
+} stage_time;
+
+// Times the stages of one input. A job runs on a single thread, so cpu is the time of
+// that thread, for check only its share of the bodies; peak_rss is the high-water mark of the whole process in KB at the end
+// of the stage. While tracing every stage is also recorded as a span. All functions
+// accept a NULL report and do nothing then.
+typedef struct {
+	const char* path;
+	stage_time  stages[STAGE_COUNT];
+	int    current;
+	double started_wall;
+	double started_cpu;
+	trace_time started_trace;
+} time_report;
+
+void time_report_init(time_report* r, const char* path);
+void time_report_begin(time_report* r, enum timing_stage stage);
+void time_report_end(time_report* r, long long bytes, long long tokens);
+void time_report_add(time_report* total, const time_report* r);
+
+void time_report_print(const time_report* r, FILE* out);
+void time_report_write_json(const time_report** files, int count, const time_report* total, FILE* out);
+
+const char* timing_stage_name(enum timing_stage stage);
+
+#endif
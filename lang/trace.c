@@ -0,0 +1,158 @@
+#include "trace.h"
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define TRACE_CHUNK_SIZE 1024
+
+typedef struct {
+	trace_time  start;
+	trace_time  duration;
+	const char* name;
+	char        detail[TRACE_DETAIL_SIZE];
+} trace_event;
+
+typedef struct _trace_chunk {
+	trace_event events[TRACE_CHUNK_SIZE];
+	int size;
+	struct _trace_chunk* next;
+} trace_chunk;
+
+typedef struct _trace_buffer {
+	int tid;
+	const char*  thread_name;
+	trace_chunk* first;
+	trace_chunk* last;
+	struct _trace_buffer* next;
+} trace_buffer;
+
+int trace_enabled = 0;
+
+static trace_time _origin = 0;
+static atomic_int _next_tid = 1;
+static _Atomic(trace_buffer*) _buffers = NULL;
+static __thread trace_buffer* _buffer = NULL;
+
+static trace_time _clock() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (trace_time) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void trace_start() {
+	_origin = _clock();
+	trace_enabled = 1;
+}
+
+trace_time trace_now() {
+	return _clock() - _origin;
+}
+
+static trace_chunk* _chunk_create() {
+	trace_chunk* c = malloc(sizeof(trace_chunk));
+	c->size = 0;
+	c->next = NULL;
+	return c;
+}
+
+// The buffer of a thread is published once, with a push onto the list of all buffers
+static trace_buffer* _thread_buffer() {
+	if(_buffer) {
+		return _buffer;
+	}
+
+	trace_buffer* b = calloc(1, sizeof(trace_buffer));
+	b->tid = atomic_fetch_add(&_next_tid, 1);
+	b->first = b->last = _chunk_create();
+
+	b->next = atomic_load(&_buffers);
+	while(!atomic_compare_exchange_weak(&_buffers, &b->next, b));
+
+	_buffer = b;
+	return b;
+}
+
+void trace_span(const char* name, const char* detail, trace_time start) {
+	if(!trace_enabled) {
+		return;
+	}
+
+	trace_buffer* b = _thread_buffer();
+	if(b->last->size == TRACE_CHUNK_SIZE) {
+		b->last->next = _chunk_create();
+		b->last = b->last->next;
+	}
+
+	trace_event* e = &b->last->events[b->last->size++];
+	e->start = start;
+	e->duration = trace_now() - start;
+	e->name = name;
+	e->detail[0] = '\0';
+	if(detail) {
+		strncpy(e->detail, detail, TRACE_DETAIL_SIZE - 1);
+		e->detail[TRACE_DETAIL_SIZE - 1] = '\0';
+	}
+}
+
+void trace_thread_name(const char* name) {
+	if(trace_enabled) {
+		_thread_buffer()->thread_name = name;
+	}
+}
+
+static void _string(FILE* f, const char* s) {
+	fputc('"', f);
+	for(; *s; s++) {
+		unsigned char c = *s;
+		if(c == '"' || c == '\\') {
+			fprintf(f, "\\%c", c);
+		} else if(c < 0x20) {
+			fprintf(f, "\\u%04x", c);
+		} else {
+			fputc(c, f);
+		}
+	}
+	fputc('"', f);
+}
+
+int trace_write(const char* path) {
+	FILE* f = fopen(path, "w");
+	if(f == NULL) {
+		return 1;
+	}
+
+	fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", f);
+
+	int first = 1;
+	for(trace_buffer* b = atomic_load(&_buffers); b; b = b->next) {
+		if(b->thread_name) {
+			fprintf(f, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":", first ? "" : ",", b->tid);
+			_string(f, b->thread_name);
+			fputs("}}", f);
+			first = 0;
+		}
+		for(trace_chunk* c = b->first; c; c = c->next) {
+			for(int i = 0; i < c->size; i++) {
+				trace_event* e = &c->events[i];
+				fprintf(f, "%s\n{\"name\":", first ? "" : ",");
+				_string(f, e->name);
+				fprintf(f, ",\"cat\":\"hatch\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d",
+						e->start / 1000.0, e->duration / 1000.0, b->tid);
+				if(e->detail[0]) {
+					fputs(",\"args\":{\"detail\":", f);
+					_string(f, e->detail);
+					fputc('}', f);
+				}
+				fputc('}', f);
+				first = 0;
+			}
+		}
+	}
+
+	fputs("\n]}\n", f);
+
+	return fclose(f) ? 1 : 0;
+}
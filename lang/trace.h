@@ -0,0 +1,29 @@
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include <stdint.h>
+
+// Longer details are cut, they only label a span
+#define TRACE_DETAIL_SIZE 48
+
+typedef uint64_t trace_time;
+
+// Set once by trace_start before any other thread records, read without
+// synchronization afterwards. Spans are only recorded while it is set.
+extern int trace_enabled;
+
+#define TRACE_NOW() (trace_enabled ? trace_now() : 0)
+
+void trace_start();
+trace_time trace_now();
+
+// Records a span from start until now on the calling thread. Every thread writes
+// into its own buffer, nothing is shared until trace_write
+void trace_span(const char* name, const char* detail, trace_time start);
+void trace_thread_name(const char* name);
+
+// Writes every recorded span as Chrome trace events. Only call it once the
+// recording threads are done.
+int trace_write(const char* path);
+
+#endif
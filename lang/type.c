@@ -1,56 +1,97 @@
 #include "type.h"
 #include "lex.h"
 #include "syntax.h"
+#include "alloc.h"
 
-static type_info* _make_type(enum type_type type, void* data) {
-	type_info* t = malloc(sizeof(type_info));
+static type_info* _make_type(parser* p, enum type_type type, void* data) {
+	type_info* t = syntax_alloc(p, sizeof(type_info));
 	t->type = type;
 	t->data = data;
+	t->canonical = NULL;
 	return t;
 }
 
-static type_info* _make_trivial(token* t) {
-	return _make_type(T_TRIVIAL, t);
+static type_info* _make_trivial(parser* p, token* t) {
+	SYNTAX_NODE_END(p, SN_TYPE, T_TRIVIAL, NULL)
+	return _make_type(p, T_TRIVIAL, t);
 }
 
-static type_info* _make_pointer(type_info* to) {
-	pointer* t = malloc(sizeof(pointer));
+static type_info* _make_pointer(parser* p, type_info* to) {
+	SYNTAX_NODE_END(p, SN_TYPE, T_POINTER, NULL)
+	pointer* t = syntax_alloc(p, sizeof(pointer));
 	t->value = to;
-	return _make_type(T_POINTER, t);
+	return _make_type(p, T_POINTER, t);
 }
 
-static type_info* _make_array(type_info* t, int sz) {
-	array* a = malloc(sizeof(array));
+static type_info* _make_array(parser* p, type_info* t, int sz) {
+	SYNTAX_NODE_END(p, SN_TYPE, T_ARRAY, NULL)
+	array* a = syntax_alloc(p, sizeof(array));
 	a->value = t;
 	a->size  = sz;
-	return _make_type(T_ARRAY, a);
+	return _make_type(p, T_ARRAY, a);
 }
 
-type_info* type(token_stream* s) {
+type_info* type(parser* p) {
+	SYNTAX_RULE(p);
 	type_info* t = NULL;
+	token* _t = NULL;
 
-	while(syntax_match_token(s, ASTERISK)) {
-		t = _make_pointer(type(s));
+	while((_t = syntax_match_token(p, ASTERISK))) {
+		syntax_begin(p, SN_TYPE, T_POINTER, _t);
+		syntax_descend(p);
+		t = _make_pointer(p, type(p));
+		syntax_ascend(p);
 	} 
 
 	if(t == NULL) {
-		token* _t = match_trivial_type(s);
+		_t = match_trivial_type(p);
 		if(_t == NULL) {
-			syntax_error_on_current(s, "trivial type required");
+			syntax_error_on_current(p, "trivial type required");
 		}
-		t = _make_trivial(_t);
+		syntax_begin(p, SN_TYPE, T_TRIVIAL, _t);
+		t = _make_trivial(p, _t);
 	}
 
-	while(syntax_match_token(s, LSQBRACE)) {
-		int sz = syntax_consume_token(s, INTEGER, "array size required after type specification")->integer_value;
-		syntax_consume_token(s, RSQBRACE, "']' required after array size specification");
-		t = _make_array(t, sz);
+	while((_t = syntax_match_token(p, LSQBRACE))) {
+		syntax_begin(p, SN_TYPE, T_ARRAY, _t);
+		int sz = syntax_consume_token(p, INTEGER, "array size required after type specification")->integer_value;
+		syntax_consume_token(p, RSQBRACE, "']' required after array size specification");
+		t = _make_array(p, t, sz);
 	} 
 
 	return t;
 }
 
-void type_accept(type_info* t, ast_visitor v) {
-	v.visit_type(t);
+int type_visit(type_info* t, const ast_visitor* v, void* ctx) {
+	return VISIT(v->visit_type, ctx, t);
+}
+
+int type_child(type_info* t, int slot, enum syntax_node_kind* kind, void** child) {
+	switch(t->type) {
+		case T_TRIVIAL:
+			break;
+		case T_POINTER:
+			if(slot < 1) WALK_CHILD(SN_TYPE, ((pointer*) t->data)->value)
+			break;
+		case T_ARRAY:
+			if(slot < 1) WALK_CHILD(SN_TYPE, ((array*) t->data)->value)
+			break;
+	}
+	return 0;
+}
+
+int type_accept(type_info* t, const ast_visitor* v, void* ctx) {
+	return syntax_walk(SN_TYPE, t, v, ctx);
+}
+
+void type_release(type_info* t) {
+	if(t->type != T_TRIVIAL) {
+		hatch_free(ALLOC_PARSER, t->data);
+	}
+	hatch_free(ALLOC_PARSER, t);
+}
+
+void type_free(type_info* t) {
+	syntax_free(SN_TYPE, t);
 }
 
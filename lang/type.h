@@ -21,8 +21,8 @@
 
 #define TRIVIAL_TYPE_AMOUNT 13
 
-#define check_trivial_type(s) \
-	(syntax_check_tokens(s, TRIVIAL_TYPE_AMOUNT, \
+#define check_trivial_type(p) \
+	(syntax_check_tokens(p, TRIVIAL_TYPE_AMOUNT, \
 		trivial_type_list \
 	)) 
 
@@ -31,8 +31,8 @@
 		trivial_type_list \
 	)) 
 
-#define match_trivial_type(s) \
-	(syntax_match_tokens(s, TRIVIAL_TYPE_AMOUNT, \
+#define match_trivial_type(p) \
+	(syntax_match_tokens(p, TRIVIAL_TYPE_AMOUNT, \
 		trivial_type_list \
 	)) 
 
@@ -41,8 +41,8 @@
 #define specificator_list \
 		CONST
 
-#define check_spec(s) \
-	(syntax_check_tokens(s, SPEC_AMOUNT, \
+#define check_spec(p) \
+	(syntax_check_tokens(p, SPEC_AMOUNT, \
 		specificator_list \
 	))
 
@@ -51,8 +51,8 @@
 		specificator_list \
 	))
 
-#define match_spec(s) \
-	(syntax_match_tokens(s, SPEC_AMOUNT, \
+#define match_spec(p) \
+	(syntax_match_tokens(p, SPEC_AMOUNT, \
 		specificator_list \
 	)) 
 
@@ -65,6 +65,8 @@ enum type_type {
 typedef struct _type_info {
 	enum type_type type;
 	void* data;
+	// The hash-consed type this spells, set by resolve_tree
+	struct _canon_type* canonical;
 } type_info;
 
 typedef struct _pointer {
@@ -76,8 +78,12 @@ typedef struct _array {
 	int size;
 } array;
 
-void type_accept(type_info* t, ast_visitor v);
+int  type_accept(type_info* t, const ast_visitor* v, void* ctx);
+int  type_visit(type_info* t, const ast_visitor* v, void* ctx);
+int  type_child(type_info* t, int slot, enum syntax_node_kind* kind, void** child);
+void type_release(type_info* t);
+void type_free(type_info* t);
 
-type_info* type(token_stream* s);
+type_info* type(parser* p);
 
 #endif
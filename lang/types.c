@@ -0,0 +1,261 @@
+#include "types.h"
+#include "class.h"
+#include "intern.h"
+#include "map.h"
+#include "statement.h"
+#include "type.h"
+#include "alloc.h"
+
+#include <string.h>
+
+#define TYPES_INITIAL_CAPACITY 64
+#define CANON_CHUNK_SIZE 256
+
+struct _canon_chunk {
+	struct _canon_chunk* next;
+	int used;
+	canon_type types[CANON_CHUNK_SIZE];
+};
+
+type_table* type_table_create() {
+	type_table* t = hatch_calloc(ALLOC_SEMANTIC, 1, sizeof(type_table));
+	t->capacity = TYPES_INITIAL_CAPACITY;
+	t->slots = hatch_calloc(ALLOC_SEMANTIC, t->capacity, sizeof(canon_type*));
+	pthread_mutex_init(&t->lock, NULL);
+	return t;
+}
+
+void type_table_free(type_table* t) {
+	while(t->chunks) {
+		canon_chunk* next = t->chunks->next;
+		hatch_free(ALLOC_SEMANTIC, t->chunks);
+		t->chunks = next;
+	}
+	hatch_free(ALLOC_SEMANTIC, t->slots);
+	pthread_mutex_destroy(&t->lock);
+	hatch_free(ALLOC_SEMANTIC, t);
+}
+
+static unsigned int _mix(unsigned int h, unsigned long long v) {
+	h ^= (unsigned int) (v ^ (v >> 32));
+	h *= 0x9e3779b1u;
+	return h ^ (h >> 15);
+}
+
+static unsigned int _hash(const canon_type* key) {
+	unsigned int h = _mix(key->kind, key->builtin);
+	h = _mix(h, intern_hash((const char*) key->element));
+	h = _mix(h, (unsigned int) key->length);
+	h = _mix(h, intern_hash((const char*) key->class));
+	// Threads intern names of their own, equal unresolved names may differ in address
+	if(key->kind == CK_UNRESOLVED) {
+		return _mix(h, builtin_string_hash(key->name));
+	}
+	return _mix(h, intern_hash(key->name));
+}
+
+static int _equal(const canon_type* a, const canon_type* b) {
+	if(a->kind == CK_UNRESOLVED || b->kind == CK_UNRESOLVED) {
+		return a->kind == b->kind && !strcmp(a->name, b->name);
+	}
+	return a->kind == b->kind && a->builtin == b->builtin && a->element == b->element &&
+		a->length == b->length && a->class == b->class && a->name == b->name;
+}
+
+static unsigned int _probe(type_table* t, const canon_type* key) {
+	unsigned int i = key->hash & (t->capacity - 1);
+	while(t->slots[i] && (t->slots[i]->hash != key->hash || !_equal(t->slots[i], key))) {
+		i = (i + 1) & (t->capacity - 1);
+	}
+	return i;
+}
+
+static void _grow(type_table* t) {
+	canon_type** slots = t->slots;
+	unsigned int capacity = t->capacity;
+
+	t->capacity *= 2;
+	t->slots = hatch_calloc(ALLOC_SEMANTIC, t->capacity, sizeof(canon_type*));
+	for(unsigned int i = 0; i < capacity; i++) {
+		if(slots[i]) {
+			t->slots[_probe(t, slots[i])] = slots[i];
+		}
+	}
+	hatch_free(ALLOC_SEMANTIC, slots);
+}
+
+static canon_type* _insert(type_table* t, canon_type* key) {
+	unsigned int i = _probe(t, key);
+	if(t->slots[i]) {
+		return t->slots[i];
+	}
+
+	if(2 * (t->size + 1) > t->capacity) {
+		_grow(t);
+		i = _probe(t, key);
+	}
+
+	if(t->chunks == NULL || t->chunks->used == CANON_CHUNK_SIZE) {
+		canon_chunk* c = hatch_malloc(ALLOC_SEMANTIC, sizeof(canon_chunk));
+		c->used = 0;
+		c->next = t->chunks;
+		t->chunks = c;
+	}
+	canon_type* type = &t->chunks->types[t->chunks->used++];
+	*type = *key;
+	t->slots[i] = type;
+	t->size++;
+	return type;
+}
+
+// The one type equal to key, made on first use. Types are never removed, so what the
+// cache holds stays valid for the life of the table.
+static canon_type* _intern(type_table* t, type_cache* cache, canon_type key) {
+	key.hash = _hash(&key);
+
+	canon_type** cached = cache ? &cache->entries[key.hash & (TYPE_CACHE_SIZE - 1)] : NULL;
+	if(cached && *cached && (*cached)->hash == key.hash && _equal(*cached, &key)) {
+		return *cached;
+	}
+
+	pthread_mutex_lock(&t->lock);
+	canon_type* type = _insert(t, &key);
+	pthread_mutex_unlock(&t->lock);
+
+	if(cached) {
+		*cached = type;
+	}
+	return type;
+}
+
+canon_type* type_builtin(type_table* t, type_cache* cache, enum lexem keyword) {
+	return _intern(t, cache, (canon_type) { .kind = CK_BUILTIN, .builtin = keyword });
+}
+
+canon_type* type_pointer_to(type_table* t, type_cache* cache, canon_type* element) {
+	return _intern(t, cache, (canon_type) { .kind = CK_POINTER, .element = element });
+}
+
+canon_type* type_array_of(type_table* t, type_cache* cache, canon_type* element, int length) {
+	return _intern(t, cache, (canon_type) { .kind = CK_ARRAY, .element = element, .length = length });
+}
+
+canon_type* type_class_of(type_table* t, type_cache* cache, class_info* c, const char* name) {
+	return _intern(t, cache, (canon_type) { .kind = CK_CLASS, .class = c, .name = name });
+}
+
+canon_type* type_unresolved(type_table* t, type_cache* cache, const char* name) {
+	return _intern(t, cache, (canon_type) { .kind = CK_UNRESOLVED, .name = name });
+}
+
+static size_t _builtin_size(enum lexem keyword) {
+	switch(keyword) {
+		case I8:
+		case U8:
+			return 1;
+		case I16:
+		case U16:
+			return 2;
+		case I32:
+		case U32:
+		case FLOAT:
+			return 4;
+		case I64:
+		case U64:
+		case DOUBLE:
+			return 8;
+		case STR:
+			return sizeof(void*);
+		default:
+			return 0;
+	}
+}
+
+static void _layout(canon_type* type);
+
+static void _layout_class(canon_type* type) {
+	class_info* c = type->class;
+	size_t size = 0;
+	size_t align = 1;
+
+	for(int i = 0; c->body && i < c->body->size; i++) {
+		qualified_statement* q = c->body->data[i];
+		if(q->is_static || q->declaration == NULL || q->declaration->type != ST_DECL) {
+			continue;
+		}
+		canon_type* member = ((decl*) q->declaration->data)->type->canonical;
+		if(member == NULL) {
+			continue;
+		}
+		_layout(member);
+		if(member->align > align) {
+			align = member->align;
+		}
+		size = (size + member->align - 1) / member->align * member->align + member->size;
+	}
+
+	// Like in C++ distinct objects of an empty class still get distinct addresses
+	type->size = size ? (size + align - 1) / align * align : 1;
+	type->align = align;
+}
+
+// A class that contains itself by value is left with size 0
+static void _layout(canon_type* type) {
+	if(type->layout != LAYOUT_PENDING) {
+		return;
+	}
+	type->layout = LAYOUT_BUSY;
+	type->size = 0;
+	type->align = 1;
+
+	switch(type->kind) {
+		case CK_BUILTIN:
+			type->size = _builtin_size(type->builtin);
+			type->align = type->size ? type->size : 1;
+			break;
+		case CK_POINTER:
+			type->size = sizeof(void*);
+			type->align = sizeof(void*);
+			break;
+		case CK_ARRAY:
+			_layout(type->element);
+			type->size = type->element->size * type->length;
+			type->align = type->element->align;
+			break;
+		case CK_CLASS:
+			_layout_class(type);
+			break;
+		case CK_UNRESOLVED:
+			break;
+	}
+
+	type->layout = LAYOUT_DONE;
+}
+
+void type_table_layout(type_table* t) {
+	for(unsigned int i = 0; i < t->capacity; i++) {
+		if(t->slots[i]) {
+			_layout(t->slots[i]);
+		}
+	}
+}
+
+void type_print(canon_type* type, emitter* out) {
+	switch(type->kind) {
+		case CK_BUILTIN:
+			emit_string(out, lex_lexem_spelling(type->builtin));
+			break;
+		case CK_POINTER:
+			emit_char(out, '*');
+			type_print(type->element, out);
+			break;
+		case CK_ARRAY:
+			type_print(type->element, out);
+			emit_format(out, "[%d]", type->length);
+			break;
+		case CK_CLASS:
+		case CK_UNRESOLVED:
+			emit_string(out, type->name);
+			break;
+	}
+}
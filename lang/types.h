@@ -0,0 +1,82 @@
+#ifndef _TYPES_H
+#define _TYPES_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+#include "emit.h"
+#include "lex.h"
+
+struct _class_info;
+
+enum canon_kind {
+	CK_BUILTIN,
+	CK_POINTER,
+	CK_ARRAY,
+	CK_CLASS,
+	// A name that is neither a typedef nor a class
+	CK_UNRESOLVED
+};
+
+enum canon_layout {
+	LAYOUT_PENDING,
+	LAYOUT_BUSY,
+	LAYOUT_DONE
+};
+
+// Canonical types are hash-consed: structurally equal types built from one table are
+// the same pointer, so comparing types is comparing pointers. Typedefs never get one
+// of their own, an alias is the type it names.
+typedef struct _canon_type {
+	enum canon_kind kind;
+	// The keyword of builtins
+	enum lexem builtin;
+	// Pointee and element type
+	struct _canon_type* element;
+	int length;
+	struct _class_info* class;
+	// Interned name of classes, unresolved names are compared by spelling
+	const char* name;
+	unsigned int hash;
+	// Cached by type_table_layout, a class is laid out like a C struct of its
+	// non-static members
+	size_t size;
+	size_t align;
+	enum canon_layout layout;
+} canon_type;
+
+typedef struct _canon_chunk canon_chunk;
+
+// Threads may build types in one table at once, inserts take the lock
+typedef struct {
+	canon_type** slots;
+	unsigned int capacity;
+	unsigned int size;
+	canon_chunk* chunks;
+	pthread_mutex_t lock;
+} type_table;
+
+#define TYPE_CACHE_SIZE 256
+
+// Per thread, remembers recently built types so most lookups skip the lock
+typedef struct {
+	canon_type* entries[TYPE_CACHE_SIZE];
+} type_cache;
+
+type_table* type_table_create();
+void type_table_free(type_table* t);
+
+// cache may be NULL
+canon_type* type_builtin(type_table* t, type_cache* cache, enum lexem keyword);
+canon_type* type_pointer_to(type_table* t, type_cache* cache, canon_type* element);
+canon_type* type_array_of(type_table* t, type_cache* cache, canon_type* element, int length);
+canon_type* type_class_of(type_table* t, type_cache* cache, struct _class_info* c, const char* name);
+canon_type* type_unresolved(type_table* t, type_cache* cache, const char* name);
+
+// Computes size and alignment of every type in the table, members of classes need
+// their canonical types by then. Not safe while other threads add types.
+void type_table_layout(type_table* t);
+
+void type_print(canon_type* type, emitter* out);
+
+#endif
@@ -13,6 +13,12 @@
         goto error; \
     } 
 
+#define WITH_CODE_GOTO_TO(out, c, message) \
+    if((code = c)) { \
+        fprintf(out, message, code); \
+        goto error; \
+    } 
+
 #define SAFE_CALL(func, ...) \
 	if(func) { \
 		func(__VA_ARGS__); \